@@ -0,0 +1,144 @@
+#ifndef __YHCHAOS_TESTS_RESP_STUB_SERVER_H__
+#define __YHCHAOS_TESTS_RESP_STUB_SERVER_H__
+
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/sock.h"
+#include "yhchaos/macro.h"
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 测试用的进程内RESP服务器，只负责收包、解析命令和发送回复，
+ *        命令的处理由各个测试传入的handler完成
+ */
+class RespStubServer : public std::enable_shared_from_this<RespStubServer> {
+public:
+    typedef std::shared_ptr<RespStubServer> ptr;
+
+    //一个客户端连接
+    struct Conn {
+        yhchaos::Sock::ptr sock;
+        //从1开始的连接序号
+        int64_t id = 0;
+        //连接级别的状态，如ASKING标记、CLIENT TRACKING的重定向连接
+        std::map<std::string, int64_t> state;
+    };
+
+    /**
+     * @brief 执行一个命令
+     * @param[in] conn 收到命令的连接
+     * @param[in] argv 命令和参数
+     * @param[out] out 回复追加到out，一次读到的所有命令的回复一起发送
+     * @return 返回false时不发送回复，直接断开连接
+     */
+    typedef std::function<bool(Conn& conn, const std::vector<std::string>& argv
+                               ,std::string& out)> handler;
+
+    RespStubServer(handler h)
+        :m_handler(h) {
+    }
+
+    /**
+     * @brief 监听addr，在iom中接受连接
+     */
+    void start(const std::string& addr
+               ,yhchaos::IOCoScheduler* iom = yhchaos::IOCoScheduler::GetThis()) {
+        auto address = yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress(addr);
+        m_sock = yhchaos::Sock::CreateTCP(address);
+        YHCHAOS_ASSERT(m_sock->bind(address) && m_sock->listen());
+        m_iom = iom;
+        m_iom->coschedule(std::bind(&RespStubServer::accept, shared_from_this()));
+    }
+
+    //关闭监听的套接字，已经建立的连接不受影响
+    void stop() {
+        if(m_sock) {
+            m_sock->close();
+        }
+    }
+
+    /**
+     * @brief 解析buf中pos开始的一个RESP数组命令
+     * @return 返回命令之后的位置，数据不完整返回0
+     */
+    static size_t ParseCmd(const std::string& buf, size_t pos, std::vector<std::string>& argv) {
+        argv.clear();
+        size_t end = buf.find("\r\n", pos);
+        if(end == std::string::npos || buf[pos] != '*') {
+            return 0;
+        }
+        int n = atoi(buf.c_str() + pos + 1);
+        pos = end + 2;
+        for(int i = 0; i < n; ++i) {
+            end = buf.find("\r\n", pos);
+            if(end == std::string::npos) {
+                return 0;
+            }
+            size_t len = atoi(buf.c_str() + pos + 1);
+            pos = end + 2;
+            if(buf.size() < pos + len + 2) {
+                return 0;
+            }
+            argv.push_back(buf.substr(pos, len));
+            pos += len + 2;
+        }
+        return pos;
+    }
+
+    static std::string Bulk(const std::string& v) {
+        return "$" + std::to_string(v.size()) + "\r\n" + v + "\r\n";
+    }
+
+    //连接数，读次数，命令数，测试可以清零
+    std::atomic<int> conns{0};
+    std::atomic<int> reads{0};
+    std::atomic<int> cmds{0};
+private:
+    void accept() {
+        while(auto client = m_sock->accept()) {
+            m_iom->coschedule(std::bind(&RespStubServer::handleClient, shared_from_this(), client));
+        }
+    }
+
+    void handleClient(yhchaos::Sock::ptr client) {
+        Conn conn;
+        conn.sock = client;
+        conn.id = ++conns;
+        std::string buf;
+        char tmp[4096];
+        while(true) {
+            int rt = client->recv(tmp, sizeof(tmp));
+            if(rt <= 0) {
+                break;
+            }
+            ++reads;
+            buf.append(tmp, rt);
+            std::string out;
+            size_t pos = 0;
+            std::vector<std::string> argv;
+            while(size_t next = ParseCmd(buf, pos, argv)) {
+                pos = next;
+                ++cmds;
+                if(!m_handler(conn, argv, out)) {
+                    client->close();
+                    return;
+                }
+            }
+            buf.erase(0, pos);
+            if(!out.empty() && client->send(out.c_str(), out.size()) <= 0) {
+                break;
+            }
+        }
+        client->close();
+    }
+private:
+    handler m_handler;
+    yhchaos::Sock::ptr m_sock;
+    yhchaos::IOCoScheduler* m_iom = nullptr;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "yhchaos/appconfig.h"
 #include "yhchaos/log.h"
+#include "yhchaos/macro.h"
 #include <yaml-cpp/yaml.h>
 #include "yhchaos/environment.h"
 #include <iostream>
@@ -219,6 +220,31 @@ void test_log() {
     YHCHAOS_LOG_INFO(system_log) << "hello system" << std::endl;
 }
 
+void test_snapshot() {
+    auto old_epoch = yhchaos::AppConfigVarBase::GetEpoch();
+    auto old = g_int_vec_value_config->getSnapshot();
+    g_int_value_config->setValue(9090);
+    g_int_vec_value_config->setValue(std::vector<int>{3, 4, 5});
+    YHCHAOS_LOG_INFO(YHCHAOS_LOG_ROOT()) << "epoch " << old_epoch << " -> "
+        << yhchaos::AppConfigVarBase::GetEpoch()
+        << " port=" << g_int_value_config->getValue()
+        << " old int_vec size=" << old->size()
+        << " new int_vec size=" << g_int_vec_value_config->getValue().size();
+    //修改配置会推进epoch，已经取出的快照不受影响
+    YHCHAOS_ASSERT(yhchaos::AppConfigVarBase::GetEpoch() > old_epoch);
+    YHCHAOS_ASSERT(old->size() == 2 && (*old)[0] == 1);
+    YHCHAOS_ASSERT(g_int_vec_value_config->getSnapshot()->size() == 3);
+    YHCHAOS_ASSERT(g_int_value_config->getValue() == 9090);
+
+    uint64_t start = yhchaos::GetCurrentUS();
+    int64_t sum = 0;
+    for(int i = 0; i < 10000000; ++i) {
+        sum += g_int_value_config->getValue();
+    }
+    YHCHAOS_LOG_INFO(YHCHAOS_LOG_ROOT()) << "10000000 getValue used "
+        << (yhchaos::GetCurrentUS() - start) << "us sum=" << sum;
+}
+
 void test_loadconf() {
     yhchaos::AppConfig::ResolveFromConfDir("conf");
 }
@@ -228,6 +254,7 @@ int main(int argc, char** argv) {
     //test_config();
     //test_class();
     //test_log();
+    test_snapshot();
     yhchaos::EnvironmentMgr::GetInstance()->init(argc, argv);
     test_loadconf();
     std::cout << " ==== " << std::endl;
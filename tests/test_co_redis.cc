@@ -0,0 +1,129 @@
+#include "yhchaos/db/cpp_redis.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include "resp_stub_server.h"
+#include <atomic>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//进程内的RESP服务器，支持PING/AUTH/SET/GET/INCR，
+//DEBUG_SLEEP ms 延迟回复，DEBUG_CLOSE 不回复直接断开，
+//DEBUG_TRICKLE n ms 回复n个字节的字符串，每隔ms毫秒发送一个字节
+static std::map<std::string, std::string> s_data;
+
+static bool handle_cmd(RespStubServer::Conn& conn, const std::vector<std::string>& argv
+                       ,std::string& out) {
+    std::string cmd = yhchaos::ToUpper(argv[0]);
+    if(cmd == "PING") {
+        out += "+PONG\r\n";
+    } else if(cmd == "AUTH") {
+        out += argv[1] == "passwd" ? "+OK\r\n" : "-ERR invalid password\r\n";
+    } else if(cmd == "SET") {
+        s_data[argv[1]] = argv[2];
+        out += "+OK\r\n";
+    } else if(cmd == "GET") {
+        auto it = s_data.find(argv[1]);
+        out += it == s_data.end() ? "$-1\r\n" : RespStubServer::Bulk(it->second);
+    } else if(cmd == "INCR") {
+        int64_t v = atoll(s_data[argv[1]].c_str()) + 1;
+        s_data[argv[1]] = std::to_string(v);
+        out += ":" + std::to_string(v) + "\r\n";
+    } else if(cmd == "DEBUG_SLEEP") {
+        usleep(atoi(argv[1].c_str()) * 1000);
+        out += "+OK\r\n";
+    } else if(cmd == "DEBUG_CLOSE") {
+        return false;
+    } else if(cmd == "DEBUG_TRICKLE") {
+        int n = atoi(argv[1].c_str());
+        std::string rsp = RespStubServer::Bulk(std::string(n, 'x'));
+        for(size_t i = 0; i < rsp.size(); ++i) {
+            if(conn.sock->send(&rsp[i], 1) <= 0) {
+                return false;
+            }
+            usleep(atoi(argv[2].c_str()) * 1000);
+        }
+    } else {
+        out += "-ERR unknown command '" + argv[0] + "'\r\n";
+    }
+    return true;
+}
+
+void run() {
+    RespStubServer::ptr server(new RespStubServer(handle_cmd));
+    server->start("127.0.0.1:8028");
+
+    std::map<std::string, std::string> conf;
+    conf["host"] = "127.0.0.1:8028";
+    conf["passwd"] = "passwd";
+    conf["timeout"] = "200";
+    yhchaos::CoCppRedis::ptr rds(new yhchaos::CoCppRedis(conf));
+    rds->setName("test");
+
+    auto r = rds->cmd("PING");
+    YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS && std::string(r->str) == "PONG");
+    YHCHAOS_ASSERT(!rds->cmd("UNKNOWN"));
+
+    //并发的命令pipeline到同一个连接，回复按顺序对应
+    int count = 5000;
+    std::atomic<int> done(0);
+    server->reads = 0;
+    server->cmds = 0;
+    uint64_t begin = yhchaos::GetCurrentMS();
+    for(int i = 0; i < count; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([rds, i, &done]() {
+            std::string key = "key_" + std::to_string(i);
+            std::string value = "value_" + std::to_string(i);
+            auto r = rds->cmd("SET %s %s", key.c_str(), value.c_str());
+            YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS);
+            r = rds->cmd(std::vector<std::string>{"GET", key});
+            YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STRING && std::string(r->str, r->len) == value);
+            r = rds->cmd("INCR counter");
+            YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_INTEGER);
+            ++done;
+        });
+    }
+    while(done < count) {
+        usleep(10 * 1000);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << count * 3 << " commands used "
+        << (yhchaos::GetCurrentMS() - begin) << "ms, server reads=" << server->reads
+        << " commands=" << server->cmds << " conns=" << server->conns;
+    YHCHAOS_ASSERT(s_data["counter"] == std::to_string(count));
+    YHCHAOS_ASSERT(server->reads < server->cmds);
+
+    //超时后等待的命令失败，下一个命令重新连接
+    YHCHAOS_ASSERT(!rds->cmd("DEBUG_SLEEP 500"));
+    r = rds->cmd("GET key_1");
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "value_1");
+
+    //连接断开后重新连接
+    YHCHAOS_ASSERT(!rds->cmd("DEBUG_CLOSE"));
+    YHCHAOS_ASSERT(rds->cmd("PING"));
+    YHCHAOS_ASSERT(server->conns == 3);
+
+    //回复分多次慢慢到达，到达超时时间就失败，不会等到整个回复读完
+    begin = yhchaos::GetCurrentMS();
+    YHCHAOS_ASSERT(!rds->cmd("DEBUG_TRICKLE 20 50"));
+    uint64_t used = yhchaos::GetCurrentMS() - begin;
+    YHCHAOS_LOG_INFO(g_logger) << "trickle reply used " << used << "ms";
+    YHCHAOS_ASSERT(used < 300);
+    YHCHAOS_ASSERT(rds->cmd("PING"));
+    YHCHAOS_ASSERT(server->conns == 4);
+
+    //认证失败
+    conf["passwd"] = "wrong";
+    yhchaos::CoCppRedis::ptr bad(new yhchaos::CoCppRedis(conf));
+    YHCHAOS_ASSERT(!bad->cmd("PING"));
+    YHCHAOS_ASSERT(!bad->isConnected());
+
+    rds->close();
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,205 @@
+#include "yhchaos/db/cpp_redis.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include "resp_stub_server.h"
+#include <atomic>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+using yhchaos::CoCppRedisCluster;
+
+//进程内的3节点集群，数据共享，按s_owner判断slot属于哪个节点
+static const int NODE_COUNT = 3;
+static const char* s_addrs[NODE_COUNT] = {"127.0.0.1:8029", "127.0.0.1:8030", "127.0.0.1:8031"};
+static int s_owner[CoCppRedisCluster::SLOT_COUNT];
+//正在迁移的slot，-1表示没有，迁移目标节点为s_importing_node
+static int s_importing_slot = -1;
+static int s_importing_node = -1;
+static yhchaos::Mtx s_mutex;
+static std::map<std::string, std::string> s_data;
+static RespStubServer::ptr s_servers[NODE_COUNT];
+
+static std::string cluster_slots() {
+    std::string out;
+    int count = 0;
+    for(int begin = 0; begin < (int)CoCppRedisCluster::SLOT_COUNT;) {
+        int end = begin;
+        while(end + 1 < (int)CoCppRedisCluster::SLOT_COUNT && s_owner[end + 1] == s_owner[begin]) {
+            ++end;
+        }
+        std::string addr = s_addrs[s_owner[begin]];
+        out += "*3\r\n:" + std::to_string(begin) + "\r\n:" + std::to_string(end)
+            + "\r\n*2\r\n" + RespStubServer::Bulk(addr.substr(0, addr.find(':')))
+            + ":" + addr.substr(addr.find(':') + 1) + "\r\n";
+        ++count;
+        begin = end + 1;
+    }
+    return "*" + std::to_string(count) + "\r\n" + out;
+}
+
+//执行一个命令，key不属于该节点时返回MOVED/ASK
+static std::string execute(int node, const std::vector<std::string>& argv, bool asking) {
+    std::string cmd = yhchaos::ToUpper(argv[0]);
+    yhchaos::Mtx::Lock lock(s_mutex);
+    if(cmd == "CLUSTER") {
+        return cluster_slots();
+    }
+    size_t step = cmd == "MSET" ? 2 : 1;
+    int slot = -1;
+    for(size_t i = 1; i < argv.size(); i += step) {
+        int s = CoCppRedisCluster::KeySlot(argv[i]);
+        if(slot >= 0 && s != slot) {
+            return "-CROSSSLOT Keys in request don't hash to the same slot\r\n";
+        }
+        slot = s;
+    }
+    if(slot >= 0) {
+        if(slot == s_importing_slot && node == s_importing_node && asking) {
+        } else if(slot == s_importing_slot && s_owner[slot] == node) {
+            return "-ASK " + std::to_string(slot) + " " + s_addrs[s_importing_node] + "\r\n";
+        } else if(s_owner[slot] != node) {
+            return "-MOVED " + std::to_string(slot) + " " + s_addrs[s_owner[slot]] + "\r\n";
+        }
+    }
+    if(cmd == "SET") {
+        s_data[argv[1]] = argv[2];
+        return "+OK\r\n";
+    } else if(cmd == "GET") {
+        auto it = s_data.find(argv[1]);
+        return it == s_data.end() ? "$-1\r\n" : RespStubServer::Bulk(it->second);
+    } else if(cmd == "MSET") {
+        for(size_t i = 1; i + 1 < argv.size(); i += 2) {
+            s_data[argv[i]] = argv[i + 1];
+        }
+        return "+OK\r\n";
+    } else if(cmd == "MGET") {
+        std::string out = "*" + std::to_string(argv.size() - 1) + "\r\n";
+        for(size_t i = 1; i < argv.size(); ++i) {
+            auto it = s_data.find(argv[i]);
+            out += it == s_data.end() ? "$-1\r\n" : RespStubServer::Bulk(it->second);
+        }
+        return out;
+    } else if(cmd == "DEL") {
+        int n = 0;
+        for(size_t i = 1; i < argv.size(); ++i) {
+            n += s_data.erase(argv[i]);
+        }
+        return ":" + std::to_string(n) + "\r\n";
+    }
+    return "-ERR unknown command '" + argv[0] + "'\r\n";
+}
+
+static bool handle_cmd(int node, RespStubServer::Conn& conn, const std::vector<std::string>& argv
+                       ,std::string& out) {
+    if(yhchaos::ToUpper(argv[0]) == "ASKING") {
+        conn.state["asking"] = 1;
+        out += "+OK\r\n";
+        return true;
+    }
+    out += execute(node, argv, conn.state["asking"]);
+    conn.state["asking"] = 0;
+    return true;
+}
+
+void test_key_slot() {
+    YHCHAOS_ASSERT(CoCppRedisCluster::KeySlot("123456789") == 12739);
+    YHCHAOS_ASSERT(CoCppRedisCluster::KeySlot("foo") == 12182);
+    YHCHAOS_ASSERT(CoCppRedisCluster::KeySlot("{user1000}.following")
+            == CoCppRedisCluster::KeySlot("{user1000}.followers"));
+    YHCHAOS_ASSERT(CoCppRedisCluster::KeySlot("{user1000}.following")
+            == CoCppRedisCluster::KeySlot("user1000"));
+    //空的{}不是hash tag
+    YHCHAOS_ASSERT(CoCppRedisCluster::KeySlot("foo{}{bar}")
+            != CoCppRedisCluster::KeySlot("bar"));
+}
+
+void run() {
+    test_key_slot();
+
+    for(int i = 0; i < (int)CoCppRedisCluster::SLOT_COUNT; ++i) {
+        s_owner[i] = i * NODE_COUNT / CoCppRedisCluster::SLOT_COUNT;
+    }
+    for(int i = 0; i < NODE_COUNT; ++i) {
+        s_servers[i].reset(new RespStubServer(std::bind(handle_cmd, i, std::placeholders::_1
+                        ,std::placeholders::_2, std::placeholders::_3)));
+        s_servers[i]->start(s_addrs[i]);
+    }
+
+    std::map<std::string, std::string> conf;
+    //只配置一个种子节点
+    conf["host"] = s_addrs[1];
+    conf["timeout"] = "1000";
+    CoCppRedisCluster::ptr rds(new CoCppRedisCluster(conf));
+    rds->setName("test_cluster");
+
+    for(int i = 0; i < 300; ++i) {
+        auto r = rds->cmd("SET key_%d value_%d", i, i);
+        YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS);
+    }
+    YHCHAOS_ASSERT(rds->getSlotNode(0) == s_addrs[0]);
+    YHCHAOS_ASSERT(rds->getSlotNode(CoCppRedisCluster::SLOT_COUNT - 1) == s_addrs[2]);
+
+    //MGET按slot拆分，每个节点一次pipeline，结果按顺序合并
+    for(int i = 0; i < NODE_COUNT; ++i) {
+        s_servers[i]->reads = 0;
+        s_servers[i]->cmds = 0;
+    }
+    std::vector<std::string> argv = {"MGET"};
+    for(int i = 0; i < 300; ++i) {
+        argv.push_back("key_" + std::to_string(i));
+    }
+    argv.push_back("none");
+    auto r = rds->cmd(argv);
+    YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_ARRAY && r->elements == 301);
+    for(int i = 0; i < 300; ++i) {
+        YHCHAOS_ASSERT(std::string(r->element[i]->str, r->element[i]->len) == "value_" + std::to_string(i));
+    }
+    YHCHAOS_ASSERT(r->element[300]->type == REDIS_REPLY_NIL);
+    for(int i = 0; i < NODE_COUNT; ++i) {
+        YHCHAOS_LOG_INFO(g_logger) << s_addrs[i] << " MGET sub commands=" << s_servers[i]->cmds
+            << " reads=" << s_servers[i]->reads;
+    }
+
+    //MSET和DEL
+    r = rds->cmd(std::vector<std::string>{"MSET", "a", "1", "b", "2", "c", "3", "{a}x", "4"});
+    YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS);
+    r = rds->cmd(std::vector<std::string>{"DEL", "a", "b", "c", "{a}x", "none"});
+    YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_INTEGER && r->integer == 4);
+
+    //slot迁移到其他节点后，MOVED重定向并更新映射表
+    int slot = CoCppRedisCluster::KeySlot("key_1");
+    int old_owner = s_owner[slot];
+    int new_owner = (old_owner + 1) % NODE_COUNT;
+    {
+        yhchaos::Mtx::Lock lock(s_mutex);
+        s_owner[slot] = new_owner;
+    }
+    r = rds->cmd("GET key_1");
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "value_1");
+    YHCHAOS_ASSERT(rds->getSlotNode(slot) == s_addrs[new_owner]);
+
+    //迁移中的slot，ASK重定向不更新映射表
+    slot = CoCppRedisCluster::KeySlot("key_2");
+    {
+        yhchaos::Mtx::Lock lock(s_mutex);
+        s_importing_slot = slot;
+        s_importing_node = (s_owner[slot] + 1) % NODE_COUNT;
+    }
+    r = rds->cmd("GET key_2");
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "value_2");
+    YHCHAOS_ASSERT(rds->getSlotNode(slot) == s_addrs[s_owner[slot]]);
+
+    YHCHAOS_ASSERT(!rds->cmd("UNKNOWN key"));
+
+    for(auto& i : s_servers) {
+        i->stop();
+    }
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
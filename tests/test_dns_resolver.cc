@@ -0,0 +1,173 @@
+#include "yhchaos/dns_resolver.h"
+#include "yhchaos/sock.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/appconfig.h"
+#include <atomic>
+#include <fstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static std::atomic<int> s_queries(0);
+static std::atomic<int> s_tcp_queries(0);
+static yhchaos::Sock::ptr s_server;
+static yhchaos::Sock::ptr s_tcp_server;
+
+//构造应答: test.yhchaos.local返回1.2.3.4(ttl=1)，
+//big.yhchaos.local通过UDP查询时返回截断(TC)的空应答，通过TCP查询返回5.6.7.8，其他域名返回NXDOMAIN
+std::string build_response(const std::string& req, bool tcp) {
+    std::string rsp(req);
+    std::string name;
+    for(size_t pos = 12; pos < rsp.size() && rsp[pos]; pos += rsp[pos] + 1) {
+        if(!name.empty()) {
+            name.push_back('.');
+        }
+        name.append(rsp, pos + 1, rsp[pos]);
+    }
+    bool is_a = rsp[rsp.size() - 3] == 1;
+    bool truncated = name == "big.yhchaos.local" && !tcp;
+    bool found = is_a && !truncated
+                 && (name == "test.yhchaos.local" || name == "big.yhchaos.local");
+    rsp[2] = truncated ? (char)0x83 : (char)0x81;
+    rsp[3] = (found || truncated) ? (char)0x80 : (char)0x83;
+    rsp[7] = found ? 1 : 0;
+    if(found) {
+        char answer[] = {(char)0xc0, 0x0c, 0, 1, 0, 1, 0, 0, 0, 1, 0, 4, 1, 2, 3, 4};
+        if(name == "big.yhchaos.local") {
+            answer[12] = 5;
+            answer[13] = 6;
+            answer[14] = 7;
+            answer[15] = 8;
+        }
+        rsp.append(answer, sizeof(answer));
+    }
+    return rsp;
+}
+
+//本地的DNS桩服务器(UDP)
+void run_stub_server() {
+    char buf[1500];
+    while(true) {
+        yhchaos::NetworkAddress::ptr from(new yhchaos::IPv4NetworkAddress);
+        int len = s_server->recvFrom(buf, sizeof(buf), from);
+        if(len <= 12) {
+            break;
+        }
+        ++s_queries;
+        std::string rsp = build_response(std::string(buf, len), false);
+        //稍微延迟，让并发的查询合并
+        usleep(50 * 1000);
+        s_server->sendTo(rsp.c_str(), rsp.size(), from);
+    }
+}
+
+//本地的DNS桩服务器(TCP)，和UDP使用相同的端口
+void run_tcp_stub_server() {
+    while(true) {
+        auto client = s_tcp_server->accept();
+        if(!client) {
+            break;
+        }
+        unsigned char len[2];
+        if(client->recv(len, 2) != 2) {
+            continue;
+        }
+        std::string req((len[0] << 8) | len[1], '\0');
+        if(client->recv(&req[0], req.size()) != (int)req.size()) {
+            continue;
+        }
+        ++s_tcp_queries;
+        std::string rsp = build_response(req, true);
+        std::string data;
+        data.push_back((char)(rsp.size() >> 8));
+        data.push_back((char)(rsp.size() & 0xff));
+        data.append(rsp);
+        client->send(data.c_str(), data.size());
+    }
+}
+
+void test_resolve() {
+    //使用固定的resolv.conf，不受本机search域和ndots的影响，每个域名只查询一个候选名
+    const char* conf = "/tmp/test_dns_resolver.conf";
+    {
+        std::ofstream ofs(conf);
+        ofs << "options ndots:1 timeout:1 attempts:1" << std::endl;
+    }
+    //修改配置后自动重新加载
+    yhchaos::AppConfig::SearchFor<std::string>("dns.resolv_conf")->setValue(conf);
+    auto resolver = yhchaos::DnsResolverMgr::GetInstance();
+    resolver->setNameservers({std::dynamic_pointer_cast<yhchaos::IPNetworkAddress>(
+                                s_server->getLocalNetworkAddress())});
+    YHCHAOS_ASSERT(resolver->isAvailable());
+
+    //并发查询同一个域名只发送一次请求
+    std::atomic<int> done(0);
+    for(int i = 0; i < 10; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([&done, resolver](){
+            std::vector<yhchaos::IPNetworkAddress::ptr> addrs;
+            YHCHAOS_ASSERT(resolver->resolve(addrs, "test.yhchaos.local"));
+            YHCHAOS_ASSERT(addrs[0]->toString() == "1.2.3.4:0");
+            ++done;
+        });
+    }
+    while(done < 10) {
+        usleep(10 * 1000);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "10 concurrent resolve, queries=" << s_queries;
+    YHCHAOS_ASSERT(s_queries == 1);
+
+    //命中缓存，并通过NetworkAddress::SearchFor使用
+    auto addr = yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("test.yhchaos.local:8080");
+    YHCHAOS_ASSERT(addr && addr->toString() == "1.2.3.4:8080");
+    YHCHAOS_ASSERT(s_queries == 1);
+
+    //负缓存
+    std::vector<yhchaos::IPNetworkAddress::ptr> addrs;
+    YHCHAOS_ASSERT(!resolver->resolve(addrs, "none.yhchaos.local"));
+    YHCHAOS_ASSERT(!resolver->resolve(addrs, "none.yhchaos.local"));
+    YHCHAOS_LOG_INFO(g_logger) << "negative cache, queries=" << s_queries;
+    YHCHAOS_ASSERT(s_queries == 2);
+
+    //TTL过期后重新查询
+    usleep(1100 * 1000);
+    YHCHAOS_ASSERT(resolver->resolve(addrs, "test.yhchaos.local"));
+    YHCHAOS_LOG_INFO(g_logger) << "ttl expired, queries=" << s_queries
+        << " " << resolver->toString();
+    YHCHAOS_ASSERT(s_queries == 3);
+
+    //UDP应答被截断，改用TCP查询
+    addrs.clear();
+    YHCHAOS_ASSERT(resolver->resolve(addrs, "big.yhchaos.local"));
+    YHCHAOS_LOG_INFO(g_logger) << "truncated, queries=" << s_queries
+        << " tcp_queries=" << s_tcp_queries;
+    YHCHAOS_ASSERT(addrs.size() == 1 && addrs[0]->toString() == "5.6.7.8:0");
+    YHCHAOS_ASSERT(s_queries == 4 && s_tcp_queries == 1);
+
+    //修改dns.hosts_file后使用新的hosts记录，不发送查询
+    const char* hosts = "/tmp/test_dns_resolver.hosts";
+    {
+        std::ofstream ofs(hosts);
+        ofs << "9.9.9.9 hosts.yhchaos.local" << std::endl;
+    }
+    yhchaos::AppConfig::SearchFor<std::string>("dns.hosts_file")->setValue(hosts);
+    addrs.clear();
+    YHCHAOS_ASSERT(resolver->resolve(addrs, "hosts.yhchaos.local"));
+    YHCHAOS_ASSERT(addrs.size() == 1 && addrs[0]->toString() == "9.9.9.9:0");
+    YHCHAOS_ASSERT(s_queries == 4);
+    s_server->close();
+    s_tcp_server->close();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    s_server = yhchaos::Sock::CreateUDPSock();
+    YHCHAOS_ASSERT(s_server->bind(yhchaos::IPv4NetworkAddress::Create("127.0.0.1", 0)));
+    s_tcp_server = yhchaos::Sock::CreateTCPSock();
+    YHCHAOS_ASSERT(s_tcp_server->bind(s_server->getLocalNetworkAddress()));
+    YHCHAOS_ASSERT(s_tcp_server->listen());
+    iom.coschedule(run_stub_server);
+    iom.coschedule(run_tcp_stub_server);
+    iom.coschedule(test_resolve);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include "yhchaos/dp/dp_stream.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include <map>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//不依赖真实连接，可以控制是否可用和是否被取消
+class MockItem : public yhchaos::LBItem {
+public:
+    typedef std::shared_ptr<MockItem> ptr;
+    virtual bool isValid() override { return valid;}
+
+    std::atomic<bool> valid{true};
+    std::atomic<bool> cancelled{false};
+};
+
+//每个请求第一次发出时耗时80ms，对冲发出的请求耗时5ms
+class MockDPLB : public yhchaos::DPSDLoadBalance {
+public:
+    typedef std::shared_ptr<MockDPLB> ptr;
+    MockDPLB()
+        :DPSDLoadBalance(nullptr) {
+        m_defaultType = yhchaos::ILB::ROUNDROBIN;
+    }
+
+    int getLaunches(uint32_t sn) {
+        yhchaos::Mtx::Lock lock(m_mutex);
+        return m_launches[sn].size();
+    }
+
+    uint64_t getLaunchTime(uint32_t sn, int idx) {
+        yhchaos::Mtx::Lock lock(m_mutex);
+        return m_launches[sn][idx];
+    }
+
+    std::atomic<int> cancels{0};
+protected:
+    virtual yhchaos::DPRes::ptr doRequest(yhchaos::LBItem::ptr conn, yhchaos::DPReq::ptr req
+                                          ,uint32_t timeout_ms) override {
+        auto item = std::static_pointer_cast<MockItem>(conn);
+        uint64_t begin = yhchaos::GetCurrentMS();
+        size_t idx = 0;
+        {
+            yhchaos::Mtx::Lock lock(m_mutex);
+            auto& launches = m_launches[req->getSn()];
+            idx = launches.size();
+            launches.push_back(begin);
+        }
+        item->cancelled = false;
+        uint64_t cost = 5;
+        if(idx == 0) {
+            cost = 80;
+            //对冲请求选择另一个流
+            item->valid = false;
+        }
+        while(yhchaos::GetCurrentMS() - begin < cost) {
+            if(item->cancelled) {
+                item->valid = true;
+                ++cancels;
+                return std::make_shared<yhchaos::DPRes>(yhchaos::AsyncSockStream::CANCELLED
+                        ,yhchaos::GetCurrentMS() - begin, nullptr, req);
+            }
+            usleep(1000);
+        }
+        item->valid = true;
+        return std::make_shared<yhchaos::DPRes>(0, cost, nullptr, req);
+    }
+
+    virtual void cancelRequest(yhchaos::LBItem::ptr conn, yhchaos::DPReq::ptr req) override {
+        std::static_pointer_cast<MockItem>(conn)->cancelled = true;
+    }
+private:
+    yhchaos::Mtx m_mutex;
+    std::map<uint32_t, std::vector<uint64_t> > m_launches;
+};
+
+void test_hedge() {
+    //每个请求积累50的额度，每两个请求最多对冲一次
+    yhchaos::AppConfig::SearchFor<uint32_t>("dp.hedge.budget_percent")->setValue(50);
+    MockDPLB::ptr lb(new MockDPLB);
+    std::vector<yhchaos::LBItem::ptr> items;
+    for(int i = 0; i < 2; ++i) {
+        MockItem::ptr item(new MockItem);
+        item->setId(i + 1);
+        item->setWeight(10000);
+        //最近耗时都在10ms，p95落在(8,12]的桶，对冲延迟为12ms
+        for(int n = 0; n < 20; ++n) {
+            item->get().incLatency(10);
+        }
+        items.push_back(item);
+    }
+    lb->get("test", "hedge", true)->set(items);
+
+    //额度不够，不对冲，等待慢的回复
+    yhchaos::DPReq::ptr req(new yhchaos::DPReq);
+    req->setSn(1);
+    auto rsp = lb->hedgeRequest("test", "hedge", req, 1000);
+    YHCHAOS_ASSERT(rsp->result == 0 && rsp->used >= 80);
+    YHCHAOS_ASSERT(lb->getLaunches(1) == 1);
+
+    //超过对冲延迟后向另一个流发送，先到的回复返回，慢的请求被取消
+    req.reset(new yhchaos::DPReq);
+    req->setSn(2);
+    rsp = lb->hedgeRequest("test", "hedge", req, 1000);
+    YHCHAOS_LOG_INFO(g_logger) << "hedged used=" << rsp->used;
+    YHCHAOS_ASSERT(rsp->result == 0 && rsp->used < 60);
+    YHCHAOS_ASSERT(lb->getLaunches(2) == 2);
+    YHCHAOS_ASSERT(lb->getLaunchTime(2, 1) - lb->getLaunchTime(2, 0) >= 10);
+    usleep(20 * 1000);
+    YHCHAOS_ASSERT(lb->cancels == 1);
+
+    //额度用完，下一个请求不对冲
+    req.reset(new yhchaos::DPReq);
+    req->setSn(3);
+    rsp = lb->hedgeRequest("test", "hedge", req, 1000);
+    YHCHAOS_ASSERT(rsp->result == 0 && rsp->used >= 80);
+    YHCHAOS_ASSERT(lb->getLaunches(3) == 1);
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(1);
+    iom.coschedule(test_hedge);
+    return 0;
+}
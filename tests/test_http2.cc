@@ -0,0 +1,148 @@
+#include "yhchaos/http2/http2_client.h"
+#include "yhchaos/http2/hpack.h"
+#include "yhchaos/http/httpsvr.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include <atomic>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static std::string to_hex(const std::string& str) {
+    static const char* s_hex = "0123456789abcdef";
+    std::string rt;
+    for(unsigned char c : str) {
+        rt.push_back(s_hex[c >> 4]);
+        rt.push_back(s_hex[c & 0xf]);
+    }
+    return rt;
+}
+
+//RFC 7541 C.4，使用哈夫曼编码的三个连续请求
+void test_hpack() {
+    yhchaos::http2::HeaderList reqs[3] = {
+        {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}
+            ,{":authority", "www.example.com"}},
+        {{":method", "GET"}, {":scheme", "http"}, {":path", "/"}
+            ,{":authority", "www.example.com"}, {"cache-control", "no-cache"}},
+        {{":method", "GET"}, {":scheme", "https"}, {":path", "/index.html"}
+            ,{":authority", "www.example.com"}, {"custom-key", "custom-value"}},
+    };
+    const char* expects[3] = {
+        "828684418cf1e3c2e5f23a6ba0ab90f4ff",
+        "828684be5886a8eb10649cbf",
+        "828785bf408825a849e95ba97d7f8925a849e95bb8e8b4bf",
+    };
+    yhchaos::http2::HPackEncoder encoder;
+    yhchaos::http2::HPackDecoder decoder;
+    for(int i = 0; i < 3; ++i) {
+        std::string block;
+        encoder.encode(reqs[i], block);
+        YHCHAOS_LOG_INFO(g_logger) << "hpack " << to_hex(block);
+        YHCHAOS_ASSERT(to_hex(block) == expects[i]);
+
+        yhchaos::http2::HeaderList headers;
+        YHCHAOS_ASSERT(decoder.decode(block.c_str(), block.size(), headers) == 0);
+        YHCHAOS_ASSERT(headers == reqs[i]);
+    }
+    YHCHAOS_ASSERT(decoder.getTable().getSize() == 164);
+
+    //重复引用动态表的索引(0xbe: custom-key: custom-value)，按解码后的大小限制
+    decoder.setMaxHeaderListSize(4096);
+    std::string bomb(1000, (char)0xbe);
+    yhchaos::http2::HeaderList headers;
+    YHCHAOS_ASSERT(decoder.decode(bomb.c_str(), bomb.size(), headers) == -2);
+    YHCHAOS_ASSERT(headers.size() < 100);
+}
+
+void run_server(yhchaos::http::HttpSvr::ptr server) {
+    auto sd = server->getCppServletDispatch();
+    sd->addCppServlet("/echo", [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            rsp->setHeader("x-path", req->getPath());
+            rsp->setHeader("x-peer", session->getRemoteNetworkAddressString());
+            rsp->setCookie("id", req->getQuery());
+            rsp->setBody(req->getBody());
+            return 0;
+    });
+    sd->addCppServlet("/slow", [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            usleep(200 * 1000);
+            rsp->setBody("slow");
+            return 0;
+    });
+    server->start();
+}
+
+void test_client(yhchaos::NetworkAddress::ptr addr, bool upgrade) {
+    yhchaos::http2::Http2Client::ptr client(new yhchaos::http2::Http2Client);
+    YHCHAOS_ASSERT(client->connect(addr, "localhost", upgrade));
+
+    auto res = client->doGet("/echo?abc", 1000);
+    YHCHAOS_LOG_INFO(g_logger) << res->toString();
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_ASSERT(res->response->getHeader("x-path") == "/echo");
+    YHCHAOS_ASSERT(res->response->getCookies().size() == 1);
+    YHCHAOS_ASSERT(res->response->getHeader("x-peer").find("127.0.0.1") == 0);
+
+    //慢请求不会阻塞同一个连接上的其他请求
+    std::atomic<int> done(0);
+    uint64_t begin = yhchaos::GetCurrentMS();
+    for(int i = 0; i < 10; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([client, &done](){
+            auto res = client->doGet("/slow", 1000);
+            YHCHAOS_ASSERT(res->result == 0 && res->response->getBody() == "slow");
+            ++done;
+        });
+    }
+    while(done < 10) {
+        usleep(10 * 1000);
+    }
+    uint64_t used = yhchaos::GetCurrentMS() - begin;
+    YHCHAOS_LOG_INFO(g_logger) << "10 concurrent slow requests used " << used << "ms";
+    YHCHAOS_ASSERT(used < 1000);
+
+    //超过流量控制窗口的消息体分片发送
+    std::string body(3 * 1024 * 1024 + 7, 'x');
+    for(size_t i = 0; i < body.size(); i += 4096) {
+        body[i] = 'a' + i % 26;
+    }
+    res = client->doPost("/echo", 5000, {}, body);
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_ASSERT(res->response->getBody() == body);
+
+    //超时的请求重置流，不影响连接
+    res = client->doGet("/slow", 50);
+    YHCHAOS_LOG_INFO(g_logger) << res->toString();
+    YHCHAOS_ASSERT(res->result == (int)yhchaos::http::HttpRes::Error::TIMEOUT);
+    res = client->doGet("/echo", 1000);
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_LOG_INFO(g_logger) << client->toString();
+    client->close();
+}
+
+void run() {
+    test_hpack();
+
+    yhchaos::http::HttpSvr::ptr server(new yhchaos::http::HttpSvr(true));
+    auto addr = yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8022");
+    YHCHAOS_ASSERT(server->bind(addr));
+    run_server(server);
+
+    test_client(addr, false);
+    test_client(addr, true);
+
+    //HTTP/1.1的请求不受影响
+    auto res = yhchaos::http::HttpClient::DoGet("http://127.0.0.1:8022/echo", 1000);
+    YHCHAOS_LOG_INFO(g_logger) << res->toString();
+    YHCHAOS_ASSERT(res->result == 0);
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
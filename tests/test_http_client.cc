@@ -11,10 +11,14 @@ static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
 void test_pool() {
     yhchaos::http::HttpClientPool::ptr pool(new yhchaos::http::HttpClientPool(
                 "www.yhchaos.top", "", 80, false, 10, 1000 * 30, 5));
+    pool->setMinIdle(2);
+    pool->setMaxIdleTime(1000 * 10);
+    pool->setWaitTimeout(500);
+    pool->start();
 
     yhchaos::IOCoScheduler::GetThis()->addTimedCoroutine(1000, [pool](){
             auto r = pool->doGet("/", 300);
-            YHCHAOS_LOG_INFO(g_logger) << r->toString();
+            YHCHAOS_LOG_INFO(g_logger) << r->toString() << " " << pool->toString();
     }, true);
 }
 
@@ -0,0 +1,157 @@
+#include "yhchaos/http/httpsvr.h"
+#include "yhchaos/http/http_client.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include <fstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static const char* s_file = "/tmp/test_http_stream.dat";
+
+void run_server(yhchaos::http::HttpSvr::ptr server) {
+    auto sd = server->getCppServletDispatch();
+    //流式读取上传的消息体，返回读到的字节数和校验和
+    yhchaos::http::FunctionCppServlet::ptr upload(new yhchaos::http::FunctionCppServlet(
+            [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            YHCHAOS_ASSERT(req->getBody().empty());
+            auto stream = req->getBodyStream();
+            uint64_t size = 0;
+            uint64_t sum = 0;
+            char buf[1000];
+            int rt = 0;
+            while(stream && (rt = stream->read(buf, sizeof(buf))) > 0) {
+                for(int i = 0; i < rt; ++i) {
+                    sum += (unsigned char)buf[i];
+                }
+                size += rt;
+            }
+            YHCHAOS_ASSERT(rt == 0);
+            rsp->setBody(std::to_string(size) + ":" + std::to_string(sum));
+            return 0;
+    }));
+    upload->setStreamBody(true);
+    sd->addCppServlet("/upload", upload);
+
+    //非流式的CppServlet收到完整的chunked消息体
+    sd->addCppServlet("/echo", [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            rsp->setBody(req->getBody());
+            return 0;
+    });
+
+    //边生成边发送
+    sd->addCppServlet("/download", [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            rsp->setBodyWriter([](yhchaos::Stream::ptr stream) {
+                for(int i = 0; i < 100; ++i) {
+                    std::string line = "line " + std::to_string(i) + "\n";
+                    if(stream->writeFixSize(line.c_str(), line.size()) <= 0) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            return 0;
+    });
+
+    sd->addCppServlet("/file", [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            if(!rsp->setBodyFile(s_file, 10)) {
+                rsp->setStatus(yhchaos::http::HStatus::NOT_FOUND);
+            }
+            return 0;
+    });
+    server->start();
+}
+
+void test_chunked_upload(yhchaos::NetworkAddress::ptr addr) {
+    auto sock = yhchaos::Sock::CreateTCP(addr);
+    YHCHAOS_ASSERT(sock->connect(addr));
+    std::string head = "POST /upload HTTP/1.1\r\n"
+                       "Host: 127.0.0.1\r\n"
+                       "Transfer-Encoding: chunked\r\n"
+                       "Connection: keep-alive\r\n\r\n";
+    YHCHAOS_ASSERT(sock->send(head.c_str(), head.size()) > 0);
+    uint64_t size = 0;
+    uint64_t sum = 0;
+    for(int i = 1; i <= 20; ++i) {
+        std::string data(i * 997, 'a' + i);
+        size += data.size();
+        sum += data.size() * (unsigned char)('a' + i);
+        char hex[32];
+        snprintf(hex, sizeof(hex), "%zx;ext=1\r\n", data.size());
+        std::string chunk = hex + data + "\r\n";
+        YHCHAOS_ASSERT(sock->send(chunk.c_str(), chunk.size()) > 0);
+        //分多次发送，服务端边收边读
+        usleep(5 * 1000);
+    }
+    std::string end = "0\r\nx-trailer: 1\r\n\r\n";
+    YHCHAOS_ASSERT(sock->send(end.c_str(), end.size()) > 0);
+
+    std::string rsp;
+    char buf[4096];
+    std::string expect = std::to_string(size) + ":" + std::to_string(sum);
+    while(rsp.find(expect) == std::string::npos) {
+        int rt = sock->recv(buf, sizeof(buf));
+        YHCHAOS_ASSERT(rt > 0);
+        rsp.append(buf, rt);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "chunked upload rsp: " << rsp;
+
+    //同一个连接上继续发送非流式的chunked请求
+    std::string req = "POST /echo HTTP/1.1\r\n"
+                      "Transfer-Encoding: chunked\r\n\r\n"
+                      "5\r\nhello\r\n6\r\n world\r\n0\r\n\r\n";
+    YHCHAOS_ASSERT(sock->send(req.c_str(), req.size()) > 0);
+    rsp.clear();
+    while(rsp.find("hello world") == std::string::npos) {
+        int rt = sock->recv(buf, sizeof(buf));
+        YHCHAOS_ASSERT(rt > 0);
+        rsp.append(buf, rt);
+    }
+    sock->close();
+}
+
+void run() {
+    std::ofstream ofs(s_file);
+    for(int i = 0; i < 100000; ++i) {
+        ofs << (char)('a' + i % 26);
+    }
+    ofs.close();
+
+    yhchaos::http::HttpSvr::ptr server(new yhchaos::http::HttpSvr(true));
+    auto addr = yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8023");
+    YHCHAOS_ASSERT(server->bind(addr));
+    run_server(server);
+
+    test_chunked_upload(addr);
+
+    auto res = yhchaos::http::HttpClient::DoGet("http://127.0.0.1:8023/download", 1000);
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_LOG_INFO(g_logger) << "download transfer-encoding="
+        << res->response->getHeader("transfer-encoding")
+        << " body_size=" << res->response->getBody().size();
+    YHCHAOS_ASSERT(res->response->getBody().find("line 99\n") != std::string::npos);
+
+    res = yhchaos::http::HttpClient::DoGet("http://127.0.0.1:8023/file", 1000);
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_LOG_INFO(g_logger) << "file content-length="
+        << res->response->getHeader("content-length");
+    YHCHAOS_ASSERT(res->response->getBody().size() == 100000 - 10);
+    YHCHAOS_ASSERT(res->response->getBody()[0] == 'a' + 10);
+
+    server->stop();
+    unlink(s_file);
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,209 @@
+#include "yhchaos/streams/loadbalance.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/iocoscheduler.h"
+#include <map>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//不依赖真实连接，所有流都视为可用
+class MockP2CItem : public yhchaos::P2CLBItem {
+public:
+    virtual bool isValid() override { return true;}
+};
+
+void test_p2c() {
+    yhchaos::P2CLB::ptr lb(new yhchaos::P2CLB);
+    std::vector<yhchaos::LBItem::ptr> items;
+    for(int i = 0; i < 1000; ++i) {
+        yhchaos::LBItem::ptr item(new MockP2CItem);
+        item->setId(i);
+        item->setWeight(10000);
+        items.push_back(item);
+    }
+    lb->set(items);
+
+    //id=0的流很慢，其他流很快
+    bool probe = false;
+    for(auto& i : items) {
+        i->onReqBegin(probe);
+        i->onReqEnd(0, i->getId() == 0 ? 500000 : 1000, probe);
+    }
+
+    std::map<uint64_t, int> hits;
+    for(int i = 0; i < 100000; ++i) {
+        auto item = lb->get();
+        YHCHAOS_ASSERT(item);
+        ++hits[item->getId()];
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "p2c slow item hits=" << hits[0]
+        << " distinct=" << hits.size();
+    //慢的流只有在两个候选都是它时才会被选中，而两个候选不会相同
+    YHCHAOS_ASSERT(hits[0] == 0);
+
+    //在途请求多的流代价更高
+    auto a = std::dynamic_pointer_cast<yhchaos::P2CLBItem>(items[1]);
+    auto b = std::dynamic_pointer_cast<yhchaos::P2CLBItem>(items[2]);
+    for(int i = 0; i < 10; ++i) {
+        a->onReqBegin(probe);
+    }
+    uint64_t now = yhchaos::GetCurrentUS();
+    YHCHAOS_LOG_INFO(g_logger) << "cost a=" << a->getCost(now)
+        << " b=" << b->getCost(now);
+    YHCHAOS_ASSERT(a->getCost(now) > b->getCost(now));
+}
+
+class MockItem : public yhchaos::LBItem {
+public:
+    virtual bool isValid() override { return true;}
+};
+
+void test_maglev() {
+    //没有service_io调度器，查找表同步重建
+    yhchaos::MaglevLB::ptr lb(new yhchaos::MaglevLB);
+    std::vector<yhchaos::LBItem::ptr> items;
+    for(int i = 0; i < 100; ++i) {
+        yhchaos::LBItem::ptr item(new MockItem);
+        item->setId(1000 + i);
+        item->setWeight(i == 0 ? 20000 : 10000);
+        items.push_back(item);
+    }
+    lb->set(items);
+    //set()返回后查找表已经可用，不带哈希值时随机选取
+    YHCHAOS_ASSERT(lb->get());
+
+    const uint64_t count = 100000;
+    std::vector<uint64_t> before(count);
+    std::map<uint64_t, int> hits;
+    for(uint64_t i = 0; i < count; ++i) {
+        before[i] = lb->get(yhchaos::murmur3_hash64(&i, sizeof(i)))->getId();
+        ++hits[before[i]];
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "maglev weight=20000 hits=" << hits[1000]
+        << " weight=10000 hits=" << hits[1001];
+    YHCHAOS_ASSERT(hits[1000] > hits[1001] * 3 / 2);
+
+    //删除一个流，只有原先落在它上面的哈希值会被大量重新映射
+    std::unordered_map<uint64_t, yhchaos::LBItem::ptr> adds;
+    std::unordered_map<uint64_t, yhchaos::LBItem::ptr> dels;
+    dels[1050];
+    lb->update(adds, dels);
+    uint64_t moved = 0;
+    for(uint64_t i = 0; i < count; ++i) {
+        auto id = lb->get(yhchaos::murmur3_hash64(&i, sizeof(i)))->getId();
+        YHCHAOS_ASSERT(id != 1050);
+        if(id != before[i]) {
+            ++moved;
+        }
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "maglev remove one item, moved=" << moved
+        << " removed item hits=" << hits[1050];
+    YHCHAOS_ASSERT(moved < hits[1050] * 3);
+}
+
+void test_breaker() {
+    yhchaos::AppConfig::SearchFor<uint32_t>("loadbalance.breaker.base_eject_ms")->setValue(100);
+    yhchaos::CircuitBreaker::ptr cb(new yhchaos::CircuitBreaker);
+    yhchaos::HolderStats stats;
+    bool probe = false;
+    YHCHAOS_ASSERT(cb->isAvailable());
+    for(int i = 0; i < 5; ++i) {
+        cb->onReqBegin(probe);
+        cb->onReqEnd(false, stats);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << cb->toString();
+    YHCHAOS_ASSERT(!cb->isAvailable());
+
+    //摘除到期后只放行一个探测请求
+    usleep(150 * 1000);
+    YHCHAOS_ASSERT(cb->isAvailable());
+    bool holder = false;
+    YHCHAOS_ASSERT(cb->onReqBegin(holder) && holder);
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::HALF_OPEN);
+    YHCHAOS_ASSERT(!cb->isAvailable());
+    //同时通过isAvailable的其他请求拿不到探测名额
+    YHCHAOS_ASSERT(!cb->onReqBegin(probe) && !probe);
+
+    //没有占用名额的请求被取消(如对冲请求中输掉的一方)，不归还名额
+    cb->onReqCancel(false);
+    YHCHAOS_ASSERT(!cb->isAvailable());
+    //探测请求被取消，归还名额
+    cb->onReqCancel(holder);
+    YHCHAOS_ASSERT(cb->isAvailable());
+    YHCHAOS_ASSERT(cb->onReqBegin(holder) && holder);
+
+    //探测失败，摘除时间翻倍
+    cb->onReqEnd(false, stats);
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::OPEN);
+    YHCHAOS_ASSERT(cb->getEjections() == 2);
+    usleep(150 * 1000);
+    YHCHAOS_ASSERT(!cb->isAvailable());
+    usleep(100 * 1000);
+    YHCHAOS_ASSERT(cb->isAvailable());
+
+    //探测成功，恢复
+    cb->onReqBegin(probe);
+    cb->onReqEnd(true, stats);
+    YHCHAOS_LOG_INFO(g_logger) << cb->toString();
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::CLOSED);
+    YHCHAOS_ASSERT(cb->isAvailable());
+}
+
+//在IOCoScheduler中由定时器转为HALF_OPEN，不需要isAvailable触发
+void test_breaker_timer() {
+    yhchaos::CircuitBreaker::ptr cb(new yhchaos::CircuitBreaker);
+    yhchaos::HolderStats stats;
+    bool probe = false;
+    for(int i = 0; i < 5; ++i) {
+        YHCHAOS_ASSERT(cb->onReqBegin(probe));
+        cb->onReqEnd(false, stats);
+    }
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::OPEN);
+    usleep(150 * 1000);
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::HALF_OPEN);
+
+    YHCHAOS_ASSERT(cb->onReqBegin(probe));
+    cb->onReqEnd(true, stats);
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::CLOSED);
+
+    //恢复后error_rate_window_ms内不按失败率摘除
+    yhchaos::AppConfig::SearchFor<uint32_t>("loadbalance.breaker.error_rate_window_ms")->setValue(200);
+    for(int i = 0; i < 20; ++i) {
+        stats.incErrs(1);
+    }
+    YHCHAOS_ASSERT(cb->onReqBegin(probe));
+    cb->onReqEnd(false, stats);
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::CLOSED);
+    usleep(250 * 1000);
+    YHCHAOS_ASSERT(cb->onReqBegin(probe));
+    cb->onReqEnd(false, stats);
+    YHCHAOS_LOG_INFO(g_logger) << cb->toString();
+    YHCHAOS_ASSERT(cb->getState() == yhchaos::CircuitBreaker::OPEN);
+}
+
+void test_latency() {
+    yhchaos::HolderStats stats;
+    for(uint32_t i = 1; i <= 100; ++i) {
+        stats.incLatency(i);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "p50=" << stats.getLatencyPercentile(50)
+        << " p95=" << stats.getLatencyPercentile(95)
+        << " p99=" << stats.getLatencyPercentile(99);
+    YHCHAOS_ASSERT(stats.getLatencyCount() == 100);
+    YHCHAOS_ASSERT(stats.getLatencyPercentile(50) == 64);
+    YHCHAOS_ASSERT(stats.getLatencyPercentile(95) == 96);
+    YHCHAOS_ASSERT(stats.getLatencyPercentile(99) == 128);
+}
+
+int main(int argc, char** argv) {
+    test_p2c();
+    test_maglev();
+    test_breaker();
+    test_latency();
+    {
+        yhchaos::IOCoScheduler iom(1);
+        iom.coschedule(test_breaker_timer);
+    }
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "yhchaos/db/cpp_mysql.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//按连接的字符集和sql_mode转义
+void test_escape() {
+    auto conn = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    YHCHAOS_ASSERT(conn);
+    MYSQL* mysql = conn->getRaw().get();
+    std::string out;
+    std::string v("a'b\"c\\d\ne\rf\032g");
+    v.push_back('\0');
+    yhchaos::CppMySQLBatch::Escape(mysql, out, v.c_str(), v.size());
+    YHCHAOS_ASSERT(out == "'a\\'b\\\"c\\\\d\\ne\\rf\\Zg\\0'");
+    out.clear();
+    yhchaos::CppMySQLBatch::Escape(mysql, out, "plain", 5);
+    YHCHAOS_ASSERT(out == "'plain'");
+}
+
+//需要本地mysql，库和用户同test_mysql
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    if(yhchaos::CppMySQLUtil::Execute("test", "create table if not exists batch_test "
+                "(id bigint primary key, name varchar(64), score double, memo varchar(64))")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+    yhchaos::CppMySQLUtil::Execute("test", "delete from batch_test");
+    test_escape();
+
+    //64KB一条语句，按长度拆成多批
+    yhchaos::CppMySQLBatch::ptr batch(new yhchaos::CppMySQLBatch("test"
+                , "INSERT INTO batch_test(id, name, score, memo)"
+                , "name = VALUES(name), score = VALUES(score)", 64 * 1024));
+    int64_t count = 100000;
+    int64_t affected = 0;
+    uint64_t begin = yhchaos::GetCurrentMS();
+    for(int64_t i = 0; i < count; ++i) {
+        int64_t rt = batch->add(i, "name_" + std::to_string(i), i * 0.5
+                                , i % 10 ? "it's \"quoted\"" : nullptr);
+        YHCHAOS_ASSERT(rt >= 0);
+        affected += rt;
+    }
+    affected += batch->flush();
+    uint64_t used = yhchaos::GetCurrentMS() - begin;
+    YHCHAOS_LOG_INFO(g_logger) << count << " rows used " << used << "ms, batches="
+        << batch->getFlushCount() << " rows/s=" << count * 1000 / (used ? used : 1);
+    YHCHAOS_ASSERT(affected == count);
+    YHCHAOS_ASSERT(batch->getFlushCount() > 1);
+
+    auto res = yhchaos::CppMySQLUtil::Query("test", "select count(*) from batch_test where memo is null");
+    YHCHAOS_ASSERT(res && res->next() && res->getInt64(0) == count / 10);
+    res = yhchaos::CppMySQLUtil::Query("test", "select memo from batch_test where id = 1");
+    YHCHAOS_ASSERT(res && res->next() && res->getString(0) == "it's \"quoted\"");
+
+    //ON DUPLICATE KEY UPDATE，更新的行影响行数为2
+    YHCHAOS_ASSERT(batch->add((int64_t)1, "updated", 100.0, nullptr) == 0);
+    YHCHAOS_ASSERT(batch->flush() == 2);
+
+    //long long，float，bool
+    YHCHAOS_ASSERT(batch->add((long long)count + 1, "types", 0.25f, true) == 0);
+    YHCHAOS_ASSERT(batch->flush() == 1);
+    res = yhchaos::CppMySQLUtil::Query("test", "select score, memo from batch_test where id = %lld"
+                                       , (long long)count + 1);
+    YHCHAOS_ASSERT(res && res->next() && res->getDouble(0) == 0.25 && res->getString(1) == "1");
+
+    //定时刷新
+    batch->startFlusher(100);
+    YHCHAOS_ASSERT(batch->add(count, "timer", 1.0, "") == 0);
+    YHCHAOS_ASSERT(batch->getRowCount() == 1);
+    usleep(300 * 1000);
+    YHCHAOS_ASSERT(batch->getRowCount() == 0);
+    batch->stopFlusher();
+    YHCHAOS_LOG_INFO(g_logger) << "total rows=" << batch->getTotalRows()
+        << " affected=" << batch->getTotalAffected() << " errors=" << batch->getErrorCount();
+
+    yhchaos::CppMySQLUtil::Execute("test", "drop table batch_test");
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
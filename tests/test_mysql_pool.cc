@@ -0,0 +1,98 @@
+#include "yhchaos/db/cpp_mysql.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include <atomic>
+#include <sstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//需要本地mysql，库和用户同test_mysql
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    params["max_conn"] = "2";
+    params["pool"] = "2";
+    params["wait_timeout"] = "300";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    auto pool = yhchaos::CppMySQLMgr::GetInstance()->getPool("test");
+    YHCHAOS_ASSERT(pool && pool->getMaxConn() == 2);
+    if(!yhchaos::CppMySQLMgr::GetInstance()->get("test")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+
+    //20个协程共用2个连接，按顺序等待
+    int count = 20;
+    std::atomic<int> done(0);
+    std::atomic<int> fail(0);
+    std::atomic<uint32_t> max_total(0);
+    for(int i = 0; i < count; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([&, i]() {
+            auto conn = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+            if(!conn) {
+                ++fail;
+            } else {
+                auto res = conn->query("select sleep(0.01), %d", i);
+                YHCHAOS_ASSERT(res && res->next() && res->getInt32(1) == i);
+                uint32_t total = pool->getTotal();
+                if(total > max_total) {
+                    max_total = total;
+                }
+            }
+            ++done;
+        });
+    }
+    while(done < count) {
+        usleep(10 * 1000);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "fail=" << fail << " max_total=" << max_total;
+    YHCHAOS_ASSERT(fail == 0 && max_total <= 2);
+
+    //连接都被占用时等待超时
+    auto c1 = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    auto c2 = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    YHCHAOS_ASSERT(c1 && c2);
+    uint64_t begin = yhchaos::GetCurrentMS();
+    YHCHAOS_ASSERT(!yhchaos::CppMySQLMgr::GetInstance()->get("test"));
+    uint64_t used = yhchaos::GetCurrentMS() - begin;
+    YHCHAOS_ASSERT(used >= 250);
+
+    //归还的连接交给等待者
+    yhchaos::IOCoScheduler::GetThis()->addTimedCoroutine(50, [&c1]() {
+        c1.reset();
+    });
+    auto c3 = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    YHCHAOS_ASSERT(c3);
+    c2.reset();
+    c3.reset();
+    YHCHAOS_ASSERT(pool->getIdle() == 2 && pool->getWaiting() == 0);
+
+    //关闭空闲连接
+    yhchaos::CppMySQLMgr::GetInstance()->checkClient(0);
+    YHCHAOS_ASSERT(pool->getTotal() == 0);
+
+    std::stringstream ss;
+    yhchaos::CppMySQLMgr::GetInstance()->dump(ss);
+    YHCHAOS_LOG_INFO(g_logger) << ss.str();
+
+    //重新注册后使用新的参数创建连接池，借出的连接归还给旧的连接池
+    auto c4 = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    YHCHAOS_ASSERT(c4);
+    params["max_conn"] = "4";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    auto new_pool = yhchaos::CppMySQLMgr::GetInstance()->getPool("test");
+    YHCHAOS_ASSERT(new_pool && new_pool != pool && new_pool->getMaxConn() == 4);
+    c4.reset();
+    YHCHAOS_ASSERT(pool->getIdle() == 1 && new_pool->getIdle() == 0);
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "yhchaos/db/cpp_mysql.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include <atomic>
+#include <sstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//需要本地mysql，库和用户同test_mysql
+//副本都指向同一个实例，test_r2的端口不可连接
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    params["wait_timeout"] = "300";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test_r1", params);
+    params["port"] = "1";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test_r2", params);
+    params.erase("port");
+    params["replicas"] = "test_r1, test_r2";
+    params["pin_ms"] = "100";
+    params["replica_retry"] = "1";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    params["replicas"] = "test_r2";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test_bad", params);
+    params.erase("replicas");
+    params["max_conn"] = "1";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test_r3", params);
+    params.erase("max_conn");
+    params["replicas"] = "test_r3";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test_busy", params);
+
+    auto group = yhchaos::CppMySQLMgr::GetInstance()->getGroup("test");
+    YHCHAOS_ASSERT(group && group->getReplicaCount() == 2);
+    YHCHAOS_ASSERT(!yhchaos::CppMySQLMgr::GetInstance()->getGroup("test_r1"));
+    if(yhchaos::CppMySQLUtil::Execute("test", "create table if not exists replica_test "
+                "(id bigint primary key, name varchar(64))")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+    yhchaos::CppMySQLUtil::Execute("test", "delete from replica_test");
+
+    //写之后当前协程读主库
+    YHCHAOS_ASSERT(group->isPinned());
+    usleep(150 * 1000);
+    YHCHAOS_ASSERT(!group->isPinned());
+
+    //连不上的副本不再使用
+    for(int i = 0; i < 20; ++i) {
+        auto res = yhchaos::CppMySQLUtil::Query("test", "select %d", i);
+        YHCHAOS_ASSERT(res && res->next() && res->getInt32(0) == i);
+    }
+    YHCHAOS_ASSERT(group->getAvailable() == 1);
+
+    //读到自己的写，其他协程不受影响
+    int count = 10;
+    std::atomic<int> done(0);
+    for(int i = 0; i < count; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([&, i]() {
+            YHCHAOS_ASSERT(!group->isPinned());
+            YHCHAOS_ASSERT(yhchaos::CppMySQLMgr::GetInstance()->execute("test"
+                        , "insert into replica_test values(%d, 'name_%d')", i, i) == 0);
+            YHCHAOS_ASSERT(group->isPinned());
+            auto res = yhchaos::CppMySQLMgr::GetInstance()->query("test"
+                        , "select name from replica_test where id = %d", i);
+            YHCHAOS_ASSERT(res && res->next() && res->getString(0) == "name_" + std::to_string(i));
+            ++done;
+        });
+    }
+    while(done < count) {
+        usleep(10 * 1000);
+    }
+
+    //事务使用主库，结束后读主库
+    usleep(150 * 1000);
+    {
+        auto trans = yhchaos::CppMySQLMgr::GetInstance()->openTransaction("test", false);
+        YHCHAOS_ASSERT(trans && trans->begin());
+        YHCHAOS_ASSERT(trans->execute("update replica_test set name = 'updated' where id = 0") == 0);
+        YHCHAOS_ASSERT(trans->commit());
+    }
+    YHCHAOS_ASSERT(group->isPinned());
+
+    //get获取的主库连接可能用来写，归还后同样读主库
+    usleep(150 * 1000);
+    YHCHAOS_ASSERT(!group->isPinned());
+    {
+        auto conn = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+        YHCHAOS_ASSERT(conn && conn->execute("update replica_test set name = 'updated' where id = 0") == 0);
+    }
+    YHCHAOS_ASSERT(group->isPinned());
+
+    //副本都不可用时读主库
+    auto bad = yhchaos::CppMySQLMgr::GetInstance()->getGroup("test_bad");
+    YHCHAOS_ASSERT(bad);
+    auto res = yhchaos::CppMySQLUtil::Query("test_bad", "select name from replica_test where id = 0");
+    YHCHAOS_ASSERT(res && res->next() && res->getString(0) == "updated");
+    YHCHAOS_ASSERT(bad->getAvailable() == 0);
+
+    //等待副本连接超时只读主库，不摘除副本
+    auto busy = yhchaos::CppMySQLMgr::GetInstance()->getGroup("test_busy");
+    YHCHAOS_ASSERT(busy);
+    {
+        auto hold = yhchaos::CppMySQLMgr::GetInstance()->get("test_r3");
+        YHCHAOS_ASSERT(hold);
+        res = yhchaos::CppMySQLUtil::Query("test_busy", "select name from replica_test where id = 0");
+        YHCHAOS_ASSERT(res && res->next() && res->getString(0) == "updated");
+        YHCHAOS_ASSERT(busy->getAvailable() == 1);
+    }
+
+    //检查复制延迟，replica_retry之后重新尝试连不上的副本
+    sleep(1);
+    YHCHAOS_ASSERT(group->getAvailable() == 2);
+    yhchaos::CppMySQLMgr::GetInstance()->checkClient(30);
+    YHCHAOS_ASSERT(group->getAvailable() == 1);
+
+    std::stringstream ss;
+    yhchaos::CppMySQLMgr::GetInstance()->dump(ss);
+    YHCHAOS_LOG_INFO(g_logger) << ss.str();
+    yhchaos::CppMySQLUtil::Execute("test", "drop table replica_test");
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
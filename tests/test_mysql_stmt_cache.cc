@@ -0,0 +1,96 @@
+#include "yhchaos/db/cpp_mysql.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//需要本地mysql，库和用户同test_mysql
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    params["stmt_cache"] = "4";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+
+    auto mysql = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    if(!mysql) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+    mysql->execute("create table if not exists stmt_cache_test "
+                   "(id bigint primary key, name varchar(64), score double)");
+    mysql->execute("delete from stmt_cache_test");
+
+    //同一个sql只prepare一次，参数缓冲区复用
+    int64_t count = 1000;
+    uint64_t begin = yhchaos::GetCurrentUS();
+    for(int64_t i = 0; i < count; ++i) {
+        std::string name = "name_" + std::to_string(i);
+        double score = i * 1.5;
+        YHCHAOS_ASSERT(mysql->execStmt("insert into stmt_cache_test values(?, ?, ?)"
+                    , i, name, score) == 0);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << count << " inserts used "
+        << (yhchaos::GetCurrentUS() - begin) / 1000 << "ms";
+    YHCHAOS_ASSERT(mysql->getStmtMisses() == 1);
+    YHCHAOS_ASSERT(mysql->getStmtHits() == (uint64_t)count - 1);
+
+    //同一个位置绑定不同长度的参数
+    std::string name = std::string(100, 'x');
+    int64_t id = 1;
+    YHCHAOS_ASSERT(mysql->execStmt("update stmt_cache_test set name = ? where id = ?"
+                , name, id) == 0);
+    std::string short_name = "y";
+    YHCHAOS_ASSERT(mysql->execStmt("update stmt_cache_test set name = ? where id = ?"
+                , short_name, id) == 0);
+
+    //结果集未释放时，同一个sql使用新的语句
+    int64_t min_id = 0;
+    auto res1 = mysql->queryStmt("select id, name from stmt_cache_test where id >= ?", min_id);
+    min_id = 500;
+    auto res2 = mysql->queryStmt("select id, name from stmt_cache_test where id >= ?", min_id);
+    YHCHAOS_ASSERT(res1 && res1->getDataCount() == count);
+    YHCHAOS_ASSERT(res2 && res2->getDataCount() == count - 500);
+    res1.reset();
+    res2.reset();
+
+    //超过缓存个数按LRU淘汰
+    for(int i = 0; i < 10; ++i) {
+        std::string sql = "select id from stmt_cache_test where id = ? and " + std::to_string(i) + " = " + std::to_string(i);
+        auto res = mysql->queryStmt(sql.c_str(), id);
+        YHCHAOS_ASSERT(res && res->next() && res->getInt64(0) == id);
+    }
+    YHCHAOS_ASSERT(mysql->getStmtCount() == 4);
+
+    //主键冲突等普通的SQL错误不会把语句从缓存中删除
+    YHCHAOS_ASSERT(mysql->execStmt("insert into stmt_cache_test values(?, ?, ?)"
+                , id, name, 1.0) != 0);
+    uint64_t stmt_hits = mysql->getStmtHits();
+    uint64_t stmt_misses = mysql->getStmtMisses();
+    YHCHAOS_ASSERT(mysql->execStmt("insert into stmt_cache_test values(?, ?, ?)"
+                , id, name, 1.0) != 0);
+    YHCHAOS_ASSERT(mysql->getStmtHits() == stmt_hits + 1);
+    YHCHAOS_ASSERT(mysql->getStmtMisses() == stmt_misses);
+    //连接仍然可用，缓存的语句继续使用
+    id = count;
+    YHCHAOS_ASSERT(mysql->execStmt("insert into stmt_cache_test values(?, ?, ?)"
+                , id, name, 1.0) == 0);
+    YHCHAOS_ASSERT(mysql->getStmtHits() == stmt_hits + 2);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    yhchaos::CppMySQLMgr::GetInstance()->getStmtCacheInfo(hits, misses);
+    YHCHAOS_LOG_INFO(g_logger) << "stmt cache hits=" << hits << " misses=" << misses
+        << " hit_rate=" << (hits * 100.0 / (hits + misses)) << "%";
+    mysql->execute("drop table stmt_cache_test");
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(1);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "yhchaos/db/cpp_mysql.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//需要本地mysql，库和用户同test_mysql
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    if(yhchaos::CppMySQLUtil::Execute("test", "create table if not exists stream_test "
+                "(id bigint primary key, name varchar(64), score double)")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+    yhchaos::CppMySQLUtil::Execute("test", "delete from stream_test");
+
+    int64_t count = 200000;
+    {
+        yhchaos::CppMySQLBatch batch("test", "INSERT INTO stream_test(id, name, score)");
+        for(int64_t i = 0; i < count; ++i) {
+            if(i % 100 == 0) {
+                YHCHAOS_ASSERT(batch.add(i, nullptr, i * 0.5) >= 0);
+            } else {
+                YHCHAOS_ASSERT(batch.add(i, "name_" + std::to_string(i), i * 0.5) >= 0);
+            }
+        }
+        YHCHAOS_ASSERT(batch.flush() >= 0);
+    }
+
+    auto conn = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    YHCHAOS_ASSERT(conn);
+
+    //按类型遍历，字符串列不拷贝
+    uint64_t begin = yhchaos::GetCurrentMS();
+    auto res = conn->queryStream("select id, name, score from stream_test order by id");
+    YHCHAOS_ASSERT(res && res->isStream());
+    int64_t expect = 0;
+    size_t bytes = 0;
+    uint64_t rows = res->visit<int64_t, yhchaos::CppMySQLStr, double>(
+            [&expect, &bytes](int64_t id, yhchaos::CppMySQLStr name, double score) {
+        YHCHAOS_ASSERT(id == expect);
+        YHCHAOS_ASSERT(score == id * 0.5);
+        YHCHAOS_ASSERT(name.isNull() == (id % 100 == 0));
+        bytes += name.size;
+        ++expect;
+        return true;
+    });
+    YHCHAOS_ASSERT(rows == (uint64_t)count && res->getErrno() == 0);
+    YHCHAOS_LOG_INFO(g_logger) << "stream visit " << rows << " rows, "
+        << bytes << " bytes used " << yhchaos::GetCurrentMS() - begin << "ms";
+    res.reset();
+
+    //中途停止，释放结果集后连接可以继续使用
+    res = conn->queryStream("select id from stream_test");
+    YHCHAOS_ASSERT(res->visit<int64_t>([](int64_t id) { return id < 100; }) <= 101);
+    res.reset();
+    auto r = conn->query("select count(*) from stream_test");
+    YHCHAOS_ASSERT(r && r->next() && r->getInt64(0) == count);
+
+    //预处理语句逐行读取
+    int64_t min_id = count / 2;
+    auto sres = conn->queryStmtStream("select id, score from stream_test where id >= ?", min_id);
+    YHCHAOS_ASSERT(sres);
+    int64_t n = 0;
+    while(sres->next()) {
+        YHCHAOS_ASSERT(sres->getInt64(0) >= min_id);
+        ++n;
+    }
+    YHCHAOS_ASSERT(n == count - min_id);
+    sres.reset();
+
+    yhchaos::CppMySQLUtil::Execute("test", "drop table stream_test");
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(1);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "test/orm/user_info.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include <mysql/errmsg.h>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//代码由构建时的orm根据bin/orm_conf生成
+//需要本地mysql，库和用户同test_mysql
+void run() {
+    std::map<std::string, std::string> params;
+    params["host"] = "127.0.0.1";
+    params["user"] = "yhchaos";
+    params["passwd"] = "blog123";
+    params["dbname"] = "blog";
+    yhchaos::CppMySQLMgr::GetInstance()->registerCppMySQL("test", params);
+    auto conn = yhchaos::CppMySQLMgr::GetInstance()->get("test");
+    if(!conn) {
+        YHCHAOS_LOG_ERROR(g_logger) << "connect fail";
+        return;
+    }
+
+    //编译期的列信息
+    static_assert(test::orm::UserInfo::COLUMN_COUNT == 7, "user columns");
+    static_assert(test::orm::UserInfo::COL_STATUS == 4, "status index");
+    YHCHAOS_ASSERT(std::string(test::orm::UserInfo::COLUMNS[0].name) == "id");
+    YHCHAOS_ASSERT(test::orm::UserInfo::COLUMNS[0].auto_increment);
+
+    conn->execute("drop table if exists user");
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::CreateTable(conn) == 0);
+
+    //默认值来自表定义，自增id写回
+    test::orm::UserInfo info;
+    YHCHAOS_ASSERT(info.status == 10 && info.email == "xx@xx.com");
+    info.name = "orm_0";
+    info.email = "orm_0@xx.com";
+    info.phone = std::string(1000, '1');
+    info.create_time = time(0);
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::Insert(info, conn) == 0);
+    YHCHAOS_ASSERT(info.id > 0);
+
+    //超过列缓冲区的字符串补读
+    auto v = test::orm::UserInfoDao::Get(info.id, conn);
+    YHCHAOS_ASSERT(v && v->name == info.name && v->phone == info.phone);
+    YHCHAOS_ASSERT(v->create_time == info.create_time && v->update_time > 0);
+    YHCHAOS_LOG_INFO(g_logger) << v->toString().substr(0, 128);
+
+    info.status = 20;
+    info.phone = "";
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::Update(info, conn) == 0);
+    v = test::orm::UserInfoDao::GetByName("orm_0", conn);
+    YHCHAOS_ASSERT(v && v->status == 20 && v->phone.empty());
+    YHCHAOS_ASSERT(!test::orm::UserInfoDao::GetByEmail("none", conn));
+
+    //冲突时更新，id为已有的行
+    test::orm::UserInfo dup;
+    dup.name = "orm_0";
+    dup.email = "orm_0@xx.com";
+    dup.status = 30;
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::InsertOrUpdate(dup, conn) == 0);
+    YHCHAOS_ASSERT(dup.id == info.id);
+
+    //批量插入
+    int count = 10000;
+    std::vector<test::orm::UserInfo::ptr> infos;
+    for(int i = 1; i <= count; ++i) {
+        test::orm::UserInfo::ptr u = std::make_shared<test::orm::UserInfo>();
+        u->name = "orm_" + std::to_string(i);
+        u->email = u->name + "@xx.com";
+        u->status = i % 2;
+        infos.push_back(u);
+    }
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::BatchInsert(infos, "test") == count);
+
+    //结果列直接读到字段
+    std::vector<test::orm::UserInfo::ptr> results;
+    uint64_t begin = yhchaos::GetCurrentUS();
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::QueryAll(results, conn) == 0);
+    YHCHAOS_LOG_INFO(g_logger) << "query " << results.size() << " rows used "
+        << (yhchaos::GetCurrentUS() - begin) / 1000 << "ms";
+    YHCHAOS_ASSERT((int)results.size() == count + 1);
+    for(auto& i : results) {
+        YHCHAOS_ASSERT(i->create_time == 0 || i->name == "orm_0");
+    }
+
+    results.clear();
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::QueryByStatus(1, results, conn) == 0);
+    YHCHAOS_ASSERT((int)results.size() == count / 2);
+
+    results.clear();
+    int64_t min_id = info.id + 100;
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::QueryWhere(results, conn
+                , "WHERE `id` > ? ORDER BY `id` LIMIT 10", min_id) == 0);
+    YHCHAOS_ASSERT(results.size() == 10 && results[0]->id == min_id + 1);
+
+    int n = 0;
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::ForEach([&n](const test::orm::UserInfo& u) {
+        return ++n < 100;
+    }, conn) == 0);
+    YHCHAOS_ASSERT(n == 100);
+
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::DeleteByStatus(0, conn) == 0);
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::Delete(info, conn) == 0);
+    YHCHAOS_ASSERT(!test::orm::UserInfoDao::Get(info.id, conn));
+    results.clear();
+    YHCHAOS_ASSERT(test::orm::UserInfoDao::QueryAll(results, conn) == 0);
+    YHCHAOS_ASSERT((int)results.size() == count / 2);
+
+    //数值超出绑定变量的范围时失败，不返回截断后的值
+    int8_t v = 0;
+    yhchaos::CppMySQLStmtFetcher fetcher(conn, "SELECT 1000");
+    fetcher.bind(0, v);
+    YHCHAOS_ASSERT(fetcher.execute() == 0);
+    YHCHAOS_ASSERT(!fetcher.next() && fetcher.getErrno() == CR_DATA_TRUNCATED);
+
+    conn->execute("drop table user");
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(1);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,185 @@
+#include "yhchaos/db/cpp_redis.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include "yhchaos/appconfig.h"
+#include "resp_stub_server.h"
+#include <atomic>
+#include <set>
+#include <sstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//进程内的RESP服务器，支持CLIENT ID/CLIENT TRACKING/SUBSCRIBE/SET/GET，
+//开启了tracking的连接GET过的key被SET时，向重定向的订阅连接推送失效通知，
+//DEBUG_KILL 关闭所有订阅连接
+static yhchaos::Mtx s_mutex;
+static std::map<std::string, std::string> s_data;
+static std::map<int64_t, yhchaos::Sock::ptr> s_subscribers;
+//key -> 需要通知的订阅连接id
+static std::map<std::string, std::set<int64_t> > s_tracking;
+static std::atomic<int> s_gets(0);
+
+//key被修改，通知后不再跟踪，和redis一致
+static void invalidate(const std::string& key) {
+    auto it = s_tracking.find(key);
+    if(it == s_tracking.end()) {
+        return;
+    }
+    std::string msg = "*3\r\n" + RespStubServer::Bulk("message") + RespStubServer::Bulk("__redis__:invalidate")
+        + "*1\r\n" + RespStubServer::Bulk(key);
+    for(auto& id : it->second) {
+        auto sub = s_subscribers.find(id);
+        if(sub != s_subscribers.end()) {
+            sub->second->send(msg.c_str(), msg.size());
+        }
+    }
+    s_tracking.erase(it);
+}
+
+static bool handle_cmd(RespStubServer::Conn& conn, const std::vector<std::string>& argv
+                       ,std::string& out) {
+    std::string cmd = yhchaos::ToUpper(argv[0]);
+    yhchaos::Mtx::Lock lock(s_mutex);
+    if(cmd == "CLIENT" && yhchaos::ToUpper(argv[1]) == "ID") {
+        out += ":" + std::to_string(conn.id) + "\r\n";
+    } else if(cmd == "CLIENT" && yhchaos::ToUpper(argv[1]) == "TRACKING") {
+        conn.state["redirect"] = atoll(argv[4].c_str());
+        out += "+OK\r\n";
+    } else if(cmd == "SUBSCRIBE") {
+        s_subscribers[conn.id] = conn.sock;
+        out += "*3\r\n" + RespStubServer::Bulk("subscribe") + RespStubServer::Bulk(argv[1]) + ":1\r\n";
+    } else if(cmd == "SET") {
+        s_data[argv[1]] = argv[2];
+        invalidate(argv[1]);
+        out += "+OK\r\n";
+    } else if(cmd == "GET") {
+        ++s_gets;
+        auto it = conn.state.find("redirect");
+        if(it != conn.state.end()) {
+            s_tracking[argv[1]].insert(it->second);
+        }
+        auto dit = s_data.find(argv[1]);
+        out += dit == s_data.end() ? "$-1\r\n" : RespStubServer::Bulk(dit->second);
+    } else if(cmd == "DEBUG_KILL") {
+        for(auto& i : s_subscribers) {
+            i.second->close();
+        }
+        s_subscribers.clear();
+        out += "+OK\r\n";
+    } else {
+        out += "-ERR unknown command '" + argv[0] + "'\r\n";
+    }
+    return true;
+}
+
+static yhchaos::ReplyPtr make_reply(const std::string& v) {
+    redisReply* r = (redisReply*)calloc(1, sizeof(redisReply));
+    r->type = REDIS_REPLY_STRING;
+    r->len = v.size();
+    r->str = strdup(v.c_str());
+    return yhchaos::ReplyPtr(r, freeReplyObject);
+}
+
+void test_cache() {
+    yhchaos::CppRedisNearCache cache(32);
+    YHCHAOS_ASSERT(!cache.get("a"));
+    cache.set("a", make_reply("1"), cache.getVersion("a"));
+    YHCHAOS_ASSERT(cache.get("a") && std::string(cache.get("a")->str) == "1");
+    YHCHAOS_ASSERT(cache.getHits() == 2 && cache.getMisses() == 1);
+
+    //请求期间key失效，回复不缓存
+    uint64_t version = cache.getVersion("b");
+    cache.del("b");
+    cache.set("b", make_reply("old"), version);
+    YHCHAOS_ASSERT(!cache.get("b"));
+
+    //每个分片LRU淘汰，总数不超过上限
+    for(int i = 0; i < 1000; ++i) {
+        std::string key = "key_" + std::to_string(i);
+        cache.set(key, make_reply(key), cache.getVersion(key));
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "near cache count=" << cache.getCount();
+    YHCHAOS_ASSERT(cache.getCount() <= 32);
+    YHCHAOS_ASSERT(cache.get("key_999"));
+
+    cache.clear();
+    YHCHAOS_ASSERT(cache.getCount() == 0);
+}
+
+static std::string get(const std::string& key) {
+    auto r = yhchaos::CppRedisUtil::Get("near", key);
+    YHCHAOS_ASSERT(r);
+    return r->type == REDIS_REPLY_STRING ? std::string(r->str, r->len) : "";
+}
+
+void run() {
+    test_cache();
+
+    RespStubServer::ptr server(new RespStubServer(handle_cmd));
+    server->start("127.0.0.1:8032");
+
+    std::map<std::string, std::string> conf;
+    conf["host"] = "127.0.0.1:8032";
+    conf["type"] = "co_redis";
+    conf["pool"] = "1";
+    conf["timeout"] = "1000";
+    std::map<std::string, std::map<std::string, std::string> > config;
+    config["plain"] = conf;
+    conf["near_cache"] = "1";
+    conf["near_cache_size"] = "1000";
+    config["near"] = conf;
+    yhchaos::AppConfig::SearchFor("redis.config"
+            , std::map<std::string, std::map<std::string, std::string> >())->setValue(config);
+
+    auto cache = yhchaos::CppRedisMgr::GetInstance()->getNearCache("near");
+    YHCHAOS_ASSERT(cache);
+    YHCHAOS_ASSERT(!yhchaos::CppRedisMgr::GetInstance()->getNearCache("plain"));
+
+    YHCHAOS_ASSERT(yhchaos::CppRedisUtil::Cmd("near", "SET k1 v1"));
+    //第一次从服务器读取，之后命中缓存
+    for(int i = 0; i < 100; ++i) {
+        YHCHAOS_ASSERT(get("k1") == "v1");
+    }
+    auto r = yhchaos::CppRedisUtil::Cmd("near", "GET %s", "k1");
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "v1");
+    r = yhchaos::CppRedisUtil::Cmd("near", std::vector<std::string>{"get", "k1"});
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "v1");
+    YHCHAOS_LOG_INFO(g_logger) << "server gets=" << s_gets << " hits=" << cache->getHits()
+        << " misses=" << cache->getMisses();
+    YHCHAOS_ASSERT(s_gets == 1 && cache->getHits() == 101);
+
+    //其他客户端修改后收到失效通知，重新读取
+    YHCHAOS_ASSERT(yhchaos::CppRedisUtil::Cmd("plain", "SET k1 v2"));
+    usleep(50 * 1000);
+    YHCHAOS_ASSERT(get("k1") == "v2");
+    YHCHAOS_ASSERT(s_gets == 2);
+
+    //不存在的key也缓存
+    YHCHAOS_ASSERT(get("none") == "");
+    YHCHAOS_ASSERT(get("none") == "");
+    YHCHAOS_ASSERT(s_gets == 3);
+
+    //失效通知连接断开，清空缓存并重新连接
+    YHCHAOS_ASSERT(yhchaos::CppRedisUtil::Cmd("plain", "DEBUG_KILL"));
+    usleep(50 * 1000);
+    YHCHAOS_ASSERT(cache->getCount() == 0);
+    YHCHAOS_ASSERT(get("k1") == "v2");
+    YHCHAOS_ASSERT(get("k1") == "v2");
+    YHCHAOS_ASSERT(s_gets == 4);
+    YHCHAOS_ASSERT(yhchaos::CppRedisUtil::Cmd("plain", "SET k1 v3"));
+    usleep(50 * 1000);
+    YHCHAOS_ASSERT(get("k1") == "v3");
+
+    std::stringstream ss;
+    yhchaos::CppRedisMgr::GetInstance()->dump(ss);
+    YHCHAOS_LOG_INFO(g_logger) << ss.str();
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
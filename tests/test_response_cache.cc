@@ -0,0 +1,165 @@
+#include "yhchaos/http/httpsvr.h"
+#include "yhchaos/http/http_client.h"
+#include "yhchaos/http/servlets/cache_servlet.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include <atomic>
+#include <stdexcept>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static std::atomic<int> s_catalog(0);
+static std::atomic<int> s_private(0);
+static std::atomic<int> s_vary(0);
+static std::atomic<int> s_nocache(0);
+
+void run_server(yhchaos::http::HttpSvr::ptr server) {
+    auto sd = server->getCppServletDispatch();
+    //模拟查询MySQL的慢接口，按Cache-Control缓存1秒
+    sd->addCppServlet("/catalog", std::make_shared<yhchaos::http::CacheCppServlet>(
+            std::make_shared<yhchaos::http::FunctionCppServlet>(
+            [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            ++s_catalog;
+            usleep(100 * 1000);
+            rsp->setHeader("Cache-Control", "public, max-age=1");
+            rsp->setBody("catalog " + req->getQuery() + " " + req->getHeader("Accept-Language"));
+            return 0;
+    }), 0, std::vector<std::string>{"Accept-Language"}));
+
+    //设置了Set-Cookie的响应不缓存
+    sd->addCppServlet("/private", std::make_shared<yhchaos::http::CacheCppServlet>(
+            std::make_shared<yhchaos::http::FunctionCppServlet>(
+            [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            ++s_private;
+            rsp->setCookie("sid", std::to_string(s_private));
+            rsp->setBody("private");
+            return 0;
+    }), 10000));
+
+    //Vary了不在缓存key中的头部，不缓存
+    sd->addCppServlet("/vary", std::make_shared<yhchaos::http::CacheCppServlet>(
+            std::make_shared<yhchaos::http::FunctionCppServlet>(
+            [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            ++s_vary;
+            rsp->setHeader("Vary", "Accept-Encoding");
+            rsp->setBody("vary");
+            return 0;
+    }), 10000));
+
+    //no-cache="..."的形式同样不缓存
+    sd->addCppServlet("/nocache", std::make_shared<yhchaos::http::CacheCppServlet>(
+            std::make_shared<yhchaos::http::FunctionCppServlet>(
+            [](yhchaos::http::HttpReq::ptr req
+                ,yhchaos::http::HttpRsp::ptr rsp
+                ,yhchaos::http::HSession::ptr session) {
+            ++s_nocache;
+            rsp->setHeader("Cache-Control", "max-age=10, no-cache=\"X-User, X-Token\"");
+            rsp->setBody("nocache");
+            return 0;
+    }), 10000));
+    server->start();
+}
+
+static yhchaos::http::HttpRes::ptr get(const std::string& path
+                        ,const std::map<std::string, std::string>& headers = {}) {
+    auto res = yhchaos::http::HttpClient::DoGet("http://127.0.0.1:8025" + path, 3000, headers);
+    YHCHAOS_ASSERT(res->result == 0);
+    return res;
+}
+
+void run() {
+    yhchaos::http::HttpSvr::ptr server(new yhchaos::http::HttpSvr(true));
+    YHCHAOS_ASSERT(server->bind(yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8025")));
+    run_server(server);
+
+    //并发未命中只执行一次
+    std::atomic<int> done(0);
+    for(int i = 0; i < 20; ++i) {
+        yhchaos::IOCoScheduler::GetThis()->coschedule([&done](){
+            auto res = get("/catalog?page=1");
+            YHCHAOS_ASSERT(res->response->getBody() == "catalog page=1 ");
+            ++done;
+        });
+    }
+    while(done < 20) {
+        usleep(10 * 1000);
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "20 concurrent requests, handler called " << s_catalog;
+    YHCHAOS_ASSERT(s_catalog == 1);
+
+    auto res = get("/catalog?page=1");
+    YHCHAOS_ASSERT(res->response->getHeader("X-Cache") == "HIT");
+    YHCHAOS_ASSERT(s_catalog == 1);
+
+    //query和vary头部不同是不同的缓存
+    res = get("/catalog?page=2");
+    YHCHAOS_ASSERT(res->response->getHeader("X-Cache") == "MISS");
+    res = get("/catalog?page=1", {{"Accept-Language", "zh"}});
+    YHCHAOS_ASSERT(res->response->getBody() == "catalog page=1 zh");
+    YHCHAOS_ASSERT(s_catalog == 3);
+
+    //不同的Host(虚拟主机)是不同的缓存
+    res = get("/catalog?page=1", {{"Host", "other.yhchaos.local"}});
+    YHCHAOS_ASSERT(res->response->getHeader("X-Cache") == "MISS");
+    YHCHAOS_ASSERT(s_catalog == 4);
+
+    //过期后重新生成
+    usleep(1100 * 1000);
+    res = get("/catalog?page=1");
+    YHCHAOS_ASSERT(res->response->getHeader("X-Cache") == "MISS");
+    YHCHAOS_ASSERT(s_catalog == 5);
+
+    //带Cookie的请求不使用缓存
+    res = get("/catalog?page=1", {{"Cookie", "sid=1"}});
+    YHCHAOS_ASSERT(res->response->getHeader("X-Cache").empty());
+    YHCHAOS_ASSERT(s_catalog == 6);
+
+    get("/private");
+    get("/private");
+    YHCHAOS_ASSERT(s_private == 2);
+
+    get("/vary");
+    get("/vary");
+    YHCHAOS_ASSERT(s_vary == 2);
+
+    get("/nocache");
+    get("/nocache");
+    YHCHAOS_ASSERT(s_nocache == 2);
+
+    //生成缓存时抛出异常，pending被移除，之后的请求可以重新生成
+    auto cache = yhchaos::http::ResponseCacheMgr::GetInstance();
+    bool loaded = false;
+    try {
+        cache->load("throw", []() -> yhchaos::http::ResponseCache::Entry::ptr {
+            throw std::runtime_error("load fail");
+        }, loaded);
+        YHCHAOS_ASSERT(false);
+    } catch(std::exception& e) {
+        YHCHAOS_ASSERT(loaded);
+    }
+    auto entry = cache->load("throw", []() {
+        auto entry = std::make_shared<yhchaos::http::ResponseCache::Entry>();
+        entry->expire = yhchaos::GetCurrentMS() + 1000;
+        return entry;
+    }, loaded);
+    YHCHAOS_ASSERT(loaded && entry);
+
+    size_t count = 0;
+    uint64_t size = 0;
+    yhchaos::http::ResponseCacheMgr::GetInstance()->getInfo(count, size);
+    YHCHAOS_LOG_INFO(g_logger) << "cache count=" << count << " size=" << size;
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include "yhchaos/http/cpp_servlet.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static yhchaos::http::CppServlet::ptr make_slt() {
+    return std::make_shared<yhchaos::http::FunctionCppServlet>(
+            [](yhchaos::http::HttpReq::ptr req
+               ,yhchaos::http::HttpRsp::ptr rsp
+               ,yhchaos::http::HSession::ptr session) {
+        return 0;
+    });
+}
+
+void test_dispatch() {
+    yhchaos::http::CppServletDispatch::ptr sd(new yhchaos::http::CppServletDispatch);
+    auto user = make_slt();
+    auto user_info = make_slt();
+    auto user_id = make_slt();
+    auto user_id_info = make_slt();
+    auto files = make_slt();
+    auto exotic = make_slt();
+
+    sd->addCppServlet("/api/user", user);
+    sd->addGlobCppServlet("/api/user/info", user_info);
+    sd->addGlobCppServlet("/api/user/:id", user_id);
+    sd->addGlobCppServlet("/api/user/:id/info", user_id_info);
+    sd->addGlobCppServlet("/static/*", files);
+    sd->addGlobCppServlet("/v[0-9]/*", exotic);
+
+    yhchaos::http::HttpReq::ptr req(new yhchaos::http::HttpReq);
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user", req) == user);
+    //静态路径优先于参数
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/info", req) == user_info);
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/123", req) == user_id);
+    YHCHAOS_ASSERT(req->getRouteParam("id") == "123");
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/456/info", req) == user_id_info);
+    YHCHAOS_ASSERT(req->getRouteParam("id") == "456");
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/static/css/a.css", req) == files);
+    YHCHAOS_ASSERT(req->getRouteParam("*") == "css/a.css");
+    //不能编译的模式回退到fnmatch
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/v1/abc", req) == exotic);
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/1/2", req) == sd->getDefault());
+
+    //同一位置的参数名冲突，拒绝添加，原有路由不受影响
+    sd->addGlobCppServlet("/api/user/:name/detail", make_slt());
+    YHCHAOS_ASSERT(!sd->getGlobCppServlet("/api/user/:name/detail"));
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/456/info", req) == user_id_info);
+    YHCHAOS_ASSERT(req->getRouteParam("id") == "456");
+
+    sd->delGlobCppServlet("/api/user/:id");
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/123", req) == sd->getDefault());
+    YHCHAOS_ASSERT(sd->getMatchedCppServlet("/api/user/456/info", req) == user_id_info);
+    YHCHAOS_LOG_INFO(g_logger) << "test_dispatch ok";
+}
+
+void test_bench() {
+    yhchaos::http::CppServletDispatch::ptr sd(new yhchaos::http::CppServletDispatch);
+    for(int i = 0; i < 1000; ++i) {
+        sd->addGlobCppServlet("/api/v" + std::to_string(i) + "/:id/*", make_slt());
+    }
+    uint64_t start = yhchaos::GetCurrentUS();
+    for(int i = 0; i < 100000; ++i) {
+        sd->getMatchedCppServlet("/api/v" + std::to_string(i % 1000) + "/1234/detail");
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "1000 routes, 100000 lookups used "
+        << (yhchaos::GetCurrentUS() - start) << "us";
+}
+
+int main(int argc, char** argv) {
+    test_dispatch();
+    test_bench();
+    return 0;
+}
@@ -0,0 +1,122 @@
+#include "yhchaos/http/httpsvr.h"
+#include "yhchaos/http/http_client.h"
+#include "yhchaos/http/servlets/static_file_servlet.h"
+#include "yhchaos/streams/zlib_stream.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include <fstream>
+#include <sys/stat.h>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static const std::string s_root = "/tmp/test_static_file";
+static const std::string s_url = "http://127.0.0.1:8024/static";
+
+static void write_file(const std::string& name, const std::string& data) {
+    std::ofstream ofs(s_root + "/" + name);
+    ofs << data;
+}
+
+static yhchaos::http::HttpRes::ptr get(const std::string& path
+                        ,const std::map<std::string, std::string>& headers = {}) {
+    auto res = yhchaos::http::HttpClient::DoGet(s_url + path, 1000, headers);
+    YHCHAOS_ASSERT(res->result == 0);
+    YHCHAOS_LOG_INFO(g_logger) << path << " " << (int)res->response->getStatus()
+        << " size=" << res->response->getBody().size();
+    return res;
+}
+
+void run() {
+    mkdir(s_root.c_str(), 0755);
+    mkdir((s_root + "/sub").c_str(), 0755);
+    write_file("hello.txt", "hello static file");
+    write_file("sub/index.html", "<html>index</html>");
+    std::string big(1024 * 1024, 'x');
+    for(size_t i = 0; i < big.size(); i += 1000) {
+        big[i] = 'a' + i % 26;
+    }
+    write_file("big.bin", big);
+    std::string js = "console.log('not compressed');";
+    write_file("app.js", js);
+    auto zs = yhchaos::ZlibStream::CreateGzip(true);
+    zs->write(js.c_str(), js.size());
+    zs->flush();
+    write_file("app.js.gz", zs->getRes());
+
+    yhchaos::http::HttpSvr::ptr server(new yhchaos::http::HttpSvr(true));
+    YHCHAOS_ASSERT(server->bind(yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8024")));
+    yhchaos::http::StaticFileCppServlet::ptr slt(
+            new yhchaos::http::StaticFileCppServlet(s_root, "/static"));
+    slt->setMaxAge(60);
+    server->getCppServletDispatch()->addGlobCppServlet("/static/*", slt);
+    server->start();
+
+    //小文件从mmap缓存返回
+    auto res = get("/hello.txt");
+    YHCHAOS_ASSERT(res->response->getBody() == "hello static file");
+    std::string etag = res->response->getHeader("ETag");
+    YHCHAOS_ASSERT(!etag.empty());
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Type").find("text/plain") == 0);
+
+    //条件请求
+    res = get("/hello.txt", {{"If-None-Match", etag}});
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::NOT_MODIFIED);
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Length") == "0");
+    res = get("/hello.txt", {{"If-Modified-Since", res->response->getHeader("Last-Modified")}});
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::NOT_MODIFIED);
+
+    //Range
+    res = get("/hello.txt", {{"Range", "bytes=6-11"}});
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::PARTIAL_CONTENT);
+    YHCHAOS_ASSERT(res->response->getBody() == "static");
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Range") == "bytes 6-11/17");
+    res = get("/hello.txt", {{"Range", "bytes=-4"}});
+    YHCHAOS_ASSERT(res->response->getBody() == "file");
+    res = get("/hello.txt", {{"Range", "bytes=100-"}});
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::RANGE_NOT_SATISFIABLE);
+    res = get("/hello.txt", {{"Range", "bytes=0-1"}, {"If-Range", "\"old\""}});
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::OK);
+
+    //大文件通过sendfile发送
+    res = get("/big.bin");
+    YHCHAOS_ASSERT(res->response->getBody() == big);
+    res = get("/big.bin", {{"Range", "bytes=1000-1999"}});
+    YHCHAOS_ASSERT(res->response->getBody() == big.substr(1000, 1000));
+
+    //预压缩的.gz文件，HttpClient会自动解压
+    res = get("/app.js", {{"Accept-Encoding", "gzip"}});
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Encoding") == "gzip");
+    YHCHAOS_ASSERT(res->response->getBody() == js);
+    res = get("/app.js");
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Encoding").empty());
+    YHCHAOS_ASSERT(res->response->getBody() == js);
+
+    //目录和禁止访问的路径
+    res = get("/sub");
+    YHCHAOS_ASSERT(res->response->getBody() == "<html>index</html>");
+    res = get("/%2e%2e/test_static_file/hello.txt");
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::FORBIDDEN);
+    res = get("/none.txt");
+    YHCHAOS_ASSERT(res->response->getStatus() == yhchaos::http::HStatus::NOT_FOUND);
+    YHCHAOS_ASSERT(res->response->getHeader("Content-Length") == "0");
+
+    //文件变化后缓存失效，写新文件后rename，不影响已经映射的旧文件
+    sleep(1);
+    write_file("hello.txt.tmp", "changed");
+    rename((s_root + "/hello.txt.tmp").c_str(), (s_root + "/hello.txt").c_str());
+    res = get("/hello.txt", {{"If-None-Match", etag}});
+    YHCHAOS_ASSERT(res->response->getBody() == "changed");
+
+    size_t count = 0;
+    uint64_t size = 0;
+    slt->getCacheInfo(count, size);
+    YHCHAOS_LOG_INFO(g_logger) << "cache count=" << count << " size=" << size;
+    server->stop();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "yhchaos/db/cpp_redis.h"
+#include "yhchaos/db/watch_thread.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+#include "resp_stub_server.h"
+#include <atomic>
+#include <sstream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//进程内的RESP服务器，支持PING/SET/GET，
+//DEBUG_SLEEP ms 延迟回复，DEBUG_CLOSE 不回复直接断开
+static std::map<std::string, std::string> s_data;
+
+static bool handle_cmd(RespStubServer::Conn& conn, const std::vector<std::string>& argv
+                       ,std::string& out) {
+    std::string cmd = yhchaos::ToUpper(argv[0]);
+    if(cmd == "PING") {
+        out += "+PONG\r\n";
+    } else if(cmd == "SET") {
+        s_data[argv[1]] = argv[2];
+        out += "+OK\r\n";
+    } else if(cmd == "GET") {
+        auto it = s_data.find(argv[1]);
+        out += it == s_data.end() ? "$-1\r\n" : RespStubServer::Bulk(it->second);
+    } else if(cmd == "DEBUG_SLEEP") {
+        usleep(atoi(argv[1].c_str()) * 1000);
+        out += "+OK\r\n";
+    } else if(cmd == "DEBUG_CLOSE") {
+        return false;
+    } else {
+        out += "-ERR unknown command '" + argv[0] + "'\r\n";
+    }
+    return true;
+}
+
+static void wait_for(std::atomic<int>& v, int expect) {
+    while(v < expect) {
+        usleep(10 * 1000);
+    }
+}
+
+void test_thread(yhchaos::IOCoScheduler* iom) {
+    yhchaos::WatchCppThread thr("watch", iom);
+    YHCHAOS_ASSERT(!thr.getBase() && thr.getIOCoScheduler() == iom);
+    std::atomic<int> inited(0);
+    thr.setInitCb([&inited](yhchaos::WatchCppThread* t) {
+        YHCHAOS_ASSERT(yhchaos::WatchCppThread::GetThis() == t);
+        ++inited;
+    });
+    thr.start();
+
+    //回调都在同一个线程中串行执行
+    int count = 10000;
+    int value = 0;
+    std::atomic<int> done(0);
+    std::atomic<int> tid(0);
+    for(int i = 0; i < count; ++i) {
+        thr.dispatch([&]() {
+            YHCHAOS_ASSERT(yhchaos::WatchCppThread::GetThis() == &thr);
+            int cur = yhchaos::GetCppThreadId();
+            int expect = 0;
+            if(!tid.compare_exchange_strong(expect, cur)) {
+                YHCHAOS_ASSERT(expect == cur);
+            }
+            ++value;
+            ++done;
+        });
+    }
+    wait_for(done, count);
+    YHCHAOS_ASSERT(value == count && inited == 1);
+    YHCHAOS_ASSERT(!yhchaos::WatchCppThread::GetThis());
+
+    //定时器在所属线程中执行
+    std::atomic<int> once(0);
+    std::atomic<int> repeat(0);
+    yhchaos::WatchCppThread::Timer::ptr t1;
+    yhchaos::WatchCppThread::Timer::ptr t2;
+    yhchaos::WatchCppThread::Timer::ptr t3;
+    done = 0;
+    thr.dispatch([&]() {
+        t1 = thr.addTimer(20, [&]() {
+            YHCHAOS_ASSERT(yhchaos::WatchCppThread::GetThis() == &thr);
+            ++once;
+        });
+        t2 = thr.addTimer(10, [&]() {
+            if(++repeat == 5) {
+                t2->cancel();
+            }
+        }, true);
+        //取消的定时器不执行
+        t3 = thr.addTimer(10, [&]() {
+            YHCHAOS_ASSERT(false);
+        });
+        t3->cancel();
+        ++done;
+    });
+    wait_for(done, 1);
+    usleep(200 * 1000);
+    YHCHAOS_ASSERT(once == 1 && repeat == 5);
+    done = 0;
+    thr.dispatch([&]() {
+        t1 = t2 = t3 = nullptr;
+        ++done;
+    });
+    wait_for(done, 1);
+
+    std::stringstream ss;
+    thr.dump(ss);
+    YHCHAOS_LOG_INFO(g_logger) << ss.str();
+    thr.stop();
+}
+
+//析构后已经调度的回调和定时器不再执行
+void test_delete(yhchaos::IOCoScheduler* iom) {
+    std::atomic<int> ran(0);
+    yhchaos::WatchCppThread::Timer::ptr timer;
+    int ran_at_delete = 0;
+    {
+        yhchaos::WatchCppThread thr("watch_delete", iom, 1);
+        thr.start();
+        timer = thr.addTimer(50, [&ran]() {
+            ++ran;
+        });
+        for(int i = 0; i < 10000; ++i) {
+            thr.dispatch([&ran]() {
+                ++ran;
+            });
+        }
+        thr.stop();
+    }
+    ran_at_delete = ran;
+    usleep(100 * 1000);
+    YHCHAOS_LOG_INFO(g_logger) << "callbacks ran before delete: " << ran_at_delete;
+    YHCHAOS_ASSERT(ran == ran_at_delete);
+    timer = nullptr;
+}
+
+//在自己的回调中析构不会死锁
+void test_delete_in_callback(yhchaos::IOCoScheduler* iom) {
+    std::atomic<int> done(0);
+    yhchaos::WatchCppThread* thr = new yhchaos::WatchCppThread("watch_self_delete", iom, 1);
+    thr->start();
+    thr->dispatch([thr, &done]() {
+        delete thr;
+        ++done;
+    });
+    wait_for(done, 1);
+    YHCHAOS_LOG_INFO(g_logger) << "deleted in its own callback";
+}
+
+void test_pool(yhchaos::IOCoScheduler* iom) {
+    //每个WatchCppThread绑定iom的一个线程
+    yhchaos::WatchCppThreadPool pool(2, "watch_pool", false, iom);
+    pool.start();
+    std::atomic<int> done(0);
+    int tids[2] = {0, 0};
+    for(int i = 0; i < 2; ++i) {
+        pool.dispatch(i, [&tids, &done, i]() {
+            tids[i] = yhchaos::GetCppThreadId();
+            ++done;
+        });
+    }
+    wait_for(done, 2);
+    YHCHAOS_ASSERT(tids[0] != tids[1]);
+    std::stringstream ss;
+    pool.dump(ss);
+    YHCHAOS_LOG_INFO(g_logger) << ss.str();
+    pool.stop();
+}
+
+//FoxCppRedis的连接和定时器在IOCoScheduler上运行
+void test_fox_redis(yhchaos::IOCoScheduler* iom) {
+    RespStubServer::ptr server(new RespStubServer(handle_cmd));
+    server->start("127.0.0.1:8033", iom);
+
+    yhchaos::WatchCppThread thr("redis", iom, 1);
+    thr.start();
+    std::map<std::string, std::string> conf;
+    conf["host"] = "127.0.0.1:8033";
+    conf["timeout"] = "200";
+    yhchaos::FoxCppRedis* rds = nullptr;
+    std::atomic<int> done(0);
+    thr.dispatch([&]() {
+        rds = new yhchaos::FoxCppRedis(yhchaos::WatchCppThread::GetThis(), conf);
+        rds->init();
+        ++done;
+    });
+    wait_for(done, 1);
+
+    auto r = rds->cmd("PING");
+    YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS && std::string(r->str) == "PONG");
+
+    int count = 1000;
+    done = 0;
+    uint64_t begin = yhchaos::GetCurrentMS();
+    for(int i = 0; i < count; ++i) {
+        iom->coschedule([rds, i, &done]() {
+            std::string key = "key_" + std::to_string(i);
+            auto r = rds->cmd("SET %s %d", key.c_str(), i);
+            YHCHAOS_ASSERT(r && r->type == REDIS_REPLY_STATUS);
+            r = rds->cmd(std::vector<std::string>{"GET", key});
+            YHCHAOS_ASSERT(r && std::string(r->str, r->len) == std::to_string(i));
+            ++done;
+        });
+    }
+    wait_for(done, count);
+    YHCHAOS_LOG_INFO(g_logger) << count * 2 << " commands used "
+        << (yhchaos::GetCurrentMS() - begin) << "ms";
+
+    //命令超时，迟到的回复被丢弃
+    YHCHAOS_ASSERT(!rds->cmd("DEBUG_SLEEP 500"));
+    usleep(500 * 1000);
+    r = rds->cmd("GET key_1");
+    YHCHAOS_ASSERT(r && std::string(r->str, r->len) == "1");
+
+    //断开后删除fd事件，释放连接
+    YHCHAOS_ASSERT(!rds->cmd("DEBUG_CLOSE"));
+    done = 0;
+    thr.dispatch([&]() {
+        YHCHAOS_ASSERT(rds->getCtxCount() == 0);
+        delete rds;
+        ++done;
+    });
+    wait_for(done, 1);
+    thr.stop();
+    server->stop();
+}
+
+void run() {
+    yhchaos::IOCoScheduler* iom = yhchaos::IOCoScheduler::GetThis();
+    test_thread(iom);
+    test_delete(iom);
+    test_delete_in_callback(iom);
+    test_pool(iom);
+    test_fox_redis(iom);
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
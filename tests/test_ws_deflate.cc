@@ -0,0 +1,124 @@
+#include "yhchaos/http/ws_server.h"
+#include "yhchaos/http/ws_client.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+static std::string make_json(int i) {
+    return "{\"type\":\"quote\",\"symbol\":\"AAPL\",\"exchange\":\"NASDAQ\",\"seq\":"
+        + std::to_string(i) + ",\"price\":" + std::to_string(180 + i % 7)
+        + ".25,\"volume\":" + std::to_string(1000 + i) + ",\"currency\":\"USD\"}";
+}
+
+void test_negotiate() {
+    using yhchaos::http::WDeflate;
+    //不认识的扩展跳过，选择第一个可以接受的offer
+    auto deflate = WDeflate::Negotiate("x-webkit-deflate-frame, permessage-deflate; client_max_window_bits");
+    YHCHAOS_ASSERT(deflate);
+    YHCHAOS_ASSERT(deflate->toString() == "permessage-deflate");
+
+    deflate = WDeflate::Negotiate("permessage-deflate; server_max_window_bits=10; client_no_context_takeover");
+    YHCHAOS_ASSERT(deflate);
+    YHCHAOS_LOG_INFO(g_logger) << deflate->toString();
+    YHCHAOS_ASSERT(deflate->getParams().server_max_window_bits == 10);
+    YHCHAOS_ASSERT(deflate->getParams().client_no_context_takeover);
+
+    //8位窗口和未知参数拒绝
+    YHCHAOS_ASSERT(!WDeflate::Negotiate("permessage-deflate; server_max_window_bits=8"));
+    YHCHAOS_ASSERT(!WDeflate::Negotiate("permessage-deflate; foo=1"));
+    deflate = WDeflate::Negotiate("permessage-deflate; server_max_window_bits=8, permessage-deflate");
+    YHCHAOS_ASSERT(deflate && deflate->getParams().server_max_window_bits == 15);
+
+    bool error = false;
+    deflate = WDeflate::Accept("permessage-deflate; server_no_context_takeover", error);
+    YHCHAOS_ASSERT(deflate && !error && deflate->getParams().server_no_context_takeover);
+    YHCHAOS_ASSERT(!WDeflate::Accept("permessage-deflate; client_max_window_bits=10", error) && error);
+}
+
+//一端压缩另一端解压，统计压缩后的总大小
+static size_t round_trip(const yhchaos::http::WDeflate::Params& params, int count) {
+    yhchaos::http::WDeflate server(params, false);
+    yhchaos::http::WDeflate client(params, true);
+    size_t total = 0;
+    for(int i = 0; i < count; ++i) {
+        std::string data = make_json(i);
+        std::string compressed;
+        std::string out;
+        YHCHAOS_ASSERT(server.compress(data, compressed));
+        YHCHAOS_ASSERT(client.decompress(compressed, out, 1024 * 1024));
+        YHCHAOS_ASSERT(out == data);
+        total += compressed.size();
+    }
+    return total;
+}
+
+void test_context_takeover() {
+    yhchaos::http::WDeflate::Params params;
+    size_t raw = 0;
+    for(int i = 0; i < 1000; ++i) {
+        raw += make_json(i).size();
+    }
+    size_t takeover = round_trip(params, 1000);
+    params.server_no_context_takeover = true;
+    size_t no_takeover = round_trip(params, 1000);
+    YHCHAOS_LOG_INFO(g_logger) << "raw=" << raw << " takeover=" << takeover
+        << " no_context_takeover=" << no_takeover;
+    YHCHAOS_ASSERT(takeover < no_takeover && no_takeover < raw);
+
+    //解压后超过最大长度失败
+    yhchaos::http::WDeflate server(params, false);
+    yhchaos::http::WDeflate client(params, true);
+    std::string compressed;
+    std::string out;
+    YHCHAOS_ASSERT(server.compress(std::string(1024 * 1024, 'a'), compressed));
+    YHCHAOS_ASSERT(!client.decompress(compressed, out, 64 * 1024));
+}
+
+void test_echo() {
+    yhchaos::http::WSvr::ptr server(new yhchaos::http::WSvr);
+    YHCHAOS_ASSERT(server->bind(yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8027")));
+    server->getWCppServletDispatch()->addCppServlet("/echo", [](yhchaos::http::HttpReq::ptr header
+                  ,yhchaos::http::WFrameMSG::ptr msg
+                  ,yhchaos::http::WSession::ptr session) {
+        session->sendMSG(msg);
+        return 0;
+    });
+    server->start();
+
+    auto rt = yhchaos::http::WClient::Create("http://127.0.0.1:8027/echo", 1000);
+    YHCHAOS_ASSERT(rt.second);
+    auto conn = rt.second;
+    YHCHAOS_ASSERT(conn->getDeflate());
+    YHCHAOS_LOG_INFO(g_logger) << rt.first->response->getHeader("Sec-WebSocket-Extensions");
+
+    for(int i = 0; i < 1000; ++i) {
+        //短消息不压缩，和压缩的消息交替发送
+        std::string data = i % 10 ? make_json(i) : std::to_string(i);
+        YHCHAOS_ASSERT(conn->sendMSG(data) > 0);
+        auto msg = conn->recvMSG();
+        YHCHAOS_ASSERT(msg && msg->getData() == data);
+    }
+    std::string big(1024 * 1024, 'a');
+    for(size_t i = 0; i < big.size(); i += 7) {
+        big[i] = 'a' + i % 26;
+    }
+    YHCHAOS_ASSERT(conn->sendMSG(big, yhchaos::http::WFrameHead::BIN_FRAME) > 0);
+    auto msg = conn->recvMSG();
+    YHCHAOS_ASSERT(msg && msg->getData() == big);
+    conn->close();
+    server->stop();
+}
+
+void run() {
+    test_negotiate();
+    test_context_takeover();
+    test_echo();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
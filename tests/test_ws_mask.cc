@@ -0,0 +1,85 @@
+#include "yhchaos/http/ws_server.h"
+#include "yhchaos/http/ws_client.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/log.h"
+#include "yhchaos/macro.h"
+#include "yhchaos/util.h"
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_ROOT();
+
+//和逐字节的实现对比，覆盖各种长度和未对齐的地址
+void test_mask() {
+    const char mask[4] = {(char)0x12, (char)0xab, (char)0x7f, (char)0xc3};
+    for(size_t len = 0; len < 200; ++len) {
+        for(size_t offset = 0; offset < 8; ++offset) {
+            std::string data(len + offset, 0);
+            for(auto& c : data) {
+                c = rand();
+            }
+            std::string expect = data;
+            for(size_t i = 0; i < len; ++i) {
+                expect[offset + i] ^= mask[i % 4];
+            }
+            yhchaos::http::WMask(&data[offset], len, mask);
+            YHCHAOS_ASSERT(data == expect);
+        }
+    }
+
+    std::string data(1024 * 1024, 'x');
+    uint64_t begin = yhchaos::GetCurrentUS();
+    for(int i = 0; i < 1000; ++i) {
+        yhchaos::http::WMask(&data[0], data.size(), mask);
+    }
+    uint64_t used = yhchaos::GetCurrentUS() - begin;
+    YHCHAOS_LOG_INFO(g_logger) << "mask 1000MB used " << used / 1000 << "ms";
+}
+
+void test_echo() {
+    yhchaos::http::WSvr::ptr server(new yhchaos::http::WSvr);
+    YHCHAOS_ASSERT(server->bind(yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress("127.0.0.1:8026")));
+    server->getWCppServletDispatch()->addCppServlet("/echo", [](yhchaos::http::HttpReq::ptr header
+                  ,yhchaos::http::WFrameMSG::ptr msg
+                  ,yhchaos::http::WSession::ptr session) {
+        session->sendMSG(msg);
+        return 0;
+    });
+    server->start();
+
+    auto rt = yhchaos::http::WClient::Create("http://127.0.0.1:8026/echo", 1000);
+    YHCHAOS_ASSERT(rt.second);
+    auto conn = rt.second;
+    //小消息连续发送，服务端从接收缓冲区中解析多个帧
+    for(int i = 0; i < 1000; ++i) {
+        std::string data = "msg " + std::to_string(i);
+        auto msg = std::make_shared<yhchaos::http::WFrameMSG>(
+                yhchaos::http::WFrameHead::TEXT_FRAME, data);
+        YHCHAOS_ASSERT(conn->sendMSG(msg) > 0);
+        //发送时加掩码不修改原消息
+        YHCHAOS_ASSERT(msg->getData() == data);
+    }
+    for(int i = 0; i < 1000; ++i) {
+        auto msg = conn->recvMSG();
+        YHCHAOS_ASSERT(msg && msg->getData() == "msg " + std::to_string(i));
+    }
+    //超过接收缓冲区的消息直接读到消息中
+    std::string big(1024 * 1024 + 3, 'a');
+    for(size_t i = 0; i < big.size(); i += 7) {
+        big[i] = 'a' + i % 26;
+    }
+    YHCHAOS_ASSERT(conn->sendMSG(big, yhchaos::http::WFrameHead::BIN_FRAME) > 0);
+    auto msg = conn->recvMSG();
+    YHCHAOS_ASSERT(msg && msg->getData() == big);
+    conn->close();
+    server->stop();
+}
+
+void run() {
+    test_mask();
+    test_echo();
+}
+
+int main(int argc, char** argv) {
+    yhchaos::IOCoScheduler iom(2);
+    iom.coschedule(run);
+    return 0;
+}
@@ -9,6 +9,10 @@ namespace yhchaos {
 
 static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
 
+std::atomic<uint64_t> AppConfigVarBase::s_epoch(1);
+std::atomic<size_t> AppConfigVarBase::s_index(0);
+thread_local std::vector<AppConfigVarBase::CacheSlot> AppConfigVarBase::t_cache;
+
 AppConfigVarBase::ptr AppConfig::SearchForBase(const std::string& name) {
     RWMtxType::ReadLock lock(GetMtx());
     auto it = GetDatas().find(name);
@@ -13,6 +13,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <functional>
+#include <atomic>
 
 #include "cpp_thread.h"
 #include "log.h"
@@ -33,7 +34,8 @@ public:
      */
     AppConfigVarBase(const std::string& name, const std::string& description = "")
         :m_name(name)
-        ,m_description(description) {
+        ,m_description(description)
+        ,m_index(s_index.fetch_add(1, std::memory_order_relaxed)) {
         std::transform(m_name.begin(), m_name.end(), m_name.begin(), ::tolower);
     }
 
@@ -66,11 +68,58 @@ public:
      * @brief 返回配置参数值的类型名称
      */
     virtual std::string getTypeName() const = 0;
+
+    /**
+     * @brief 返回全局配置版本号，任意配置参数的值发生变化时加1
+     */
+    static uint64_t GetEpoch() { return s_epoch.load(std::memory_order_acquire);}
+protected:
+    /**
+     * @brief 线程本地的配置快照缓存项
+     */
+    struct CacheSlot {
+        /// 读取value时的全局配置版本号
+        uint64_t epoch = 0;
+        /// 配置值的只读快照
+        std::shared_ptr<const void> value;
+    };
+
+    /**
+     * @brief 返回当前线程缓存的配置快照
+     * @details epoch与全局配置版本号不一致时调用load重新读取快照
+     */
+    template<class L>
+    const void* getCached(L load) {
+        uint64_t epoch = s_epoch.load(std::memory_order_acquire);
+        if(t_cache.size() <= m_index) {
+            t_cache.resize(m_index + 1);
+        }
+        CacheSlot& slot = t_cache[m_index];
+        if(slot.epoch != epoch) {
+            slot.value = load();
+            slot.epoch = epoch;
+        }
+        return slot.value.get();
+    }
+
+    /**
+     * @brief 配置值发生变化后调用，使所有线程的缓存失效
+     */
+    static void BumpEpoch() { s_epoch.fetch_add(1, std::memory_order_release);}
 protected:
     /// 配置参数的名称
     std::string m_name;
     /// 配置参数的描述
     std::string m_description;
+    /// 在线程本地缓存中的下标
+    size_t m_index;
+private:
+    /// 全局配置版本号
+    static std::atomic<uint64_t> s_epoch;
+    /// 配置参数下标分配器
+    static std::atomic<size_t> s_index;
+    /// 线程本地的配置快照缓存，按m_index索引
+    static thread_local std::vector<CacheSlot> t_cache;
 };
 
 /**
@@ -337,7 +386,8 @@ public:
             ,const T& default_value
             ,const std::string& description = "")
         :AppConfigVarBase(name, description)
-        ,m_val(default_value) {
+        ,m_val(default_value)
+        ,m_snapshot(std::make_shared<const T>(default_value)) {
     }
 
     /**
@@ -375,10 +425,20 @@ public:
 
     /**
      * @brief 获取当前参数的值
+     * @details 不加锁，读取当前线程缓存的快照，只在全局配置版本号变化后才重新加载
      */
     const T getValue() {
-        RWMtxType::ReadLock lock(m_mutex);
-        return m_val;
+        return *static_cast<const T*>(getCached([this]() {
+            return std::shared_ptr<const void>(std::atomic_load(&m_snapshot));
+        }));
+    }
+
+    /**
+     * @brief 获取当前参数值的只读快照
+     * @details 快照不可修改，setValue会发布新的快照，适合需要长期持有或避免拷贝大对象的场景
+     */
+    std::shared_ptr<const T> getSnapshot() const {
+        return std::atomic_load(&m_snapshot);
     }
 
     /**
@@ -397,6 +457,8 @@ public:
         }
         RWMtxType::WriteLock lock(m_mutex);
         m_val = v;
+        std::atomic_store(&m_snapshot, std::make_shared<const T>(v));
+        BumpEpoch();
     }
 
     /**
@@ -446,6 +508,8 @@ public:
 private:
     RWMtxType m_mutex;
     T m_val;
+    /// m_val的只读快照，通过std::atomic_load/std::atomic_store访问
+    std::shared_ptr<const T> m_snapshot;
     //变更回调函数组, uint64_t key,要求唯一，一般可以用hash
     std::map<uint64_t, on_change_cb> m_cbs;
 };
@@ -38,6 +38,11 @@ public:
      */
     const std::string& getName() const { return m_name;}
 
+    /**
+     * @brief 返回调度线程的id，start()之后有效
+     */
+    const std::vector<int>& getThreadIds() const { return m_threadIds;}
+
     /**
      * @brief 返回当前线程所属的调度器
      */
@@ -1,6 +1,13 @@
 #include "cpp_mysql.h"
+#include <mysql/errmsg.h>
+#include <mysql/mysqld_error.h>
 #include "yhchaos/log.h"
 #include "yhchaos/appconfig.h"
+#include "yhchaos/iocoscheduler.h"
+#include "yhchaos/macro.h"
+#include <algorithm>
+#include <atomic>
+#include <inttypes.h>
 
 namespace yhchaos {
 
@@ -8,6 +15,9 @@ static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
 static yhchaos::AppConfigVar<std::map<std::string, std::map<std::string, std::string> > >::ptr g_mysql_dbs
     = yhchaos::AppConfig::SearchFor("mysql.dbs", std::map<std::string, std::map<std::string, std::string> >()
             , "mysql dbs");
+static yhchaos::AppConfigVar<uint64_t>::ptr g_mysql_check_interval
+    = yhchaos::AppConfig::SearchFor("mysql.pool.check_interval", (uint64_t)5000
+            , "mysql pool health check interval ms, 0 disable");
 
 bool mysql_time_to_time_t(const MYSQL_TIME& mt, time_t& ts) {
     struct tm tm;
@@ -89,11 +99,19 @@ static MYSQL* mysql_init(std::map<std::string, std::string>& params,
     return mysql;
 }
 
+//所有连接的预处理语句缓存命中和未命中次数
+static std::atomic<uint64_t> s_stmt_hits(0);
+static std::atomic<uint64_t> s_stmt_misses(0);
+
 CppMySQL:: CppMySQL(const std::map<std::string, std::string>& args)
     :m_params(args)
     ,m_lastUsedTime(0)
+    ,m_lastPingTime(0)
     ,m_hasError(false)
-    ,m_poolSize(10) {
+    ,m_poolSize(10)
+    ,m_stmtCacheSize(64)
+    ,m_stmtHits(0)
+    ,m_stmtMisses(0) {
 }
 
 bool CppMySQL::connect() {
@@ -101,6 +119,8 @@ bool CppMySQL::connect() {
         return true;
     }
 
+    //预处理语句属于旧连接，在关闭连接前释放
+    clearStmts();
     MYSQL* m = mysql_init(m_params, 0);
     if(!m) {
         m_hasError = true;
@@ -108,10 +128,80 @@ bool CppMySQL::connect() {
     }
     m_hasError = false;
     m_poolSize = yhchaos::GetParamValue(m_params, "pool", 5);
+    m_stmtCacheSize = yhchaos::GetParamValue(m_params, "stmt_cache", 64);
     m_mysql.reset(m, mysql_close);
     return true;
 }
 
+CppMySQLStmt::ptr CppMySQL::getStmt(const std::string& sql) {
+    if(m_stmtCacheSize == 0) {
+        ++m_stmtMisses;
+        ++s_stmt_misses;
+        return CppMySQLStmt::Create(shared_from_this(), sql);
+    }
+    auto it = m_stmts.find(sql);
+    if(it != m_stmts.end()) {
+        CppMySQLStmt::ptr st = it->second->second;
+        //只有缓存和st持有，没有未释放的结果集
+        if(st.use_count() == 2) {
+            m_stmtLru.splice(m_stmtLru.begin(), m_stmtLru, it->second);
+            ++m_stmtHits;
+            ++s_stmt_hits;
+            return st;
+        }
+        ++m_stmtMisses;
+        ++s_stmt_misses;
+        return CppMySQLStmt::Create(shared_from_this(), sql);
+    }
+    ++m_stmtMisses;
+    ++s_stmt_misses;
+    //缓存的语句不持有连接，否则连接不会回到连接池
+    CppMySQLStmt::ptr st = CppMySQLStmt::Create(getCppMySQL(), sql);
+    if(!st) {
+        return nullptr;
+    }
+    m_stmtLru.push_front(std::make_pair(sql, st));
+    m_stmts[sql] = m_stmtLru.begin();
+    while(m_stmts.size() > m_stmtCacheSize) {
+        m_stmts.erase(m_stmtLru.back().first);
+        m_stmtLru.pop_back();
+    }
+    return st;
+}
+
+//连接已经断开，连接上所有的预处理语句都失效
+static bool IsConnError(int err) {
+    switch(err) {
+        case CR_CONNECTION_ERROR:
+        case CR_CONN_HOST_ERROR:
+        case CR_SERVER_GONE_ERROR:
+        case CR_SERVER_LOST:
+        case CR_SERVER_LOST_EXTENDED:
+        case CR_COMMANDS_OUT_OF_SYNC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void CppMySQL::onStmtError(const std::string& sql, int err) {
+    if(IsConnError(err)) {
+        m_hasError = true;
+    } else if(err != ER_UNKNOWN_STMT_HANDLER && err != ER_NEED_REPREPARE) {
+        return;
+    }
+    auto it = m_stmts.find(sql);
+    if(it != m_stmts.end()) {
+        m_stmtLru.erase(it->second);
+        m_stmts.erase(it);
+    }
+}
+
+void CppMySQL::clearStmts() {
+    m_stmts.clear();
+    m_stmtLru.clear();
+}
+
 yhchaos::IMySQLStmt::ptr CppMySQL::prepare(const std::string& sql) {
     return CppMySQLStmt::Create(shared_from_this(), sql);
 }
@@ -178,6 +268,20 @@ int CppMySQL::execute(const std::string& sql) {
     return r;
 }
 
+int CppMySQL::executeLong(const std::string& sql) {
+    int r = ::mysql_real_query(m_mysql.get(), sql.c_str(), sql.size());
+    if(r) {
+        int err = mysql_errno(m_mysql.get());
+        YHCHAOS_LOG_ERROR(g_logger) << "bytes=" << sql.size() << " cmd=" << sql.substr(0, 128)
+            << "... errno=" << err << " error: " << getErrStr();
+        //主键冲突等普通的SQL错误不需要重新连接
+        m_hasError = IsConnError(err);
+    } else {
+        m_hasError = false;
+    }
+    return r;
+}
+
 std::shared_ptr<CppMySQL> CppMySQL::getCppMySQL() {
     return CppMySQL::ptr(this, yhchaos::nop<CppMySQL>);
 }
@@ -233,6 +337,7 @@ CppMySQLStmt::ptr CppMySQLStmt::Create(CppMySQL::ptr db, const std::string& stmt
     int count = mysql_stmt_param_count(st);
     CppMySQLStmt::ptr rt(new CppMySQLStmt(db, st));
     rt->m_binds.resize(count);
+    rt->m_bindSizes.resize(count);
     memset(&rt->m_binds[0], 0, sizeof(rt->m_binds[0]) * count);
     return rt;
 }
@@ -262,6 +367,15 @@ CppMySQLStmt::~CppMySQLStmt() {
     }
 }
 
+void* CppMySQLStmt::bindBuffer(int idx, size_t size) {
+    if(m_bindSizes[idx] < size || !m_binds[idx].buffer) {
+        free(m_binds[idx].buffer);
+        m_binds[idx].buffer = malloc(size ? size : 1);
+        m_bindSizes[idx] = size;
+    }
+    return m_binds[idx].buffer;
+}
+
 int CppMySQLStmt::bind(int idx, const int8_t& value) {
     return bindInt8(idx, value);
 }
@@ -344,10 +458,7 @@ int CppMySQLStmt::bindInt8(int idx, const int8_t& value) {
     idx -= 1;
     m_binds[idx].buffer_type = MYSQL_TYPE_TINY;
 #define BIND_COPY(ptr, size) \
-    if(m_binds[idx].buffer == nullptr) { \
-        m_binds[idx].buffer = malloc(size); \
-    } \
-    memcpy(m_binds[idx].buffer, ptr, size);
+    memcpy(bindBuffer(idx, size), ptr, size);
     BIND_COPY(&value, sizeof(value));
     m_binds[idx].is_unsigned = false;
     m_binds[idx].buffer_length = sizeof(value);
@@ -437,13 +548,7 @@ int CppMySQLStmt::bindString(int idx, const char* value) {
     idx -= 1;
     m_binds[idx].buffer_type = MYSQL_TYPE_STRING;
 #define BIND_COPY_LEN(ptr, size) \
-    if(m_binds[idx].buffer == nullptr) { \
-        m_binds[idx].buffer = malloc(size); \
-    } else if((size_t)m_binds[idx].buffer_length < (size_t)size) { \
-        free(m_binds[idx].buffer); \
-        m_binds[idx].buffer = malloc(size); \
-    } \
-    memcpy(m_binds[idx].buffer, ptr, size); \
+    memcpy(bindBuffer(idx, size), ptr, size); \
     m_binds[idx].buffer_length = size;
     BIND_COPY_LEN(value, strlen(value));
     return 0;
@@ -503,16 +608,29 @@ IMySQLData::ptr CppMySQLStmt::query() {
     return CppMySQLStmtRes::Create(shared_from_this());
 }
 
-CppMySQLRes::CppMySQLRes(MYSQL_RES* res, int eno, const char* estr)
+IMySQLData::ptr CppMySQLStmt::queryStream() {
+    mysql_stmt_bind_param(m_stmt, &m_binds[0]);
+    return CppMySQLStmtRes::Create(shared_from_this(), true);
+}
+
+CppMySQLRes::CppMySQLRes(MYSQL_RES* res, int eno, const char* estr
+                         ,std::shared_ptr<CppMySQL> conn)
     :m_errno(eno)
     ,m_errstr(estr)
     ,m_cur(nullptr)
-    ,m_curLength(nullptr) {
+    ,m_curLength(nullptr)
+    ,m_conn(conn) {
     if(res) {
+        //流式结果集释放时读完连接上剩余的行
         m_data.reset(res, mysql_free_res);
     }
 }
 
+const char* CppMySQLRes::getData(int idx, size_t& len) {
+    len = m_cur[idx] ? m_curLength[idx] : 0;
+    return m_cur[idx];
+}
+
 bool CppMySQLRes::foreach(data_cb cb) {
     MYSQL_ROW row;
     uint64_t fields = getColumnCount();
@@ -542,7 +660,11 @@ int CppMySQLRes::getColumnType(int idx) {
 }
 
 std::string CppMySQLRes::getColumnName(int idx) {
-    return "";
+    if(idx < 0 || idx >= getColumnCount()) {
+        return "";
+    }
+    MYSQL_FIELD* fields = mysql_fetch_fields(m_data.get());
+    return fields ? fields[idx].name : "";
 }
 
 bool CppMySQLRes::isNull(int idx) {
@@ -609,11 +731,22 @@ time_t CppMySQLRes::getTime(int idx) {
 
 bool CppMySQLRes::next() {
     m_cur = mysql_fetch_row(m_data.get());
+    if(!m_cur) {
+        //流式结果集读取中连接出错和读完都返回nullptr
+        if(m_conn && mysql_errno(m_conn->getRaw().get())) {
+            m_errno = mysql_errno(m_conn->getRaw().get());
+            m_errstr = mysql_error(m_conn->getRaw().get());
+            m_conn->m_hasError = true;
+            YHCHAOS_LOG_ERROR(g_logger) << "stream fetch error: " << m_errno
+                << " " << m_errstr;
+        }
+        return false;
+    }
     m_curLength = mysql_fetch_lengths(m_data.get());
     return m_cur;
 }
 
-CppMySQLStmtRes::ptr CppMySQLStmtRes::Create(std::shared_ptr<CppMySQLStmt> stmt) {
+CppMySQLStmtRes::ptr CppMySQLStmtRes::Create(std::shared_ptr<CppMySQLStmt> stmt, bool stream) {
     int eno = mysql_stmt_errno(stmt->getRaw());
     const char* errstr = mysql_stmt_error(stmt->getRaw());
     CppMySQLStmtRes::ptr rt(new CppMySQLStmtRes(stmt, eno, errstr));
@@ -669,9 +802,13 @@ CppMySQLStmtRes::ptr CppMySQLStmtRes::Create(std::shared_ptr<CppMySQLStmt> stmt)
                                     , stmt->getErrStr()));
     }
 
-    stmt->execute();
+    if(stmt->execute()) {
+        return CppMySQLStmtRes::ptr(new CppMySQLStmtRes(stmt, stmt->getErrno()
+                                    , stmt->getErrStr()));
+    }
 
-    if(mysql_stmt_store_res(stmt->getRaw())) {
+    //流式结果集由mysql_stmt_fetch逐行读取
+    if(!stream && mysql_stmt_store_res(stmt->getRaw())) {
         return CppMySQLStmtRes::ptr(new CppMySQLStmtRes(stmt, stmt->getErrno()
                                     , stmt->getErrStr()));
     }
@@ -803,6 +940,177 @@ CppMySQLStmtRes::~CppMySQLStmtRes() {
 }
 
 
+CppMySQLStmtFetcher::CppMySQLStmtFetcher(CppMySQL::ptr conn, const std::string& sql, bool stream)
+    :m_conn(conn)
+    ,m_sql(sql)
+    ,m_stream(stream)
+    ,m_executed(false)
+    ,m_errno(0) {
+    m_stmt = conn->getStmt(sql);
+    if(!m_stmt) {
+        m_errno = conn->getErrno();
+        m_errstr = conn->getErrStr();
+        if(!m_errno) {
+            m_errno = -1;
+        }
+        return;
+    }
+    size_t num = mysql_stmt_field_count(m_stmt->getRaw());
+    m_binds.resize(num);
+    m_cols.resize(num);
+    if(num) {
+        memset(&m_binds[0], 0, sizeof(m_binds[0]) * num);
+    }
+    for(size_t i = 0; i < num; ++i) {
+        m_binds[i].buffer_type = MYSQL_TYPE_NULL;
+        m_binds[i].is_null = &m_cols[i].is_null;
+        m_binds[i].error = &m_cols[i].error;
+        m_binds[i].length = &m_cols[i].length;
+    }
+}
+
+CppMySQLStmtFetcher::~CppMySQLStmtFetcher() {
+    if(m_executed) {
+        //流式结果集未读完的行在这里丢弃
+        mysql_stmt_free_res(m_stmt->getRaw());
+    }
+}
+
+bool CppMySQLStmtFetcher::checkIndex(int idx) {
+    if(idx < 0 || idx >= (int)m_binds.size()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLStmtFetcher bind invalid idx=" << idx
+            << " columns=" << m_binds.size() << " sql=" << m_sql;
+        return false;
+    }
+    return true;
+}
+
+void CppMySQLStmtFetcher::bindValue(int idx, enum_field_types type, bool is_unsigned
+                                    ,void* ptr, size_t size) {
+    if(!checkIndex(idx)) {
+        return;
+    }
+    m_binds[idx].buffer_type = type;
+    m_binds[idx].buffer = ptr;
+    m_binds[idx].buffer_length = size;
+    m_binds[idx].is_unsigned = is_unsigned;
+}
+
+#define XX(type, mysql_type, is_unsigned) \
+    void CppMySQLStmtFetcher::bind(int idx, type& value) { \
+        bindValue(idx, mysql_type, is_unsigned, &value, sizeof(value)); \
+    }
+XX(int8_t, MYSQL_TYPE_TINY, false);
+XX(uint8_t, MYSQL_TYPE_TINY, true);
+XX(int16_t, MYSQL_TYPE_SHORT, false);
+XX(uint16_t, MYSQL_TYPE_SHORT, true);
+XX(int32_t, MYSQL_TYPE_LONG, false);
+XX(uint32_t, MYSQL_TYPE_LONG, true);
+XX(int64_t, MYSQL_TYPE_LONGLONG, false);
+XX(uint64_t, MYSQL_TYPE_LONGLONG, true);
+XX(float, MYSQL_TYPE_FLOAT, false);
+XX(double, MYSQL_TYPE_DOUBLE, false);
+#undef XX
+
+void CppMySQLStmtFetcher::bind(int idx, std::string& value) {
+    if(!checkIndex(idx)) {
+        return;
+    }
+    Column& col = m_cols[idx];
+    col.str = &value;
+    //大多数的varchar一次读完，长的列再补读
+    col.buf.resize(256);
+    bindValue(idx, MYSQL_TYPE_STRING, false, &col.buf[0], col.buf.size());
+}
+
+int CppMySQLStmtFetcher::doExecute() {
+    MYSQL_STMT* stmt = m_stmt->getRaw();
+    //没有绑定变量的列不读取
+    if(!m_binds.empty() && mysql_stmt_bind_res(stmt, &m_binds[0])) {
+        return onError();
+    }
+    if(m_stmt->execute()) {
+        return onError();
+    }
+    m_executed = true;
+    if(!m_stream && mysql_stmt_store_res(stmt)) {
+        return onError();
+    }
+    return 0;
+}
+
+int CppMySQLStmtFetcher::onError() {
+    m_errno = m_stmt->getErrno();
+    m_errstr = m_stmt->getErrStr();
+    if(!m_errno) {
+        m_errno = -1;
+    }
+    YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLStmtFetcher sql=" << m_sql
+        << " errno=" << m_errno << " errstr=" << m_errstr;
+    m_conn->onStmtError(m_sql, m_errno);
+    return m_errno;
+}
+
+bool CppMySQLStmtFetcher::next() {
+    if(!m_executed || m_errno) {
+        return false;
+    }
+    MYSQL_STMT* stmt = m_stmt->getRaw();
+    int rt = mysql_stmt_fetch(stmt);
+    if(rt == MYSQL_NO_DATA) {
+        return false;
+    }
+    //MYSQL_DATA_TRUNCATED: 字符串列超过缓冲区时下面补读，其他类型的列被截断时失败
+    if(rt != 0 && rt != MYSQL_DATA_TRUNCATED) {
+        onError();
+        return false;
+    }
+    for(size_t i = 0; i < m_binds.size(); ++i) {
+        MYSQL_BIND& b = m_binds[i];
+        Column& col = m_cols[i];
+        if(!b.buffer) {
+            continue;
+        }
+        if(col.is_null) {
+            if(col.str) {
+                col.str->clear();
+            } else {
+                memset(b.buffer, 0, b.buffer_length);
+            }
+            continue;
+        }
+        if(!col.str) {
+            //数值超出绑定变量的范围，或者类型不能转换
+            if(rt == MYSQL_DATA_TRUNCATED && col.error) {
+                m_errno = CR_DATA_TRUNCATED;
+                m_errstr = "column " + std::to_string(i) + " truncated";
+                YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLStmtFetcher sql=" << m_sql
+                    << " errno=" << m_errno << " errstr=" << m_errstr;
+                return false;
+            }
+            continue;
+        }
+        if(col.length <= b.buffer_length) {
+            col.str->assign(&col.buf[0], col.length);
+            continue;
+        }
+        col.str->resize(col.length);
+        MYSQL_BIND full;
+        memset(&full, 0, sizeof(full));
+        unsigned long length = 0;
+        full.buffer_type = MYSQL_TYPE_STRING;
+        full.buffer = &(*col.str)[0];
+        full.buffer_length = col.length;
+        full.length = &length;
+        if(mysql_stmt_fetch_column(stmt, &full, i, 0)) {
+            onError();
+            return false;
+        }
+    }
+    return true;
+}
+
+
 IMySQLData::ptr CppMySQL::query(const char* format, ...) {
     va_list ap;
     va_start(ap, format);
@@ -838,6 +1146,33 @@ IMySQLData::ptr CppMySQL::query(const std::string& sql) {
 
 }
 
+CppMySQLRes::ptr CppMySQL::queryStream(const char* format, ...) {
+    va_list ap;
+    va_start(ap, format);
+    auto rt = queryStream(yhchaos::StringUtil::Formatv(format, ap));
+    va_end(ap);
+    return rt;
+}
+
+CppMySQLRes::ptr CppMySQL::queryStream(const std::string& sql) {
+    m_cmd = sql;
+    MYSQL* mysql = m_mysql.get();
+    if(::mysql_real_query(mysql, m_cmd.c_str(), m_cmd.size())) {
+        YHCHAOS_LOG_ERROR(g_logger) << "queryStream(" << m_cmd << ") error:"
+            << mysql_error(mysql);
+        m_hasError = true;
+        return nullptr;
+    }
+    MYSQL_RES* res = mysql_use_res(mysql);
+    if(!res) {
+        YHCHAOS_LOG_ERROR(g_logger) << "mysql_use_res() error:" << mysql_error(mysql);
+        m_hasError = true;
+        return nullptr;
+    }
+    m_hasError = false;
+    return std::make_shared<CppMySQLRes>(res, 0, "", shared_from_this());
+}
+
 const char* CppMySQL::cmd() {
     return m_cmd.c_str();
 }
@@ -978,98 +1313,711 @@ CppMySQLTransaction::CppMySQLTransaction(CppMySQL::ptr mysql, bool auto_commit)
     ,m_hasError(false) {
 }
 
-CppMySQLManager::CppMySQLManager()
-    :m_maxConn(10) {
-    mysql_library_init(0, nullptr, nullptr);
+const uint64_t CppMySQLPool::s_waitBounds[CppMySQLPool::WAIT_BUCKETS - 1] = {1, 5, 10, 50, 100, 500, 1000};
+
+CppMySQLPool::CppMySQLPool(const std::string& name, const std::map<std::string, std::string>& args
+                           ,uint32_t max_conn)
+    :m_name(name)
+    ,m_args(args)
+    ,m_total(0)
+    ,m_gets(0)
+    ,m_waits(0)
+    ,m_timeouts(0)
+    ,m_connectErrors(0) {
+    m_maxConn = std::max(1, yhchaos::GetParamValue(m_args, "max_conn", (int)max_conn));
+    m_maxIdle = std::min(m_maxConn, (uint32_t)yhchaos::GetParamValue(m_args, "pool", 5));
+    m_waitTimeout = yhchaos::GetParamValue(m_args, "wait_timeout", 3000);
+    m_pingInterval = yhchaos::GetParamValue(m_args, "ping_interval", 30);
+    m_idleTimeout = yhchaos::GetParamValue(m_args, "idle_timeout", 60);
+    for(size_t i = 0; i < WAIT_BUCKETS; ++i) {
+        m_waitHist[i] = 0;
+    }
 }
 
-CppMySQLManager::~CppMySQLManager() {
-    mysql_library_end();
-    for(auto& i : m_conns) {
-        for(auto& n : i.second) {
-            delete n;
+CppMySQLPool::~CppMySQLPool() {
+    for(auto& i : m_idle) {
+        delete i;
+    }
+}
+
+CppMySQL::ptr CppMySQLPool::get() {
+    bool conn_error = false;
+    return get(conn_error);
+}
+
+CppMySQL::ptr CppMySQLPool::get(bool& conn_error) {
+    conn_error = false;
+    ++m_gets;
+    CppMySQL* conn = nullptr;
+    bool create = false;
+    Waiter::ptr waiter;
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    {
+        MtxType::Lock lock(m_mutex);
+        if(!m_idle.empty()) {
+            conn = m_idle.back();
+            m_idle.pop_back();
+        } else if(m_total < m_maxConn) {
+            ++m_total;
+            create = true;
+        } else if(iom) {
+            waiter = std::make_shared<Waiter>();
+            waiter->scheduler = iom;
+            waiter->coroutine = Coroutine::GetThis();
+            m_waiters.push_back(waiter);
         }
     }
+
+    if(waiter) {
+        ++m_waits;
+        uint64_t begin = yhchaos::GetCurrentMS();
+        std::weak_ptr<Waiter> weak(waiter);
+        CppMySQLPool::ptr self = shared_from_this();
+        auto timer = iom->addConditionTimedCoroutine(m_waitTimeout, [self, weak]() {
+            auto w = weak.lock();
+            if(w) {
+                self->onWaitTimeout(w);
+            }
+        }, weak);
+        Coroutine::YieldToHold();
+        timer->cancel();
+        addWaitTime(yhchaos::GetCurrentMS() - begin);
+        conn = waiter->conn;
+        create = waiter->create;
+    }
+
+    if(!conn && !create) {
+        ++m_timeouts;
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLPool(" << m_name << ") exhausted, max_conn="
+            << m_maxConn << (waiter ? " wait timeout" : " not in coroutine");
+        return nullptr;
+    }
+    if(create) {
+        conn = new CppMySQL(m_args);
+        if(!conn->connect()) {
+            ++m_connectErrors;
+            conn_error = true;
+            delete conn;
+            releaseSlot();
+            return nullptr;
+        }
+    } else if(conn->isNeedCheck() && !conn->ping() && !conn->connect()) {
+        ++m_connectErrors;
+        conn_error = true;
+        YHCHAOS_LOG_WARN(g_logger) << "reconnect " << m_name << " fail";
+        delete conn;
+        releaseSlot();
+        return nullptr;
+    }
+    conn->m_lastUsedTime = time(0);
+    return CppMySQL::ptr(conn, std::bind(&CppMySQLPool::release,
+                shared_from_this(), std::placeholders::_1));
 }
 
-CppMySQL::ptr CppMySQLManager::get(const std::string& name) {
+void CppMySQLPool::release(CppMySQL* m) {
+    if(!m->m_mysql) {
+        delete m;
+        releaseSlot();
+        return;
+    }
+    m->m_lastUsedTime = time(0);
+    put(m);
+}
+
+void CppMySQLPool::put(CppMySQL* m) {
+    Waiter::ptr waiter;
+    {
+        MtxType::Lock lock(m_mutex);
+        if(m_waiters.empty()) {
+            if(m_idle.size() < m_maxIdle) {
+                m_idle.push_back(m);
+                return;
+            }
+            --m_total;
+        } else {
+            waiter = m_waiters.front();
+            m_waiters.pop_front();
+            waiter->done = true;
+            waiter->conn = m;
+        }
+    }
+    if(waiter) {
+        waiter->scheduler->coschedule(waiter->coroutine);
+    } else {
+        //空闲连接已经足够
+        delete m;
+    }
+}
+
+void CppMySQLPool::releaseSlot() {
+    Waiter::ptr waiter;
+    {
+        MtxType::Lock lock(m_mutex);
+        if(m_waiters.empty()) {
+            --m_total;
+            return;
+        }
+        waiter = m_waiters.front();
+        m_waiters.pop_front();
+        waiter->done = true;
+        waiter->create = true;
+    }
+    waiter->scheduler->coschedule(waiter->coroutine);
+}
+
+void CppMySQLPool::onWaitTimeout(Waiter::ptr waiter) {
+    {
+        MtxType::Lock lock(m_mutex);
+        if(waiter->done) {
+            return;
+        }
+        waiter->done = true;
+        m_waiters.remove(waiter);
+    }
+    waiter->scheduler->coschedule(waiter->coroutine);
+}
+
+void CppMySQLPool::addWaitTime(uint64_t ms) {
+    size_t i = 0;
+    while(i < WAIT_BUCKETS - 1 && ms >= s_waitBounds[i]) {
+        ++i;
+    }
+    ++m_waitHist[i];
+}
+
+void CppMySQLPool::check(int idle_sec) {
+    uint64_t now = time(0);
+    uint64_t idle_timeout = idle_sec >= 0 ? idle_sec : m_idleTimeout;
+    std::vector<CppMySQL*> closes;
+    std::vector<CppMySQL*> pings;
+    {
+        MtxType::Lock lock(m_mutex);
+        for(auto it = m_idle.begin(); it != m_idle.end();) {
+            CppMySQL* m = *it;
+            if(now - m->m_lastUsedTime >= idle_timeout) {
+                closes.push_back(m);
+            } else if(now - std::max(m->m_lastUsedTime, m->m_lastPingTime) >= m_pingInterval) {
+                pings.push_back(m);
+            } else {
+                ++it;
+                continue;
+            }
+            it = m_idle.erase(it);
+        }
+    }
+    for(auto& i : closes) {
+        delete i;
+        releaseSlot();
+    }
+    //ping不在锁中，ping期间连接不在空闲列表中
+    for(auto& i : pings) {
+        i->m_lastPingTime = now;
+        if(i->ping()) {
+            put(i);
+        } else {
+            YHCHAOS_LOG_WARN(g_logger) << "CppMySQLPool(" << m_name << ") ping fail, close";
+            delete i;
+            releaseSlot();
+        }
+    }
+}
+
+uint32_t CppMySQLPool::getTotal() {
+    MtxType::Lock lock(m_mutex);
+    return m_total;
+}
+
+uint32_t CppMySQLPool::getIdle() {
+    MtxType::Lock lock(m_mutex);
+    return m_idle.size();
+}
+
+uint32_t CppMySQLPool::getWaiting() {
     MtxType::Lock lock(m_mutex);
-    auto it = m_conns.find(name);
-    if(it != m_conns.end()) {
-        if(!it->second.empty()) {
-            CppMySQL* rt = it->second.front();
-            it->second.pop_front();
-            lock.unlock();
-            if(!rt->isNeedCheck()) {
-                rt->m_lastUsedTime = time(0);
-                return CppMySQL::ptr(rt, std::bind(&CppMySQLManager::freeCppMySQL,
-                            this, name, std::placeholders::_1));
+    return m_waiters.size();
+}
+
+std::ostream& CppMySQLPool::dump(std::ostream& os) {
+    {
+        MtxType::Lock lock(m_mutex);
+        os << "[CppMySQLPool name=" << m_name << " max_conn=" << m_maxConn
+           << " total=" << m_total << " idle=" << m_idle.size()
+           << " waiting=" << m_waiters.size();
+    }
+    os << " gets=" << m_gets << " waits=" << m_waits << " timeouts=" << m_timeouts
+       << " connect_errors=" << m_connectErrors << " wait_ms={";
+    for(size_t i = 0; i < WAIT_BUCKETS; ++i) {
+        if(i) {
+            os << ",";
+        }
+        if(i < WAIT_BUCKETS - 1) {
+            os << "<" << s_waitBounds[i];
+        } else {
+            os << ">=" << s_waitBounds[WAIT_BUCKETS - 2];
+        }
+        os << ":" << m_waitHist[i];
+    }
+    os << "}]";
+    return os;
+}
+
+CppMySQLReplicaGroup::CppMySQLReplicaGroup(const std::string& name, CppMySQLPool::ptr primary)
+    :m_name(name)
+    ,m_primary(primary)
+    ,m_next(0)
+    ,m_writes(0)
+    ,m_pinnedReads(0)
+    ,m_fallbacks(0)
+    ,m_failovers(0) {
+    auto& args = primary->getArgs();
+    std::string policy = yhchaos::GetParamValue<std::string>(args, "read_policy", "least_outstanding");
+    if(policy == "latency") {
+        m_policy = LATENCY;
+    } else {
+        if(policy != "least_outstanding") {
+            YHCHAOS_LOG_WARN(g_logger) << "CppMySQLReplicaGroup name=" << name
+                << " invalid read_policy=" << policy << ", use least_outstanding";
+        }
+        m_policy = LEAST_OUTSTANDING;
+    }
+    m_maxLag = yhchaos::GetParamValue(args, "max_lag", 10);
+    m_pinMs = yhchaos::GetParamValue(args, "pin_ms", 1000);
+    m_retryMs = yhchaos::GetParamValue(args, "replica_retry", 5) * 1000;
+}
+
+void CppMySQLReplicaGroup::addReplica(CppMySQLPool::ptr pool) {
+    Replica::ptr r = std::make_shared<Replica>();
+    r->pool = pool;
+    m_replicas.push_back(r);
+}
+
+bool CppMySQLReplicaGroup::isAvailable(Replica::ptr r, uint64_t now) {
+    int64_t lag = r->lag;
+    return r->downUntil <= now && lag >= 0 && lag <= m_maxLag;
+}
+
+size_t CppMySQLReplicaGroup::getAvailable() {
+    uint64_t now = yhchaos::GetCurrentMS();
+    size_t count = 0;
+    for(auto& i : m_replicas) {
+        if(isAvailable(i, now)) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+CppMySQLReplicaGroup::Replica::ptr CppMySQLReplicaGroup::choose(uint64_t now
+                                    ,const std::vector<Replica::ptr>& tried) {
+    size_t size = m_replicas.size();
+    //从轮转的位置开始比较，负载相同时分散到不同副本
+    size_t start = m_next++;
+    Replica::ptr best;
+    uint64_t best_score = 0;
+    for(size_t i = 0; i < size; ++i) {
+        auto& r = m_replicas[(start + i) % size];
+        if(!isAvailable(r, now)
+                || std::find(tried.begin(), tried.end(), r) != tried.end()) {
+            continue;
+        }
+        uint64_t score = r->outstanding;
+        if(m_policy == LATENCY) {
+            score = (score + 1) * (r->latency + 1);
+        }
+        if(!best || score < best_score) {
+            best = r;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void CppMySQLReplicaGroup::markDown(Replica::ptr r) {
+    ++r->errors;
+    r->downUntil = yhchaos::GetCurrentMS() + m_retryMs;
+    YHCHAOS_LOG_WARN(g_logger) << "CppMySQLReplicaGroup name=" << m_name
+        << " replica=" << r->pool->getName() << " down for " << m_retryMs << "ms";
+}
+
+CppMySQL::ptr CppMySQLReplicaGroup::getRead() {
+    Replica::ptr replica;
+    return getRead(replica);
+}
+
+CppMySQL::ptr CppMySQLReplicaGroup::getRead(Replica::ptr& replica) {
+    if(isPinned()) {
+        ++m_pinnedReads;
+        return m_primary->get();
+    }
+    uint64_t now = yhchaos::GetCurrentMS();
+    std::vector<Replica::ptr> tried;
+    while(Replica::ptr r = choose(now, tried)) {
+        tried.push_back(r);
+        bool conn_error = false;
+        auto conn = r->pool->get(conn_error);
+        if(!conn) {
+            //连接或ping失败的副本一段时间内不再使用；
+            //等待连接超时只说明副本繁忙，不摘除，尝试下一个副本
+            if(conn_error) {
+                markDown(r);
             }
-            if(rt->ping()) {
-                rt->m_lastUsedTime = time(0);
-                return CppMySQL::ptr(rt, std::bind(&CppMySQLManager::freeCppMySQL,
-                            this, name, std::placeholders::_1));
-            } else if(rt->connect()) {
-                rt->m_lastUsedTime = time(0);
-                return CppMySQL::ptr(rt, std::bind(&CppMySQLManager::freeCppMySQL,
-                            this, name, std::placeholders::_1));
+            continue;
+        }
+        ++r->outstanding;
+        ++r->reads;
+        replica = r;
+        uint64_t begin = yhchaos::GetCurrentUS();
+        return CppMySQL::ptr(conn.get(), [conn, r, begin](CppMySQL*) {
+            uint64_t used = yhchaos::GetCurrentUS() - begin;
+            uint64_t old = r->latency;
+            r->latency = old ? (old * 7 + used) / 8 : used;
+            --r->outstanding;
+        });
+    }
+    ++m_fallbacks;
+    return m_primary->get();
+}
+
+CppMySQL::ptr CppMySQLReplicaGroup::getWrite() {
+    auto conn = m_primary->get();
+    if(!conn) {
+        return nullptr;
+    }
+    ++m_writes;
+    if(!m_pinMs) {
+        return conn;
+    }
+    //归还时可能在其他协程，记下获取连接的协程
+    uint64_t id = Coroutine::GetCoroutineId();
+    CppMySQLReplicaGroup::ptr self = shared_from_this();
+    return CppMySQL::ptr(conn.get(), [conn, self, id](CppMySQL*) {
+        self->markWrite(id);
+    });
+}
+
+IMySQLData::ptr CppMySQLReplicaGroup::query(const std::string& sql) {
+    Replica::ptr replica;
+    auto conn = getRead(replica);
+    if(!conn) {
+        return nullptr;
+    }
+    auto res = conn->query(sql);
+    if(res || !replica || conn->ping()) {
+        return res;
+    }
+    //副本连接失效，改读主库
+    markDown(replica);
+    conn.reset();
+    ++m_failovers;
+    conn = m_primary->get();
+    if(!conn) {
+        return nullptr;
+    }
+    return conn->query(sql);
+}
+
+void CppMySQLReplicaGroup::markWrite() {
+    if(m_pinMs) {
+        markWrite(Coroutine::GetCoroutineId());
+    }
+}
+
+void CppMySQLReplicaGroup::markWrite(uint64_t coroutine_id) {
+    uint64_t until = yhchaos::GetCurrentMS() + m_pinMs;
+    MtxType::Lock lock(m_mutex);
+    m_pins[coroutine_id] = until;
+}
+
+bool CppMySQLReplicaGroup::isPinned() {
+    uint64_t id = Coroutine::GetCoroutineId();
+    MtxType::Lock lock(m_mutex);
+    auto it = m_pins.find(id);
+    if(it == m_pins.end()) {
+        return false;
+    }
+    if(it->second <= yhchaos::GetCurrentMS()) {
+        m_pins.erase(it);
+        return false;
+    }
+    return true;
+}
+
+bool CppMySQLReplicaGroup::QueryLag(CppMySQL::ptr conn, int64_t& lag) {
+    //8.0.22之前只支持SHOW SLAVE STATUS
+    auto res = conn->query("SHOW REPLICA STATUS");
+    if(!res) {
+        res = conn->query("SHOW SLAVE STATUS");
+        if(!res) {
+            return false;
+        }
+    }
+    //没有配置复制，按没有延迟处理
+    lag = 0;
+    if(!res->next()) {
+        return true;
+    }
+    for(int i = 0; i < res->getColumnCount(); ++i) {
+        std::string name = res->getColumnName(i);
+        if(name == "Seconds_Behind_Source" || name == "Seconds_Behind_Master") {
+            lag = res->isNull(i) ? -1 : res->getInt64(i);
+            break;
+        }
+    }
+    return true;
+}
+
+void CppMySQLReplicaGroup::check() {
+    for(auto& r : m_replicas) {
+        auto conn = r->pool->get();
+        if(!conn) {
+            markDown(r);
+            continue;
+        }
+        int64_t lag = 0;
+        if(!QueryLag(conn, lag)) {
+            if(!conn->ping()) {
+                markDown(r);
             } else {
-                YHCHAOS_LOG_WARN(g_logger) << "reconnect " << name << " fail";
-                return nullptr;
+                YHCHAOS_LOG_WARN(g_logger) << "CppMySQLReplicaGroup name=" << m_name
+                    << " replica=" << r->pool->getName() << " query lag fail, errno="
+                    << conn->getErrno() << " errstr=" << conn->getErrStr();
             }
+            continue;
+        }
+        if(lag != r->lag) {
+            YHCHAOS_LOG_INFO(g_logger) << "CppMySQLReplicaGroup name=" << m_name
+                << " replica=" << r->pool->getName() << " lag " << r->lag << " -> " << lag;
+        }
+        r->lag = lag;
+        r->downUntil = 0;
+    }
+
+    uint64_t now = yhchaos::GetCurrentMS();
+    MtxType::Lock lock(m_mutex);
+    for(auto it = m_pins.begin(); it != m_pins.end();) {
+        if(it->second <= now) {
+            it = m_pins.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+std::ostream& CppMySQLReplicaGroup::dump(std::ostream& os) {
+    size_t pins = 0;
+    {
+        MtxType::Lock lock(m_mutex);
+        pins = m_pins.size();
+    }
+    uint64_t now = yhchaos::GetCurrentMS();
+    os << "[CppMySQLReplicaGroup name=" << m_name << " primary=" << m_primary->getName()
+       << " policy=" << (m_policy == LATENCY ? "latency" : "least_outstanding")
+       << " writes=" << m_writes << " pinned_reads=" << m_pinnedReads
+       << " fallbacks=" << m_fallbacks << " failovers=" << m_failovers
+       << " pins=" << pins << " replicas={";
+    for(size_t i = 0; i < m_replicas.size(); ++i) {
+        auto& r = m_replicas[i];
+        if(i) {
+            os << ",";
+        }
+        os << r->pool->getName() << ":{available=" << isAvailable(r, now)
+           << " outstanding=" << r->outstanding << " latency_us=" << r->latency
+           << " lag=" << r->lag << " reads=" << r->reads << " errors=" << r->errors << "}";
+    }
+    os << "}]";
+    return os;
+}
+
+CppMySQLManager::CppMySQLManager()
+    :m_maxConn(10) {
+    mysql_library_init(0, nullptr, nullptr);
+}
+
+CppMySQLManager::~CppMySQLManager() {
+    if(m_checker) {
+        m_checker->cancel();
+    }
+    m_groups.clear();
+    m_pools.clear();
+    mysql_library_end();
+}
+
+void CppMySQLManager::getStmtCacheInfo(uint64_t& hits, uint64_t& misses) {
+    hits = s_stmt_hits;
+    misses = s_stmt_misses;
+}
+
+CppMySQLPool::ptr CppMySQLManager::getPool(const std::string& name) {
+    {
+        MtxType::ReadLock lock(m_mutex);
+        auto it = m_pools.find(name);
+        if(it != m_pools.end()) {
+            return it->second;
         }
     }
     //std::map<std::string, std::map<std::string, std::string>=name->args{key:value}
     auto config = g_mysql_dbs->getValue();
-    auto sit = config.find(name);
-    std::map<std::string, std::string> args;
-    if(sit != config.end()) {
-        args = sit->second;
-    } else {
-        sit = m_dbDefines.find(name);
-        if(sit != m_dbDefines.end()) {
-            args = sit->second;
-        } else {
-            return nullptr;
+    CppMySQLPool::ptr pool;
+    bool start_checker = false;
+    {
+        MtxType::WriteLock lock(m_mutex);
+        auto it = m_pools.find(name);
+        if(it != m_pools.end()) {
+            return it->second;
         }
+        auto sit = config.find(name);
+        if(sit == config.end()) {
+            sit = m_dbDefines.find(name);
+            if(sit == m_dbDefines.end()) {
+                return nullptr;
+            }
+        }
+        pool = std::make_shared<CppMySQLPool>(name, sit->second, m_maxConn);
+        m_pools[name] = pool;
+        start_checker = !m_checker && g_mysql_check_interval->getValue()
+                            && yhchaos::IOCoScheduler::GetThis();
     }
-    lock.unlock();
-    CppMySQL* rt = new CppMySQL(args);
-    if(rt->connect()) {
-        rt->m_lastUsedTime = time(0);
-        return CppMySQL::ptr(rt, std::bind(&CppMySQLManager::freeCppMySQL,
-                    this, name, std::placeholders::_1));
-    } else {
-        delete rt;
+    if(start_checker) {
+        startChecker(g_mysql_check_interval->getValue());
+    }
+    return pool;
+}
+
+CppMySQL::ptr CppMySQLManager::get(const std::string& name) {
+    //配置了副本时get返回的主库连接可能用来写，同getWrite标记当前协程读主库
+    auto group = getGroup(name);
+    if(group) {
+        return group->getWrite();
+    }
+    auto pool = getPool(name);
+    if(!pool) {
         return nullptr;
     }
+    return pool->get();
+}
+
+CppMySQLReplicaGroup::ptr CppMySQLManager::getGroup(const std::string& name) {
+    {
+        MtxType::ReadLock lock(m_mutex);
+        auto it = m_groups.find(name);
+        if(it != m_groups.end()) {
+            return it->second;
+        }
+    }
+    auto pool = getPool(name);
+    if(!pool) {
+        return nullptr;
+    }
+    CppMySQLReplicaGroup::ptr group;
+    std::string replicas = yhchaos::GetParamValue<std::string>(pool->getArgs(), "replicas");
+    if(!replicas.empty()) {
+        group = std::make_shared<CppMySQLReplicaGroup>(name, pool);
+        for(auto& i : yhchaos::split(replicas, ',')) {
+            std::string replica = yhchaos::StringUtil::Trim(i);
+            if(replica.empty() || replica == name) {
+                continue;
+            }
+            auto rpool = getPool(replica);
+            if(!rpool) {
+                YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::getGroup name=" << name
+                    << " replica=" << replica << " not exists";
+                continue;
+            }
+            group->addReplica(rpool);
+        }
+        if(!group->getReplicaCount()) {
+            group = nullptr;
+        }
+    }
+    MtxType::WriteLock lock(m_mutex);
+    auto it = m_groups.find(name);
+    if(it != m_groups.end()) {
+        return it->second;
+    }
+    m_groups[name] = group;
+    return group;
+}
+
+CppMySQL::ptr CppMySQLManager::getRead(const std::string& name) {
+    auto group = getGroup(name);
+    if(group) {
+        return group->getRead();
+    }
+    return get(name);
+}
+
+CppMySQL::ptr CppMySQLManager::getWrite(const std::string& name) {
+    return get(name);
 }
 
 void CppMySQLManager::registerCppMySQL(const std::string& name, const std::map<std::string, std::string>& params) {
-    MtxType::Lock lock(m_mutex);
+    MtxType::WriteLock lock(m_mutex);
     m_dbDefines[name] = params;
+    //重新注册后按新的参数创建连接池和读写分离组；
+    //借出的连接持有旧的连接池，归还后随旧的连接池一起释放
+    m_pools.erase(name);
+    m_groups.erase(name);
 }
 
 void CppMySQLManager::checkClient(int sec) {
-    time_t now = time(0);
-    std::vector<CppMySQL*> conns;
-    MtxType::Lock lock(m_mutex);
-    for(auto& i : m_conns) {
-        for(auto it = i.second.begin();
-                it != i.second.end();) {
-            if((int)(now - (*it)->m_lastUsedTime) >= sec) {
-                auto tmp = *it;
-                i.second.erase(it++);
-                conns.push_back(tmp);
-            } else {
-                ++it;
+    std::vector<CppMySQLPool::ptr> pools;
+    std::vector<CppMySQLReplicaGroup::ptr> groups;
+    {
+        MtxType::ReadLock lock(m_mutex);
+        for(auto& i : m_pools) {
+            pools.push_back(i.second);
+        }
+        for(auto& i : m_groups) {
+            if(i.second) {
+                groups.push_back(i.second);
             }
         }
     }
-    lock.unlock();
-    for(auto& i : conns) {
-        delete i;
+    for(auto& i : pools) {
+        i->check(sec);
+    }
+    for(auto& i : groups) {
+        i->check();
+    }
+}
+
+void CppMySQLManager::startChecker(uint64_t interval_ms) {
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    YHCHAOS_ASSERT(iom);
+    MtxType::WriteLock lock(m_mutex);
+    if(m_checker) {
+        m_checker->cancel();
     }
+    m_checker = iom->addTimedCoroutine(interval_ms, [this]() {
+        checkClient(-1);
+    }, true);
+}
+
+std::ostream& CppMySQLManager::dump(std::ostream& os) {
+    std::vector<CppMySQLPool::ptr> pools;
+    std::vector<CppMySQLReplicaGroup::ptr> groups;
+    {
+        MtxType::ReadLock lock(m_mutex);
+        for(auto& i : m_pools) {
+            pools.push_back(i.second);
+        }
+        for(auto& i : m_groups) {
+            if(i.second) {
+                groups.push_back(i.second);
+            }
+        }
+    }
+    os << "[CppMySQLManager pools=" << pools.size() << " stmt_cache_hits=" << s_stmt_hits
+       << " stmt_cache_misses=" << s_stmt_misses << "]" << std::endl;
+    for(auto& i : pools) {
+        os << "    ";
+        i->dump(os) << std::endl;
+    }
+    for(auto& i : groups) {
+        os << "    ";
+        i->dump(os) << std::endl;
+    }
+    return os;
 }
 
 int CppMySQLManager::execute(const std::string& name, const char* format, ...) {
@@ -1081,7 +2029,7 @@ int CppMySQLManager::execute(const std::string& name, const char* format, ...) {
 }
 
 int CppMySQLManager::execute(const std::string& name, const char* format, va_list ap) {
-    auto conn = get(name);
+    auto conn = getWrite(name);
     if(!conn) {
         YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::execute, get(" << name
             << ") fail, format=" << format;
@@ -1091,7 +2039,7 @@ int CppMySQLManager::execute(const std::string& name, const char* format, va_lis
 }
 
 int CppMySQLManager::execute(const std::string& name, const std::string& sql) {
-    auto conn = get(name);
+    auto conn = getWrite(name);
     if(!conn) {
         YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::execute, get(" << name
             << ") fail, sql=" << sql;
@@ -1109,6 +2057,10 @@ IMySQLData::ptr CppMySQLManager::query(const std::string& name, const char* form
 }
 
 IMySQLData::ptr CppMySQLManager::query(const std::string& name, const char* format, va_list ap) {
+    auto group = getGroup(name);
+    if(group) {
+        return query(name, yhchaos::StringUtil::Formatv(format, ap));
+    }
     auto conn = get(name);
     if(!conn) {
         YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::query, get(" << name
@@ -1119,6 +2071,10 @@ IMySQLData::ptr CppMySQLManager::query(const std::string& name, const char* form
 }
 
 IMySQLData::ptr CppMySQLManager::query(const std::string& name, const std::string& sql) {
+    auto group = getGroup(name);
+    if(group) {
+        return group->query(sql);
+    }
     auto conn = get(name);
     if(!conn) {
         YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::query, get(" << name
@@ -1129,7 +2085,7 @@ IMySQLData::ptr CppMySQLManager::query(const std::string& name, const std::strin
 }
 
 CppMySQLTransaction::ptr CppMySQLManager::openTransaction(const std::string& name, bool auto_commit) {
-    auto conn = get(name);
+    auto conn = getWrite(name);
     if(!conn) {
         YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLManager::openTransaction, get(" << name
             << ") fail";
@@ -1139,15 +2095,228 @@ CppMySQLTransaction::ptr CppMySQLManager::openTransaction(const std::string& nam
     return trans;
 }
 
-void CppMySQLManager::freeCppMySQL(const std::string& name, CppMySQL* m) {
-    if(m->m_mysql) {
+CppMySQLBatch::CppMySQLBatch(const std::string& name, const std::string& insert_sql
+                             ,const std::string& on_duplicate, size_t max_bytes)
+    :m_name(name)
+    ,m_prefix(insert_sql + " VALUES ")
+    ,m_maxBytes(max_bytes)
+    ,m_maxAge(0)
+    ,m_rows(0)
+    ,m_firstTime(0)
+    ,m_flushCount(0)
+    ,m_totalRows(0)
+    ,m_totalAffected(0)
+    ,m_errorCount(0) {
+    if(!on_duplicate.empty()) {
+        m_suffix = " ON DUPLICATE KEY UPDATE " + on_duplicate;
+    }
+}
+
+CppMySQLBatch::~CppMySQLBatch() {
+    if(m_timer) {
+        m_timer->cancel();
+    }
+    //析构时不执行SQL，结果无法返回给调用者，剩余的行需要先调用flush()
+    MtxType::Lock lock(m_mutex);
+    if(m_rows) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLBatch(" << m_name
+            << ") destroyed without flush, drop rows=" << m_rows;
+    }
+}
+
+void CppMySQLBatch::Escape(MYSQL* mysql, std::string& out, const char* str, size_t len) {
+    //每个字节最多转义为两个字节，加上两个单引号
+    size_t pos = out.size();
+    out.resize(pos + len * 2 + 2);
+    out[pos] = '\'';
+    unsigned long n = mysql_real_escape_string_quote(mysql, &out[pos + 1], str, len, '\'');
+    out[pos + 1 + n] = '\'';
+    out.resize(pos + n + 2);
+}
+
+void CppMySQLBatch::AppendInt(std::string& out, int64_t v) {
+    char buf[32];
+    out.append(buf, snprintf(buf, sizeof(buf), "%" PRId64, v));
+}
+
+void CppMySQLBatch::AppendUint(std::string& out, uint64_t v) {
+    char buf[32];
+    out.append(buf, snprintf(buf, sizeof(buf), "%" PRIu64, v));
+}
+
+void CppMySQLBatch::AppendDouble(std::string& out, double v, int digits) {
+    char buf[48];
+    out.append(buf, snprintf(buf, sizeof(buf), "%.*g", digits, v));
+}
+
+void CppMySQLBatch::Append(MYSQL* mysql, std::string& out, const char* v) {
+    if(!v) {
+        out.append("NULL");
+        return;
+    }
+    Escape(mysql, out, v, strlen(v));
+}
+
+void CppMySQLBatch::Append(MYSQL* mysql, std::string& out, const std::string& v) {
+    Escape(mysql, out, v.c_str(), v.size());
+}
+
+void CppMySQLBatch::Append(MYSQL* mysql, std::string& out, std::nullptr_t v) {
+    out.append("NULL");
+}
+
+void CppMySQLBatch::Append(MYSQL* mysql, std::string& out, const CppMySQLTime& v) {
+    char buf[48];
+    out.append(buf, snprintf(buf, sizeof(buf), "FROM_UNIXTIME(%" PRId64 ")", (int64_t)v.ts));
+}
+
+std::string& CppMySQLBatch::GetRowBuffer() {
+    static thread_local std::string s_row;
+    return s_row;
+}
+
+CppMySQL::ptr CppMySQLBatch::getConn() {
+    auto conn = CppMySQLMgr::GetInstance()->get(m_name);
+    if(!conn) {
+        ++m_errorCount;
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLBatch get(" << m_name << ") fail";
+        return nullptr;
+    }
+    if(!m_maxBytes) {
+        m_maxBytes = GetServerMaxBytes(conn, m_name);
+    }
+    return conn;
+}
+
+size_t CppMySQLBatch::GetServerMaxBytes(CppMySQL::ptr conn, const std::string& name) {
+    //同一个数据库只查询一次
+    static MtxType s_mutex;
+    static std::map<std::string, size_t> s_maxBytes;
+    {
+        MtxType::Lock lock(s_mutex);
+        auto it = s_maxBytes.find(name);
+        if(it != s_maxBytes.end()) {
+            return it->second;
+        }
+    }
+    //留出协议头的空间
+    size_t max_bytes = 1024 * 1024;
+    auto res = conn->query("SELECT @@max_allowed_packet");
+    if(res && res->next()) {
+        int64_t v = res->getInt64(0);
+        if(v > 4096) {
+            max_bytes = v - 1024;
+        }
+        MtxType::Lock lock(s_mutex);
+        s_maxBytes[name] = max_bytes;
+    } else {
+        YHCHAOS_LOG_WARN(g_logger) << "CppMySQLBatch(" << name
+            << ") get max_allowed_packet fail, use " << max_bytes;
+    }
+    return max_bytes;
+}
+
+int64_t CppMySQLBatch::addRow(CppMySQL::ptr conn, const std::string& row) {
+    std::string sql;
+    size_t rows = 0;
+    {
+        MtxType::Lock lock(m_mutex);
+        //加上这一行超过长度限制，先执行已有的行
+        if(m_rows && m_buffer.size() + 1 + row.size() + m_suffix.size() > m_maxBytes) {
+            sql.swap(m_buffer);
+            sql.append(m_suffix);
+            rows = m_rows;
+            m_rows = 0;
+            m_buffer.reserve(sql.capacity());
+        }
+        if(m_rows == 0) {
+            m_buffer.append(m_prefix);
+            m_firstTime = yhchaos::GetCurrentMS();
+        } else {
+            m_buffer.push_back(',');
+        }
+        m_buffer.append(row);
+        ++m_rows;
+    }
+    if(rows) {
+        return execute(conn, sql, rows);
+    }
+    return 0;
+}
+
+int64_t CppMySQLBatch::flush() {
+    std::string sql;
+    size_t rows = 0;
+    {
         MtxType::Lock lock(m_mutex);
-        if(m_conns[name].size() < (size_t)m->m_poolSize) {
-            m_conns[name].push_back(m);
+        if(m_rows == 0) {
+            return 0;
+        }
+        sql.swap(m_buffer);
+        sql.append(m_suffix);
+        rows = m_rows;
+        m_rows = 0;
+        m_buffer.reserve(sql.capacity());
+    }
+    auto conn = CppMySQLMgr::GetInstance()->get(m_name);
+    if(!conn) {
+        ++m_errorCount;
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLBatch get(" << m_name
+            << ") fail, drop rows=" << rows;
+        return -1;
+    }
+    return execute(conn, sql, rows);
+}
+
+int64_t CppMySQLBatch::execute(CppMySQL::ptr conn, const std::string& sql, size_t rows) {
+    ++m_flushCount;
+    if(conn->executeLong(sql)) {
+        ++m_errorCount;
+        YHCHAOS_LOG_ERROR(g_logger) << "CppMySQLBatch(" << m_name << ") drop rows=" << rows;
+        return -1;
+    }
+    int64_t affected = conn->getAffectedRows();
+    m_totalRows += rows;
+    m_totalAffected += affected;
+    return affected;
+}
+
+size_t CppMySQLBatch::getRowCount() {
+    MtxType::Lock lock(m_mutex);
+    return m_rows;
+}
+
+void CppMySQLBatch::startFlusher(uint64_t max_age_ms) {
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    YHCHAOS_ASSERT(iom);
+    stopFlusher();
+    m_maxAge = max_age_ms;
+    std::weak_ptr<CppMySQLBatch> weak(shared_from_this());
+    //检查间隔为等待时间的一半，一行最多等待1.5倍max_age_ms
+    m_timer = iom->addConditionTimedCoroutine(std::max(max_age_ms / 2, (uint64_t)1), [weak]() {
+        auto self = weak.lock();
+        if(self) {
+            self->onTimer();
+        }
+    }, weak, true);
+}
+
+void CppMySQLBatch::stopFlusher() {
+    if(m_timer) {
+        m_timer->cancel();
+        m_timer = nullptr;
+    }
+    flush();
+}
+
+void CppMySQLBatch::onTimer() {
+    {
+        MtxType::Lock lock(m_mutex);
+        if(m_rows == 0 || yhchaos::GetCurrentMS() - m_firstTime < m_maxAge) {
             return;
         }
     }
-    delete m;
+    flush();
 }
 
 IMySQLData::ptr CppMySQLUtil::Query(const std::string& name, const char* format, ...) {
@@ -1159,19 +2328,11 @@ IMySQLData::ptr CppMySQLUtil::Query(const std::string& name, const char* format,
 }
 
 IMySQLData::ptr CppMySQLUtil::Query(const std::string& name, const char* format,va_list ap) {
-    auto m = CppMySQLMgr::GetInstance()->get(name);
-    if(!m) {
-        return nullptr;
-    }
-    return m->query(format, ap);
+    return CppMySQLMgr::GetInstance()->query(name, format, ap);
 }
 
 IMySQLData::ptr CppMySQLUtil::Query(const std::string& name, const std::string& sql) {
-    auto m = CppMySQLMgr::GetInstance()->get(name);
-    if(!m) {
-        return nullptr;
-    }
-    return m->query(sql);
+    return CppMySQLMgr::GetInstance()->query(name, sql);
 }
 
 IMySQLData::ptr CppMySQLUtil::TryQuery(const std::string& name, uint32_t count, const char* format, ...) {
@@ -1207,7 +2368,7 @@ int CppMySQLUtil::Execute(const std::string& name, const char* format, ...) {
 }
 
 int CppMySQLUtil::Execute(const std::string& name, const char* format, va_list ap) {
-    auto m = CppMySQLMgr::GetInstance()->get(name);
+    auto m = CppMySQLMgr::GetInstance()->getWrite(name);
     if(!m) {
         return -1;
     }
@@ -1215,7 +2376,7 @@ int CppMySQLUtil::Execute(const std::string& name, const char* format, va_list a
 }
 
 int CppMySQLUtil::Execute(const std::string& name, const std::string& sql) {
-    auto m = CppMySQLMgr::GetInstance()->get(name);
+    auto m = CppMySQLMgr::GetInstance()->getWrite(name);
     if(!m) {
         return -1;
     }
@@ -5,7 +5,13 @@
 #include <memory>
 #include <functional>
 #include <map>
+#include <list>
 #include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <type_traits>
+#include <limits>
+#include <stdlib.h>
 #include "yhchaos/mtx.h"
 #include "db.h"
 #include "yhchaos/singleton.h"
@@ -16,6 +22,9 @@ namespace yhchaos {
 //typedef std::shared_ptr<MYSQL> CppMySQLPtr;
 class CppMySQL;
 class CppMySQLStmt;
+class TimedCoroutine;
+class CoScheduler;
+class Coroutine;
 //class ICppMySQLUpdate {
 //public:
 //    typedef std::shared_ptr<ICppMySQLUpdate> ptr;
@@ -27,7 +36,7 @@ class CppMySQLStmt;
 //};
 
 struct CppMySQLTime {
-    CppMySQLTime(time_t t)
+    explicit CppMySQLTime(time_t t)
         :ts(t) { }
     time_t ts;
 };
@@ -35,13 +44,29 @@ struct CppMySQLTime {
 bool mysql_time_to_time_t(const MYSQL_TIME& mt, time_t& ts);
 bool time_t_to_mysql_time(const time_t& ts, MYSQL_TIME& mt);
 
+/**
+ * @brief 不拷贝的字符串列，指向当前行的数据，取下一行后失效
+ */
+struct CppMySQLStr {
+    const char* data;
+    size_t size;
+
+    bool isNull() const { return data == nullptr;}
+    std::string str() const { return data ? std::string(data, size) : std::string();}
+};
+
 //结果集数据类
 class CppMySQLRes : public IMySQLData {
 public:
     typedef std::shared_ptr<CppMySQLRes> ptr;
     typedef std::function<bool(MYSQL_ROW row
                 ,int field_count, int row_no)> data_cb;
-    CppMySQLRes(MYSQL_RES* res, int eno, const char* estr);
+    /**
+     * @brief 构造函数
+     * @param[in] conn 流式结果集(mysql_use_res)所在的连接，结果集释放前连接不回到连接池
+     */
+    CppMySQLRes(MYSQL_RES* res, int eno, const char* estr
+                ,std::shared_ptr<CppMySQL> conn = nullptr);
 
     MYSQL_RES* get() const { return m_data.get();}
 
@@ -50,6 +75,28 @@ public:
 
     bool foreach(data_cb cb);
 
+    /**
+     * @brief 是否是流式结果集
+     * @details 流式结果集边取边从连接读取，getDataCount()返回已经读取的行数，
+     *          释放前不能在同一个连接上执行其他语句
+     */
+    bool isStream() const { return m_conn != nullptr;}
+
+    /**
+     * @brief 当前行第idx列的数据，不拷贝，NULL返回nullptr
+     */
+    const char* getData(int idx, size_t& len);
+
+    /**
+     * @brief 按类型遍历剩余的行
+     * @details 列按顺序转换成Args，支持整数，浮点数，CppMySQLStr，std::string，
+     *          NULL转换成0或空，cb返回false时停止
+     *          res->visit<int64_t, CppMySQLStr>([](int64_t id, CppMySQLStr name) { return true; });
+     * @return 返回遍历的行数
+     */
+    template<typename... Args, typename F>
+    uint64_t visit(F cb);
+
     int getDataCount() override;
     int getColumnCount() override;
     int getColumnBytes(int idx) override;
@@ -76,15 +123,96 @@ private:
     std::string m_errstr;
     MYSQL_ROW m_cur;
     unsigned long* m_curLength;
+    //声明在m_data之前，先释放结果集再释放连接
+    std::shared_ptr<CppMySQL> m_conn;
     std::shared_ptr<MYSQL_RES> m_data;
 };
 
+namespace {
+
+//列转换成visit的参数类型
+template<typename T>
+struct CppMySQLCell {
+    static T Get(const char* v, unsigned long len) {
+        static_assert(sizeof(T) < 0, "invalid type");
+        return T();
+    }
+};
+
+#define XX(type, conv) \
+template<> \
+struct CppMySQLCell<type> { \
+    static type Get(const char* v, unsigned long len) { \
+        return v ? (type)conv : type(); \
+    } \
+};
+
+XX(int8_t, strtol(v, nullptr, 10));
+XX(uint8_t, strtoul(v, nullptr, 10));
+XX(int16_t, strtol(v, nullptr, 10));
+XX(uint16_t, strtoul(v, nullptr, 10));
+XX(int32_t, strtol(v, nullptr, 10));
+XX(uint32_t, strtoul(v, nullptr, 10));
+XX(int64_t, strtoll(v, nullptr, 10));
+XX(uint64_t, strtoull(v, nullptr, 10));
+XX(float, strtof(v, nullptr));
+XX(double, strtod(v, nullptr));
+XX(std::string, std::string(v, len));
+#undef XX
+
+template<>
+struct CppMySQLCell<CppMySQLStr> {
+    static CppMySQLStr Get(const char* v, unsigned long len) {
+        CppMySQLStr rt;
+        rt.data = v;
+        rt.size = v ? len : 0;
+        return rt;
+    }
+};
+
+template<size_t... I>
+struct CppMySQLIndex {};
+
+template<size_t N, size_t... I>
+struct CppMySQLMakeIndex : CppMySQLMakeIndex<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct CppMySQLMakeIndex<0, I...> {
+    typedef CppMySQLIndex<I...> type;
+};
+
+template<typename... Args, typename F, size_t... I>
+bool CppMySQLVisitRow(F& cb, MYSQL_ROW row, unsigned long* lengths, CppMySQLIndex<I...>) {
+    return cb(CppMySQLCell<typename std::decay<Args>::type>::Get(row[I], lengths[I])...);
+}
+}
+
+template<typename... Args, typename F>
+uint64_t CppMySQLRes::visit(F cb) {
+    if(getColumnCount() < (int)sizeof...(Args)) {
+        return 0;
+    }
+    uint64_t count = 0;
+    while(next()) {
+        ++count;
+        if(!CppMySQLVisitRow<Args...>(cb, m_cur, m_curLength
+                    ,typename CppMySQLMakeIndex<sizeof...(Args)>::type())) {
+            break;
+        }
+    }
+    return count;
+}
+
 //结果集统计信息类
 class CppMySQLStmtRes : public IMySQLData {
 friend class CppMySQLStmt;
 public:
     typedef std::shared_ptr<CppMySQLStmtRes> ptr;
-    static CppMySQLStmtRes::ptr Create(std::shared_ptr<CppMySQLStmt> stmt);
+    /**
+     * @brief 执行语句并创建结果集
+     * @param[in] stream 为true时不缓存整个结果集(mysql_stmt_store_res)，next()逐行从连接读取
+     */
+    static CppMySQLStmtRes::ptr Create(std::shared_ptr<CppMySQLStmt> stmt, bool stream = false);
     ~CppMySQLStmtRes();
 
     int getErrno() const { return m_errno;}
@@ -135,9 +263,15 @@ private:
 };
 
 class CppMySQLManager;
+class CppMySQLPool;
+class CppMySQLBatch;
+class CppMySQLStmtFetcher;
 class CppMySQL : public IMySQLDB
               ,public std::enable_shared_from_this<CppMySQL> {
 friend class CppMySQLManager;
+friend class CppMySQLPool;
+friend class CppMySQLRes;
+friend class CppMySQLStmtFetcher;
 public:
     typedef std::shared_ptr<CppMySQL> ptr;
 
@@ -149,6 +283,11 @@ public:
     virtual int execute(const char* format, ...) override;
     int execute(const char* format, va_list ap);
     virtual int execute(const std::string& sql) override;
+    /**
+     * @brief 执行很长的语句(如多行插入)，出错时只打印语句的前128个字节
+     * @return 成功返回0
+     */
+    int executeLong(const std::string& sql);
     int64_t getLastInsertId() override;
     std::shared_ptr<CppMySQL> getCppMySQL();
     std::shared_ptr<MYSQL> getRaw();
@@ -159,6 +298,14 @@ public:
     IMySQLData::ptr query(const char* format, va_list ap); 
     IMySQLData::ptr query(const std::string& sql) override;
 
+    /**
+     * @brief 流式查询(mysql_use_res)，不在客户端缓存整个结果集
+     * @details 行在next()时才从连接读取，消费者慢时由TCP流控限制服务器发送；
+     *          结果集持有连接，释放前不能在这个连接上执行其他语句
+     */
+    CppMySQLRes::ptr queryStream(const char* format, ...);
+    CppMySQLRes::ptr queryStream(const std::string& sql);
+
     IMySqlTrans::ptr openTransaction(bool auto_commit) override;
     yhchaos::IMySQLStmt::ptr prepare(const std::string& sql) override;
 
@@ -168,6 +315,25 @@ public:
     template<class... Args>
     IMySQLData::ptr queryStmt(const char* stmt, Args&&... args);
 
+    /**
+     * @brief 流式执行预处理查询，逐行从连接读取，同queryStream
+     */
+    template<class... Args>
+    IMySQLData::ptr queryStmtStream(const char* stmt, Args&&... args);
+
+    /**
+     * @brief 获取sql的预处理语句，execStmt/queryStmt使用
+     * @details 每个连接按sql缓存预处理语句(LRU，参数stmt_cache指定个数，默认64，0不缓存)，
+     *          缓存的语句不持有连接，使用期间需要持有连接；
+     *          缓存的语句还有未释放的结果集时，创建一个不缓存的语句；
+     *          重新连接时清空缓存
+     */
+    std::shared_ptr<CppMySQLStmt> getStmt(const std::string& sql);
+
+    uint64_t getStmtHits() const { return m_stmtHits;}
+    uint64_t getStmtMisses() const { return m_stmtMisses;}
+    size_t getStmtCount() const { return m_stmts.size();}
+
     const char* cmd();
 
     bool use(const std::string& dbname);
@@ -176,6 +342,12 @@ public:
     uint64_t getInsertId();
 private:
     bool isNeedCheck();
+    //预处理语句执行失败，只有连接断开或语句句柄失效时从缓存中删除，
+    //连接断开时标记下次使用前检查连接；主键冲突等普通的SQL错误不影响缓存
+    void onStmtError(const std::string& sql, int err);
+    template<class... Args>
+    IMySQLData::ptr doQueryStmt(bool stream, const char* stmt, Args&... args);
+    void clearStmts();
 private:
     std::map<std::string, std::string> m_params;//args
     std::shared_ptr<MYSQL> m_mysql;
@@ -184,8 +356,18 @@ private:
     std::string m_dbname;
 
     uint64_t m_lastUsedTime;//0
+    //连接池中空闲时上次ping的时间
+    uint64_t m_lastPingTime;//0
     bool m_hasError;//false
     int32_t m_poolSize;//10
+
+    //预处理语句缓存，声明在m_mysql之后，先于连接关闭
+    typedef std::list<std::pair<std::string, std::shared_ptr<CppMySQLStmt> > > StmtList;
+    StmtList m_stmtLru;
+    std::unordered_map<std::string, StmtList::iterator> m_stmts;
+    size_t m_stmtCacheSize;//64
+    uint64_t m_stmtHits;//0
+    uint64_t m_stmtMisses;//0
 };
 
 class CppMySQLTransaction : public IMySqlTrans {
@@ -265,28 +447,348 @@ public:
     int execute() override;
     int64_t getLastInsertId() override;
     IMySQLData::ptr query() override;
+    /**
+     * @brief 流式查询，结果集不缓存在客户端
+     */
+    IMySQLData::ptr queryStream();
 
     MYSQL_STMT* getRaw() const { return m_stmt;}
 private:
     CppMySQLStmt(CppMySQL::ptr db, MYSQL_STMT* stmt);
+    //参数idx的缓冲区，容量不够时重新分配，语句重复使用时复用
+    void* bindBuffer(int idx, size_t size);
 private:
     CppMySQL::ptr m_mysql;
     MYSQL_STMT* m_stmt;
     std::vector<MYSQL_BIND> m_binds;
+    //m_binds中缓冲区的容量
+    std::vector<size_t> m_bindSizes;
 };
 
-class CppMySQLManager {
+/**
+ * @brief 预处理查询，结果列直接读到调用者绑定的变量
+ * @details 整数和浮点数列由mysql_stmt_fetch按二进制协议写入变量，不经过IMySQLData的虚函数和字符串转换；
+ *          字符串列先读到列的缓冲区再赋值，超过缓冲区的部分用mysql_stmt_fetch_column补读；
+ *          其他类型的列被截断(超出变量的范围)时next()返回false，错误码为CR_DATA_TRUNCATED；
+ *          NULL列置为0或空字符串；
+ *          语句从连接的预处理语句缓存中获取，使用期间需要持有连接。orm生成的代码使用
+ */
+class CppMySQLStmtFetcher : public Noncopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] conn 连接
+     * @param[in] sql 查询语句
+     * @param[in] stream 为true时不缓存结果集，next()逐行从连接读取
+     */
+    CppMySQLStmtFetcher(CppMySQL::ptr conn, const std::string& sql, bool stream = false);
+    ~CppMySQLStmtFetcher();
+
+    /**
+     * @brief 绑定第idx列(从0开始)到value，需要在execute之前调用
+     */
+    void bind(int idx, int8_t& value);
+    void bind(int idx, uint8_t& value);
+    void bind(int idx, int16_t& value);
+    void bind(int idx, uint16_t& value);
+    void bind(int idx, int32_t& value);
+    void bind(int idx, uint32_t& value);
+    void bind(int idx, int64_t& value);
+    void bind(int idx, uint64_t& value);
+    void bind(int idx, float& value);
+    void bind(int idx, double& value);
+    void bind(int idx, std::string& value);
+
+    /**
+     * @brief 绑定参数并执行
+     * @return 返回0成功，否则返回错误码
+     */
+    template<class... Args>
+    int execute(Args&&... args);
+
+    /**
+     * @brief 读取下一行到绑定的变量
+     * @return 没有更多的行或者出错返回false，用getErrno区分
+     */
+    bool next();
+
+    int getColumnCount() const { return m_binds.size();}
+    int getErrno() const { return m_errno;}
+    const std::string& getErrStr() const { return m_errstr;}
+private:
+    struct Column {
+        my_bool is_null = 0;
+        my_bool error = 0;
+        unsigned long length = 0;
+        //字符串列绑定的变量
+        std::string* str = nullptr;
+        std::vector<char> buf;
+    };
+
+    bool checkIndex(int idx);
+    void bindValue(int idx, enum_field_types type, bool is_unsigned, void* ptr, size_t size);
+    int doExecute();
+    int onError();
+private:
+    CppMySQL::ptr m_conn;
+    std::string m_sql;
+    bool m_stream;
+    bool m_executed;
+    CppMySQLStmt::ptr m_stmt;
+    std::vector<MYSQL_BIND> m_binds;
+    std::vector<Column> m_cols;
+    int m_errno;
+    std::string m_errstr;
+};
+
+/**
+ * @brief 一个数据库的连接池
+ * @details 1. 连接总数(空闲+使用中)不超过max_conn(参数max_conn，默认为CppMySQLManager::getMaxConn())
+ *          2. 达到上限时，协程中的get按FIFO等待归还的连接，超过wait_timeout(毫秒，默认3000)返回nullptr，
+ *             不在协程中直接返回nullptr
+ *          3. 空闲连接最多保留pool个(默认5)，check时ping空闲超过ping_interval(秒，默认30)的连接，
+ *             关闭空闲超过idle_timeout(秒，默认60)的连接
+ *          4. 统计等待时间的分布
+ */
+class CppMySQLPool : public std::enable_shared_from_this<CppMySQLPool> {
+public:
+    typedef std::shared_ptr<CppMySQLPool> ptr;
+    typedef yhchaos::Mtx MtxType;
+
+    CppMySQLPool(const std::string& name, const std::map<std::string, std::string>& args
+                 ,uint32_t max_conn);
+    ~CppMySQLPool();
+
+    /**
+     * @brief 获取连接，释放时归还连接池
+     */
+    CppMySQL::ptr get();
+
+    /**
+     * @brief 获取连接，释放时归还连接池
+     * @param[out] conn_error 返回nullptr时，是否是因为连接或者ping失败(而不是等待超时)
+     */
+    CppMySQL::ptr get(bool& conn_error);
+
+    /**
+     * @brief 健康检查，ping长时间空闲的连接，关闭超时和失效的连接
+     * @param[in] idle_sec 关闭空闲超过idle_sec秒的连接，-1表示使用idle_timeout
+     */
+    void check(int idle_sec = -1);
+
+    const std::string& getName() const { return m_name;}
+    const std::map<std::string, std::string>& getArgs() const { return m_args;}
+    uint32_t getMaxConn() const { return m_maxConn;}
+    uint32_t getTotal();
+    uint32_t getIdle();
+    uint32_t getWaiting();
+
+    std::ostream& dump(std::ostream& os);
+private:
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        CoScheduler* scheduler = nullptr;
+        std::shared_ptr<Coroutine> coroutine;
+        //归还的连接
+        CppMySQL* conn = nullptr;
+        //得到了创建连接的名额
+        bool create = false;
+        //已经被唤醒(得到连接，名额或超时)
+        bool done = false;
+    };
+
+    //连接用完后归还
+    void release(CppMySQL* m);
+    //连接放回空闲列表或交给第一个等待者
+    void put(CppMySQL* m);
+    //连接关闭或创建失败，名额交给第一个等待者
+    void releaseSlot();
+    void onWaitTimeout(Waiter::ptr waiter);
+    void addWaitTime(uint64_t ms);
+private:
+    std::string m_name;
+    std::map<std::string, std::string> m_args;
+    uint32_t m_maxConn;
+    uint32_t m_maxIdle;
+    uint64_t m_waitTimeout;
+    uint32_t m_pingInterval;
+    uint32_t m_idleTimeout;
+
+    MtxType m_mutex;
+    //空闲连接，尾部是最近归还的
+    std::list<CppMySQL*> m_idle;
+    std::list<Waiter::ptr> m_waiters;
+    //空闲+使用中+正在创建的连接数
+    uint32_t m_total;
+
+    //等待时间分布的上界(毫秒)，最后一个桶是更大的
+    static const size_t WAIT_BUCKETS = 8;
+    static const uint64_t s_waitBounds[WAIT_BUCKETS - 1];
+    std::atomic<uint64_t> m_waitHist[WAIT_BUCKETS];
+    std::atomic<uint64_t> m_gets;
+    std::atomic<uint64_t> m_waits;
+    std::atomic<uint64_t> m_timeouts;
+    std::atomic<uint64_t> m_connectErrors;
+};
+
+/**
+ * @brief 读写分离，一个主库和若干只读副本组成的逻辑库
+ * @details 主库参数replicas指定副本(逗号分隔，副本是mysql.dbs或registerCppMySQL中的库名)，
+ *          query读副本，execute和事务使用主库；
+ *          read_policy: least_outstanding(默认，选未完成请求最少的)，latency(按平均耗时加权)；
+ *          max_lag: 复制延迟超过max_lag秒(默认10)或复制中断的副本不参与读；
+ *          pin_ms: 协程归还写连接后pin_ms毫秒(默认1000)内的读也使用主库，读到自己的写；
+ *          replica_retry: 副本获取连接失败后replica_retry秒(默认5)内不使用；
+ *          没有可用副本时读主库
+ */
+class CppMySQLReplicaGroup : public std::enable_shared_from_this<CppMySQLReplicaGroup> {
 public:
+    typedef std::shared_ptr<CppMySQLReplicaGroup> ptr;
     typedef yhchaos::Mtx MtxType;
 
+    enum ReadPolicy {
+        LEAST_OUTSTANDING = 0,
+        LATENCY = 1
+    };
+
+    CppMySQLReplicaGroup(const std::string& name, CppMySQLPool::ptr primary);
+
+    /**
+     * @brief 添加副本，只在创建时调用
+     */
+    void addReplica(CppMySQLPool::ptr pool);
+
+    /**
+     * @brief 获取读连接，按read_policy选择副本
+     */
+    CppMySQL::ptr getRead();
+
+    /**
+     * @brief 获取主库连接，归还时标记当前协程写过主库
+     */
+    CppMySQL::ptr getWrite();
+
+    /**
+     * @brief 在读连接上查询，副本连接失效时标记不可用并改读主库
+     */
+    IMySQLData::ptr query(const std::string& sql);
+
+    /**
+     * @brief 当前协程接下来pin_ms毫秒内读主库
+     */
+    void markWrite();
+
+    /**
+     * @brief 当前协程是否需要读主库
+     */
+    bool isPinned();
+
+    /**
+     * @brief 检查副本的复制延迟，恢复可以连接的副本，清理过期的协程标记
+     */
+    void check();
+
+    const std::string& getName() const { return m_name;}
+    CppMySQLPool::ptr getPrimary() const { return m_primary;}
+    size_t getReplicaCount() const { return m_replicas.size();}
+    ReadPolicy getPolicy() const { return m_policy;}
+
+    /**
+     * @brief 当前可以读的副本数
+     */
+    size_t getAvailable();
+
+    std::ostream& dump(std::ostream& os);
+private:
+    struct Replica {
+        typedef std::shared_ptr<Replica> ptr;
+        CppMySQLPool::ptr pool;
+        //未归还的读连接数
+        std::atomic<uint32_t> outstanding{0};
+        //读连接占用时间的滑动平均(微秒)
+        std::atomic<uint64_t> latency{0};
+        //复制延迟(秒)，-1表示复制中断
+        std::atomic<int64_t> lag{0};
+        //在这个时间(毫秒)之前不使用
+        std::atomic<uint64_t> downUntil{0};
+        std::atomic<uint64_t> reads{0};
+        std::atomic<uint64_t> errors{0};
+    };
+
+    CppMySQL::ptr getRead(Replica::ptr& replica);
+    //选择可用的副本，跳过已经尝试过的
+    Replica::ptr choose(uint64_t now, const std::vector<Replica::ptr>& tried);
+    bool isAvailable(Replica::ptr r, uint64_t now);
+    void markDown(Replica::ptr r);
+    void markWrite(uint64_t coroutine_id);
+    //查询复制延迟，查询失败返回false
+    static bool QueryLag(CppMySQL::ptr conn, int64_t& lag);
+private:
+    std::string m_name;
+    CppMySQLPool::ptr m_primary;
+    std::vector<Replica::ptr> m_replicas;
+    ReadPolicy m_policy;
+    int64_t m_maxLag;
+    uint64_t m_pinMs;
+    uint64_t m_retryMs;
+
+    MtxType m_mutex;
+    //协程id -> 读主库的截止时间(毫秒)
+    std::unordered_map<uint64_t, uint64_t> m_pins;
+
+    std::atomic<uint32_t> m_next;
+    std::atomic<uint64_t> m_writes;
+    std::atomic<uint64_t> m_pinnedReads;
+    std::atomic<uint64_t> m_fallbacks;
+    std::atomic<uint64_t> m_failovers;
+};
+
+class CppMySQLManager {
+public:
+    typedef yhchaos::RWMtx MtxType;
+
     CppMySQLManager();
     ~CppMySQLManager();
 
+    /**
+     * @brief 获取主库连接，配置了副本时同getWrite，归还后当前协程一段时间内读主库
+     */
     CppMySQL::ptr get(const std::string& name);
     void registerCppMySQL(const std::string& name, const std::map<std::string, std::string>& params);
 
+    /**
+     * @brief 获取name的连接池，第一次使用时按mysql.dbs或registerCppMySQL的参数创建
+     */
+    CppMySQLPool::ptr getPool(const std::string& name);
+
+    /**
+     * @brief 获取name的读写分离组，name没有配置replicas时返回nullptr
+     */
+    CppMySQLReplicaGroup::ptr getGroup(const std::string& name);
+
+    /**
+     * @brief 获取读连接，配置了副本时按读写分离选择，否则同get
+     */
+    CppMySQL::ptr getRead(const std::string& name);
+
+    /**
+     * @brief 获取写连接(主库)，配置了副本时归还后当前协程一段时间内读主库
+     */
+    CppMySQL::ptr getWrite(const std::string& name);
+
+    /**
+     * @brief 关闭空闲超过sec秒的连接，并做健康检查
+     */
     void checkClient(int sec = 30);
 
+    /**
+     * @brief 在当前IOCoScheduler中启动定时健康检查
+     * @details get第一次在IOCoScheduler中调用时按mysql.pool.check_interval自动启动
+     */
+    void startChecker(uint64_t interval_ms);
+
+    std::ostream& dump(std::ostream& os);
+
     uint32_t getMaxConn() const { return m_maxConn;}
     void setMaxConn(uint32_t v) { m_maxConn = v;}
 
@@ -299,15 +801,174 @@ public:
     IMySQLData::ptr query(const std::string& name, const std::string& sql);
 
     CppMySQLTransaction::ptr openTransaction(const std::string& name, bool auto_commit);
-private:
-    void freeCppMySQL(const std::string& name, CppMySQL* m);
+
+    /**
+     * @brief 所有连接的预处理语句缓存命中和未命中次数
+     */
+    void getStmtCacheInfo(uint64_t& hits, uint64_t& misses);
 private:
     uint32_t m_maxConn;//10
     MtxType m_mutex;
-    std::map<std::string, std::list<CppMySQL*> > m_conns;
+    //每个数据库一个连接池，池内的锁互相独立
+    std::map<std::string, CppMySQLPool::ptr> m_pools;
+    //读写分离组，没有副本的库保存nullptr
+    std::map<std::string, CppMySQLReplicaGroup::ptr> m_groups;
     std::map<std::string, std::map<std::string, std::string> > m_dbDefines;
+    std::shared_ptr<TimedCoroutine> m_checker;
+};
+
+/**
+ * @brief 批量插入
+ * @details 同一个INSERT模板的行累积到一条多行的INSERT ... VALUES (...),(...)中，
+ *          语句长度超过max_allowed_packet前执行；
+ *          可以启动定时器，最早的行等待超过指定时间时执行；
+ *          add从连接池取一个连接，按连接的字符集和sql_mode转义到线程的缓冲区，不持有锁
+ */
+class CppMySQLBatch : public std::enable_shared_from_this<CppMySQLBatch> {
+public:
+    typedef std::shared_ptr<CppMySQLBatch> ptr;
+    typedef yhchaos::Mtx MtxType;
+
+    /**
+     * @brief 构造函数
+     * @param[in] name CppMySQLMgr中的数据库名
+     * @param[in] insert_sql 不包含VALUES的插入语句，如"INSERT INTO t(a, b)"
+     * @param[in] on_duplicate ON DUPLICATE KEY UPDATE之后的部分，如"b = VALUES(b)"，为空不加
+     * @param[in] max_bytes 一条语句的最大长度，0表示使用服务器的max_allowed_packet(第一次add时查询，按数据库名缓存)
+     */
+    CppMySQLBatch(const std::string& name, const std::string& insert_sql
+                  ,const std::string& on_duplicate = "", size_t max_bytes = 0);
+
+    /**
+     * @brief 析构函数，不执行剩余的行
+     * @details 剩余的行需要在析构前调用flush()或stopFlusher()执行，否则丢弃并打印错误日志
+     */
+    ~CppMySQLBatch();
+
+    /**
+     * @brief 添加一行，值的个数和顺序和insert_sql中的列一致
+     * @details 支持整数(包括bool)，浮点数，字符串，CppMySQLTime，nullptr(NULL)；
+     *          CppMySQLTime总是写入FROM_UNIXTIME(ts)，NULL需要显式传nullptr
+     * @return 返回0表示已缓存，>0表示触发了一次执行，返回该批的影响行数，-1表示获取连接或执行失败
+     */
+    template<typename... Args>
+    int64_t add(const Args&... args);
+
+    /**
+     * @brief 执行缓存的行
+     * @return 返回影响行数，没有缓存的行返回0，失败返回-1
+     */
+    int64_t flush();
+
+    /**
+     * @brief 在当前IOCoScheduler中启动定时器，最早的行等待超过max_age_ms时执行
+     */
+    void startFlusher(uint64_t max_age_ms);
+
+    /**
+     * @brief 停止定时器并执行缓存的行
+     */
+    void stopFlusher();
+
+    size_t getRowCount();
+    uint64_t getFlushCount() const { return m_flushCount;}
+    uint64_t getTotalRows() const { return m_totalRows;}
+    uint64_t getTotalAffected() const { return m_totalAffected;}
+    uint64_t getErrorCount() const { return m_errorCount;}
+
+    /**
+     * @brief 把字符串转换为带单引号的SQL字面量追加到out
+     * @details 使用mysql_real_escape_string_quote，按连接的字符集和NO_BACKSLASH_ESCAPES转义
+     */
+    static void Escape(MYSQL* mysql, std::string& out, const char* str, size_t len);
+private:
+    //整数，包括bool(0/1)
+    template<typename T>
+    static typename std::enable_if<std::is_integral<T>::value>::type
+    Append(MYSQL* mysql, std::string& out, T v) {
+        if(std::is_signed<T>::value) {
+            AppendInt(out, (int64_t)v);
+        } else {
+            AppendUint(out, (uint64_t)v);
+        }
+    }
+
+    //浮点数，按类型的有效位数输出
+    template<typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    Append(MYSQL* mysql, std::string& out, T v) {
+        AppendDouble(out, (double)v, std::numeric_limits<T>::max_digits10);
+    }
+
+    static void Append(MYSQL* mysql, std::string& out, const char* v);
+    static void Append(MYSQL* mysql, std::string& out, const std::string& v);
+    static void Append(MYSQL* mysql, std::string& out, std::nullptr_t v);
+    //FROM_UNIXTIME(ts)
+    static void Append(MYSQL* mysql, std::string& out, const CppMySQLTime& v);
+
+    static void AppendInt(std::string& out, int64_t v);
+    static void AppendUint(std::string& out, uint64_t v);
+    static void AppendDouble(std::string& out, double v, int digits);
+
+    static void AppendValues(MYSQL* mysql, std::string& out) {}
+
+    template<typename Head, typename... Tail>
+    static void AppendValues(MYSQL* mysql, std::string& out, const Head& head, const Tail&... tail) {
+        if(out.size() > 1) {
+            out.push_back(',');
+        }
+        Append(mysql, out, head);
+        AppendValues(mysql, out, tail...);
+    }
+
+    //当前线程转义一行的缓冲区
+    static std::string& GetRowBuffer();
+
+    //从连接池获取连接，第一次调用时查询max_allowed_packet
+    CppMySQL::ptr getConn();
+    int64_t addRow(CppMySQL::ptr conn, const std::string& row);
+    int64_t execute(CppMySQL::ptr conn, const std::string& sql, size_t rows);
+    //查询服务器的max_allowed_packet，按数据库名缓存
+    static size_t GetServerMaxBytes(CppMySQL::ptr conn, const std::string& name);
+    //定时器回调
+    void onTimer();
+private:
+    std::string m_name;
+    //"INSERT INTO t(a, b) VALUES "
+    std::string m_prefix;
+    //" ON DUPLICATE KEY UPDATE ..."
+    std::string m_suffix;
+    //0表示还没有查询服务器的max_allowed_packet
+    std::atomic<size_t> m_maxBytes;
+    uint64_t m_maxAge;
+
+    MtxType m_mutex;
+    std::string m_buffer;
+    size_t m_rows;
+    //第一行加入的时间
+    uint64_t m_firstTime;
+    std::shared_ptr<TimedCoroutine> m_timer;
+
+    std::atomic<uint64_t> m_flushCount;
+    std::atomic<uint64_t> m_totalRows;
+    std::atomic<uint64_t> m_totalAffected;
+    std::atomic<uint64_t> m_errorCount;
 };
 
+template<typename... Args>
+int64_t CppMySQLBatch::add(const Args&... args) {
+    auto conn = getConn();
+    if(!conn) {
+        return -1;
+    }
+    std::string& row = GetRowBuffer();
+    row.clear();
+    row.push_back('(');
+    AppendValues(conn->getRaw().get(), row, args...);
+    row.push_back(')');
+    return addRow(conn, row);
+}
+
 class CppMySQLUtil {
 public:
     static IMySQLData::ptr Query(const std::string& name, const char* format, ...);
@@ -343,7 +1004,7 @@ int bindX(CppMySQLStmt::ptr stmt, Args&... args) {
 
 template<typename... Args>
 int CppMySQL::execStmt(const char* stmt, Args&&... args) {
-    auto st = CppMySQLStmt::Create(shared_from_this(), stmt);
+    auto st = getStmt(stmt);
     if(!st) {
         return -1;
     }
@@ -351,12 +1012,38 @@ int CppMySQL::execStmt(const char* stmt, Args&&... args) {
     if(rt != 0) {
         return rt;
     }
-    return st->execute();
+    rt = st->execute();
+    if(rt != 0) {
+        onStmtError(stmt, st->getErrno());
+    }
+    return rt;
 }
 
 template<class... Args>
 IMySQLData::ptr CppMySQL::queryStmt(const char* stmt, Args&&... args) {
-    auto st = CppMySQLStmt::Create(shared_from_this(), stmt);
+    return doQueryStmt(false, stmt, args...);
+}
+
+template<class... Args>
+IMySQLData::ptr CppMySQL::queryStmtStream(const char* stmt, Args&&... args) {
+    return doQueryStmt(true, stmt, args...);
+}
+
+template<class... Args>
+int CppMySQLStmtFetcher::execute(Args&&... args) {
+    if(!m_stmt) {
+        return m_errno;
+    }
+    int rt = bindX(m_stmt, args...);
+    if(rt != 0) {
+        return m_errno = rt;
+    }
+    return doExecute();
+}
+
+template<class... Args>
+IMySQLData::ptr CppMySQL::doQueryStmt(bool stream, const char* stmt, Args&... args) {
+    auto st = getStmt(stmt);
     if(!st) {
         return nullptr;
     }
@@ -364,7 +1051,17 @@ IMySQLData::ptr CppMySQL::queryStmt(const char* stmt, Args&&... args) {
     if(rt != 0) {
         return nullptr;
     }
-    return st->query();
+    auto res = std::static_pointer_cast<CppMySQLStmtRes>(stream ? st->queryStream() : st->query());
+    if(!res) {
+        onStmtError(stmt, st->getErrno());
+        return nullptr;
+    }
+    if(res->getErrno()) {
+        onStmtError(stmt, res->getErrno());
+    }
+    //缓存的语句不持有连接，结果集释放前连接不回到连接池
+    CppMySQL::ptr self = shared_from_this();
+    return IMySQLData::ptr(res.get(), [res, self](IMySQLData*) {});
 }
 
 namespace {
@@ -406,19 +1103,28 @@ struct CppMySQLBinder<N, type, Tail...> { \
 //    }
 //};
 
-XX(char*, char*);
-XX(const char*, char*);
-XX(std::string, std::string&);
-XX(int8_t, int8_t&);
-XX(uint8_t, uint8_t&);
-XX(int16_t, int16_t&);
-XX(uint16_t, uint16_t&);
-XX(int32_t, int32_t&);
-XX(uint32_t, uint32_t&);
-XX(int64_t, int64_t&);
-XX(uint64_t, uint64_t&);
-XX(float, float&);
-XX(double, double&);
+//参数是const引用，const的变量(如orm生成的代码中const对象的字段)也可以绑定
+#define YY(type) \
+XX(type, const type&); \
+template<size_t N, typename... Tail> \
+struct CppMySQLBinder<N, const type, Tail...> \
+    : public CppMySQLBinder<N, type, Tail...> { \
+};
+
+XX(char*, const char*);
+XX(const char*, const char*);
+YY(std::string);
+YY(int8_t);
+YY(uint8_t);
+YY(int16_t);
+YY(uint16_t);
+YY(int32_t);
+YY(uint32_t);
+YY(int64_t);
+YY(uint64_t);
+YY(float);
+YY(double);
+#undef YY
 //XX(MYSQL_TIME, MYSQL_TIME&);
 #undef XX
 }
@@ -1,6 +1,7 @@
 #include "cpp_redis.h"
 #include "yhchaos/yhchaos.h"
 #include "yhchaos/log.h"
+#include <random>
 
 namespace yhchaos {
 
@@ -385,10 +386,142 @@ int CppRedisCluster::appendCmd(const std::vector<std::string>& argv) {
     return redisClusterAppendCommandArg(m_context.get(), argv.size(), &v[0], &l[0]);
 }
 
+//IOCoScheduler模式的WatchCppThread上的hiredis异步事件适配，同adapters/libevent.h
+//IOCoScheduler的fd事件触发一次就删除，需要继续监听时重新添加；
+//删除后重新添加时增加gen，忽略删除前已经触发、还没执行的事件
+struct CppRedisIOEvents {
+    typedef std::shared_ptr<CppRedisIOEvents> ptr;
+    redisAsyncContext* ctx = nullptr;
+    yhchaos::WatchCppThread* thread = nullptr;
+    int fd = -1;
+    bool reading = false;
+    bool writing = false;
+    bool readArmed = false;
+    bool writeArmed = false;
+    uint64_t readGen = 0;
+    uint64_t writeGen = 0;
+    //ctx->ev.data是裸指针，cleanup之前保持自己不被释放
+    ptr self;
+};
+
+static void CppRedisIOArm(CppRedisIOEvents::ptr e, yhchaos::IOCoScheduler::FdEvent event);
+
+static void CppRedisIOOnEvent(CppRedisIOEvents::ptr e, yhchaos::IOCoScheduler::FdEvent event
+                              ,uint64_t gen) {
+    bool read = event == yhchaos::IOCoScheduler::READ;
+    if(!e->ctx || gen != (read ? e->readGen : e->writeGen)) {
+        return;
+    }
+    if(read) {
+        e->readArmed = false;
+        redisAsyncHandleRead(e->ctx);
+        //处理过程中ctx可能被释放(cleanup)
+        if(e->ctx && e->reading) {
+            CppRedisIOArm(e, event);
+        }
+    } else {
+        e->writeArmed = false;
+        redisAsyncHandleWrite(e->ctx);
+        if(e->ctx && e->writing) {
+            CppRedisIOArm(e, event);
+        }
+    }
+}
+
+static void CppRedisIOArm(CppRedisIOEvents::ptr e, yhchaos::IOCoScheduler::FdEvent event) {
+    bool read = event == yhchaos::IOCoScheduler::READ;
+    bool& armed = read ? e->readArmed : e->writeArmed;
+    if(armed) {
+        return;
+    }
+    uint64_t gen = read ? ++e->readGen : ++e->writeGen;
+    armed = e->thread->addFdEvent(e->fd, event, std::bind(CppRedisIOOnEvent, e, event, gen));
+    if(!armed) {
+        YHCHAOS_LOG_ERROR(g_logger) << "redis addFdEvent fail fd=" << e->fd << " event=" << event;
+    }
+}
+
+static void CppRedisIODisarm(CppRedisIOEvents* e, yhchaos::IOCoScheduler::FdEvent event) {
+    bool read = event == yhchaos::IOCoScheduler::READ;
+    bool& armed = read ? e->readArmed : e->writeArmed;
+    if(armed) {
+        e->thread->delFdEvent(e->fd, event);
+        armed = false;
+        ++(read ? e->readGen : e->writeGen);
+    }
+}
+
+static void CppRedisIOAddRead(void* privdata) {
+    CppRedisIOEvents* e = static_cast<CppRedisIOEvents*>(privdata);
+    e->reading = true;
+    CppRedisIOArm(e->self, yhchaos::IOCoScheduler::READ);
+}
+
+static void CppRedisIODelRead(void* privdata) {
+    CppRedisIOEvents* e = static_cast<CppRedisIOEvents*>(privdata);
+    e->reading = false;
+    CppRedisIODisarm(e, yhchaos::IOCoScheduler::READ);
+}
+
+static void CppRedisIOAddWrite(void* privdata) {
+    CppRedisIOEvents* e = static_cast<CppRedisIOEvents*>(privdata);
+    e->writing = true;
+    CppRedisIOArm(e->self, yhchaos::IOCoScheduler::WRITE);
+}
+
+static void CppRedisIODelWrite(void* privdata) {
+    CppRedisIOEvents* e = static_cast<CppRedisIOEvents*>(privdata);
+    e->writing = false;
+    CppRedisIODisarm(e, yhchaos::IOCoScheduler::WRITE);
+}
+
+static void CppRedisIOCleanup(void* privdata) {
+    CppRedisIOEvents::ptr e = static_cast<CppRedisIOEvents*>(privdata)->self;
+    CppRedisIODelRead(e.get());
+    CppRedisIODelWrite(e.get());
+    e->ctx = nullptr;
+    e->self = nullptr;
+}
+
+//libevent模式用redisLibeventAttach，IOCoScheduler模式在thread所在的IOCoScheduler中监听
+static int CppRedisAttach(redisAsyncContext* ac, yhchaos::WatchCppThread* thread) {
+    if(thread->getBase()) {
+        return redisLibeventAttach(ac, thread->getBase());
+    }
+    if(ac->ev.data) {
+        return REDIS_ERR;
+    }
+    CppRedisIOEvents::ptr e = std::make_shared<CppRedisIOEvents>();
+    e->ctx = ac;
+    e->thread = thread;
+    e->fd = ac->c.fd;
+    e->self = e;
+    ac->ev.addRead = CppRedisIOAddRead;
+    ac->ev.delRead = CppRedisIODelRead;
+    ac->ev.addWrite = CppRedisIOAddWrite;
+    ac->ev.delWrite = CppRedisIODelWrite;
+    ac->ev.cleanup = CppRedisIOCleanup;
+    ac->ev.data = e.get();
+    return REDIS_OK;
+}
+
+//集群连接到各个节点时调用
+static int CppRedisAttachLink(redisAsyncContext* ac, void* thread) {
+    return CppRedisAttach(ac, static_cast<yhchaos::WatchCppThread*>(thread));
+}
+
+static int CppRedisClusterAttach(redisClusterAsyncContext* acc, yhchaos::WatchCppThread* thread) {
+    if(thread->getBase()) {
+        return redisClusterLibeventAttach(acc, thread->getBase());
+    }
+    acc->adapter = thread;
+    acc->attach_fn = CppRedisAttachLink;
+    return REDIS_OK;
+}
+
 FoxCppRedis::FoxCppRedis(yhchaos::WatchCppThread* thr, const std::map<std::string, std::string>& conf)
     :m_thread(thr)
-    ,m_status(UNCONNECTED)
-    ,m_event(nullptr) {
+    ,m_status(UNCONNECTED) {
     m_type = ICppRedis::FOX_REDIS;
     auto tmp = get_value(conf, "host");
     auto pos = tmp.find(":");
@@ -586,17 +719,15 @@ bool FoxCppRedis::pinit() {
     }
     ctx->data = this;
     //让redis的事件在m_thread创建的线程中进行监听，当事件发生时调用相应的处理函数，这里是ConnectCb
-    redisLibeventAttach(ctx, m_thread->getBase());
+    CppRedisAttach(ctx, m_thread);
     redisAsyncSetConnectCallback(ctx, ConnectCb);
     redisAsyncSetDisconnectCallback(ctx, DisconnectCb);
     m_status = CONNECTING;
     //m_context.reset(ctx, redisAsyncFree);
     m_context.reset(ctx, yhchaos::nop<redisAsyncContext>);
     //m_context.reset(ctx, std::bind(&FoxCppRedis::delayDelete, this, std::placeholders::_1));
-    if(m_event == nullptr) {
-        m_event = event_new(m_thread->getBase(), -1, EV_TIMEOUT | EV_PERSIST, TimeCb, this);
-        struct timeval tv = {120, 0};
-        evtimer_add(m_event, &tv);
+    if(!m_timer) {
+        m_timer = m_thread->addTimer(120 * 1000, std::bind(&FoxCppRedis::TimeCb, 0, 0, this), true);
     }
     TimeCb(0, 0, this);
     return true;
@@ -707,15 +838,13 @@ void FoxCppRedis::pcmd(FCtx* fctx) {
 }
 
 FoxCppRedis::~FoxCppRedis() {
-    if(m_event) {
-        evtimer_del(m_event);
-        event_free(m_event);
+    if(m_timer) {
+        m_timer->cancel();
     }
 }
 
 FoxCppRedis::Ctx::Ctx(FoxCppRedis* r)
-    :ev(nullptr)
-    ,timeout(false)
+    :timeout(false)
     ,rds(r)
     //,coscheduler(nullptr)
     ,thread(nullptr) {
@@ -729,10 +858,9 @@ FoxCppRedis::Ctx::~Ctx() {
     yhchaos::Atomic::subFetch(rds->m_ctxCount, 1);
     //++destory;
     //cancelFdEvent();
-    if(ev) {
-        evtimer_del(ev);
-        event_free(ev);
-        ev = nullptr;
+    if(timer) {
+        timer->cancel();
+        timer = nullptr;
     }
 
 }
@@ -755,8 +883,8 @@ void FoxCppRedis::Ctx::cancelFdEvent() {
 }
 
 bool FoxCppRedis::Ctx::init() {
-    ev = evtimer_new(rds->m_thread->getBase(), FdEventCb, this);
-    evtimer_add(ev, &rds->m_cmdTimeout);
+    timer = thread->addTimer(rds->m_cmdTimeout.tv_sec * 1000 + rds->m_cmdTimeout.tv_usec / 1000
+                             ,std::bind(&Ctx::FdEventCb, 0, 0, this));
     return true;
 }
 
@@ -778,8 +906,7 @@ void FoxCppRedis::Ctx::FdEventCb(int fd, short event, void* d) {
 
 FoxCppRedisCluster::FoxCppRedisCluster(yhchaos::WatchCppThread* thr, const std::map<std::string, std::string>& conf)
     :m_thread(thr)
-    ,m_status(UNCONNECTED)
-    ,m_event(nullptr) {
+    ,m_status(UNCONNECTED) {
     m_ctxCount = 0;
 
     m_type = ICppRedis::FOX_REDIS_CLUSTER;
@@ -942,7 +1069,7 @@ bool FoxCppRedisCluster::pinit() {
     YHCHAOS_LOG_INFO(g_logger) << "FoxCppRedisCluster pinit:" << m_host;
     auto ctx = redisClusterAsyncConnect(m_host.c_str(), 0);
     ctx->data = this;
-    redisClusterLibeventAttach(ctx, m_thread->getBase());
+    CppRedisClusterAttach(ctx, m_thread);
     redisClusterAsyncSetConnectCallback(ctx, ConnectCb);
     redisClusterAsyncSetDisconnectCallback(ctx, DisconnectCb);
     if(!ctx) {
@@ -959,10 +1086,8 @@ bool FoxCppRedisCluster::pinit() {
     //m_context.reset(ctx, redisAsyncFree);
     m_context.reset(ctx, yhchaos::nop<redisClusterAsyncContext>);
     //m_context.reset(ctx, std::bind(&FoxCppRedisCluster::delayDelete, this, std::placeholders::_1));
-    if(m_event == nullptr) {
-        m_event = event_new(m_thread->getBase(), -1, EV_TIMEOUT | EV_PERSIST, TimeCb, this);
-        struct timeval tv = {120, 0};
-        evtimer_add(m_event, &tv);
+    if(!m_timer) {
+        m_timer = m_thread->addTimer(120 * 1000, std::bind(&FoxCppRedisCluster::TimeCb, 0, 0, this), true);
         TimeCb(0, 0, this);
     }
     return true;
@@ -1065,15 +1190,13 @@ void FoxCppRedisCluster::pcmd(FCtx* fctx) {
 }
 
 FoxCppRedisCluster::~FoxCppRedisCluster() {
-    if(m_event) {
-        evtimer_del(m_event);
-        event_free(m_event);
+    if(m_timer) {
+        m_timer->cancel();
     }
 }
 
 FoxCppRedisCluster::Ctx::Ctx(FoxCppRedisCluster* r)
-    :ev(nullptr)
-    ,timeout(false)
+    :timeout(false)
     ,rds(r)
     //,coscheduler(nullptr)
     ,thread(nullptr) {
@@ -1091,10 +1214,9 @@ FoxCppRedisCluster::Ctx::~Ctx() {
     //++destory;
     //cancelFdEvent();
 
-    if(ev) {
-        evtimer_del(ev);
-        event_free(ev);
-        ev = nullptr;
+    if(timer) {
+        timer->cancel();
+        timer = nullptr;
     }
 }
 
@@ -1143,14 +1265,14 @@ void FoxCppRedisCluster::Ctx::cancelFdEvent() {
 
 bool FoxCppRedisCluster::Ctx::init() {
     YHCHAOS_ASSERT(thread == yhchaos::WatchCppThread::GetThis());
-    ev = evtimer_new(rds->m_thread->getBase(), FdEventCb, this);
-    evtimer_add(ev, &rds->m_cmdTimeout);
+    timer = thread->addTimer(rds->m_cmdTimeout.tv_sec * 1000 + rds->m_cmdTimeout.tv_usec / 1000
+                             ,std::bind(&Ctx::FdEventCb, 0, 0, this));
     return true;
 }
 
 void FoxCppRedisCluster::Ctx::FdEventCb(int fd, short event, void* d) {
     Ctx* ctx = static_cast<Ctx*>(d);
-    if(!ctx->ev) {
+    if(!ctx->timer) {
         return;
     }
     ctx->timeout = 1;
@@ -1169,6 +1291,1096 @@ void FoxCppRedisCluster::Ctx::FdEventCb(int fd, short event, void* d) {
     //ctx->tref = nullptr;
 }
 
+CppRedisNearCache::CppRedisNearCache(size_t max_count)
+    :m_maxCount(std::max((size_t)1, max_count / SHARD_COUNT))
+    ,m_enabled(true)
+    ,m_hits(0)
+    ,m_misses(0) {
+}
+
+CppRedisNearCache::Shard& CppRedisNearCache::getShard(const std::string& key) {
+    return m_shards[std::hash<std::string>()(key) % SHARD_COUNT];
+}
+
+ReplyPtr CppRedisNearCache::get(const std::string& key) {
+    if(!m_enabled) {
+        return nullptr;
+    }
+    Shard& shard = getShard(key);
+    {
+        yhchaos::Mtx::Lock lock(shard.mutex);
+        auto it = shard.items.find(key);
+        if(it != shard.items.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            ++m_hits;
+            return it->second->second;
+        }
+    }
+    ++m_misses;
+    return nullptr;
+}
+
+uint64_t CppRedisNearCache::getVersion(const std::string& key) {
+    Shard& shard = getShard(key);
+    yhchaos::Mtx::Lock lock(shard.mutex);
+    return shard.version;
+}
+
+void CppRedisNearCache::set(const std::string& key, ReplyPtr rpy, uint64_t version) {
+    if(!m_enabled) {
+        return;
+    }
+    Shard& shard = getShard(key);
+    yhchaos::Mtx::Lock lock(shard.mutex);
+    //请求发出后分片中有key失效了，回复可能是旧值，不缓存
+    if(shard.version != version) {
+        return;
+    }
+    auto it = shard.items.find(key);
+    if(it != shard.items.end()) {
+        it->second->second = rpy;
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+    shard.lru.push_front(std::make_pair(key, rpy));
+    shard.items[key] = shard.lru.begin();
+    while(shard.items.size() > m_maxCount) {
+        shard.items.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+    }
+}
+
+void CppRedisNearCache::del(const std::string& key) {
+    Shard& shard = getShard(key);
+    yhchaos::Mtx::Lock lock(shard.mutex);
+    ++shard.version;
+    auto it = shard.items.find(key);
+    if(it != shard.items.end()) {
+        shard.lru.erase(it->second);
+        shard.items.erase(it);
+    }
+}
+
+void CppRedisNearCache::clear() {
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        yhchaos::Mtx::Lock lock(m_shards[i].mutex);
+        ++m_shards[i].version;
+        m_shards[i].lru.clear();
+        m_shards[i].items.clear();
+    }
+}
+
+size_t CppRedisNearCache::getCount() {
+    size_t count = 0;
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        yhchaos::Mtx::Lock lock(m_shards[i].mutex);
+        count += m_shards[i].items.size();
+    }
+    return count;
+}
+
+void CppRedisNearCache::setEnabled(bool v) {
+    m_enabled = v;
+    if(!v) {
+        clear();
+    }
+}
+
+CoCppRedis::CoCppRedis(const std::map<std::string, std::string>& conf) {
+    m_type = ICppRedis::CO_REDIS;
+    auto tmp = get_value(conf, "host");
+    auto pos = tmp.find(":");
+    m_host = tmp.substr(0, pos);
+    m_port = yhchaos::TypeUtil::Atoi(tmp.substr(pos + 1));
+    m_passwd = get_value(conf, "passwd");
+    m_logEnable = yhchaos::TypeUtil::Atoi(get_value(conf, "log_enable", "1"));
+
+    tmp = get_value(conf, "timeout_com");
+    if(tmp.empty()) {
+        tmp = get_value(conf, "timeout");
+    }
+    m_cmdTimeout = yhchaos::TypeUtil::Atoi(tmp);
+    tmp = get_value(conf, "timeout_connect");
+    m_connectTimeout = tmp.empty() ? m_cmdTimeout : yhchaos::TypeUtil::Atoi(tmp);
+}
+
+CoCppRedis::~CoCppRedis() {
+    close();
+}
+
+ReplyPtr CoCppRedis::cmd(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    auto r = cmd(fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+ReplyPtr CoCppRedis::cmd(const char* fmt, va_list ap) {
+    char* buf = nullptr;
+    int len = redisvFormatCommand(&buf, fmt, ap);
+    if(len == -1 || !buf) {
+        YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error: " << fmt;
+        return nullptr;
+    }
+    std::string cmd(buf, len);
+    free(buf);
+    return pcmd(cmd);
+}
+
+ReplyPtr CoCppRedis::cmd(const std::vector<std::string>& argv) {
+    std::string cmd = FormatCommand(argv);
+    if(cmd.empty()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error";
+        return nullptr;
+    }
+    return pcmd(cmd);
+}
+
+ReplyPtr CoCppRedis::pcmd(const std::string& cmd, Conn::ptr conn) {
+    std::vector<ReplyPtr> rpys;
+    send(cmd, 1, rpys, conn);
+    ReplyPtr rpy = rpys.empty() ? nullptr : rpys[0];
+    if(!rpy) {
+        if(m_logEnable) {
+            std::string tmp = cmd;
+            yhchaos::replace(tmp, "\r\n", "\\r\\n");
+            YHCHAOS_LOG_ERROR(g_logger) << "redis cmd: '" << tmp << "' fail ("
+                << m_host << ":" << m_port << ", " << m_name << ")";
+        }
+        return nullptr;
+    }
+    if(rpy->type == REDIS_REPLY_ERROR) {
+        if(m_logEnable) {
+            std::string tmp = cmd;
+            yhchaos::replace(tmp, "\r\n", "\\r\\n");
+            YHCHAOS_LOG_ERROR(g_logger) << "redis cmd: '" << tmp << "' reply: "
+                << rpy->str << " (" << m_host << ":" << m_port << ", " << m_name << ")";
+        }
+        return nullptr;
+    }
+    return rpy;
+}
+
+std::vector<ReplyPtr> CoCppRedis::pipeline(const std::vector<std::vector<std::string> >& cmds) {
+    std::string buf;
+    for(auto& argv : cmds) {
+        std::string cmd = FormatCommand(argv);
+        if(cmd.empty()) {
+            YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error";
+            return std::vector<ReplyPtr>(cmds.size());
+        }
+        buf.append(cmd);
+    }
+    std::vector<ReplyPtr> rpys;
+    send(buf, cmds.size(), rpys);
+    return rpys;
+}
+
+ReplyPtr CoCppRedis::cachedGet(const std::string& key) {
+    std::string cmd = FormatCommand({"GET", key});
+    if(!yhchaos::IOCoScheduler::GetThis()) {
+        return pcmd(cmd);
+    }
+    Conn::ptr conn = getConn();
+    if(!conn) {
+        return nullptr;
+    }
+    //连接关闭时清空缓存并增加版本号，回复到达前连接断开的不会写入缓存
+    CppRedisNearCache::ptr cache = conn->trackSock ? conn->nearCache : nullptr;
+    uint64_t version = 0;
+    if(cache) {
+        auto rt = cache->get(key);
+        if(rt) {
+            return rt;
+        }
+        version = cache->getVersion(key);
+    }
+    ReplyPtr rpy = pcmd(cmd, conn);
+    if(rpy && cache) {
+        cache->set(key, rpy, version);
+    }
+    return rpy;
+}
+
+std::string CoCppRedis::FormatCommand(const std::vector<std::string>& argv) {
+    if(argv.empty()) {
+        return "";
+    }
+    std::vector<const char*> args;
+    std::vector<size_t> args_len;
+    for(auto& i : argv) {
+        args.push_back(i.c_str());
+        args_len.push_back(i.size());
+    }
+    char* buf = nullptr;
+    int len = redisFormatCommandArgv(&buf, argv.size(), &(args[0]), &(args_len[0]));
+    if(len == -1 || !buf) {
+        return "";
+    }
+    std::string cmd(buf, len);
+    free(buf);
+    return cmd;
+}
+
+void CoCppRedis::send(const std::string& cmds, size_t count, std::vector<ReplyPtr>& rpys
+                      ,Conn::ptr conn) {
+    rpys.resize(count);
+    if(!yhchaos::IOCoScheduler::GetThis()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis cmd must run in IOCoScheduler ("
+            << m_host << ":" << m_port << ", " << m_name << ")";
+        return;
+    }
+    if(!conn) {
+        conn = getConn();
+    }
+    if(!conn) {
+        return;
+    }
+    std::vector<FCtx::ptr> ctxs;
+    for(size_t i = 0; i < count; ++i) {
+        ctxs.push_back(std::make_shared<FCtx>());
+    }
+    bool writer = false;
+    {
+        yhchaos::Mtx::Lock lock(conn->mutex);
+        if(conn->closed) {
+            return;
+        }
+        //回复的顺序和进入发送缓冲区的顺序一致，同一批命令连续排列
+        uint64_t now = yhchaos::GetCurrentMS();
+        for(auto& i : ctxs) {
+            i->sendTime = now;
+            conn->waits.push_back(i);
+        }
+        conn->sendBuf.append(cmds);
+        if(!conn->writing) {
+            conn->writing = true;
+            writer = true;
+        }
+    }
+    //没有协程在发送时由当前协程发送，否则由正在发送的协程一起发出去
+    if(writer) {
+        Flush(conn);
+    }
+    for(size_t i = 0; i < count; ++i) {
+        ctxs[i]->sem.wait();
+        rpys[i] = ctxs[i]->rpy;
+    }
+}
+
+CoCppRedis::Conn::ptr CoCppRedis::getConn() {
+    Connecting::ptr connecting;
+    {
+        yhchaos::Mtx::Lock lock(m_mutex);
+        if(m_conn) {
+            yhchaos::Mtx::Lock lock2(m_conn->mutex);
+            if(!m_conn->closed) {
+                return m_conn;
+            }
+        }
+        if(m_connecting) {
+            ++m_connecting->waiters;
+            connecting = m_connecting;
+        } else {
+            m_connecting = std::make_shared<Connecting>();
+        }
+    }
+    if(connecting) {
+        connecting->sem.wait();
+        return connecting->conn;
+    }
+
+    Conn::ptr conn = connect();
+    uint32_t waiters = 0;
+    {
+        yhchaos::Mtx::Lock lock(m_mutex);
+        if(conn) {
+            m_conn = conn;
+        }
+        connecting.swap(m_connecting);
+        connecting->conn = conn;
+        waiters = connecting->waiters;
+    }
+    for(uint32_t i = 0; i < waiters; ++i) {
+        connecting->sem.notify();
+    }
+    return conn;
+}
+
+//同步读取一个回复，只在连接建立时使用
+static ReplyPtr read_reply(Sock::ptr sock, redisReader* reader) {
+    char buf[1024];
+    while(true) {
+        void* r = nullptr;
+        if(redisReaderGetReply(reader, &r) != REDIS_OK) {
+            return nullptr;
+        }
+        if(r) {
+            return ReplyPtr((redisReply*)r, freeReplyObject);
+        }
+        int rt = sock->recv(buf, sizeof(buf));
+        if(rt <= 0 || redisReaderFeed(reader, buf, rt) != REDIS_OK) {
+            return nullptr;
+        }
+    }
+}
+
+//同步执行一个命令，只在连接建立时使用
+static ReplyPtr sync_cmd(Sock::ptr sock, const std::vector<std::string>& argv) {
+    std::string cmd = CoCppRedis::FormatCommand(argv);
+    if(cmd.empty() || sock->send(cmd.c_str(), cmd.size()) != (int)cmd.size()) {
+        return nullptr;
+    }
+    redisReader* reader = redisReaderCreate();
+    ReplyPtr rpy = read_reply(sock, reader);
+    redisReaderFree(reader);
+    return rpy;
+}
+
+Sock::ptr CoCppRedis::connectSock(const std::string& addr_str) {
+    auto addr = yhchaos::NetworkAddress::SearchForAnyIPNetworkAddress(addr_str);
+    if(!addr) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis invalid host: " << addr_str;
+        return nullptr;
+    }
+    Sock::ptr sock = Sock::CreateTCP(addr);
+    if(!sock->connect(addr, m_connectTimeout ? m_connectTimeout : (uint64_t)-1)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis connect fail: " << addr_str
+            << " (" << m_name << ")";
+        return nullptr;
+    }
+    if(m_cmdTimeout) {
+        sock->setRecvTimeout(m_cmdTimeout);
+        sock->setSendTimeout(m_cmdTimeout);
+    }
+    if(!m_passwd.empty()) {
+        ReplyPtr rpy = sync_cmd(sock, {"AUTH", m_passwd});
+        if(!rpy || rpy->type != REDIS_REPLY_STATUS || strcmp(rpy->str, "OK")) {
+            YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis auth error: " << addr_str
+                << " (" << m_name << ")" << (rpy && rpy->str ? rpy->str : "");
+            return nullptr;
+        }
+    }
+    return sock;
+}
+
+Sock::ptr CoCppRedis::startTracking(Sock::ptr sock, const std::string& addr_str) {
+    //失效通知连接：订阅__redis__:invalidate，数据连接的CLIENT TRACKING重定向到它
+    Sock::ptr track = connectSock(addr_str);
+    if(!track) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis tracking connect fail: " << addr_str
+            << " (" << m_name << ")";
+        return nullptr;
+    }
+    //失效通知连接上没有命令，不设置接收超时
+    track->setRecvTimeout(-1);
+    ReplyPtr id = sync_cmd(track, {"CLIENT", "ID"});
+    ReplyPtr sub = id && id->type == REDIS_REPLY_INTEGER
+            ? sync_cmd(track, {"SUBSCRIBE", "__redis__:invalidate"}) : nullptr;
+    ReplyPtr rpy = sub && sub->type == REDIS_REPLY_ARRAY
+            ? sync_cmd(sock, {"CLIENT", "TRACKING", "on", "REDIRECT", std::to_string(id->integer)})
+            : nullptr;
+    if(!rpy || rpy->type != REDIS_REPLY_STATUS) {
+        track->close();
+        //服务器不支持CLIENT TRACKING(redis 6以下)，客户端缓存不再使用
+        YHCHAOS_LOG_WARN(g_logger) << "CoCppRedis client tracking not supported: " << addr_str
+            << " (" << m_name << ")" << (rpy && rpy->str ? rpy->str : "")
+            << ", near cache disabled";
+        m_nearCache->setEnabled(false);
+        return nullptr;
+    }
+    return track;
+}
+
+CoCppRedis::Conn::ptr CoCppRedis::connect() {
+    std::string addr_str = m_host + ":" + std::to_string(m_port);
+    Sock::ptr sock = connectSock(addr_str);
+    if(!sock) {
+        return nullptr;
+    }
+    Sock::ptr track;
+    if(m_nearCache && m_nearCache->isEnabled()) {
+        track = startTracking(sock, addr_str);
+        //收不到失效通知的连接读到的值会让缓存一直过期，不使用这个连接，下次命令重新连接
+        if(!track && m_nearCache->isEnabled()) {
+            sock->close();
+            return nullptr;
+        }
+    }
+    YHCHAOS_LOG_INFO(g_logger) << "CoCppRedis connect " << addr_str
+        << " success (" << m_name << ")" << (track ? " tracking" : "");
+
+    Conn::ptr conn = std::make_shared<Conn>();
+    conn->sock = sock;
+    conn->addr = addr_str;
+    conn->timeout = m_cmdTimeout;
+    conn->logEnable = m_logEnable;
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    if(track) {
+        conn->trackSock = track;
+        conn->nearCache = m_nearCache;
+        iom->coschedule(std::bind(&CoCppRedis::Track, conn));
+    }
+    iom->coschedule(std::bind(&CoCppRedis::Read, conn));
+    return conn;
+}
+
+void CoCppRedis::Track(Conn::ptr conn) {
+    redisReader* reader = redisReaderCreate();
+    std::vector<char> buf(16 * 1024);
+    std::string reason;
+    while(reason.empty()) {
+        int rt = conn->trackSock->recv(&buf[0], buf.size());
+        if(rt <= 0) {
+            reason = "tracking connection closed";
+            break;
+        }
+        if(redisReaderFeed(reader, &buf[0], rt) != REDIS_OK) {
+            reason = "tracking feed fail";
+            break;
+        }
+        while(true) {
+            void* r = nullptr;
+            if(redisReaderGetReply(reader, &r) != REDIS_OK) {
+                reason = "tracking protocol error";
+                break;
+            }
+            if(!r) {
+                break;
+            }
+            //["message", "__redis__:invalidate", [key...]]，key为nil表示FLUSHALL
+            ReplyPtr rpy((redisReply*)r, freeReplyObject);
+            if(rpy->type != REDIS_REPLY_ARRAY || rpy->elements != 3
+                    || rpy->element[0]->type != REDIS_REPLY_STRING
+                    || strcmp(rpy->element[0]->str, "message")) {
+                continue;
+            }
+            redisReply* keys = rpy->element[2];
+            if(keys->type == REDIS_REPLY_ARRAY) {
+                for(size_t i = 0; i < keys->elements; ++i) {
+                    redisReply* key = keys->element[i];
+                    if(key->type == REDIS_REPLY_STRING) {
+                        conn->nearCache->del(std::string(key->str, key->len));
+                    }
+                }
+            } else if(keys->type == REDIS_REPLY_STRING) {
+                conn->nearCache->del(std::string(keys->str, keys->len));
+            } else {
+                conn->nearCache->clear();
+            }
+        }
+    }
+    redisReaderFree(reader);
+    CloseConn(conn, reason);
+}
+
+void CoCppRedis::Flush(Conn::ptr conn) {
+    std::string buf;
+    while(true) {
+        {
+            yhchaos::Mtx::Lock lock(conn->mutex);
+            if(conn->sendBuf.empty() || conn->closed) {
+                conn->writing = false;
+                return;
+            }
+            buf.swap(conn->sendBuf);
+        }
+        size_t offset = 0;
+        while(offset < buf.size()) {
+            int rt = conn->sock->send(&buf[offset], buf.size() - offset);
+            if(rt <= 0) {
+                CloseConn(conn, "send fail errno=" + std::to_string(errno));
+                return;
+            }
+            offset += rt;
+        }
+        buf.clear();
+    }
+}
+
+void CoCppRedis::Read(Conn::ptr conn) {
+    redisReader* reader = redisReaderCreate();
+    std::vector<char> buf(64 * 1024);
+    std::string reason;
+    //当前设置的接收超时
+    uint64_t recv_timeout = conn->timeout;
+    while(reason.empty()) {
+        if(conn->timeout) {
+            //每次读之前检查最早命令的截止时间，回复分多次慢慢到达时也不会超过超时时间
+            uint64_t wait = conn->timeout;
+            {
+                yhchaos::Mtx::Lock lock(conn->mutex);
+                if(!conn->waits.empty()) {
+                    uint64_t deadline = conn->waits.front()->sendTime + conn->timeout;
+                    uint64_t now = yhchaos::GetCurrentMS();
+                    if(deadline <= now) {
+                        reason = "timeout";
+                        break;
+                    }
+                    wait = deadline - now;
+                }
+            }
+            //recv最多等到截止时间，差距在1/4以内时不调整，避免每次读都调用setsockopt
+            if(wait <= recv_timeout * 3 / 4 || (wait == conn->timeout && recv_timeout != wait)) {
+                conn->sock->setRecvTimeout(wait);
+                recv_timeout = wait;
+            }
+        }
+        int rt = conn->sock->recv(&buf[0], buf.size());
+        if(rt <= 0) {
+            if(rt < 0 && (errno == ETIMEDOUT || errno == EAGAIN)) {
+                //由循环开始处检查是否超时
+                yhchaos::Mtx::Lock lock(conn->mutex);
+                if(!conn->closed) {
+                    continue;
+                }
+                reason = "closed";
+                break;
+            }
+            reason = rt == 0 ? "closed by peer" : "recv fail errno=" + std::to_string(errno);
+            break;
+        }
+        if(redisReaderFeed(reader, &buf[0], rt) != REDIS_OK) {
+            reason = "feed fail";
+            break;
+        }
+        while(true) {
+            void* r = nullptr;
+            if(redisReaderGetReply(reader, &r) != REDIS_OK) {
+                reason = std::string("protocol error: ") + reader->errstr;
+                break;
+            }
+            if(!r) {
+                break;
+            }
+            FCtx::ptr ctx;
+            {
+                yhchaos::Mtx::Lock lock(conn->mutex);
+                if(!conn->waits.empty()) {
+                    ctx = conn->waits.front();
+                    conn->waits.pop_front();
+                }
+            }
+            if(!ctx) {
+                freeReplyObject(r);
+                reason = "unexpected reply";
+                break;
+            }
+            ctx->rpy.reset((redisReply*)r, freeReplyObject);
+            ctx->sem.notify();
+        }
+    }
+    redisReaderFree(reader);
+    CloseConn(conn, reason);
+}
+
+void CoCppRedis::CloseConn(Conn::ptr conn, const std::string& reason) {
+    std::deque<FCtx::ptr> waits;
+    {
+        yhchaos::Mtx::Lock lock(conn->mutex);
+        if(conn->closed) {
+            return;
+        }
+        conn->closed = true;
+        waits.swap(conn->waits);
+    }
+    if(conn->logEnable) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedis connection " << conn->addr
+            << " closed: " << reason << ", pending " << waits.size();
+    }
+    //读协程在recv中时close会唤醒它
+    conn->sock->close();
+    if(conn->trackSock) {
+        //收不到失效通知了，缓存的数据可能已经过期
+        conn->trackSock->close();
+        conn->nearCache->clear();
+    }
+    for(auto& i : waits) {
+        i->sem.notify();
+    }
+}
+
+void CoCppRedis::close() {
+    Conn::ptr conn;
+    {
+        yhchaos::Mtx::Lock lock(m_mutex);
+        conn.swap(m_conn);
+    }
+    if(conn) {
+        CloseConn(conn, "close");
+    }
+}
+
+bool CoCppRedis::isConnected() {
+    yhchaos::Mtx::Lock lock(m_mutex);
+    if(!m_conn) {
+        return false;
+    }
+    yhchaos::Mtx::Lock lock2(m_conn->mutex);
+    return !m_conn->closed;
+}
+
+CoCppRedisCluster::CoCppRedisCluster(const std::map<std::string, std::string>& conf)
+    :m_conf(conf)
+    ,m_slots(SLOT_COUNT, -1)
+    ,m_refreshing(false) {
+    m_type = ICppRedis::CO_REDIS_CLUSTER;
+    m_passwd = get_value(conf, "passwd");
+    m_logEnable = yhchaos::TypeUtil::Atoi(get_value(conf, "log_enable", "1"));
+    std::string hosts = get_value(conf, "host");
+    size_t begin = 0;
+    while(begin < hosts.size()) {
+        size_t end = hosts.find(',', begin);
+        if(end == std::string::npos) {
+            end = hosts.size();
+        }
+        std::string host = yhchaos::StringUtil::Trim(hosts.substr(begin, end - begin));
+        if(!host.empty()) {
+            m_seeds.push_back(host);
+        }
+        begin = end + 1;
+    }
+}
+
+//redis集群使用的CRC16(XMODEM)
+struct RedisCrc16Table {
+    uint16_t table[256];
+    RedisCrc16Table() {
+        for(int i = 0; i < 256; ++i) {
+            uint16_t crc = i << 8;
+            for(int j = 0; j < 8; ++j) {
+                crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+            }
+            table[i] = crc;
+        }
+    }
+};
+
+static uint16_t redis_crc16(const char* buf, size_t len) {
+    static RedisCrc16Table s_crc;
+    uint16_t crc = 0;
+    for(size_t i = 0; i < len; ++i) {
+        crc = (crc << 8) ^ s_crc.table[((crc >> 8) ^ (uint8_t)buf[i]) & 0xff];
+    }
+    return crc;
+}
+
+uint32_t CoCppRedisCluster::KeySlot(const std::string& key) {
+    size_t begin = key.find('{');
+    if(begin != std::string::npos) {
+        size_t end = key.find('}', begin + 1);
+        if(end != std::string::npos && end != begin + 1) {
+            return redis_crc16(key.c_str() + begin + 1, end - begin - 1) & (SLOT_COUNT - 1);
+        }
+    }
+    return redis_crc16(key.c_str(), key.size()) & (SLOT_COUNT - 1);
+}
+
+int32_t CoCppRedisCluster::CmdSlot(const std::vector<std::string>& argv) {
+    if(argv.size() < 2) {
+        return -1;
+    }
+    std::string name = yhchaos::ToUpper(argv[0]);
+    if(name == "EVAL" || name == "EVALSHA") {
+        if(argv.size() > 3 && yhchaos::TypeUtil::Atoi(argv[2]) > 0) {
+            return KeySlot(argv[3]);
+        }
+        return -1;
+    }
+    if(name == "PING" || name == "ECHO" || name == "INFO" || name == "CLUSTER"
+            || name == "CONFIG" || name == "SCRIPT" || name == "TIME") {
+        return -1;
+    }
+    return KeySlot(argv[1]);
+}
+
+//解析redisFormatCommand编码的命令
+static bool parse_command(const char* buf, size_t len, std::vector<std::string>& argv) {
+    const char* end = buf + len;
+    if(len < 4 || *buf != '*') {
+        return false;
+    }
+    char* next = nullptr;
+    long n = strtol(buf + 1, &next, 10);
+    buf = next + 2;
+    for(long i = 0; i < n; ++i) {
+        if(buf >= end || *buf != '$') {
+            return false;
+        }
+        long l = strtol(buf + 1, &next, 10);
+        buf = next + 2;
+        if(l < 0 || buf + l + 2 > end) {
+            return false;
+        }
+        argv.push_back(std::string(buf, l));
+        buf += l + 2;
+    }
+    return true;
+}
+
+ReplyPtr CoCppRedisCluster::cmd(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    auto r = cmd(fmt, ap);
+    va_end(ap);
+    return r;
+}
+
+ReplyPtr CoCppRedisCluster::cmd(const char* fmt, va_list ap) {
+    char* buf = nullptr;
+    int len = redisvFormatCommand(&buf, fmt, ap);
+    if(len == -1 || !buf) {
+        YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error: " << fmt;
+        return nullptr;
+    }
+    std::vector<std::string> argv;
+    bool ok = parse_command(buf, len, argv);
+    free(buf);
+    if(!ok) {
+        YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error: " << fmt;
+        return nullptr;
+    }
+    return cmd(argv);
+}
+
+ReplyPtr CoCppRedisCluster::cmd(const std::vector<std::string>& argv) {
+    if(argv.empty()) {
+        return nullptr;
+    }
+    if(!yhchaos::IOCoScheduler::GetThis()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedisCluster cmd must run in IOCoScheduler ("
+            << m_name << ")";
+        return nullptr;
+    }
+    std::string name = yhchaos::ToUpper(argv[0]);
+    if(name == "MGET" || name == "DEL" || name == "EXISTS"
+            || name == "UNLINK" || name == "TOUCH") {
+        return check(argv, multiKey(argv, 1));
+    }
+    if(name == "MSET") {
+        return check(argv, multiKey(argv, 2));
+    }
+    return check(argv, route(argv));
+}
+
+ReplyPtr CoCppRedisCluster::check(const std::vector<std::string>& argv, ReplyPtr rpy) {
+    if(rpy && rpy->type != REDIS_REPLY_ERROR) {
+        return rpy;
+    }
+    if(m_logEnable) {
+        std::stringstream ss;
+        for(size_t i = 0; i < argv.size() && i < 8; ++i) {
+            ss << (i ? " " : "") << argv[i];
+        }
+        YHCHAOS_LOG_ERROR(g_logger) << "redis cmd: '" << ss.str() << "' "
+            << (rpy ? std::string("reply: ") + rpy->str : std::string("fail"))
+            << " (" << m_name << ")";
+    }
+    return nullptr;
+}
+
+CoCppRedis::ptr CoCppRedisCluster::getNode(const std::string& addr) {
+    {
+        yhchaos::RWMtx::ReadLock lock(m_mutex);
+        auto it = m_conns.find(addr);
+        if(it != m_conns.end()) {
+            return it->second;
+        }
+    }
+    yhchaos::RWMtx::WriteLock lock(m_mutex);
+    auto it = m_conns.find(addr);
+    if(it != m_conns.end()) {
+        return it->second;
+    }
+    auto conf = m_conf;
+    conf["host"] = addr;
+    CoCppRedis::ptr node(new CoCppRedis(conf));
+    node->setName(m_name + "@" + addr);
+    m_conns[addr] = node;
+    return node;
+}
+
+std::string CoCppRedisCluster::getSlotNode(uint32_t slot) {
+    yhchaos::RWMtx::ReadLock lock(m_mutex);
+    if(slot >= SLOT_COUNT || m_slots[slot] < 0) {
+        return "";
+    }
+    return m_nodes[m_slots[slot]];
+}
+
+static uint32_t cluster_rand() {
+    //每个线程独立的引擎，避免rand()的全局锁
+    static thread_local std::minstd_rand s_rand(
+            (uint32_t)yhchaos::GetCurrentUS() ^ (uint32_t)yhchaos::GetCppThreadId());
+    return s_rand();
+}
+
+std::string CoCppRedisCluster::selectNode(int32_t slot) {
+    yhchaos::RWMtx::ReadLock lock(m_mutex);
+    if(slot >= 0 && m_slots[slot] >= 0) {
+        return m_nodes[m_slots[slot]];
+    }
+    if(!m_nodes.empty()) {
+        return m_nodes[cluster_rand() % m_nodes.size()];
+    }
+    return m_seeds.empty() ? "" : m_seeds[cluster_rand() % m_seeds.size()];
+}
+
+bool CoCppRedisCluster::refreshSlots() {
+    std::vector<std::string> nodes;
+    {
+        yhchaos::RWMtx::ReadLock lock(m_mutex);
+        nodes = m_nodes;
+    }
+    for(auto& i : m_seeds) {
+        if(std::find(nodes.begin(), nodes.end(), i) == nodes.end()) {
+            nodes.push_back(i);
+        }
+    }
+    for(auto& addr : nodes) {
+        auto r = getNode(addr)->pipeline({{"CLUSTER", "SLOTS"}})[0];
+        if(!r || r->type != REDIS_REPLY_ARRAY) {
+            continue;
+        }
+        std::vector<std::string> new_nodes;
+        std::vector<int16_t> slots(SLOT_COUNT, -1);
+        for(size_t n = 0; n < r->elements; ++n) {
+            //[start, end, [ip, port, id], replicas...]
+            redisReply* range = r->element[n];
+            if(range->type != REDIS_REPLY_ARRAY || range->elements < 3
+                    || range->element[2]->type != REDIS_REPLY_ARRAY
+                    || range->element[2]->elements < 2) {
+                continue;
+            }
+            redisReply* master = range->element[2];
+            std::string ip(master->element[0]->str ? master->element[0]->str : ""
+                           ,master->element[0]->len);
+            if(ip.empty()) {
+                //节点不知道自己的ip时返回空串，使用当前连接的地址
+                ip = addr.substr(0, addr.find(':'));
+            }
+            std::string node = ip + ":" + std::to_string(master->element[1]->integer);
+            auto it = std::find(new_nodes.begin(), new_nodes.end(), node);
+            int16_t idx = it - new_nodes.begin();
+            if(it == new_nodes.end()) {
+                new_nodes.push_back(node);
+            }
+            long long start = std::max(0LL, range->element[0]->integer);
+            long long end = std::min((long long)SLOT_COUNT - 1, range->element[1]->integer);
+            for(long long s = start; s <= end; ++s) {
+                slots[s] = idx;
+            }
+        }
+        if(new_nodes.empty()) {
+            continue;
+        }
+        YHCHAOS_LOG_INFO(g_logger) << "CoCppRedisCluster refresh slots from " << addr
+            << " nodes=" << new_nodes.size() << " (" << m_name << ")";
+        yhchaos::RWMtx::WriteLock lock(m_mutex);
+        m_nodes.swap(new_nodes);
+        m_slots.swap(slots);
+        return true;
+    }
+    YHCHAOS_LOG_ERROR(g_logger) << "CoCppRedisCluster refresh slots fail (" << m_name << ")";
+    return false;
+}
+
+void CoCppRedisCluster::asyncRefresh() {
+    {
+        yhchaos::RWMtx::WriteLock lock(m_mutex);
+        if(m_refreshing) {
+            return;
+        }
+        m_refreshing = true;
+    }
+    //只有设置了m_refreshing的后台刷新负责清除它，同步的refreshSlots不影响
+    //刷新期间对象可能已经释放，协程只持有weak_ptr
+    std::weak_ptr<CoCppRedisCluster> weak = shared_from_this();
+    yhchaos::IOCoScheduler::GetThis()->coschedule([weak]() {
+        auto self = weak.lock();
+        if(!self) {
+            return;
+        }
+        self->refreshSlots();
+        yhchaos::RWMtx::WriteLock lock(self->m_mutex);
+        self->m_refreshing = false;
+    });
+}
+
+ReplyPtr CoCppRedisCluster::route(const std::vector<std::string>& argv) {
+    bool empty = false;
+    {
+        yhchaos::RWMtx::ReadLock lock(m_mutex);
+        empty = m_nodes.empty();
+    }
+    if(empty) {
+        refreshSlots();
+    }
+    int32_t slot = CmdSlot(argv);
+    std::string addr = selectNode(slot);
+    bool asking = false;
+    ReplyPtr rpy;
+    //最多重定向5次
+    for(int i = 0; i < 6 && !addr.empty(); ++i) {
+        auto node = getNode(addr);
+        if(asking) {
+            rpy = node->pipeline({{"ASKING"}, argv})[1];
+            asking = false;
+        } else {
+            rpy = node->pipeline({argv})[0];
+        }
+        if(!rpy) {
+            //节点可能下线了，刷新映射表，命令不重试
+            asyncRefresh();
+            return nullptr;
+        }
+        if(rpy->type != REDIS_REPLY_ERROR || !rpy->str) {
+            return rpy;
+        }
+        //MOVED 3999 127.0.0.1:6381 / ASK 3999 127.0.0.1:6381
+        bool moved = strncmp(rpy->str, "MOVED ", 6) == 0;
+        if(!moved && strncmp(rpy->str, "ASK ", 4) != 0) {
+            return rpy;
+        }
+        std::string err(rpy->str, rpy->len);
+        size_t pos = err.find(' ', moved ? 6 : 4);
+        if(pos == std::string::npos) {
+            return rpy;
+        }
+        addr = err.substr(pos + 1);
+        if(moved) {
+            int32_t moved_slot = yhchaos::TypeUtil::Atoi(err.substr(6, pos - 6));
+            if(moved_slot >= 0 && moved_slot < (int32_t)SLOT_COUNT) {
+                yhchaos::RWMtx::WriteLock lock(m_mutex);
+                auto it = std::find(m_nodes.begin(), m_nodes.end(), addr);
+                if(it == m_nodes.end()) {
+                    it = m_nodes.insert(m_nodes.end(), addr);
+                }
+                m_slots[moved_slot] = it - m_nodes.begin();
+            }
+            asyncRefresh();
+        } else {
+            asking = true;
+        }
+    }
+    return rpy;
+}
+
+static redisReply* create_reply(int type) {
+    redisReply* r = (redisReply*)calloc(1, sizeof(redisReply));
+    r->type = type;
+    return r;
+}
+
+ReplyPtr CoCppRedisCluster::multiKey(const std::vector<std::string>& argv, size_t step) {
+    if(argv.size() < 2 || (argv.size() - 1) % step) {
+        return route(argv);
+    }
+    size_t count = (argv.size() - 1) / step;
+    std::map<uint32_t, std::vector<size_t> > slot_keys;
+    for(size_t i = 0; i < count; ++i) {
+        slot_keys[KeySlot(argv[1 + i * step])].push_back(i);
+    }
+    if(slot_keys.size() == 1) {
+        return route(argv);
+    }
+    {
+        bool empty = false;
+        {
+            yhchaos::RWMtx::ReadLock lock(m_mutex);
+            empty = m_nodes.empty();
+        }
+        if(empty) {
+            refreshSlots();
+        }
+    }
+
+    //每个slot一个子命令，同一节点的子命令一起pipeline
+    struct Sub {
+        std::vector<std::string> argv;
+        std::vector<size_t> keys;
+        ReplyPtr rpy;
+    };
+    std::vector<Sub> subs;
+    std::map<std::string, std::vector<size_t> > node_subs;
+    for(auto& i : slot_keys) {
+        Sub sub;
+        sub.argv.push_back(argv[0]);
+        for(auto& k : i.second) {
+            for(size_t n = 0; n < step; ++n) {
+                sub.argv.push_back(argv[1 + k * step + n]);
+            }
+        }
+        sub.keys = i.second;
+        node_subs[selectNode(i.first)].push_back(subs.size());
+        subs.push_back(std::move(sub));
+    }
+
+    auto run_node = [this, &subs](const std::string& addr, const std::vector<size_t>& idxs) {
+        std::vector<std::vector<std::string> > cmds;
+        for(auto& i : idxs) {
+            cmds.push_back(subs[i].argv);
+        }
+        auto rpys = getNode(addr)->pipeline(cmds);
+        for(size_t i = 0; i < idxs.size(); ++i) {
+            subs[idxs[i]].rpy = rpys[i];
+        }
+    };
+    //不同节点并行执行，当前协程执行第一个节点
+    CoroutineSem sem;
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    for(auto it = std::next(node_subs.begin()); it != node_subs.end(); ++it) {
+        auto addr = it->first;
+        auto* idxs = &it->second;
+        iom->coschedule([&run_node, &sem, addr, idxs]() {
+            run_node(addr, *idxs);
+            sem.notify();
+        });
+    }
+    run_node(node_subs.begin()->first, node_subs.begin()->second);
+    for(size_t i = 1; i < node_subs.size(); ++i) {
+        sem.wait();
+    }
+
+    //重定向或者失败的子命令单独重试
+    for(auto& i : subs) {
+        if(!i.rpy || i.rpy->type == REDIS_REPLY_ERROR) {
+            i.rpy = route(i.argv);
+        }
+        if(!i.rpy || i.rpy->type == REDIS_REPLY_ERROR) {
+            return i.rpy;
+        }
+    }
+
+    std::string name = yhchaos::ToUpper(argv[0]);
+    if(name == "MGET") {
+        redisReply* r = create_reply(REDIS_REPLY_ARRAY);
+        r->elements = count;
+        r->element = (redisReply**)calloc(count, sizeof(redisReply*));
+        ReplyPtr rt(r, freeReplyObject);
+        for(auto& i : subs) {
+            if(i.rpy->type != REDIS_REPLY_ARRAY || i.rpy->elements != i.keys.size()) {
+                return nullptr;
+            }
+            for(size_t n = 0; n < i.keys.size(); ++n) {
+                r->element[i.keys[n]] = CppRedisReplyClone(i.rpy->element[n]);
+            }
+        }
+        return rt;
+    } else if(name == "MSET") {
+        redisReply* r = create_reply(REDIS_REPLY_STATUS);
+        r->str = strdup("OK");
+        r->len = 2;
+        return ReplyPtr(r, freeReplyObject);
+    }
+    redisReply* r = create_reply(REDIS_REPLY_INTEGER);
+    for(auto& i : subs) {
+        r->integer += i.rpy->integer;
+    }
+    return ReplyPtr(r, freeReplyObject);
+}
+
 ICppRedis::ptr CppRedisManager::get(const std::string& name) {
     yhchaos::RWMtx::WriteLock lock(m_mutex);
     auto it = m_datas.find(name);
@@ -1181,7 +2393,9 @@ ICppRedis::ptr CppRedisManager::get(const std::string& name) {
     auto r = it->second.front();
     it->second.pop_front();
     if(r->getType() == ICppRedis::FOX_REDIS
-            || r->getType() == ICppRedis::FOX_REDIS_CLUSTER) {
+            || r->getType() == ICppRedis::FOX_REDIS_CLUSTER
+            || r->getType() == ICppRedis::CO_REDIS
+            || r->getType() == ICppRedis::CO_REDIS_CLUSTER) {
         it->second.push_back(r);
         return std::shared_ptr<ICppRedis>(r, yhchaos::nop<ICppRedis>);
     }
@@ -1201,6 +2415,12 @@ ICppRedis::ptr CppRedisManager::get(const std::string& name) {
                         ,this, std::placeholders::_1));
 }
 
+CppRedisNearCache::ptr CppRedisManager::getNearCache(const std::string& name) {
+    yhchaos::RWMtx::ReadLock lock(m_mutex);
+    auto it = m_nearCaches.find(name);
+    return it == m_nearCaches.end() ? nullptr : it->second;
+}
+
 void CppRedisManager::freeCppRedis(ICppRedis* r) {
     yhchaos::RWMtx::WriteLock lock(m_mutex);
     m_datas[r->getName()].push_back(r);
@@ -1219,7 +2439,9 @@ void CppRedisManager::init() {
                     type: fox_redis
                     pool: 2
                     timeout: 100
-            desc: "type: redis,redis_cluster,fox_redis,fox_redis_cluster"
+                    near_cache: 1
+                    near_cache_size: 100000
+            desc: "type: redis,redis_cluster,fox_redis,fox_redis_cluster,co_redis,co_redis_cluster"
     */
     //redis.config
     m_config = g_redis->getValue();
@@ -1269,6 +2491,28 @@ void CppRedisManager::init() {
                     m_datas[name].push_back(rds);
                     yhchaos::Atomic::addFetch(done, 1);
                 });
+            } else if(type == "co_redis") {
+                //连接在第一个命令时在调用者的IOCoScheduler中建立，所有协程共享
+                yhchaos::CoCppRedis* rds(new yhchaos::CoCppRedis(i.second));
+                rds->setName(i.first);
+                yhchaos::RWMtx::WriteLock lock(m_mutex);
+                if(yhchaos::TypeUtil::Atoi(get_value(i.second, "near_cache"))) {
+                    auto& cache = m_nearCaches[i.first];
+                    if(!cache) {
+                        cache.reset(new CppRedisNearCache(yhchaos::TypeUtil::Atoi(
+                                        get_value(i.second, "near_cache_size", "100000"))));
+                    }
+                    rds->setNearCache(cache);
+                }
+                m_datas[i.first].push_back(rds);
+                yhchaos::Atomic::addFetch(done, 1);
+            } else if(type == "co_redis_cluster") {
+                yhchaos::CoCppRedisCluster::ptr rds(new yhchaos::CoCppRedisCluster(i.second));
+                rds->setName(i.first);
+                yhchaos::RWMtx::WriteLock lock(m_mutex);
+                m_coClusters.push_back(rds);
+                m_datas[i.first].push_back(rds.get());
+                yhchaos::Atomic::addFetch(done, 1);
             } else {
                 yhchaos::Atomic::addFetch(done, 1);
             }
@@ -1289,6 +2533,13 @@ std::ostream& CppRedisManager::dump(std::ostream& os) {
         }
         os << "]" << std::endl;
     }
+    yhchaos::RWMtx::ReadLock lock(m_mutex);
+    for(auto& i : m_nearCaches) {
+        os << "    " << i.first << " near_cache: count=" << i.second->getCount()
+           << " hits=" << i.second->getHits()
+           << " misses=" << i.second->getMisses()
+           << " enabled=" << i.second->isEnabled() << std::endl;
+    }
     return os;
 }
 
@@ -1300,7 +2551,32 @@ ReplyPtr CppRedisUtil::Cmd(const std::string& name, const char* fmt, ...) {
     return rt;
 }
 
+//fmt的命令名是字面的GET，命令名由参数传入时不识别
+static bool is_get_fmt(const char* fmt) {
+    while(*fmt == ' ') {
+        ++fmt;
+    }
+    return strncasecmp(fmt, "GET", 3) == 0 && fmt[3] == ' ';
+}
+
 ReplyPtr CppRedisUtil::Cmd(const std::string& name, const char* fmt, va_list ap) {
+    if(is_get_fmt(fmt) && CppRedisMgr::GetInstance()->getNearCache(name)) {
+        //只有GET需要解析出参数走客户端缓存，其他命令直接发送
+        char* buf = nullptr;
+        int len = redisvFormatCommand(&buf, fmt, ap);
+        if(len == -1 || !buf) {
+            YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error: " << fmt;
+            return nullptr;
+        }
+        std::vector<std::string> argv;
+        bool ok = parse_command(buf, len, argv);
+        free(buf);
+        if(!ok) {
+            YHCHAOS_LOG_ERROR(g_logger) << "redis fmt error: " << fmt;
+            return nullptr;
+        }
+        return Cmd(name, argv);
+    }
     auto rds = CppRedisMgr::GetInstance()->get(name);
     if(!rds) {
         return nullptr;
@@ -1313,9 +2589,20 @@ ReplyPtr CppRedisUtil::Cmd(const std::string& name, const std::vector<std::strin
     if(!rds) {
         return nullptr;
     }
+    //缓存和失效通知绑定在连接上，由CoCppRedis判断连接是否可以使用缓存
+    if(rds->getType() == ICppRedis::CO_REDIS && args.size() == 2
+            && strcasecmp(args[0].c_str(), "GET") == 0) {
+        auto co = std::static_pointer_cast<CoCppRedis>(rds);
+        if(co->getNearCache()) {
+            return co->cachedGet(args[1]);
+        }
+    }
     return rds->cmd(args);
 }
 
+ReplyPtr CppRedisUtil::Get(const std::string& name, const std::string& key) {
+    return Cmd(name, std::vector<std::string>{"GET", key});
+}
 
 ReplyPtr CppRedisUtil::TryCmd(const std::string& name, uint32_t count, const char* fmt, ...) {
     for(uint32_t i = 0; i < count; ++i) {
@@ -8,7 +8,12 @@
 #include <sys/time.h>
 #include <string>
 #include <memory>
+#include <deque>
+#include <list>
+#include <atomic>
+#include <unordered_map>
 #include "yhchaos/mtx.h"
+#include "yhchaos/sock.h"
 #include "yhchaos/db/watch_cpp_thread.h"
 #include "yhchaos/singleton.h"
 
@@ -22,7 +27,9 @@ public:
         REDIS = 1,
         REDIS_CLUSTER = 2,
         FOX_REDIS = 3,
-        FOX_REDIS_CLUSTER = 4
+        FOX_REDIS_CLUSTER = 4,
+        CO_REDIS = 5,
+        CO_REDIS_CLUSTER = 6
     };
     typedef std::shared_ptr<ICppRedis> ptr;
     ICppRedis() : m_logEnable(true) { }
@@ -82,7 +89,7 @@ public:
                     type: fox_redis
                     pool: 2
                     timeout: 100
-            desc: "type: redis,redis_cluster,fox_redis,fox_redis_cluster"
+            desc: "type: redis,redis_cluster,fox_redis,fox_redis_cluster,co_redis,co_redis_cluster"
     */
     CppRedis(const std::map<std::string, std::string>& conf);
 
@@ -191,7 +198,8 @@ private:
     struct Ctx {
         typedef std::shared_ptr<Ctx> ptr;
 
-        event* ev;//nullptr
+        //命令超时定时器
+        WatchCppThread::Timer::ptr timer;
         bool timeout;//false
 
         FoxCppRedis* rds;//rds
@@ -244,7 +252,8 @@ private:
 
     struct timeval m_cmdTimeout;//conf中timeout_com ？ timeout_com ：timeout 
     std::string m_err;
-    struct event* m_event;//nullptr
+    //定时ping
+    WatchCppThread::Timer::ptr m_timer;
     /**父类成员
     std::string m_name;
     std::string m_passwd;
@@ -291,7 +300,7 @@ private:
     struct Ctx {
         typedef std::shared_ptr<Ctx> ptr;
 
-        event* ev;
+        WatchCppThread::Timer::ptr timer;
         bool timeout;//1
         FoxCppRedisCluster* rds;
         FCtx* fctx;
@@ -331,7 +340,270 @@ private:
 
     struct timeval m_cmdTimeout;
     std::string m_err;
-    struct event* m_event;
+    WatchCppThread::Timer::ptr m_timer;
+};
+
+/**
+ * @brief redis客户端缓存，缓存GET的回复
+ * @details
+ *  1. 按key的hash分片，每个分片一个LRU，总条数受near_cache_size限制
+ *  2. 连接建立时通过CLIENT TRACKING(RESP2的REDIRECT模式)让redis把缓存过的key的失效通知
+ *     推送到订阅了__redis__:invalidate的另一个连接上，收到后删除对应的缓存
+ *  3. 失效通知的连接断开时清空缓存
+ *  4. 每个分片有一个版本号，删除和清空时递增，请求发出后版本变了的回复不缓存，
+ *     避免失效通知先于回复到达时缓存旧值
+ *  在redis.config中配置near_cache: 1开启，只支持co_redis，通过CppRedisUtil的GET使用
+ */
+class CppRedisNearCache {
+public:
+    typedef std::shared_ptr<CppRedisNearCache> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] max_count 最大缓存条数
+     */
+    CppRedisNearCache(size_t max_count);
+
+    /**
+     * @brief 获取缓存的回复，统计命中和未命中次数
+     */
+    ReplyPtr get(const std::string& key);
+
+    /**
+     * @brief key所在分片的版本号，发送请求前获取
+     */
+    uint64_t getVersion(const std::string& key);
+
+    /**
+     * @brief 缓存回复，分片版本号和version不一致时不缓存
+     */
+    void set(const std::string& key, ReplyPtr rpy, uint64_t version);
+
+    void del(const std::string& key);
+    void clear();
+
+    size_t getCount();
+    uint64_t getHits() const { return m_hits;}
+    uint64_t getMisses() const { return m_misses;}
+
+    bool isEnabled() const { return m_enabled;}
+    /**
+     * @brief 服务器不支持CLIENT TRACKING时关闭
+     */
+    void setEnabled(bool v);
+private:
+    struct Shard {
+        yhchaos::Mtx mutex;
+        std::list<std::pair<std::string, ReplyPtr> > lru;
+        std::unordered_map<std::string, std::list<std::pair<std::string, ReplyPtr> >::iterator> items;
+        uint64_t version = 0;
+    };
+    Shard& getShard(const std::string& key);
+private:
+    static const size_t SHARD_COUNT = 16;
+    Shard m_shards[SHARD_COUNT];
+    //每个分片的最大条数
+    size_t m_maxCount;
+    std::atomic<bool> m_enabled;
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+};
+
+/**
+ * @brief 协程redis客户端
+ * @details
+ *  1. 在调用者的IOCoScheduler中通过hook的Sock直接收发RESP协议，不经过WatchCppThread，没有跨线程切换
+ *  2. 所有协程共享一个连接，命令追加到发送缓冲区，正在发送的协程把期间追加的命令一起发出去(自动pipeline)
+ *  3. 每个连接一个读协程，按FIFO顺序把回复交给等待的协程
+ *  4. 连接断开或者最早的命令超时后，所有等待的命令返回nullptr，下一个命令重新连接
+ *  配置同FoxCppRedis，type: co_redis
+ */
+class CoCppRedis : public ICppRedis {
+public:
+    typedef std::shared_ptr<CoCppRedis> ptr;
+
+    CoCppRedis(const std::map<std::string, std::string>& conf);
+    ~CoCppRedis();
+
+    virtual ReplyPtr cmd(const char* fmt, ...) override;
+    virtual ReplyPtr cmd(const char* fmt, va_list ap) override;
+    virtual ReplyPtr cmd(const std::vector<std::string>& argv) override;
+
+    /**
+     * @brief 把多个命令一起发送，按顺序返回回复
+     * @details 和其他协程的命令共享连接，这批命令在发送缓冲区中连续排列。
+     *          回复原样返回，包括错误回复(用于处理集群的MOVED/ASK)，连接失败的命令为nullptr
+     */
+    std::vector<ReplyPtr> pipeline(const std::vector<std::vector<std::string> >& cmds);
+
+    /**
+     * @brief 通过客户端缓存执行GET
+     * @details 只有开启了CLIENT TRACKING的连接读写缓存，没有失效通知连接时直接发送GET
+     */
+    ReplyPtr cachedGet(const std::string& key);
+
+    /**
+     * @brief 把参数编码成RESP命令，失败返回空串
+     */
+    static std::string FormatCommand(const std::vector<std::string>& argv);
+
+    /**
+     * @brief 关闭当前连接，等待的命令返回nullptr
+     */
+    void close();
+
+    /**
+     * @brief 当前是否有可用的连接
+     */
+    bool isConnected();
+
+    /**
+     * @brief 设置客户端缓存，之后建立的连接开启CLIENT TRACKING
+     */
+    void setNearCache(CppRedisNearCache::ptr v) { m_nearCache = v;}
+    CppRedisNearCache::ptr getNearCache() const { return m_nearCache;}
+private:
+    //一个命令的等待上下文
+    struct FCtx {
+        typedef std::shared_ptr<FCtx> ptr;
+        CoroutineSem sem;
+        ReplyPtr rpy;
+        //进入发送缓冲区的时间(毫秒)
+        uint64_t sendTime = 0;
+    };
+    //一个连接，读协程持有它，CoCppRedis析构后读协程仍然可以安全退出
+    struct Conn {
+        typedef std::shared_ptr<Conn> ptr;
+        Sock::ptr sock;
+        std::string addr;
+        //命令超时时间(毫秒)，0表示不超时
+        uint64_t timeout = 0;
+        bool logEnable = true;
+
+        Mtx mutex;
+        //已经进入发送缓冲区还没有收到回复的命令，和发送顺序一致
+        std::deque<FCtx::ptr> waits;
+        //等待发送的命令
+        std::string sendBuf;
+        //是否有协程正在发送
+        bool writing = false;
+        bool closed = false;
+
+        //接收失效通知的连接，没有开启客户端缓存时为nullptr
+        Sock::ptr trackSock;
+        CppRedisNearCache::ptr nearCache;
+    };
+    //正在建立的连接，同时需要连接的协程等待第一个协程的结果
+    struct Connecting {
+        typedef std::shared_ptr<Connecting> ptr;
+        CoroutineSem sem;
+        uint32_t waiters = 0;
+        Conn::ptr conn;
+    };
+private:
+    //发送一个已经编码的命令，等待回复，错误回复返回nullptr
+    ReplyPtr pcmd(const std::string& cmd, Conn::ptr conn = nullptr);
+    //发送count个已经编码的命令，等待全部回复，conn为nullptr时使用getConn()
+    void send(const std::string& cmds, size_t count, std::vector<ReplyPtr>& rpys
+              ,Conn::ptr conn = nullptr);
+    //获取可用的连接，没有时建立连接
+    Conn::ptr getConn();
+    //建立连接并认证，启动读协程
+    Conn::ptr connect();
+    //建立socket并认证
+    Sock::ptr connectSock(const std::string& addr);
+    //建立失效通知连接，开启sock的CLIENT TRACKING，失败返回nullptr，服务器不支持时关闭客户端缓存
+    Sock::ptr startTracking(Sock::ptr sock, const std::string& addr);
+    //发送缓冲区中的命令，直到缓冲区为空
+    static void Flush(Conn::ptr conn);
+    //读协程，解析回复并唤醒等待的协程
+    static void Read(Conn::ptr conn);
+    //失效通知的读协程，删除失效的缓存
+    static void Track(Conn::ptr conn);
+    //关闭连接，唤醒所有等待的命令
+    static void CloseConn(Conn::ptr conn, const std::string& reason);
+private:
+    std::string m_host;
+    uint16_t m_port;
+    //timeout_com ? timeout_com : timeout
+    uint64_t m_cmdTimeout;
+    //timeout_connect ? timeout_connect : m_cmdTimeout
+    uint64_t m_connectTimeout;
+
+    Mtx m_mutex;
+    Conn::ptr m_conn;
+    Connecting::ptr m_connecting;
+    CppRedisNearCache::ptr m_nearCache;
+};
+
+/**
+ * @brief 协程redis集群客户端
+ * @details
+ *  1. 缓存CLUSTER SLOTS得到的16384个slot到节点的映射，按CRC16(key)计算slot，支持{hash tag}
+ *  2. 每个节点一个CoCppRedis，同一节点的命令自动pipeline
+ *  3. 收到MOVED时更新该slot并在后台刷新整个映射表，收到ASK时向目标节点发送ASKING和命令
+ *  4. MGET/MSET/DEL/EXISTS等多key命令按slot拆分，同一节点的子命令一起pipeline，
+ *     不同节点并行执行，结果按原来的顺序合并。
+ *     拆分后的命令不是原子的: MSET可能部分节点成功部分失败(返回nullptr，已成功的不会回滚)，
+ *     MGET的各个子命令在不同时间点读取，需要原子性时用{hash tag}把key放到同一个slot
+ *  5. 后台刷新slot映射表的协程只持有weak_ptr，对象必须由shared_ptr(CoCppRedisCluster::ptr)管理
+ *  配置同FoxCppRedisCluster，host为逗号分隔的种子节点，type: co_redis_cluster
+ */
+class CoCppRedisCluster : public ICppRedis
+                        , public std::enable_shared_from_this<CoCppRedisCluster> {
+public:
+    typedef std::shared_ptr<CoCppRedisCluster> ptr;
+    static const uint32_t SLOT_COUNT = 16384;
+
+    CoCppRedisCluster(const std::map<std::string, std::string>& conf);
+
+    virtual ReplyPtr cmd(const char* fmt, ...) override;
+    virtual ReplyPtr cmd(const char* fmt, va_list ap) override;
+    virtual ReplyPtr cmd(const std::vector<std::string>& argv) override;
+
+    /**
+     * @brief 从已知节点获取CLUSTER SLOTS，更新slot映射表
+     * @return 是否成功
+     */
+    bool refreshSlots();
+
+    /**
+     * @brief slot当前对应的节点地址，未知时返回空串
+     */
+    std::string getSlotNode(uint32_t slot);
+
+    /**
+     * @brief key所在的slot，有非空的{hash tag}时只计算tag
+     */
+    static uint32_t KeySlot(const std::string& key);
+private:
+    //获取节点的连接，不存在时创建
+    CoCppRedis::ptr getNode(const std::string& addr);
+    //按slot选择节点，未知时选择种子节点
+    std::string selectNode(int32_t slot);
+    //命令的第一个key所在的slot，没有key返回-1
+    static int32_t CmdSlot(const std::vector<std::string>& argv);
+    //发送一个命令，处理MOVED/ASK重定向，返回原始回复
+    ReplyPtr route(const std::vector<std::string>& argv);
+    //多key命令按slot拆分执行
+    ReplyPtr multiKey(const std::vector<std::string>& argv, size_t step);
+    //在后台刷新slot映射表，同时只有一个协程刷新
+    void asyncRefresh();
+    //错误回复记录日志后返回nullptr
+    ReplyPtr check(const std::vector<std::string>& argv, ReplyPtr rpy);
+private:
+    //种子节点
+    std::vector<std::string> m_seeds;
+    std::map<std::string, std::string> m_conf;
+
+    yhchaos::RWMtx m_mutex;
+    //节点地址
+    std::vector<std::string> m_nodes;
+    //slot对应的m_nodes下标，-1表示未知
+    std::vector<int16_t> m_slots;
+    std::map<std::string, CoCppRedis::ptr> m_conns;
+    //是否正在刷新slot映射表
+    bool m_refreshing;
 };
 
 class CppRedisManager {
@@ -339,6 +611,11 @@ public:
     CppRedisManager();
     ICppRedis::ptr get(const std::string& name);
 
+    /**
+     * @brief 获取客户端缓存，没有配置near_cache时返回nullptr
+     */
+    CppRedisNearCache::ptr getNearCache(const std::string& name);
+
     std::ostream& dump(std::ostream& os);
 private:
     void freeCppRedis(ICppRedis* r);
@@ -346,17 +623,31 @@ private:
 private:
     yhchaos::RWMtx m_mutex;
     std::map<std::string, std::list<ICppRedis*> > m_datas;
+    std::map<std::string, CppRedisNearCache::ptr> m_nearCaches;
     std::map<std::string, std::map<std::string, std::string> > m_config;
+    //协程集群客户端需要由shared_ptr持有，生命周期同管理器
+    std::list<CoCppRedisCluster::ptr> m_coClusters;
 };
 
 typedef yhchaos::Singleton<CppRedisManager> CppRedisMgr;
 
+/**
+ * @brief 通过CppRedisMgr执行命令
+ * @details 配置了near_cache的redis，GET先查客户端缓存。
+ *          格式化的Cmd只有fmt以字面的"GET "开头时才解析参数查缓存，
+ *          其他命令不做额外的格式化和解析
+ */
 class CppRedisUtil {
 public:
     static ReplyPtr Cmd(const std::string& name, const char* fmt, ...);
     static ReplyPtr Cmd(const std::string& name, const char* fmt, va_list ap); 
     static ReplyPtr Cmd(const std::string& name, const std::vector<std::string>& args); 
 
+    /**
+     * @brief GET key，配置了near_cache时先查客户端缓存，不需要格式化命令
+     */
+    static ReplyPtr Get(const std::string& name, const std::string& key);
+
     static ReplyPtr TryCmd(const std::string& name, uint32_t count, const char* fmt, ...);
     static ReplyPtr TryCmd(const std::string& name, uint32_t count, const std::vector<std::string>& args); 
 };
@@ -4,6 +4,7 @@
 #include "yhchaos/util.h"
 #include "yhchaos/macro.h"
 #include "yhchaos/appconfig.h"
+#include "yhchaos/worker.h"
 #include <iomanip>
 
 namespace yhchaos {
@@ -63,7 +64,10 @@ WatchCppThread::WatchCppThread(const std::string& name, struct event_base* base)
     ,m_name(name)
     ,m_working(false)
     ,m_start(false)
-    ,m_total(0) {
+    ,m_total(0)
+    ,m_iom(nullptr)
+    ,m_threadId(-1)
+    ,m_tasks(0) {
     int fds[2];
     if(evutil_socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1) {
         //YHCHAOS_LOG_ERROR(g_logger) << "WatchCppThread init error";
@@ -86,13 +90,154 @@ WatchCppThread::WatchCppThread(const std::string& name, struct event_base* base)
     event_add(m_event, NULL);
 }
 
+WatchCppThread::WatchCppThread(const std::string& name, IOCoScheduler* iom, uint32_t index)
+    :m_read(0)
+    ,m_write(0)
+    ,m_base(NULL)
+    ,m_event(NULL)
+    ,m_thread(NULL)
+    ,m_name(name)
+    ,m_working(false)
+    ,m_start(false)
+    ,m_total(0)
+    ,m_iom(iom)
+    ,m_threadId(-1)
+    ,m_tasks(0)
+    ,m_alive(std::make_shared<Alive>()) {
+    m_alive->thread = this;
+    m_alive->iom = iom;
+    auto& ids = iom->getThreadIds();
+    if(ids.empty()) {
+        throw std::logic_error("IOCoScheduler " + iom->getName() + " not started");
+    }
+    m_threadId = ids[index % ids.size()];
+    m_alive->threadId = m_threadId;
+}
+
+bool WatchCppThread::Run(const Alive::ptr& alive, const callback& cb, bool task) {
+    //先增加running再检查thread，和析构中先置空thread再检查running配对
+    ++alive->running;
+    WatchCppThread* thread = alive->thread;
+    if(!thread) {
+        --alive->running;
+        return false;
+    }
+    if(task) {
+        yhchaos::Atomic::subFetch(thread->m_tasks, (uint64_t)1);
+    }
+    WatchCppThread* prev = s_thread;
+    s_thread = thread;
+    thread->m_working = true;
+    try {
+        cb();
+    } catch (std::exception& ex) {
+        YHCHAOS_LOG_ERROR(g_logger) << "exception:" << ex.what();
+    } catch (const char* c) {
+        YHCHAOS_LOG_ERROR(g_logger) << "exception:" << c;
+    } catch (...) {
+        YHCHAOS_LOG_ERROR(g_logger) << "uncatch exception";
+    }
+    s_thread = prev;
+    //回调中可能析构了对象
+    if(alive->thread) {
+        thread->m_working = false;
+        yhchaos::Atomic::addFetch(thread->m_total, (uint64_t)1);
+    }
+    --alive->running;
+    return true;
+}
+
+void WatchCppThread::RunInThread(const Alive::ptr& alive, const callback& cb) {
+    if((int)yhchaos::GetCppThreadId() == alive->threadId) {
+        Run(alive, cb);
+    } else {
+        alive->iom->coschedule([alive, cb]() {
+            Run(alive, cb);
+        }, alive->threadId);
+    }
+}
+
+WatchCppThread::Timer::Timer(callback cb)
+    :m_cb(cb)
+    ,m_event(nullptr)
+    ,m_cancelled(false) {
+}
+
+WatchCppThread::Timer::~Timer() {
+    cancel();
+    if(m_event) {
+        event_free(m_event);
+    }
+}
+
+void WatchCppThread::Timer::cancel() {
+    m_cancelled = true;
+    if(m_event) {
+        evtimer_del(m_event);
+    }
+    if(m_timer) {
+        m_timer->cancel();
+        m_timer = nullptr;
+    }
+}
+
+void WatchCppThread::Timer::TimerCb(evutil_socket_t sock, short which, void* args) {
+    Timer* timer = static_cast<Timer*>(args);
+    //回调中可能释放定时器
+    callback cb = timer->m_cb;
+    cb();
+}
+
+WatchCppThread::Timer::ptr WatchCppThread::addTimer(uint64_t ms, callback cb, bool recurring) {
+    Timer::ptr timer(new Timer(cb));
+    if(m_iom) {
+        //定时器在任意线程触发，转到绑定的线程执行
+        std::weak_ptr<Timer> weak(timer);
+        Alive::ptr alive = m_alive;
+        timer->m_timer = m_iom->addTimedCoroutine(ms, [alive, weak]() {
+            RunInThread(alive, [weak]() {
+                auto t = weak.lock();
+                if(t && !t->m_cancelled) {
+                    callback cb = t->m_cb;
+                    cb();
+                }
+            });
+        }, recurring);
+    } else {
+        timer->m_event = event_new(m_base, -1, EV_TIMEOUT | (recurring ? EV_PERSIST : 0)
+                                   ,&Timer::TimerCb, timer.get());
+        struct timeval tv;
+        tv.tv_sec = ms / 1000;
+        tv.tv_usec = ms % 1000 * 1000;
+        evtimer_add(timer->m_event, &tv);
+    }
+    return timer;
+}
+
+bool WatchCppThread::addFdEvent(int fd, IOCoScheduler::FdEvent event, callback cb) {
+    YHCHAOS_ASSERT(m_iom);
+    YHCHAOS_ASSERT((int)yhchaos::GetCppThreadId() == m_threadId);
+    Alive::ptr alive = m_alive;
+    return m_iom->addFdEvent(fd, event, [alive, cb]() {
+        RunInThread(alive, cb);
+    }) == 0;
+}
+
+bool WatchCppThread::delFdEvent(int fd, IOCoScheduler::FdEvent event) {
+    YHCHAOS_ASSERT(m_iom);
+    return m_iom->delFdEvent(fd, event);
+}
+
 void WatchCppThread::dump(std::ostream& os) {
     RWMtx::ReadLock lock(m_mutex);
     os << "[thread name=" << m_name
        << " working=" << m_working
-       << " tasks=" << m_callbacks.size()
-       << " total=" << m_total
-       << "]" << std::endl;
+       << " tasks=" << (m_iom ? m_tasks : m_callbacks.size())
+       << " total=" << m_total;
+    if(m_iom) {
+        os << " io_coscheduler=" << m_iom->getName() << " thread=" << m_threadId;
+    }
+    os << "]" << std::endl;
 }
 
 std::thread::id WatchCppThread::getId() const {
@@ -114,6 +259,16 @@ void  WatchCppThread::setData(const std::string& name, void* v) {
 }
 
 WatchCppThread::~WatchCppThread() {
+    if(m_alive) {
+        m_alive->thread = nullptr;
+        //在其他线程析构时等待绑定线程上正在执行的回调结束，
+        //在自己的回调中析构时不等待，Run在回调返回后不再访问this
+        if(s_thread != this) {
+            while(m_alive->running) {
+                usleep(100);
+            }
+        }
+    }
     if(m_read) {
         close(m_read);
     }
@@ -134,6 +289,20 @@ WatchCppThread::~WatchCppThread() {
 }
 
 void WatchCppThread::start() {
+    if(m_iom) {
+        if(m_start) {
+            throw std::logic_error("WatchCppThread is running");
+        }
+        m_start = true;
+        if(m_initCb) {
+            init_cb cb;
+            cb.swap(m_initCb);
+            dispatch([this, cb]() {
+                cb(this);
+            });
+        }
+        return;
+    }
     if(m_thread) {
         //YHCHAOS_LOG_ERROR(g_logger) << "WatchCppThread is running";
         throw std::logic_error("WatchCppThread is running");
@@ -155,6 +324,15 @@ void WatchCppThread::thread_cb() {
 }
 
 bool WatchCppThread::dispatch(callback cb) {
+    if(m_iom) {
+        //直接放入iom绑定线程的任务队列，不需要m_callbacks和套接字唤醒
+        yhchaos::Atomic::addFetch(m_tasks, (uint64_t)1);
+        Alive::ptr alive = m_alive;
+        m_iom->coschedule([alive, cb]() {
+            Run(alive, cb, true);
+        }, m_threadId);
+        return true;
+    }
     RWMtx::WriteLock lock(m_mutex);
     m_callbacks.push_back(cb);
     //if(m_callbacks.size() > 1) {
@@ -174,6 +352,12 @@ bool WatchCppThread::dispatch(uint32_t id, callback cb) {
 }
 
 bool WatchCppThread::batchDispatch(const std::vector<callback>& cbs) {
+    if(m_iom) {
+        for(auto& i : cbs) {
+            dispatch(i);
+        }
+        return true;
+    }
     RWMtx::WriteLock lock(m_mutex);
     for(auto& i : cbs) {
         m_callbacks.push_back(i);
@@ -191,6 +375,10 @@ void WatchCppThread::broadcast(callback cb) {
 }
 
 void WatchCppThread::stop() {
+    if(m_iom) {
+        m_start = false;
+        return;
+    }
     RWMtx::WriteLock lock(m_mutex);
     m_callbacks.push_back(nullptr);
     if(m_thread) {
@@ -212,7 +400,8 @@ void WatchCppThread::join() {
     }
 }
 
-WatchCppThreadPool::WatchCppThreadPool(uint32_t size, const std::string& name, bool advance)
+WatchCppThreadPool::WatchCppThreadPool(uint32_t size, const std::string& name, bool advance
+                                       ,IOCoScheduler* iom)
     :m_size(size)
     ,m_cur(0)
     ,m_name(name)
@@ -221,7 +410,8 @@ WatchCppThreadPool::WatchCppThreadPool(uint32_t size, const std::string& name, b
     ,m_total(0) {
     m_threads.resize(m_size);
     for(size_t i = 0; i < size; ++i) {
-        WatchCppThread* t(new WatchCppThread(name + "_" + std::to_string(i)));
+        WatchCppThread* t = iom ? new WatchCppThread(name + "_" + std::to_string(i), iom, i)
+                                : new WatchCppThread(name + "_" + std::to_string(i));
         m_threads[i] = t;
     }
 }
@@ -462,6 +652,7 @@ void WatchCppThreadManager::init() {
         auto num = yhchaos::GetParamValue(i.second, "num", 0);
         auto name = i.first;
         auto advance = yhchaos::GetParamValue(i.second, "advance", 0);
+        auto io = yhchaos::GetParamValue<std::string>(i.second, "io_coscheduler");
         if(num <= 0) {
             YHCHAOS_LOG_ERROR(g_logger) << "thread pool:" << name
                         << " num:" << num
@@ -469,15 +660,28 @@ void WatchCppThreadManager::init() {
                         << " invalid";
             continue;
         }
+        IOCoScheduler* iom = nullptr;
+        if(!io.empty()) {
+            auto s = yhchaos::CoSchedulerMgr::GetInstance()->getAsIOCoScheduler(io);
+            if(!s) {
+                YHCHAOS_LOG_ERROR(g_logger) << "thread pool:" << name
+                            << " io_coscheduler:" << io << " not exists";
+                continue;
+            }
+            iom = s.get();
+        }
         if(num == 1) {
-            m_threads[i.first] = WatchCppThread::ptr(new WatchCppThread(i.first));
-            YHCHAOS_LOG_INFO(g_logger) << "init thread : " << i.first;
+            m_threads[i.first] = iom ? WatchCppThread::ptr(new WatchCppThread(i.first, iom))
+                                     : WatchCppThread::ptr(new WatchCppThread(i.first));
+            YHCHAOS_LOG_INFO(g_logger) << "init thread : " << i.first
+                       << " io_coscheduler:" << io;
         } else {
             m_threads[i.first] = WatchCppThreadPool::ptr(new WatchCppThreadPool(
-                            num, name, advance));
+                            num, name, advance, iom));
             YHCHAOS_LOG_INFO(g_logger) << "init thread pool:" << name
                        << " num:" << num
-                       << " advance:" << advance;
+                       << " advance:" << advance
+                       << " io_coscheduler:" << io;
         }
     }
 }
@@ -2,6 +2,7 @@
 #define __YHCHAOS_DB_WATCH_THREAD_H__
 
 #include <thread>
+#include <atomic>
 #include <vector>
 #include <list>
 #include <map>
@@ -11,6 +12,7 @@
 
 #include "yhchaos/singleton.h"
 #include "yhchaos/mtx.h"
+#include "yhchaos/iocoscheduler.h"
 
 namespace yhchaos {
 
@@ -36,13 +38,48 @@ public:
 //当调用start()时，创建一个线程m_thread执行thread_cb()，在thread_cb()中用event_base_loop阻塞监听fd[0]
 //主线程可以通过向fd[1]写来唤醒m_thread
 //通过向m_callcb列表添加回调函数的形式让m_thread被唤醒时执行回调函数
+//
+//IOCoScheduler模式：不创建线程、event_base和套接字对，回调固定调度到IOCoScheduler的一个线程上执行，
+//同一个WatchCppThread的回调、定时器和fd事件都在这个线程中串行执行，回调中不能阻塞或切换协程
 class WatchCppThread : public IWatchCppThread {
 public:
     typedef std::shared_ptr<WatchCppThread> ptr;
     //void()
     typedef IWatchCppThread::callback callback;
     typedef std::function<void (WatchCppThread*)> init_cb;
+
+    /**
+     * @brief 定时器，回调在所属的WatchCppThread中执行
+     * @details libevent模式下是evtimer，IOCoScheduler模式下是TimedCoroutine
+     */
+    class Timer {
+    friend class WatchCppThread;
+    public:
+        typedef std::shared_ptr<Timer> ptr;
+        ~Timer();
+
+        /**
+         * @brief 取消定时器，只能在所属的WatchCppThread中调用
+         */
+        void cancel();
+    private:
+        Timer(callback cb);
+        static void TimerCb(evutil_socket_t sock, short which, void* args);
+    private:
+        callback m_cb;
+        struct event* m_event;//nullptr
+        std::shared_ptr<TimedCoroutine> m_timer;
+        bool m_cancelled;//false
+    };
+
     WatchCppThread(const std::string& name = "", struct event_base* base = NULL);
+
+    /**
+     * @brief IOCoScheduler模式
+     * @param[in] iom 已经启动的IOCoScheduler
+     * @param[in] index 绑定iom的第index % 线程数个线程
+     */
+    WatchCppThread(const std::string& name, IOCoScheduler* iom, uint32_t index = 0);
     ~WatchCppThread();
 
 
@@ -80,9 +117,27 @@ public:
     void stop();
     bool isStart() const { return m_start;}
 
+    //IOCoScheduler模式下返回nullptr
     struct event_base* getBase() { return m_base;}
     std::thread::id getId() const;
 
+    IOCoScheduler* getIOCoScheduler() const { return m_iom;}
+
+    /**
+     * @brief 添加定时器
+     * @param[in] ms 超时时间(毫秒)
+     * @param[in] cb 回调，在本线程中执行
+     * @param[in] recurring 是否循环
+     */
+    Timer::ptr addTimer(uint64_t ms, callback cb, bool recurring = false);
+
+    /**
+     * @brief IOCoScheduler模式下监听fd的读写事件，事件触发一次后删除，回调在本线程中执行
+     * @details 只能在本线程中调用
+     */
+    bool addFdEvent(int fd, IOCoScheduler::FdEvent event, callback cb);
+    bool delFdEvent(int fd, IOCoScheduler::FdEvent event);
+
     void* getData(const std::string& name);
     template<class T>
     T* getData(const std::string& name) {
@@ -97,6 +152,32 @@ public:
 private:
     void thread_cb();
     static void read_cb(evutil_socket_t sock, short which, void* args);
+private:
+    /**
+     * @brief IOCoScheduler模式下的存活标记
+     * @details 调度出去的回调、定时器和fd事件持有它而不是this，回调都在绑定线程threadId上串行执行，
+     *          执行前检查thread，执行期间running计数不为0，不持有任何锁。
+     *          析构时先置空thread，之后的回调都不再执行；在其他线程析构时等待running归零，
+     *          在自己的回调中析构时直接返回，回调结束后不再访问对象
+     */
+    struct Alive {
+        typedef std::shared_ptr<Alive> ptr;
+        std::atomic<WatchCppThread*> thread{nullptr};
+        std::atomic<int> running{0};
+        IOCoScheduler* iom = nullptr;
+        int threadId = -1;
+    };
+
+    /**
+     * @brief IOCoScheduler模式下执行回调，期间GetThis()返回对象
+     * @param[in] alive 存活标记
+     * @param[in] cb 回调
+     * @param[in] task 是否是dispatch调度的任务，是则减少m_tasks
+     * @return 对象已析构返回false，回调不执行
+     */
+    static bool Run(const Alive::ptr& alive, const callback& cb, bool task = false);
+    //在绑定的线程中直接执行，否则调度过去
+    static void RunInThread(const Alive::ptr& alive, const callback& cb);
 private:
     evutil_socket_t m_read;//Unix套接字对fd[0]读端
     evutil_socket_t m_write;//fd[1]
@@ -115,6 +196,11 @@ private:
     bool m_working;//false，在start()中设置为true
     bool m_start;//false，表示当前正在执行回调函数
     uint64_t m_total;//0，总共执行的回调函数的个数
+
+    IOCoScheduler* m_iom;//nullptr，不为空时是IOCoScheduler模式
+    int m_threadId;//-1，绑定的iom线程
+    uint64_t m_tasks;//0，IOCoScheduler模式下已调度未执行的回调个数
+    Alive::ptr m_alive;//IOCoScheduler模式下的存活标记
 };
 
 class WatchCppThreadPool : public IWatchCppThread {
@@ -122,7 +208,9 @@ public:
     typedef std::shared_ptr<WatchCppThreadPool> ptr;
     typedef IWatchCppThread::callback callback;
     //构造函数创建size个WatchCppThread对象，添加到m_trheads线程池中
-    WatchCppThreadPool(uint32_t size, const std::string& name = "", bool advance = false);
+    //iom不为空时每个WatchCppThread依次绑定iom的一个线程
+    WatchCppThreadPool(uint32_t size, const std::string& name = "", bool advance = false
+                       ,IOCoScheduler* iom = nullptr);
     ~WatchCppThreadPool();
     //运行m_threads中的每个WatchCppThread对象的start()，将他们的m_initCB设为WatchCppThreadPool::init_cb
     void start();
@@ -178,8 +266,10 @@ public:
     void broadcast(const std::string& name, callback cb);
 
     void dumpWatchCppThreadStatus(std::ostream& os);
-    //根据g_thread_info_set散列[string->[string->string]]=[name->["num"/"advance"->string]]
-    //来创建fox线程池和fox线程对象并添加到m_threads中
+    //根据g_thread_info_set散列[string->[string->string]]=[name->["num"/"advance"/"io_coscheduler"->string]]
+    //来创建fox线程池和fox线程对象并添加到m_threads中，
+    //配置了io_coscheduler时不创建线程，在CoSchedulerMgr中同名的IOCoScheduler上执行
+    //(CoSchedulerMgr需要先init)
     void init();
     //执行m_threads中的每个WatchCppThread对象或foxCppThreadPoling的start()
     void start();
@@ -0,0 +1,636 @@
+#include "dns_resolver.h"
+#include "appconfig.h"
+#include "hookfunc.h"
+#include "coscheduler.h"
+#include "sock.h"
+#include "log.h"
+#include "util.h"
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <string.h>
+
+namespace yhchaos {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
+static yhchaos::AppConfigVar<bool>::ptr g_dns_enable =
+    yhchaos::AppConfig::SearchFor("dns.enable", true, "use coroutine dns resolver in NetworkAddress::SearchFor");
+
+static yhchaos::AppConfigVar<std::string>::ptr g_dns_hosts_file =
+    yhchaos::AppConfig::SearchFor("dns.hosts_file", std::string("/etc/hosts"), "dns hosts file");
+
+static yhchaos::AppConfigVar<std::string>::ptr g_dns_resolv_conf =
+    yhchaos::AppConfig::SearchFor("dns.resolv_conf", std::string("/etc/resolv.conf"), "dns resolv.conf");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dns_max_ttl =
+    yhchaos::AppConfig::SearchFor("dns.max_ttl", (uint32_t)300, "dns cache max ttl(s)");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dns_negative_ttl =
+    yhchaos::AppConfig::SearchFor("dns.negative_ttl", (uint32_t)10, "dns negative cache ttl(s)");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dns_cache_max_size =
+    yhchaos::AppConfig::SearchFor("dns.cache_max_size", (uint32_t)10000, "dns cache max size");
+
+static bool s_dns_enable = true;
+static uint32_t s_dns_max_ttl = 300;
+static uint32_t s_dns_negative_ttl = 10;
+static uint32_t s_dns_cache_max_size = 10000;
+
+struct _DnsIniter {
+    _DnsIniter() {
+        s_dns_enable = g_dns_enable->getValue();
+        g_dns_enable->addListener([](const bool& ov, const bool& nv){
+            s_dns_enable = nv;
+        });
+        s_dns_max_ttl = g_dns_max_ttl->getValue();
+        g_dns_max_ttl->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_dns_max_ttl = nv;
+        });
+        s_dns_negative_ttl = g_dns_negative_ttl->getValue();
+        g_dns_negative_ttl->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_dns_negative_ttl = nv;
+        });
+        s_dns_cache_max_size = g_dns_cache_max_size->getValue();
+        g_dns_cache_max_size->addListener([](const uint32_t& ov, const uint32_t& nv){
+            s_dns_cache_max_size = nv;
+        });
+        //监听器在新值生效前调用，直接使用nv加载，不能通过reload()读取配置
+        g_dns_hosts_file->addListener([](const std::string& ov, const std::string& nv){
+            auto dns = DnsResolverMgr::GetInstance();
+            if(dns->loadHosts(nv)) {
+                dns->clearCache();
+            }
+        });
+        g_dns_resolv_conf->addListener([](const std::string& ov, const std::string& nv){
+            auto dns = DnsResolverMgr::GetInstance();
+            if(dns->loadResolvConf(nv)) {
+                dns->clearCache();
+            }
+        });
+    }
+};
+
+static _DnsIniter s_dns_initer;
+
+enum {
+    DNS_TYPE_A = 1,
+    DNS_TYPE_AAAA = 28,
+    DNS_CLASS_IN = 1,
+    DNS_RCODE_NXDOMAIN = 3,
+    DNS_FLAG_TC = 0x0200,
+    DNS_HEADER_SIZE = 12,
+    DNS_MAX_PACKET = 1500
+};
+
+static uint16_t dns_rand_id() {
+    static thread_local std::mt19937 s_rand(std::random_device{}());
+    return (uint16_t)s_rand();
+}
+
+static void dns_put16(std::string& buf, uint16_t v) {
+    buf.push_back((char)(v >> 8));
+    buf.push_back((char)(v & 0xff));
+}
+
+static uint16_t dns_get16(const uint8_t* p) {
+    return ((uint16_t)p[0] << 8) | p[1];
+}
+
+static uint32_t dns_get32(const uint8_t* p) {
+    return ((uint32_t)dns_get16(p) << 16) | dns_get16(p + 2);
+}
+
+//构造查询报文，设置RD标志，只有一个问题
+static bool dns_build_query(std::string& buf, uint16_t id
+                            ,const std::string& name, uint16_t qtype) {
+    buf.clear();
+    dns_put16(buf, id);
+    dns_put16(buf, 0x0100);
+    dns_put16(buf, 1);
+    dns_put16(buf, 0);
+    dns_put16(buf, 0);
+    dns_put16(buf, 0);
+    size_t begin = 0;
+    while(begin < name.size()) {
+        size_t end = name.find('.', begin);
+        if(end == std::string::npos) {
+            end = name.size();
+        }
+        size_t len = end - begin;
+        if(len == 0 || len > 63) {
+            return false;
+        }
+        buf.push_back((char)len);
+        buf.append(name, begin, len);
+        begin = end + 1;
+    }
+    buf.push_back(0);
+    dns_put16(buf, qtype);
+    dns_put16(buf, DNS_CLASS_IN);
+    return buf.size() - DNS_HEADER_SIZE <= 255 + 5;
+}
+
+//跳过一个(可能被压缩的)域名，返回跳过后的位置，失败返回0
+static size_t dns_skip_name(const uint8_t* data, size_t len, size_t pos) {
+    while(pos < len) {
+        uint8_t l = data[pos];
+        if((l & 0xC0) == 0xC0) {
+            return pos + 2 <= len ? pos + 2 : 0;
+        }
+        if(l == 0) {
+            return pos + 1;
+        }
+        pos += l + 1;
+    }
+    return 0;
+}
+
+//解析应答报文
+//@return rcode, 报文非法返回-1
+static int dns_parse_response(const uint8_t* data, size_t len, uint16_t id, uint16_t qtype
+                              ,std::vector<IPNetworkAddress::ptr>& addrs, uint32_t& ttl) {
+    if(len < DNS_HEADER_SIZE || dns_get16(data) != id) {
+        return -1;
+    }
+    uint16_t flags = dns_get16(data + 2);
+    if(!(flags & 0x8000)) {
+        return -1;
+    }
+    int rcode = flags & 0x0f;
+    uint16_t qdcount = dns_get16(data + 4);
+    uint16_t ancount = dns_get16(data + 6);
+    size_t pos = DNS_HEADER_SIZE;
+    for(uint16_t i = 0; i < qdcount; ++i) {
+        pos = dns_skip_name(data, len, pos);
+        if(!pos || pos + 4 > len) {
+            return -1;
+        }
+        pos += 4;
+    }
+    ttl = ~0u;
+    for(uint16_t i = 0; i < ancount; ++i) {
+        pos = dns_skip_name(data, len, pos);
+        if(!pos || pos + 10 > len) {
+            return -1;
+        }
+        uint16_t type = dns_get16(data + pos);
+        uint16_t cls = dns_get16(data + pos + 2);
+        uint32_t rttl = dns_get32(data + pos + 4);
+        uint16_t rdlen = dns_get16(data + pos + 8);
+        pos += 10;
+        if(pos + rdlen > len) {
+            return -1;
+        }
+        //CNAME链上的记录同样计入TTL
+        ttl = std::min(ttl, rttl);
+        if(cls == DNS_CLASS_IN && type == qtype) {
+            if(type == DNS_TYPE_A && rdlen == 4) {
+                sockaddr_in addr;
+                memset(&addr, 0, sizeof(addr));
+                addr.sin_family = AF_INET;
+                memcpy(&addr.sin_addr.s_addr, data + pos, 4);
+                addrs.push_back(std::make_shared<IPv4NetworkAddress>(addr));
+            } else if(type == DNS_TYPE_AAAA && rdlen == 16) {
+                addrs.push_back(std::make_shared<IPv6NetworkAddress>(data + pos));
+            }
+        }
+        pos += rdlen;
+    }
+    if(addrs.empty()) {
+        ttl = 0;
+    }
+    return rcode;
+}
+
+//TCP上读满length字节
+static bool dns_recv_all(Sock::ptr sock, void* buffer, size_t length) {
+    size_t offset = 0;
+    while(offset < length) {
+        int rt = sock->recv((char*)buffer + offset, length - offset);
+        if(rt <= 0) {
+            return false;
+        }
+        offset += rt;
+    }
+    return true;
+}
+
+//通过TCP查询，报文前带2字节的长度
+static bool dns_query_tcp(IPNetworkAddress::ptr server, const std::string& req
+                          ,uint32_t timeout, std::string& rsp) {
+    Sock::ptr sock = Sock::CreateTCP(server);
+    if(!sock || !sock->connect(server, timeout * 1000)) {
+        return false;
+    }
+    sock->setSendTimeout(timeout * 1000);
+    sock->setRecvTimeout(timeout * 1000);
+    std::string data;
+    dns_put16(data, req.size());
+    data.append(req);
+    if(sock->send(data.c_str(), data.size()) != (int)data.size()) {
+        return false;
+    }
+    uint8_t len[2];
+    if(!dns_recv_all(sock, len, sizeof(len))) {
+        return false;
+    }
+    rsp.resize(dns_get16(len));
+    return !rsp.empty() && dns_recv_all(sock, &rsp[0], rsp.size());
+}
+
+//数字形式的IP地址不需要查询
+static IPNetworkAddress::ptr dns_numeric(const std::string& host) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    if(inet_pton(AF_INET, host.c_str(), &addr.sin_addr) == 1) {
+        addr.sin_family = AF_INET;
+        return std::make_shared<IPv4NetworkAddress>(addr);
+    }
+    sockaddr_in6 addr6;
+    memset(&addr6, 0, sizeof(addr6));
+    if(inet_pton(AF_INET6, host.c_str(), &addr6.sin6_addr) == 1) {
+        addr6.sin6_family = AF_INET6;
+        return std::make_shared<IPv6NetworkAddress>(addr6);
+    }
+    return nullptr;
+}
+
+static IPNetworkAddress::ptr dns_clone(IPNetworkAddress::ptr addr) {
+    return std::dynamic_pointer_cast<IPNetworkAddress>(
+            NetworkAddress::Create(addr->getAddr(), addr->getAddrLen()));
+}
+
+DnsResolver::DnsResolver()
+    :m_ndots(1)
+    ,m_timeout(5)
+    ,m_attempts(2) {
+    reload();
+}
+
+bool DnsResolver::reload() {
+    bool rt = loadHosts(g_dns_hosts_file->getValue());
+    rt = loadResolvConf(g_dns_resolv_conf->getValue()) && rt;
+    clearCache();
+    return rt;
+}
+
+bool DnsResolver::loadHosts(const std::string& path) {
+    std::ifstream ifs(path);
+    if(!ifs) {
+        YHCHAOS_LOG_WARN(g_logger) << "DnsResolver load hosts fail, path=" << path;
+        return false;
+    }
+    std::unordered_map<std::string, std::vector<IPNetworkAddress::ptr> > hosts;
+    std::string line;
+    while(std::getline(ifs, line)) {
+        auto pos = line.find('#');
+        if(pos != std::string::npos) {
+            line.resize(pos);
+        }
+        std::istringstream iss(line);
+        std::string ip;
+        if(!(iss >> ip)) {
+            continue;
+        }
+        auto addr = IPNetworkAddress::Create(ip.c_str());
+        if(!addr) {
+            continue;
+        }
+        std::string name;
+        while(iss >> name) {
+            hosts[ToLower(name)].push_back(addr);
+        }
+    }
+    RWMtxType::WriteLock lock(m_mutex);
+    m_hosts.swap(hosts);
+    return true;
+}
+
+bool DnsResolver::loadResolvConf(const std::string& path) {
+    std::ifstream ifs(path);
+    if(!ifs) {
+        YHCHAOS_LOG_WARN(g_logger) << "DnsResolver load resolv.conf fail, path=" << path;
+        return false;
+    }
+    std::vector<IPNetworkAddress::ptr> servers;
+    std::vector<std::string> search;
+    uint32_t ndots = 1;
+    uint32_t timeout = 5;
+    uint32_t attempts = 2;
+    std::string line;
+    while(std::getline(ifs, line)) {
+        std::istringstream iss(line);
+        std::string key;
+        if(!(iss >> key) || key[0] == '#' || key[0] == ';') {
+            continue;
+        }
+        if(key == "nameserver") {
+            std::string ip;
+            if(iss >> ip) {
+                auto addr = IPNetworkAddress::Create(ip.c_str(), 53);
+                if(addr) {
+                    servers.push_back(addr);
+                }
+            }
+        } else if(key == "search" || key == "domain") {
+            search.clear();
+            std::string domain;
+            while(iss >> domain) {
+                search.push_back(domain);
+            }
+        } else if(key == "options") {
+            std::string opt;
+            while(iss >> opt) {
+                if(opt.compare(0, 6, "ndots:") == 0) {
+                    ndots = atoi(opt.c_str() + 6);
+                } else if(opt.compare(0, 8, "timeout:") == 0) {
+                    timeout = std::max(1, atoi(opt.c_str() + 8));
+                } else if(opt.compare(0, 9, "attempts:") == 0) {
+                    attempts = std::max(1, atoi(opt.c_str() + 9));
+                }
+            }
+        }
+    }
+    RWMtxType::WriteLock lock(m_mutex);
+    m_nameservers.swap(servers);
+    m_search.swap(search);
+    m_ndots = ndots;
+    m_timeout = timeout;
+    m_attempts = attempts;
+    return true;
+}
+
+bool DnsResolver::isAvailable() {
+    if(!s_dns_enable || !yhchaos::is_hook_enable() || !CoScheduler::GetThis()) {
+        return false;
+    }
+    RWMtxType::ReadLock lock(m_mutex);
+    return !m_nameservers.empty();
+}
+
+void DnsResolver::clearCache() {
+    RWMtxType::WriteLock lock(m_mutex);
+    m_cache.clear();
+}
+
+void DnsResolver::setNameservers(const std::vector<IPNetworkAddress::ptr>& v) {
+    RWMtxType::WriteLock lock(m_mutex);
+    m_nameservers = v;
+    m_cache.clear();
+}
+
+std::vector<IPNetworkAddress::ptr> DnsResolver::getNameservers() {
+    RWMtxType::ReadLock lock(m_mutex);
+    return m_nameservers;
+}
+
+bool DnsResolver::resolve(std::vector<IPNetworkAddress::ptr>& result, const std::string& host
+                          ,int family) {
+    auto addr = dns_numeric(host);
+    if(addr) {
+        if(family == AF_UNSPEC || family == addr->getFamily()) {
+            result.push_back(addr);
+            return true;
+        }
+        return false;
+    }
+    std::string name = ToLower(host);
+    if(!name.empty() && name[name.size() - 1] == '.') {
+        name.resize(name.size() - 1);
+    }
+    if(name.empty()) {
+        return false;
+    }
+    size_t old_size = result.size();
+    {
+        RWMtxType::ReadLock lock(m_mutex);
+        auto it = m_hosts.find(name);
+        if(it != m_hosts.end()) {
+            for(auto& i : it->second) {
+                if(family == AF_UNSPEC || family == i->getFamily()) {
+                    result.push_back(dns_clone(i));
+                }
+            }
+        }
+    }
+    if(result.size() > old_size) {
+        return true;
+    }
+
+    Entry entry;
+    if(family == AF_INET || family == AF_UNSPEC) {
+        if(lookup(name, DNS_TYPE_A, entry)) {
+            for(auto& i : entry.addrs) {
+                result.push_back(dns_clone(i));
+            }
+        }
+    }
+    if(family == AF_INET6 || family == AF_UNSPEC) {
+        if(lookup(name, DNS_TYPE_AAAA, entry)) {
+            for(auto& i : entry.addrs) {
+                result.push_back(dns_clone(i));
+            }
+        }
+    }
+    return result.size() > old_size;
+}
+
+bool DnsResolver::lookup(const std::string& name, uint16_t qtype, Entry& entry) {
+    std::string key = name + "#" + std::to_string(qtype);
+    uint64_t now = GetCurrentMS();
+    {
+        RWMtxType::ReadLock lock(m_mutex);
+        auto it = m_cache.find(key);
+        if(it != m_cache.end() && it->second.expire > now) {
+            entry = it->second;
+            return !entry.addrs.empty();
+        }
+    }
+
+    Pending::ptr pending;
+    bool leader = false;
+    {
+        RWMtxType::WriteLock lock(m_mutex);
+        auto it = m_cache.find(key);
+        if(it != m_cache.end() && it->second.expire > now) {
+            entry = it->second;
+            return !entry.addrs.empty();
+        }
+        auto pit = m_pending.find(key);
+        if(pit == m_pending.end()) {
+            pending = std::make_shared<Pending>();
+            m_pending[key] = pending;
+            leader = true;
+        } else {
+            pending = pit->second;
+            ++pending->waiters;
+        }
+    }
+
+    if(!leader) {
+        pending->sem.wait();
+        entry = pending->entry;
+        return pending->ok;
+    }
+
+    pending->ok = query(name, qtype, pending->entry);
+    uint32_t waiters = 0;
+    {
+        RWMtxType::WriteLock lock(m_mutex);
+        //查询失败(超时、SERVFAIL等)不缓存
+        if(pending->entry.expire) {
+            addCacheNolock(key, pending->entry);
+        }
+        m_pending.erase(key);
+        waiters = pending->waiters;
+    }
+    for(uint32_t i = 0; i < waiters; ++i) {
+        pending->sem.notify();
+    }
+    entry = pending->entry;
+    return pending->ok;
+}
+
+void DnsResolver::addCacheNolock(const std::string& key, const Entry& entry) {
+    if(m_cache.size() >= s_dns_cache_max_size) {
+        uint64_t now = GetCurrentMS();
+        for(auto it = m_cache.begin(); it != m_cache.end();) {
+            if(it->second.expire <= now) {
+                it = m_cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if(m_cache.size() >= s_dns_cache_max_size) {
+            m_cache.clear();
+        }
+    }
+    m_cache[key] = entry;
+}
+
+bool DnsResolver::query(const std::string& name, uint16_t qtype, Entry& entry) {
+    std::vector<IPNetworkAddress::ptr> servers;
+    std::vector<std::string> names;
+    {
+        RWMtxType::ReadLock lock(m_mutex);
+        servers = m_nameservers;
+        uint32_t dots = std::count(name.begin(), name.end(), '.');
+        if(dots < m_ndots) {
+            for(auto& i : m_search) {
+                names.push_back(name + "." + i);
+            }
+        }
+    }
+    names.push_back(name);
+    if(servers.empty()) {
+        return false;
+    }
+
+    bool negative = false;
+    for(auto& i : names) {
+        int rt = queryName(servers, i, qtype, entry);
+        if(rt > 0) {
+            return true;
+        }
+        if(rt == 0) {
+            negative = true;
+        }
+    }
+    entry.addrs.clear();
+    //所有的候选名都确认不存在才负缓存
+    entry.expire = negative ? GetCurrentMS() + s_dns_negative_ttl * 1000 : 0;
+    return false;
+}
+
+int DnsResolver::queryName(const std::vector<IPNetworkAddress::ptr>& servers
+                           ,const std::string& name, uint16_t qtype, Entry& entry) {
+    uint32_t timeout = 0;
+    uint32_t attempts = 0;
+    {
+        RWMtxType::ReadLock lock(m_mutex);
+        timeout = m_timeout;
+        attempts = m_attempts;
+    }
+    uint16_t id = dns_rand_id();
+    std::string req;
+    if(!dns_build_query(req, id, name, qtype)) {
+        YHCHAOS_LOG_DEBUG(g_logger) << "DnsResolver invalid name=" << name;
+        return 0;
+    }
+    uint8_t buf[DNS_MAX_PACKET];
+    for(uint32_t n = 0; n < attempts; ++n) {
+        for(auto& server : servers) {
+            Sock::ptr sock = Sock::CreateUDP(server);
+            if(!sock || !sock->connect(server)) {
+                continue;
+            }
+            sock->setRecvTimeout(timeout * 1000);
+            if(sock->send(req.c_str(), req.size()) != (int)req.size()) {
+                continue;
+            }
+            //connect之后只会收到该nameserver的报文，id不一致的丢弃，直到超时
+            while(true) {
+                int len = sock->recv(buf, sizeof(buf));
+                if(len <= 0) {
+                    YHCHAOS_LOG_DEBUG(g_logger) << "DnsResolver query timeout name=" << name
+                        << " server=" << *server;
+                    break;
+                }
+                std::vector<IPNetworkAddress::ptr> addrs;
+                uint32_t ttl = 0;
+                int rcode = dns_parse_response(buf, len, id, qtype, addrs, ttl);
+                if(rcode < 0) {
+                    continue;
+                }
+                //应答被截断，记录不完整，改用TCP向同一个nameserver重新查询
+                if(dns_get16(buf + 2) & DNS_FLAG_TC) {
+                    std::string rsp;
+                    addrs.clear();
+                    if(!dns_query_tcp(server, req, timeout, rsp)) {
+                        YHCHAOS_LOG_DEBUG(g_logger) << "DnsResolver tcp query fail name=" << name
+                            << " server=" << *server;
+                        break;
+                    }
+                    rcode = dns_parse_response((const uint8_t*)rsp.c_str(), rsp.size()
+                                               ,id, qtype, addrs, ttl);
+                    if(rcode < 0 || (dns_get16((const uint8_t*)rsp.c_str() + 2) & DNS_FLAG_TC)) {
+                        break;
+                    }
+                }
+                if(rcode == 0 && !addrs.empty()) {
+                    entry.addrs.swap(addrs);
+                    entry.expire = GetCurrentMS() + std::min(ttl, s_dns_max_ttl) * 1000;
+                    return 1;
+                }
+                if(rcode == 0 || rcode == DNS_RCODE_NXDOMAIN) {
+                    return 0;
+                }
+                YHCHAOS_LOG_DEBUG(g_logger) << "DnsResolver query name=" << name
+                    << " server=" << *server << " rcode=" << rcode;
+                break;
+            }
+        }
+    }
+    return -1;
+}
+
+std::string DnsResolver::toString() {
+    std::stringstream ss;
+    RWMtxType::ReadLock lock(m_mutex);
+    ss << "[DnsResolver nameservers=";
+    for(auto& i : m_nameservers) {
+        ss << *i << " ";
+    }
+    ss << "hosts=" << m_hosts.size()
+       << " cache=" << m_cache.size()
+       << " pending=" << m_pending.size()
+       << " ndots=" << m_ndots
+       << " timeout=" << m_timeout
+       << " attempts=" << m_attempts
+       << "]";
+    return ss.str();
+}
+
+}
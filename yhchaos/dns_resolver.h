@@ -0,0 +1,126 @@
+#ifndef __YHCHAOS_DNS_RESOLVER_H__
+#define __YHCHAOS_DNS_RESOLVER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "mtx.h"
+#include "singleton.h"
+#include "network_address.h"
+
+namespace yhchaos {
+
+/**
+ * @brief 协程化的DNS解析器
+ * @details 通过UDP socket直接向resolv.conf中的nameserver查询A/AAAA记录，
+ *          socket的读写经过hook由IOCoScheduler调度，不会阻塞IO线程，
+ *          应答被截断(TC)时改用TCP重新查询
+ *          1. 优先查询hosts文件
+ *          2. 按记录的TTL缓存结果，NXDOMAIN和空结果也会缓存(负缓存)
+ *          3. 同一个域名同时只有一个协程在查询，其他协程等待它的结果
+ */
+class DnsResolver : Noncopyable {
+public:
+    typedef std::shared_ptr<DnsResolver> ptr;
+    typedef RWMtx RWMtxType;
+
+    DnsResolver();
+
+    /**
+     * @brief 重新读取hosts文件和resolv.conf
+     */
+    bool reload();
+
+    /**
+     * @brief 读取hosts文件，替换当前的hosts记录
+     * @param[in] path hosts文件路径
+     * @return 文件打开失败返回false，保留原来的记录
+     */
+    bool loadHosts(const std::string& path);
+
+    /**
+     * @brief 读取resolv.conf，替换nameserver、search域和options
+     * @param[in] path resolv.conf路径
+     * @return 文件打开失败返回false，保留原来的配置
+     */
+    bool loadResolvConf(const std::string& path);
+
+    /**
+     * @brief 解析域名
+     * @param[out] result 解析结果，端口为0
+     * @param[in] host 域名或者IP地址
+     * @param[in] family AF_INET查询A记录，AF_INET6查询AAAA记录，AF_UNSPEC两者都查
+     * @return 是否解析到地址
+     * @details 必须在开启hook的协程中调用
+     */
+    bool resolve(std::vector<IPNetworkAddress::ptr>& result, const std::string& host
+                 ,int family = AF_INET);
+
+    /**
+     * @brief 当前上下文能否使用该解析器
+     * @details 配置dns.enable开启，在开启hook的协程中，并且配置了nameserver
+     */
+    bool isAvailable();
+
+    /**
+     * @brief 清空解析缓存
+     */
+    void clearCache();
+
+    /**
+     * @brief 设置nameserver，覆盖resolv.conf中的配置
+     */
+    void setNameservers(const std::vector<IPNetworkAddress::ptr>& v);
+    std::vector<IPNetworkAddress::ptr> getNameservers();
+    std::string toString();
+private:
+    /**
+     * @brief 缓存项，addrs为空表示负缓存
+     */
+    struct Entry {
+        std::vector<IPNetworkAddress::ptr> addrs;
+        /// 过期时间(毫秒)
+        uint64_t expire = 0;
+    };
+
+    /**
+     * @brief 正在进行的查询
+     */
+    struct Pending {
+        typedef std::shared_ptr<Pending> ptr;
+        CoroutineSem sem;
+        /// 等待结果的协程数，受m_mutex保护
+        uint32_t waiters = 0;
+        Entry entry;
+        bool ok = false;
+    };
+
+    //查询一个域名的一种记录，带缓存和请求合并
+    bool lookup(const std::string& name, uint16_t qtype, Entry& entry);
+    //依次尝试search域，向nameserver发送查询
+    bool query(const std::string& name, uint16_t qtype, Entry& entry);
+    //向nameserver查询完整域名
+    //@return 1 成功, 0 域名不存在或者没有记录, -1 失败
+    int queryName(const std::vector<IPNetworkAddress::ptr>& servers
+                  ,const std::string& name, uint16_t qtype, Entry& entry);
+    void addCacheNolock(const std::string& key, const Entry& entry);
+private:
+    RWMtxType m_mutex;
+    /// hosts文件，小写域名 -> 地址
+    std::unordered_map<std::string, std::vector<IPNetworkAddress::ptr> > m_hosts;
+    std::vector<IPNetworkAddress::ptr> m_nameservers;
+    std::vector<std::string> m_search;
+    uint32_t m_ndots;
+    uint32_t m_timeout;
+    uint32_t m_attempts;
+    /// 解析缓存，key=小写域名#记录类型
+    std::unordered_map<std::string, Entry> m_cache;
+    std::unordered_map<std::string, Pending::ptr> m_pending;
+};
+
+typedef yhchaos::Singleton<DnsResolver> DnsResolverMgr;
+
+}
+
+#endif
@@ -11,6 +11,18 @@ static yhchaos::AppConfigVar<std::unordered_map<std::string
     yhchaos::AppConfig::SearchFor("dp_services", std::unordered_map<std::string
     ,std::unordered_map<std::string, std::string> >(), "dp_services");
 
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dp_hedge_percentile =
+    yhchaos::AppConfig::SearchFor("dp.hedge.percentile", (uint32_t)95
+    ,"dp hedge request after this latency percentile, 0 disable");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dp_hedge_budget_percent =
+    yhchaos::AppConfig::SearchFor("dp.hedge.budget_percent", (uint32_t)5
+    ,"dp hedge requests percent of total requests");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_dp_hedge_min_delay =
+    yhchaos::AppConfig::SearchFor("dp.hedge.min_delay_ms", (uint32_t)2
+    ,"dp hedge request min delay(ms)");
+
 //static yhchaos::AppConfigVar<std::unordered_map<std::string
 //    ,std::unordered_map<std::string, std::string> > >::ptr g_dp_services =
 //    yhchaos::AppConfig::SearchFor("dp_services", std::unordered_map<std::string
@@ -179,7 +191,8 @@ bool DPClient::connect(yhchaos::NetworkAddress::ptr addr) {
 }
 
 DPSDLoadBalance::DPSDLoadBalance(ISD::ptr sd)
-    :SDLoadBalance(sd) {
+    :SDLoadBalance(sd)
+    ,m_hedgeTokens(std::make_shared<std::atomic<int64_t> >(0)) {
 }
 
 static SockStream::ptr create_dp_stream(ServiceItemInfo::ptr info) {
@@ -226,22 +239,168 @@ DPRes::ptr DPSDLoadBalance::request(const std::string& domain, const std::string
     if(!conn) {
         return std::make_shared<DPRes>(ILoadBalance::NO_CONNECTION, 0, nullptr, req);
     }
+    return doRequest(conn, req, timeout_ms);
+}
+
+DPRes::ptr DPSDLoadBalance::doRequest(LBItem::ptr conn, DPReq::ptr req, uint32_t timeout_ms) {
+    //熔断器的探测名额已经被其他请求占用
+    bool probe = false;
+    if(!conn->onReqBegin(probe)) {
+        return std::make_shared<DPRes>(ILoadBalance::NO_CONNECTION, 0, nullptr, req);
+    }
     uint64_t ts = yhchaos::GetCurrentMS();
+    uint64_t us = yhchaos::GetCurrentUS();
     auto& stats = conn->get(ts / 1000);
     stats.incDoing(1);
     stats.incTotal(1);
     auto r = conn->getStreamAs<DPStream>()->request(req, timeout_ms);
     uint64_t ts2 = yhchaos::GetCurrentMS();
+    uint64_t us2 = yhchaos::GetCurrentUS();
     if(r->result == 0) {
         stats.incOks(1);
         stats.incUsedTime(ts2 -ts);
+        stats.incLatency(ts2 - ts);
     } else if(r->result == AsyncSockStream::TIMEOUT) {
         stats.incTimeouts(1);
+    } else if(r->result == AsyncSockStream::CANCELLED) {
+        //被对冲请求取消，不算失败
     } else if(r->result < 0) {
         stats.incErrs(1);
     }
     stats.decDoing(1);
+    conn->onReqEnd(r->result, us2 - us, probe);
     return r;
 }
 
+void DPSDLoadBalance::cancelRequest(LBItem::ptr conn, DPReq::ptr req) {
+    conn->getStreamAs<DPStream>()->cancel(req->getSn());
+}
+
+namespace {
+//一次对冲请求的共享状态，在发起的各个协程间共享
+struct HedgeCtx {
+    typedef std::shared_ptr<HedgeCtx> ptr;
+    yhchaos::Mtx mutex;
+    //决出结果时通知等待的调用者
+    yhchaos::CoroutineSem sem;
+    //已发出的请求
+    std::vector<LBItem::ptr> conns;
+    //还没有结束的请求数
+    uint32_t pending = 0;
+    bool done = false;
+    DPRes::ptr result;
+};
+}
+
+//在新协程中执行func向conn发送请求，第一个成功的回复或全部失败后通知调用者
+static void hedge_launch(HedgeCtx::ptr ctx, LBItem::ptr conn
+                         ,std::function<DPRes::ptr()> func) {
+    {
+        yhchaos::Mtx::Lock lock(ctx->mutex);
+        ctx->conns.push_back(conn);
+        ++ctx->pending;
+    }
+    yhchaos::IOCoScheduler::GetThis()->coschedule([ctx, func](){
+        DPRes::ptr r;
+        {
+            yhchaos::Mtx::Lock lock(ctx->mutex);
+            if(ctx->done) {
+                --ctx->pending;
+                return;
+            }
+        }
+        r = func();
+        yhchaos::Mtx::Lock lock(ctx->mutex);
+        --ctx->pending;
+        if(ctx->done) {
+            return;
+        }
+        ctx->result = r;
+        if(r->result >= 0 || ctx->pending == 0) {
+            ctx->done = true;
+            lock.unlock();
+            ctx->sem.notify();
+        }
+    });
+}
+
+DPRes::ptr DPSDLoadBalance::hedgeRequest(const std::string& domain, const std::string& service,
+                                               DPReq::ptr req, uint32_t timeout_ms) {
+    auto lb = get(domain, service);
+    if(!lb) {
+        return std::make_shared<DPRes>(ILoadBalance::NO_SERVICE, 0, nullptr, req);
+    }
+    auto conn = lb->get();
+    if(!conn) {
+        return std::make_shared<DPRes>(ILoadBalance::NO_CONNECTION, 0, nullptr, req);
+    }
+
+    //每个请求积累budget_percent的额度，上限为10次对冲
+    auto tokens = m_hedgeTokens;
+    if(*tokens < 1000) {
+        *tokens += g_dp_hedge_budget_percent->getValue();
+    }
+
+    uint32_t percentile = g_dp_hedge_percentile->getValue();
+    uint32_t delay = 0;
+    if(percentile) {
+        //样本太少时百分位没有意义
+        HolderStats total = conn->getTotal();
+        if(total.getLatencyCount() >= 20) {
+            delay = std::max(total.getLatencyPercentile(percentile)
+                        ,g_dp_hedge_min_delay->getValue());
+        }
+    }
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    if(!delay || delay >= timeout_ms || !iom) {
+        return doRequest(conn, req, timeout_ms);
+    }
+
+    uint64_t ts = yhchaos::GetCurrentMS();
+    HedgeCtx::ptr ctx(new HedgeCtx);
+    hedge_launch(ctx, conn, [this, conn, req, timeout_ms](){
+        return doRequest(conn, req, timeout_ms);
+    });
+    auto timer = iom->addTimedCoroutine(delay, [this, ctx, lb, conn, req, timeout_ms, ts, tokens](){
+        {
+            yhchaos::Mtx::Lock lock(ctx->mutex);
+            if(ctx->done) {
+                return;
+            }
+        }
+        int64_t v = *tokens;
+        do {
+            if(v < 100) {
+                return;
+            }
+        } while(!tokens->compare_exchange_weak(v, v - 100));
+
+        LBItem::ptr other;
+        for(int i = 0; i < 3 && (!other || other == conn); ++i) {
+            other = lb->get();
+        }
+        uint64_t used = yhchaos::GetCurrentMS() - ts;
+        if(!other || other == conn || used >= timeout_ms) {
+            *tokens += 100;
+            return;
+        }
+        uint32_t left = timeout_ms - used;
+        hedge_launch(ctx, other, [this, other, req, left](){
+            return doRequest(other, req, left);
+        });
+    });
+
+    ctx->sem.wait();
+    timer->cancel();
+    yhchaos::Mtx::Lock lock(ctx->mutex);
+    auto conns = ctx->conns;
+    auto r = ctx->result;
+    lock.unlock();
+    //取消其他还在等待回复的请求，已经结束的请求取消不到
+    for(auto& i : conns) {
+        cancelRequest(i, req);
+    }
+    return std::make_shared<DPRes>(r->result, yhchaos::GetCurrentMS() - ts, r->response, req);
+}
+
 }
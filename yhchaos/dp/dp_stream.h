@@ -139,6 +139,25 @@ public:
     DPRes::ptr request(const std::string& domain, const std::string& service,
                              DPReq::ptr req, uint32_t timeout_ms, uint64_t idx = -1);
 
+    /**
+     * @brief 对冲请求，只能用于幂等的请求
+     * @details 
+     *  1. 先向一个流发送请求，超过该流最近耗时的dp.hedge.percentile百分位仍没有回复时，
+     *     再选一个不同的流发送同一个请求
+     *  2. 先收到的成功回复作为结果返回，并取消另一个还在等待的请求
+     *  3. 对冲请求数不超过总请求数的dp.hedge.budget_percent，额度不够或样本不足时退化为request
+     *  4. 返回后仍可能有被取消的请求在结束中，对象需要比请求活得长
+    */
+    DPRes::ptr hedgeRequest(const std::string& domain, const std::string& service,
+                             DPReq::ptr req, uint32_t timeout_ms);
+protected:
+    //向conn发送请求，并更新conn的统计信息
+    virtual DPRes::ptr doRequest(LBItem::ptr conn, DPReq::ptr req, uint32_t timeout_ms);
+    //取消conn上还在等待回复的请求，已经结束的请求取消不到
+    virtual void cancelRequest(LBItem::ptr conn, DPReq::ptr req);
+private:
+    //对冲额度，每个请求增加budget_percent，每次对冲消耗100
+    std::shared_ptr<std::atomic<int64_t> > m_hedgeTokens;
 };
 
 }
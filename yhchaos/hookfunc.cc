@@ -1,5 +1,6 @@
 #include "hookfunc.h"
 #include <dlfcn.h>
+#include <sys/sendfile.h>
 
 #include "appconfig.h"
 #include "log.h"
@@ -33,6 +34,7 @@ static thread_local bool t_hook_enable = false;
     XX(send) \
     XX(sendto) \
     XX(sendmsg) \
+    XX(sendfile) \
     XX(close) \
     XX(fcntl) \
     XX(ioctl) \
@@ -358,6 +360,11 @@ ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
     return do_io(s, sendmsg_fun, "sendmsg", yhchaos::IOCoScheduler::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
+//out_fd是socket时，发送缓冲区满了会挂起当前协程，等可写后继续
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    return do_io(out_fd, sendfile_fun, "sendfile", yhchaos::IOCoScheduler::WRITE, SO_SNDTIMEO, in_fd, offset, count);
+}
+
 int close(int fd) {
     if(!yhchaos::t_hook_enable) {
         return close_fun(fd);
@@ -74,6 +74,9 @@ extern sendto_func sendto_fun;
 typedef ssize_t (*sendmsg_func)(int s, const struct msghdr *msg, int flags);
 extern sendmsg_func sendmsg_fun;
 
+typedef ssize_t (*sendfile_func)(int out_fd, int in_fd, off_t *offset, size_t count);
+extern sendfile_func sendfile_fun;
+
 typedef int (*close_func)(int fd);
 extern close_func close_fun;
 
@@ -1,9 +1,12 @@
 #include "cpp_servlet.h"
+#include "yhchaos/log.h"
 #include <fnmatch.h>
 
 namespace yhchaos {
 namespace http {
 
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
 FunctionCppServlet::FunctionCppServlet(callback cb)
     :CppServlet("FunctionCppServlet")
     ,m_cb(cb) {
@@ -17,41 +20,244 @@ int32_t FunctionCppServlet::handle(yhchaos::http::HttpReq::ptr request
 
 
 
+struct CppServletRouter::Node {
+    ~Node() {
+        for(auto& i : children) {
+            delete i;
+        }
+        delete param;
+    }
+    /// 压缩后的静态路径
+    std::string path;
+    /// 静态子节点的首字符，与children一一对应
+    std::string indices;
+    std::vector<Node*> children;
+    /// :name子节点，匹配一个路径段后从该节点继续
+    Node* param = nullptr;
+    std::string paramName;
+    /// 在此处结束的路由
+    ICppServletCreator::ptr handler;
+    /// 在此处开始的尾部通配路由
+    ICppServletCreator::ptr wildcard;
+};
+
+CppServletRouter::CppServletRouter()
+    :m_root(new Node) {
+}
+
+CppServletRouter::~CppServletRouter() {
+    delete m_root;
+}
+
+static bool is_param_char(char c) {
+    return isalnum(c) || c == '_';
+}
+
+bool CppServletRouter::IsCompilable(const std::string& pattern) {
+    for(size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if(c == '?' || c == '[' || c == '\\') {
+            return false;
+        }
+        if(c == '*' && i != pattern.size() - 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+CppServletRouter::Node* CppServletRouter::InsertStatic(Node* n, const std::string& s) {
+    size_t pos = 0;
+    while(pos < s.size()) {
+        auto idx = n->indices.find(s[pos]);
+        if(idx == std::string::npos) {
+            auto c = new Node;
+            c->path = s.substr(pos);
+            n->indices.push_back(s[pos]);
+            n->children.push_back(c);
+            return c;
+        }
+        auto c = n->children[idx];
+        size_t common = 0;
+        while(common < c->path.size() && pos + common < s.size()
+                && c->path[common] == s[pos + common]) {
+            ++common;
+        }
+        if(common < c->path.size()) {
+            auto mid = new Node;
+            mid->path = c->path.substr(0, common);
+            c->path = c->path.substr(common);
+            mid->indices.push_back(c->path[0]);
+            mid->children.push_back(c);
+            n->children[idx] = mid;
+            c = mid;
+        }
+        pos += common;
+        n = c;
+    }
+    return n;
+}
+
+bool CppServletRouter::add(const std::string& pattern, ICppServletCreator::ptr creator) {
+    Node* n = m_root;
+    size_t pos = 0;
+    while(pos < pattern.size()) {
+        char c = pattern[pos];
+        if(c == '*') {
+            n->wildcard = creator;
+            return true;
+        }
+        if(c == ':' && (pos == 0 || pattern[pos - 1] == '/')
+                && pos + 1 < pattern.size() && is_param_char(pattern[pos + 1])) {
+            size_t end = pos + 1;
+            while(end < pattern.size() && is_param_char(pattern[end])) {
+                ++end;
+            }
+            std::string name = pattern.substr(pos + 1, end - pos - 1);
+            if(!n->param) {
+                n->param = new Node;
+                n->paramName = name;
+            } else if(n->paramName != name) {
+                //共用参数节点会让后加的路由取到错误的参数名
+                YHCHAOS_LOG_ERROR(g_logger) << "CppServletRouter add pattern=" << pattern
+                    << " param :" << name << " conflicts with :" << n->paramName;
+                return false;
+            }
+            n = n->param;
+            pos = end;
+            continue;
+        }
+        //静态部分一直到下一个参数或通配
+        size_t end = pos;
+        while(end < pattern.size() && pattern[end] != '*'
+                && !(pattern[end] == ':' && (end == 0 || pattern[end - 1] == '/'))) {
+            ++end;
+        }
+        if(end == pos) {
+            //不是合法参数的':'按普通字符处理
+            ++end;
+        }
+        n = InsertStatic(n, pattern.substr(pos, end - pos));
+        pos = end;
+    }
+    n->handler = creator;
+    return true;
+}
+
+bool CppServletRouter::Match(const Node* n, const std::string& path, size_t pos
+                             ,HttpReq::MapType* params, ICppServletCreator::ptr& rt) {
+    if(pos == path.size() && n->handler) {
+        rt = n->handler;
+        return true;
+    }
+    if(pos < path.size()) {
+        auto idx = n->indices.find(path[pos]);
+        if(idx != std::string::npos) {
+            auto c = n->children[idx];
+            if(path.compare(pos, c->path.size(), c->path) == 0
+                    && Match(c, path, pos + c->path.size(), params, rt)) {
+                return true;
+            }
+        }
+        if(n->param && path[pos] != '/') {
+            size_t end = path.find('/', pos);
+            if(end == std::string::npos) {
+                end = path.size();
+            }
+            if(Match(n->param, path, end, params, rt)) {
+                if(params) {
+                    (*params)[n->paramName] = path.substr(pos, end - pos);
+                }
+                return true;
+            }
+        }
+    }
+    if(n->wildcard) {
+        rt = n->wildcard;
+        if(params) {
+            (*params)["*"] = path.substr(pos);
+        }
+        return true;
+    }
+    return false;
+}
+
+ICppServletCreator::ptr CppServletRouter::match(const std::string& path, HttpReq::MapType* params) const {
+    ICppServletCreator::ptr rt;
+    Match(m_root, path, 0, params, rt);
+    return rt;
+}
+
+struct CppServletDispatch::Routes {
+    std::unordered_map<std::string, ICppServletCreator::ptr> datas;
+    CppServletRouter router;
+    /// 不能编译进前缀树的模糊匹配，按添加顺序fnmatch
+    std::vector<std::pair<std::string, ICppServletCreator::ptr> > globs;
+};
+
 CppServletDispatch::CppServletDispatch()
-    :CppServlet("CppServletDispatch") {
+    :CppServlet("CppServletDispatch")
+    ,m_routes(std::make_shared<const Routes>()) {
     m_default.reset(new NotFoundCppServlet("yhchaos/1.0"));
 }
 
 int32_t CppServletDispatch::handle(yhchaos::http::HttpReq::ptr request
                , yhchaos::http::HttpRsp::ptr response
                , yhchaos::http::HSession::ptr session) {
-    auto slt = getMatchedCppServlet(request->getPath());
+    auto slt = getMatchedCppServlet(request->getPath(), request);
     if(slt) {
         slt->handle(request, response, session);
     }
     return 0;
 }
 
+bool CppServletDispatch::rebuildNolock() {
+    std::shared_ptr<Routes> routes(new Routes);
+    routes->datas = m_datas;
+    for(auto& i : m_globs) {
+        if(CppServletRouter::IsCompilable(i.first)) {
+            if(!routes->router.add(i.first, i.second)) {
+                return false;
+            }
+        } else {
+            routes->globs.push_back(i);
+        }
+    }
+    std::atomic_store(&m_routes, std::shared_ptr<const Routes>(routes));
+    return true;
+}
+
+void CppServletDispatch::addGlobNolock(const std::string& uri, ICppServletCreator::ptr creator) {
+    auto old = m_globs;
+    for(auto it = m_globs.begin();
+            it != m_globs.end(); ++it) {
+        if(it->first == uri) {
+            m_globs.erase(it);
+            break;
+        }
+    }
+    m_globs.push_back(std::make_pair(uri, creator));
+    if(!rebuildNolock()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "addGlobCppServlet uri=" << uri << " rejected";
+        m_globs.swap(old);
+    }
+}
+
 void CppServletDispatch::addCppServlet(const std::string& uri, CppServlet::ptr slt) {
     RWMtxType::WriteLock lock(m_mutex);
     m_datas[uri] = std::make_shared<HoldCppServletCreator>(slt);
+    rebuildNolock();
 }
 
 void CppServletDispatch::addCppServletCreator(const std::string& uri, ICppServletCreator::ptr creator) {
     RWMtxType::WriteLock lock(m_mutex);
     m_datas[uri] = creator;
+    rebuildNolock();
 }
 
 void CppServletDispatch::addGlobCppServletCreator(const std::string& uri, ICppServletCreator::ptr creator) {
     RWMtxType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
-        if(it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
-    }
-    m_globs.push_back(std::make_pair(uri, creator));
+    addGlobNolock(uri, creator);
 }
 
 void CppServletDispatch::addCppServlet(const std::string& uri
@@ -59,20 +265,13 @@ void CppServletDispatch::addCppServlet(const std::string& uri
     RWMtxType::WriteLock lock(m_mutex);
     m_datas[uri] = std::make_shared<HoldCppServletCreator>(
                         std::make_shared<FunctionCppServlet>(cb));
+    rebuildNolock();
 }
 
 void CppServletDispatch::addGlobCppServlet(const std::string& uri
                                     ,CppServlet::ptr slt) {
     RWMtxType::WriteLock lock(m_mutex);
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
-        if(it->first == uri) {
-            m_globs.erase(it);
-            break;
-        }
-    }
-    m_globs.push_back(std::make_pair(uri
-                , std::make_shared<HoldCppServletCreator>(slt)));
+    addGlobNolock(uri, std::make_shared<HoldCppServletCreator>(slt));
 }
 
 void CppServletDispatch::addGlobCppServlet(const std::string& uri
@@ -83,6 +282,7 @@ void CppServletDispatch::addGlobCppServlet(const std::string& uri
 void CppServletDispatch::delCppServlet(const std::string& uri) {
     RWMtxType::WriteLock lock(m_mutex);
     m_datas.erase(uri);
+    rebuildNolock();
 }
 
 void CppServletDispatch::delGlobCppServlet(const std::string& uri) {
@@ -94,6 +294,7 @@ void CppServletDispatch::delGlobCppServlet(const std::string& uri) {
             break;
         }
     }
+    rebuildNolock();
 }
 
 CppServlet::ptr CppServletDispatch::getCppServlet(const std::string& uri) {
@@ -114,13 +315,26 @@ CppServlet::ptr CppServletDispatch::getGlobCppServlet(const std::string& uri) {
 }
 
 CppServlet::ptr CppServletDispatch::getMatchedCppServlet(const std::string& uri) {
-    RWMtxType::ReadLock lock(m_mutex);
-    auto mit = m_datas.find(uri);
-    if(mit != m_datas.end()) {
+    return getMatchedCppServlet(uri, nullptr);
+}
+
+CppServlet::ptr CppServletDispatch::getMatchedCppServlet(const std::string& uri
+                                                        ,HttpReq::ptr request) {
+    auto routes = std::atomic_load(&m_routes);
+    auto mit = routes->datas.find(uri);
+    if(mit != routes->datas.end()) {
         return mit->second->get();
     }
-    for(auto it = m_globs.begin();
-            it != m_globs.end(); ++it) {
+    HttpReq::MapType params;
+    auto creator = routes->router.match(uri, request ? &params : nullptr);
+    if(creator) {
+        if(request && !params.empty()) {
+            request->setRouteParams(params);
+        }
+        return creator->get();
+    }
+    for(auto it = routes->globs.begin();
+            it != routes->globs.end(); ++it) {
         if(!fnmatch(it->first.c_str(), uri.c_str(), 0)) {
             return it->second->get();
         }
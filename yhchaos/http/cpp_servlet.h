@@ -10,6 +10,7 @@
 #include "http_session.h"
 #include "yhchaos/cpp_thread.h"
 #include "yhchaos/util.h"
+#include "yhchaos/noncopyable.h"
 
 namespace yhchaos {
 namespace http {
@@ -27,7 +28,8 @@ public:
      * @param[in] name 名称
      */
     CppServlet(const std::string& name)
-        :m_name(name) {}
+        :m_name(name)
+        ,m_streamBody(false) {}
 
     /**
      * @brief 析构函数
@@ -49,9 +51,22 @@ public:
      * @brief 返回CppServlet名称
      */
     const std::string& getName() const { return m_name;}
+
+    /**
+     * @brief 是否流式读取请求的消息体
+     * @details 为true时HttpSvr不预先读取消息体，handle中通过request->getBodyStream()读取
+     */
+    bool isStreamBody() const { return m_streamBody;}
+
+    /**
+     * @brief 设置是否流式读取请求的消息体，用于上传大文件等场景
+     */
+    void setStreamBody(bool v) { m_streamBody = v;}
 protected:
     /// 名称
     std::string m_name;
+    /// 是否流式读取请求的消息体
+    bool m_streamBody;
 };
 
 /**
@@ -122,6 +137,53 @@ public:
     }
 };
 
+/**
+ * @brief 压缩前缀树(radix tree)路由
+ * @details 支持三种模式，查找的代价与路径长度成正比，与路由的个数无关
+ *  1. 静态路径: /api/user
+ *  2. 参数: /api/user/:id，:id匹配一个不含'/'的非空路径段，捕获为参数id
+ *  3. 尾部通配: 以*结尾，如"/static/"后跟*，*匹配剩余的任意内容(包括'/')，捕获为参数"*"
+ *  同一个位置优先匹配静态路径，其次参数，最后通配，匹配失败时回溯；
+ *  匹配按模式的具体程度，与添加顺序无关
+ */
+class CppServletRouter : Noncopyable {
+public:
+    typedef std::shared_ptr<CppServletRouter> ptr;
+    CppServletRouter();
+    ~CppServletRouter();
+
+    /**
+     * @brief pattern能否编译进前缀树
+     * @details 含有?、[、\\或*不在末尾的fnmatch模式不能编译
+     */
+    static bool IsCompilable(const std::string& pattern);
+
+    /**
+     * @brief 添加路由，pattern已存在时覆盖
+     * @param[in] pattern 满足IsCompilable的模式
+     * @param[in] creator servlet
+     * @return 同一位置已有不同名字的参数(如/u/:id和/u/:name)时返回false，此时树可能已被部分修改
+     */
+    bool add(const std::string& pattern, ICppServletCreator::ptr creator);
+
+    /**
+     * @brief 匹配路径
+     * @param[in] path 请求路径
+     * @param[out] params 非空时保存捕获的参数
+     * @return 没有匹配的路由时返回nullptr
+     */
+    ICppServletCreator::ptr match(const std::string& path, HttpReq::MapType* params) const;
+private:
+    struct Node;
+    //在n下插入静态路径s，必要时分裂节点，返回s结束处的节点
+    static Node* InsertStatic(Node* n, const std::string& s);
+    //从n开始匹配path[pos:]
+    static bool Match(const Node* n, const std::string& path, size_t pos
+                      ,HttpReq::MapType* params, ICppServletCreator::ptr& rt);
+private:
+    Node* m_root;
+};
+
 /**
  * @brief CppServlet分发器，是一个特殊的servlet，由其handle函数决定具体去请求哪一个servlet
  */
@@ -156,6 +218,8 @@ public:
      * @brief 添加模糊匹配servlet，如果uri已存在，则会覆盖
      * @param[in] uri uri 模糊匹配 /yhchaos_*
      * @param[in] slt servlet
+     * @details 能编译进前缀树的模式(见CppServletRouter::IsCompilable)总是优先于不能编译的模式，
+     *          与添加顺序无关；与已有路由在同一位置的参数名冲突时拒绝添加并输出错误日志
      */
     void addGlobCppServlet(const std::string& uri, CppServlet::ptr slt);
 
@@ -218,16 +282,35 @@ public:
      * @brief 通过uri获取servlet
      * @param[in] uri uri
      * @return 优先精准匹配,其次模糊匹配,最后返回默认
+     * @details 模糊匹配先查前缀树，再按添加顺序对不能编译的模式执行fnmatch，
+     *          因此前缀树中的模式会覆盖先添加的fnmatch模式(与旧版本按添加顺序匹配不同)；
+     *          读取的是路由快照，不加锁
      */
     CppServlet::ptr getMatchedCppServlet(const std::string& uri);
 
+    /**
+     * @brief 通过uri获取servlet，并把捕获的路由参数设置到request中
+     * @param[in] uri uri
+     * @param[in] request 非空时设置路由参数
+     */
+    CppServlet::ptr getMatchedCppServlet(const std::string& uri, HttpReq::ptr request);
+
     void listAllCppServletCreator(std::map<std::string, ICppServletCreator::ptr>& infos);
     void listAllGlobCppServletCreator(std::map<std::string, ICppServletCreator::ptr>& infos);
 private:
+    //根据m_datas和m_globs生成新的路由快照并替换m_routes，需持有m_mutex写锁
+    //@return 参数名冲突时返回false，不替换m_routes
+    bool rebuildNolock();
+    //添加或覆盖模糊匹配，冲突时回滚，需持有m_mutex写锁
+    void addGlobNolock(const std::string& uri, ICppServletCreator::ptr creator);
+private:
+    struct Routes;
     RWMtxType m_mutex;
     std::unordered_map<std::string, ICppServletCreator::ptr> m_datas;
     /// 模糊匹配servlet 数组，上面不匹配的时候使用
     std::vector<std::pair<std::string, ICppServletCreator::ptr> > m_globs;
+    /// 由m_datas和m_globs编译出的只读路由快照，通过std::atomic_load/std::atomic_store访问
+    std::shared_ptr<const Routes> m_routes;
     CppServlet::ptr m_default;
 };
 
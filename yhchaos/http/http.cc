@@ -1,5 +1,6 @@
 #include "http.h"
 #include "yhchaos/util.h"
+#include <sys/stat.h>
 
 namespace yhchaos {
 namespace http {
@@ -91,6 +92,16 @@ std::string HttpReq::getCookie(const std::string& key
     return it == m_cookies.end() ? def : it->second;
 }
 
+std::string HttpReq::getRouteParam(const std::string& key
+                            ,const std::string& def) const {
+    auto it = m_routeParams.find(key);
+    return it == m_routeParams.end() ? def : it->second;
+}
+
+void HttpReq::setRouteParam(const std::string& key, const std::string& val) {
+    m_routeParams[key] = val;
+}
+
 void HttpReq::setHeader(const std::string& key, const std::string& val) {
     m_headers[key] = val;
 }
@@ -272,7 +283,29 @@ HttpRsp::HttpRsp(uint8_t version, bool close)
     :m_status(HStatus::OK)
     ,m_version(version)
     ,m_close(close)
-    ,m_websocket(false) {
+    ,m_websocket(false)
+    ,m_bodyFileOffset(0)
+    ,m_bodyFileLength(0)
+    ,m_bodyData(nullptr)
+    ,m_bodyDataLength(0) {
+}
+
+void HttpRsp::setBodyData(std::shared_ptr<const void> holder, const char* data, uint64_t length) {
+    m_bodyDataHolder = holder;
+    m_bodyData = data;
+    m_bodyDataLength = length;
+}
+
+bool HttpRsp::setBodyFile(const std::string& path, uint64_t offset, uint64_t length) {
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)
+            || offset > (uint64_t)st.st_size) {
+        return false;
+    }
+    m_bodyFile = path;
+    m_bodyFileOffset = offset;
+    m_bodyFileLength = std::min(length, (uint64_t)st.st_size - offset);
+    return true;
 }
 
 std::string HttpRsp::getHeader(const std::string& key, const std::string& def) const {
@@ -343,7 +376,19 @@ std::ostream& HttpRsp::dump(std::ostream& os) const {
     if(!m_websocket) {
         os << "connection: " << (m_close ? "close" : "keep-alive") << "\r\n";
     }
-    if(!m_body.empty()) {
+    if(m_bodyWriter) {
+        //HTTP/1.0不支持chunked，以关闭连接作为消息体的结束
+        if(m_version >= 0x11) {
+            os << "transfer-encoding: chunked\r\n";
+        }
+        os << "\r\n";
+    } else if(hasBodyFile()) {
+        //文件内容由HSession::sendRsp在头部之后发送
+        os << "content-length: " << m_bodyFileLength << "\r\n\r\n";
+    } else if(m_bodyData) {
+        //内存中的消息体同样由HSession::sendRsp在头部之后发送
+        os << "content-length: " << m_bodyDataLength << "\r\n\r\n";
+    } else if(!m_body.empty()) {
         os << "content-length: " << m_body.size() << "\r\n\r\n"
            << m_body;
     } else {
@@ -7,7 +7,9 @@
 #include <vector>
 #include <iostream>
 #include <sstream>
+#include <functional>
 #include <boost/lexical_cast.hpp>
+#include "yhchaos/stream.h"
 
 namespace yhchaos {
 namespace http {
@@ -296,6 +298,11 @@ public:
      */
     const MapType& getCookies() const { return m_cookies;}
 
+    /**
+     * @brief 返回路由匹配时从路径中捕获的参数MAP(:name和*)
+     */
+    const MapType& getRouteParams() const { return m_routeParams;}
+
     /**
      * @brief 设置HTTP请求的方法名
      * @param[in] v HTTP请求
@@ -347,6 +354,18 @@ public:
      */
     void setBody(const std::string& v) { m_body = v;}
 
+    /**
+     * @brief 获取流式读取消息体的流
+     * @details 只有匹配到的CppServlet设置了setStreamBody(true)时不为空，
+     *          读到0表示消息体结束；否则消息体已经完整读到getBody()中
+     */
+    Stream::ptr getBodyStream() const { return m_bodyStream;}
+
+    /**
+     * @brief 设置流式读取消息体的流，由HSession::recvReqHeader设置
+     */
+    void setBodyStream(Stream::ptr v) { m_bodyStream = v;}
+
     /**
      * @brief 是否自动关闭
      */
@@ -385,6 +404,12 @@ public:
      */
     void setCookies(const MapType& v) { m_cookies = v;}
 
+    /**
+     * @brief 设置路由参数MAP
+     * @param[in] v map
+     */
+    void setRouteParams(const MapType& v) { m_routeParams = v;}
+
     /**
      * @brief 获取HTTP请求的头部参数
      * @param[in] key 关键字
@@ -409,6 +434,14 @@ public:
      */
     std::string getCookie(const std::string& key, const std::string& def = "");
 
+    /**
+     * @brief 获取路由参数，如/user/:id中的id，尾部*捕获的内容的关键字为"*"
+     * @param[in] key 关键字
+     * @param[in] def 默认值
+     * @return 如果存在则返回对应值,否则返回默认值
+     */
+    std::string getRouteParam(const std::string& key, const std::string& def = "") const;
+
     
     /**
      * @brief 设置HTTP请求的头部参数
@@ -431,6 +464,13 @@ public:
      */
     void setCookie(const std::string& key, const std::string& val);
 
+    /**
+     * @brief 设置路由参数
+     * @param[in] key 关键字
+     * @param[in] val 值
+     */
+    void setRouteParam(const std::string& key, const std::string& val);
+
     /**
      * @brief 删除HTTP请求的头部参数
      * @param[in] key 关键字
@@ -605,6 +645,10 @@ private:
     MapType m_params;
     /// 请求Cookie MAP,在第一次调用get_cookie/has_cockie先调用initCookies()函数，从m_headers中初始化，已经不为空则不初始化
     MapType m_cookies;
+    /// 路由参数MAP，CppServletDispatch匹配路由时设置
+    MapType m_routeParams;
+    /// 还没有读取的消息体，流式读取时使用
+    Stream::ptr m_bodyStream;
 };
 
 /**
@@ -616,6 +660,11 @@ public:
     typedef std::shared_ptr<HttpRsp> ptr;
     /// MapType
     typedef std::map<std::string, std::string, CaseInsensitiveLess> MapType;
+    /**
+     * @brief 流式输出消息体的回调
+     * @details 参数是输出流，每次write的数据作为一个chunk发送，返回false表示出错，连接会被关闭
+     */
+    typedef std::function<bool(Stream::ptr)> BodyWriter;
     /**
      * @brief 构造函数
      * @param[in] version 版本
@@ -663,9 +712,9 @@ public:
     const MapType& getHeaders() const { return m_headers;}
 
     /**
-     * @brief 返回响应Cookie MAP
+     * @brief 返回响应的Set-Cookie列表
     */
-    const MapType& getCookies() const { return m_cookies;}
+    const std::vector<std::string>& getCookies() const { return m_cookies;}
 
     /**
      * @brief 设置响应状态
@@ -708,10 +757,54 @@ public:
     void setHeaders(const MapType& v) { m_headers = v;}
 
     /**
-     * @brief 设置响应Cookie MAP
+     * @brief 设置响应的Set-Cookie列表
     */
-    void setCookies(const MapType& v) { m_cookies = v;}
-    
+    void setCookies(const std::vector<std::string>& v) { m_cookies = v;}
+
+    /**
+     * @brief 设置流式输出消息体的回调
+     * @details HTTP/1.1使用chunked编码边生成边发送，HTTP/1.0发送完成后关闭连接，
+     *          设置后忽略getBody()
+     */
+    void setBodyWriter(BodyWriter v) { m_bodyWriter = v;}
+
+    /**
+     * @brief 获取流式输出消息体的回调
+     */
+    const BodyWriter& getBodyWriter() const { return m_bodyWriter;}
+
+    /**
+     * @brief 使用文件的一部分作为消息体，发送时通过sendfile直接从文件发送
+     * @param[in] path 文件路径
+     * @param[in] offset 起始偏移
+     * @param[in] length 长度，超出文件大小时截断到文件末尾
+     * @return 文件不存在或者不是普通文件返回false
+     */
+    bool setBodyFile(const std::string& path, uint64_t offset = 0, uint64_t length = (uint64_t)-1);
+
+    /**
+     * @brief 是否使用文件作为消息体
+     */
+    bool hasBodyFile() const { return !m_bodyFile.empty();}
+    const std::string& getBodyFile() const { return m_bodyFile;}
+    uint64_t getBodyFileOffset() const { return m_bodyFileOffset;}
+    uint64_t getBodyFileLength() const { return m_bodyFileLength;}
+
+    /**
+     * @brief 使用一段内存作为消息体，发送时直接从这段内存写出，不拷贝到getBody()
+     * @param[in] holder 持有这段内存的对象，保证发送完成前data有效
+     * @param[in] data 起始地址
+     * @param[in] length 长度
+     */
+    void setBodyData(std::shared_ptr<const void> holder, const char* data, uint64_t length);
+
+    /**
+     * @brief 是否使用setBodyData设置的内存作为消息体
+     */
+    bool hasBodyData() const { return m_bodyData != nullptr;}
+    const char* getBodyData() const { return m_bodyData;}
+    uint64_t getBodyDataLength() const { return m_bodyDataLength;}
+
     /**
      * @brief 获取响应头部参数
      * @param[in] key 关键字
@@ -792,6 +885,16 @@ private:
     MapType m_headers;
 
     std::vector<std::string> m_cookies;
+    /// 流式输出消息体的回调
+    BodyWriter m_bodyWriter;
+    /// 作为消息体的文件
+    std::string m_bodyFile;
+    uint64_t m_bodyFileOffset;
+    uint64_t m_bodyFileLength;
+    /// 作为消息体的内存及其持有者
+    std::shared_ptr<const void> m_bodyDataHolder;
+    const char* m_bodyData;
+    uint64_t m_bodyDataLength;
 };
 
 /**
@@ -331,67 +331,364 @@ HttpClientPool::HttpClientPool(const std::string& host
     ,m_isHttps(is_https) {
 }
 
-HttpClient::ptr HttpClientPool::getClient() {
+HttpClientPool::~HttpClientPool() {
+    stop();
+    for(auto& i : m_shards) {
+        for(auto& n : i.second->conns) {
+            delete n;
+        }
+    }
+}
+
+bool HttpClientPool::start(IOCoScheduler* iom) {
+    if(!iom) {
+        YHCHAOS_LOG_ERROR(g_logger) << "HttpClientPool::start iom is null, host=" << m_host;
+        return false;
+    }
+    stop();
+    m_iom = iom;
+    uint64_t interval = std::max(m_maxIdleTime / 2, 100u);
+    std::weak_ptr<HttpClientPool> weak_self = shared_from_this();
+    m_timer = m_iom->addTimedCoroutine(interval, [weak_self](){
+        auto self = weak_self.lock();
+        if(self) {
+            self->reap();
+        }
+    }, true);
+    reap();
+    return true;
+}
+
+void HttpClientPool::stop() {
+    if(m_timer) {
+        m_timer->cancel();
+        m_timer = nullptr;
+    }
+}
+
+HttpClient::ptr HttpClientPool::wrap(HttpClient* ptr) {
+    return HttpClient::ptr(ptr, std::bind(&HttpClientPool::ReleasePtr
+                               , std::placeholders::_1, this));
+}
+
+HttpClient* HttpClientPool::createClient() {
+    IPNetworkAddress::ptr addr = NetworkAddress::SearchForAnyIPNetworkAddress(m_host);
+    if(!addr) {
+        YHCHAOS_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
+        return nullptr;
+    }
+    addr->setPort(m_port);
+    Sock::ptr sock = m_isHttps ? SSLSock::CreateTCP(addr) : Sock::CreateTCP(addr);
+    if(!sock) {
+        YHCHAOS_LOG_ERROR(g_logger) << "create sock fail: " << *addr;
+        return nullptr;
+    }
+    if(!sock->connect(addr)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "sock connect fail: " << *addr;
+        return nullptr;
+    }
+    HttpClient* conn = new HttpClient(sock);
+    conn->m_createTime = yhchaos::GetCurrentMS();
+    conn->m_lastActive = conn->m_createTime;
+    return conn;
+}
+
+bool HttpClientPool::isReusable(HttpClient* conn, uint64_t now_ms) {
+    return conn->isConnected()
+        && (conn->m_createTime + m_maxAliveTime) > now_ms
+        && (conn->m_lastActive + m_maxIdleTime) > now_ms;
+}
+
+HttpClientPool::Shard::ptr HttpClientPool::getShard(bool auto_create) {
+    pid_t tid = yhchaos::GetCppThreadId();
+    {
+        RWMtxType::ReadLock lock(m_shardMutex);
+        auto it = m_shards.find(tid);
+        if(it != m_shards.end() || !auto_create) {
+            return it == m_shards.end() ? nullptr : it->second;
+        }
+    }
+    RWMtxType::WriteLock lock(m_shardMutex);
+    auto& shard = m_shards[tid];
+    if(!shard) {
+        shard = std::make_shared<Shard>();
+    }
+    return shard;
+}
+
+HttpClient* HttpClientPool::popIdle() {
     uint64_t now_ms = yhchaos::GetCurrentMS();
     std::vector<HttpClient*> invalid_conns;
     HttpClient* ptr = nullptr;
-    MtxType::Lock lock(m_mutex);
-    //找到第一个已经连接的HttpClient
-    while(!m_conns.empty()) {
-        auto conn = *m_conns.begin();
-        m_conns.pop_front();
-        if(!conn->isConnected()) {
+    auto pop = [&](Shard::ptr shard) {
+        MtxType::Lock lock(shard->mutex);
+        while(!shard->conns.empty()) {
+            auto conn = shard->conns.back();
+            shard->conns.pop_back();
+            if(isReusable(conn, now_ms)) {
+                ptr = conn;
+                break;
+            }
             invalid_conns.push_back(conn);
-            continue;
         }
-        if((conn->m_createTime + m_maxAliveTime) > now_ms) {
-            invalid_conns.push_back(conn);
-            continue;
+    };
+
+    //先取当前线程最近归还的连接
+    auto self = getShard(false);
+    if(self) {
+        pop(self);
+    }
+    if(!ptr) {
+        std::vector<Shard::ptr> shards;
+        {
+            RWMtxType::ReadLock lock(m_shardMutex);
+            for(auto& i : m_shards) {
+                if(i.second != self) {
+                    shards.push_back(i.second);
+                }
+            }
+        }
+        for(auto& i : shards) {
+            pop(i);
+            if(ptr) {
+                break;
+            }
         }
-        ptr = conn;
-        break;
     }
-    lock.unlock();
     for(auto i : invalid_conns) {
-        delete i;
+        closeClient(i);
     }
-    m_total -= invalid_conns.size();
+    return ptr;
+}
 
-    if(!ptr) {
-        IPNetworkAddress::ptr addr = NetworkAddress::SearchForAnyIPNetworkAddress(m_host);
-        if(!addr) {
-            YHCHAOS_LOG_ERROR(g_logger) << "get addr fail: " << m_host;
-            return nullptr;
+void HttpClientPool::putIdle(HttpClient* conn) {
+    conn->m_lastActive = yhchaos::GetCurrentMS();
+    if(m_waiting) {
+        Waiter::ptr waiter;
+        {
+            MtxType::Lock lock(m_mutex);
+            if(!m_waiters.empty()) {
+                waiter = m_waiters.front();
+                m_waiters.pop_front();
+                --m_waiting;
+                waiter->done = true;
+                waiter->conn = conn;
+            }
         }
-        addr->setPort(m_port);
-        Sock::ptr sock = m_isHttps ? SSLSock::CreateTCP(addr) : Sock::CreateTCP(addr);
-        if(!sock) {
-            YHCHAOS_LOG_ERROR(g_logger) << "create sock fail: " << *addr;
-            return nullptr;
+        if(waiter) {
+            waiter->sem.notify();
+            return;
+        }
+    }
+    auto shard = getShard(true);
+    MtxType::Lock lock(shard->mutex);
+    shard->conns.push_back(conn);
+}
+
+bool HttpClientPool::acquireSlot() {
+    MtxType::Lock lock(m_mutex);
+    if(m_maxSize && (uint32_t)m_total >= m_maxSize) {
+        return false;
+    }
+    ++m_total;
+    return true;
+}
+
+void HttpClientPool::releaseSlot() {
+    Waiter::ptr waiter;
+    {
+        MtxType::Lock lock(m_mutex);
+        if(m_waiters.empty()) {
+            --m_total;
+            return;
         }
-        if(!sock->connect(addr)) {
-            YHCHAOS_LOG_ERROR(g_logger) << "sock connect fail: " << *addr;
+        //名额直接转交，m_total不变
+        waiter = m_waiters.front();
+        m_waiters.pop_front();
+        --m_waiting;
+        waiter->done = true;
+        waiter->slot = true;
+    }
+    waiter->sem.notify();
+}
+
+void HttpClientPool::closeClient(HttpClient* conn) {
+    delete conn;
+    releaseSlot();
+}
+
+HttpClient* HttpClientPool::waitClient(bool& slot) {
+    IOCoScheduler* iom = IOCoScheduler::GetThis();
+    if(!iom || !m_waitTimeout) {
+        return nullptr;
+    }
+    Waiter::ptr waiter = std::make_shared<Waiter>();
+    {
+        MtxType::Lock lock(m_mutex);
+        //加锁后再检查一次，期间可能有连接关闭
+        if(!m_maxSize || (uint32_t)m_total < m_maxSize) {
+            ++m_total;
+            slot = true;
             return nullptr;
         }
+        m_waiters.push_back(waiter);
+        ++m_waiting;
+    }
+    //注册后再检查一次空闲连接，避免错过注册前刚归还的连接
+    HttpClient* ptr = popIdle();
+    if(ptr) {
+        bool notified = false;
+        {
+            MtxType::Lock lock(m_mutex);
+            notified = waiter->done;
+            if(!notified) {
+                waiter->done = true;
+                m_waiters.remove(waiter);
+                --m_waiting;
+            }
+        }
+        if(notified) {
+            //已经被唤醒，把拿到的连接或名额让给其他等待者
+            waiter->sem.wait();
+            if(waiter->conn) {
+                putIdle(waiter->conn);
+            } else if(waiter->slot) {
+                releaseSlot();
+            }
+        }
+        return ptr;
+    }
 
-        ptr = new HttpClient(sock);
-        ++m_total;
+    HttpClientPool* self = this;
+    auto timer = iom->addTimedCoroutine(m_waitTimeout, [self, waiter](){
+        {
+            MtxType::Lock lock(self->m_mutex);
+            if(waiter->done) {
+                return;
+            }
+            waiter->done = true;
+            self->m_waiters.remove(waiter);
+            --self->m_waiting;
+        }
+        waiter->sem.notify();
+    });
+    waiter->sem.wait();
+    timer->cancel();
+    slot = waiter->slot;
+    if(!waiter->conn && !slot) {
+        YHCHAOS_LOG_WARN(g_logger) << "HttpClientPool wait connection timeout host="
+            << m_host << " wait_timeout=" << m_waitTimeout
+            << " total=" << m_total;
     }
-    return HttpClient::ptr(ptr, std::bind(&HttpClientPool::ReleasePtr
-                               , std::placeholders::_1, this));
+    return waiter->conn;
+}
+
+HttpClient::ptr HttpClientPool::getClient() {
+    HttpClient* ptr = popIdle();
+    if(ptr) {
+        return wrap(ptr);
+    }
+    bool slot = acquireSlot();
+    if(!slot) {
+        ptr = waitClient(slot);
+        if(ptr) {
+            return wrap(ptr);
+        }
+        if(!slot) {
+            return nullptr;
+        }
+    }
+    ptr = createClient();
+    if(!ptr) {
+        releaseSlot();
+        return nullptr;
+    }
+    return wrap(ptr);
 }
 
 void HttpClientPool::ReleasePtr(HttpClient* ptr, HttpClientPool* pool) {
     ++ptr->m_request;
     if(!ptr->isConnected()
-            || ((ptr->m_createTime + pool->m_maxAliveTime) <= yhchaos::GetCurrentMS())//目前还处于alive状态
-            || (ptr->m_request >= pool->m_maxReq)) {//
-        delete ptr;
-        --pool->m_total;
+            || ((ptr->m_createTime + pool->m_maxAliveTime) <= yhchaos::GetCurrentMS())//超过最长存活时间
+            || (ptr->m_request >= pool->m_maxReq)) {//超过最大请求次数
+        pool->closeClient(ptr);
+        return;
+    }
+    pool->putIdle(ptr);
+}
+
+void HttpClientPool::reap() {
+    uint64_t now_ms = yhchaos::GetCurrentMS();
+    std::vector<HttpClient*> invalid_conns;
+    uint32_t idle = 0;
+    {
+        RWMtxType::ReadLock lock(m_shardMutex);
+        for(auto& i : m_shards) {
+            MtxType::Lock slock(i.second->mutex);
+            auto& conns = i.second->conns;
+            for(auto it = conns.begin(); it != conns.end();) {
+                if(isReusable(*it, now_ms)) {
+                    ++it;
+                } else {
+                    invalid_conns.push_back(*it);
+                    it = conns.erase(it);
+                }
+            }
+            idle += conns.size();
+        }
+    }
+    for(auto i : invalid_conns) {
+        closeClient(i);
+    }
+    if(!m_iom || idle >= m_minIdle) {
         return;
     }
-    MtxType::Lock lock(pool->m_mutex);
-    pool->m_conns.push_back(ptr);
+    //补足min_idle，分散到调度器的各个线程上建立连接
+    auto self = shared_from_this();
+    for(uint32_t i = idle; i < m_minIdle; ++i) {
+        if(!acquireSlot()) {
+            break;
+        }
+        m_iom->coschedule([self](){
+            HttpClient* conn = self->createClient();
+            if(conn) {
+                self->putIdle(conn);
+            } else {
+                self->releaseSlot();
+            }
+        });
+    }
+}
+
+uint32_t HttpClientPool::getIdleCount() {
+    uint32_t idle = 0;
+    RWMtxType::ReadLock lock(m_shardMutex);
+    for(auto& i : m_shards) {
+        MtxType::Lock slock(i.second->mutex);
+        idle += i.second->conns.size();
+    }
+    return idle;
+}
+
+std::string HttpClientPool::toString() {
+    size_t shards = 0;
+    {
+        RWMtxType::ReadLock lock(m_shardMutex);
+        shards = m_shards.size();
+    }
+    std::stringstream ss;
+    ss << "[HttpClientPool host=" << m_host
+       << " port=" << m_port
+       << " total=" << m_total
+       << " idle=" << getIdleCount()
+       << " waiting=" << m_waiting
+       << " shards=" << shards
+       << " max_size=" << m_maxSize
+       << " min_idle=" << m_minIdle
+       << " max_idle_time=" << m_maxIdleTime
+       << " wait_timeout=" << m_waitTimeout
+       << "]";
+    return ss.str();
 }
 
 HttpRes::ptr HttpClientPool::doGet(const std::string& url
@@ -5,8 +5,10 @@
 #include "http.h"
 #include "yhchaos/uridesc.h"
 #include "yhchaos/cpp_thread.h"
+#include "yhchaos/iocoscheduler.h"
 
 #include <list>
+#include <unordered_map>
 
 namespace yhchaos {
 namespace http {
@@ -195,14 +197,23 @@ public:
 
 private:
     uint64_t m_createTime = 0;
+    //最近一次归还到连接池的时间
+    uint64_t m_lastActive = 0;
     //当shared_ptr变为0请求释放资源的次数，即使用了的次数
     uint64_t m_request = 0;
 };
 
-class HttpClientPool {
+/**
+ * @brief HTTP连接池
+ * @details 1. 空闲连接按线程分片保存(后进先出)，优先复用当前IO线程上最近归还的连接，没有时再从其他线程借
+ *          2. start之后定时回收空闲超时、存活超时和已断开的连接，并保持至少min_idle个空闲连接
+ *          3. 连接数达到max_size时getClient在等待队列中等待归还的连接，超过wait_timeout返回nullptr
+ */
+class HttpClientPool : public std::enable_shared_from_this<HttpClientPool> {
 public:
     typedef std::shared_ptr<HttpClientPool> ptr;
     typedef Mtx MtxType;
+    typedef RWMtx RWMtxType;
     //通过uri来设置m_host和m_port
     static HttpClientPool::ptr Create(const std::string& uri
                                    ,const std::string& vhost
@@ -217,10 +228,41 @@ public:
                        ,uint32_t max_size
                        ,uint32_t max_alive_time
                        ,uint32_t max_request);
-    //从m_conn获取一个已经连接的httpconnection对象，删除第一个连接对象前未连接的对象，如果没有
-    //连接对象，就创建一个新的连接对象返回（新建一个socket）
+    ~HttpClientPool();
+
+    /**
+     * @brief 启动空闲连接回收定时器，并预热min_idle个连接
+     * @param[in] iom 定时器和预热协程所在的调度器
+     */
+    bool start(IOCoScheduler* iom = IOCoScheduler::GetThis());
+
+    /**
+     * @brief 停止回收定时器
+     */
+    void stop();
+
+    //获取一个已经连接的HttpClient，优先复用当前线程的空闲连接，其次其他线程的空闲连接，
+    //都没有时新建连接；连接数达到max_size时等待连接归还
     HttpClient::ptr getClient();
 
+    /// 最少保持的空闲连接数
+    uint32_t getMinIdle() const { return m_minIdle;}
+    void setMinIdle(uint32_t v) { m_minIdle = v;}
+
+    /// 空闲连接的最长保留时间(毫秒)
+    uint32_t getMaxIdleTime() const { return m_maxIdleTime;}
+    void setMaxIdleTime(uint32_t v) { m_maxIdleTime = v;}
+
+    /// 连接数达到max_size时的最长等待时间(毫秒)
+    uint32_t getWaitTimeout() const { return m_waitTimeout;}
+    void setWaitTimeout(uint32_t v) { m_waitTimeout = v;}
+
+    /// 当前的连接数(包括正在使用的)
+    int32_t getTotal() const { return m_total;}
+    /// 当前的空闲连接数
+    uint32_t getIdleCount();
+    std::string toString();
+
 
     /**
      * @brief 发送HTTP的GET请求
@@ -313,20 +355,72 @@ public:
     HttpRes::ptr doReq(HttpReq::ptr req
                             , uint64_t timeout_ms);
 private:
+    /**
+     * @brief 一个线程的空闲连接栈
+     */
+    struct Shard {
+        typedef std::shared_ptr<Shard> ptr;
+        MtxType mutex;
+        std::vector<HttpClient*> conns;
+    };
+
+    /**
+     * @brief 等待连接的协程
+     * @details done之后conn非空表示拿到了归还的连接，slot为true表示拿到了新建连接的名额，
+     *          都没有表示等待超时
+     */
+    struct Waiter {
+        typedef std::shared_ptr<Waiter> ptr;
+        CoroutineSem sem;
+        HttpClient* conn = nullptr;
+        bool slot = false;
+        bool done = false;
+    };
+
     static void ReleasePtr(HttpClient* ptr, HttpClientPool* pool);
+    HttpClient::ptr wrap(HttpClient* ptr);
+    //新建连接，调用前需要已经占用一个连接名额
+    HttpClient* createClient();
+    //连接是否还可以复用
+    bool isReusable(HttpClient* conn, uint64_t now_ms);
+    Shard::ptr getShard(bool auto_create);
+    //从空闲连接中取一个可用的连接，顺带删除不可用的连接
+    HttpClient* popIdle();
+    //归还可用的连接，有等待者时直接交给等待者
+    void putIdle(HttpClient* conn);
+    //占用一个连接名额
+    bool acquireSlot();
+    //释放一个连接名额，有等待者时直接转交给等待者
+    void releaseSlot();
+    //关闭连接并释放名额
+    void closeClient(HttpClient* conn);
+    //等待连接归还或者名额释放
+    HttpClient* waitClient(bool& slot);
+    //回收空闲连接，并补足min_idle
+    void reap();
 private:
     std::string m_host;//host
     std::string m_vhost;//vhost
     uint32_t m_port;//m_port(port ? port : (is_https ? 443 : 80))
-    uint32_t m_maxSize;//max_size
+    uint32_t m_maxSize;//max_size,为0表示不限制
     uint32_t m_maxAliveTime;//max_alive_time
     uint32_t m_maxReq;//max_request,某个连接使用的最大次数
     bool m_isHttps;//is_https
-    //保护m_conns
+    uint32_t m_minIdle = 0;
+    uint32_t m_maxIdleTime = 60 * 1000;
+    uint32_t m_waitTimeout = 3000;
+    //保护m_waiters和连接名额的占用
     MtxType m_mutex;
-    //要建立的连接
-    std::list<HttpClient*> m_conns;
+    std::list<Waiter::ptr> m_waiters;
+    std::atomic<uint32_t> m_waiting = {0};
+    //保护m_shards
+    RWMtxType m_shardMutex;
+    //线程id -> 空闲连接
+    std::unordered_map<pid_t, Shard::ptr> m_shards;
+    //连接总数
     std::atomic<int32_t> m_total = {0};
+    IOCoScheduler* m_iom = nullptr;
+    TimedCoroutine::ptr m_timer;
 };
 
 }
@@ -1,14 +1,247 @@
 #include "http_session.h"
 #include "http_parser.h"
+#include "yhchaos/util.h"
+#include <fcntl.h>
+#include <sys/sendfile.h>
 
 namespace yhchaos {
 namespace http {
 
+/// chunk长度行和trailer行的最大长度
+static const size_t s_max_chunk_line = 8192;
+/// 流式读写时每次的缓冲区大小
+static const size_t s_body_buffer_size = 64 * 1024;
+
+HttpBodyReader::HttpBodyReader(SockStream::ptr stream, const std::string& buffered
+                               ,uint64_t length, bool chunked)
+    :m_stream(stream)
+    ,m_buffer(buffered)
+    ,m_pos(0)
+    ,m_remain(chunked ? 0 : length)
+    ,m_readSize(0)
+    ,m_chunked(chunked)
+    ,m_chunkCRLF(false)
+    ,m_finished(!chunked && length == 0)
+    ,m_error(false) {
+}
+
+int HttpBodyReader::read(void* buffer, size_t length) {
+    if(m_error) {
+        return -1;
+    }
+    if(m_finished || length == 0) {
+        return 0;
+    }
+    //chunked时当前chunk读完了，读取下一个chunk的长度
+    if(m_remain == 0) {
+        if(!nextChunk()) {
+            m_error = true;
+            return -1;
+        }
+        if(m_finished) {
+            return 0;
+        }
+    }
+    int rt = readRaw(buffer, std::min((uint64_t)length, m_remain));
+    if(rt <= 0) {
+        m_error = true;
+        return -1;
+    }
+    m_remain -= rt;
+    m_readSize += rt;
+    if(!m_chunked && m_remain == 0) {
+        m_finished = true;
+    }
+    return rt;
+}
+
+int HttpBodyReader::read(ByteBuffer::ptr ba, size_t length) {
+    std::string buf;
+    buf.resize(length);
+    int rt = read(&buf[0], length);
+    if(rt > 0) {
+        ba->write(buf.c_str(), rt);
+    }
+    return rt;
+}
+
+bool HttpBodyReader::readAll(std::string& body, uint64_t max_size) {
+    if(!m_chunked) {
+        if(m_remain > max_size) {
+            return false;
+        }
+        body.reserve(body.size() + m_remain);
+    }
+    uint64_t size = 0;
+    char buf[4096];
+    while(!m_finished) {
+        int rt = read(buf, sizeof(buf));
+        if(rt < 0) {
+            return false;
+        }
+        size += rt;
+        if(size > max_size) {
+            return false;
+        }
+        body.append(buf, rt);
+    }
+    return true;
+}
+
+bool HttpBodyReader::drain(uint64_t max_size) {
+    if(!m_chunked && m_remain > max_size) {
+        return false;
+    }
+    uint64_t size = 0;
+    char buf[4096];
+    while(!m_finished) {
+        int rt = read(buf, sizeof(buf));
+        if(rt < 0) {
+            return false;
+        }
+        size += rt;
+        if(size > max_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int HttpBodyReader::readRaw(void* buffer, size_t length) {
+    if(m_pos < m_buffer.size()) {
+        size_t len = std::min(length, m_buffer.size() - m_pos);
+        memcpy(buffer, &m_buffer[m_pos], len);
+        m_pos += len;
+        if(m_pos == m_buffer.size()) {
+            m_buffer.clear();
+            m_pos = 0;
+        }
+        return len;
+    }
+    return m_stream->read(buffer, length);
+}
+
+bool HttpBodyReader::readLine(std::string& line) {
+    while(true) {
+        size_t pos = m_buffer.find('\n', m_pos);
+        if(pos != std::string::npos) {
+            line = m_buffer.substr(m_pos, pos - m_pos);
+            if(!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            m_pos = pos + 1;
+            return true;
+        }
+        if(m_buffer.size() - m_pos > s_max_chunk_line) {
+            return false;
+        }
+        m_buffer.erase(0, m_pos);
+        m_pos = 0;
+        char buf[1024];
+        int rt = m_stream->read(buf, sizeof(buf));
+        if(rt <= 0) {
+            return false;
+        }
+        m_buffer.append(buf, rt);
+    }
+}
+
+bool HttpBodyReader::nextChunk() {
+    std::string line;
+    if(m_chunkCRLF) {
+        //上一个chunk数据之后的CRLF
+        if(!readLine(line) || !line.empty()) {
+            return false;
+        }
+        m_chunkCRLF = false;
+    }
+    if(!readLine(line)) {
+        return false;
+    }
+    //去掉chunk扩展(;name=value)
+    std::string hex = StringUtil::Trim(line.substr(0, line.find(';')));
+    if(hex.empty() || hex.size() > 15) {
+        return false;
+    }
+    char* end = nullptr;
+    uint64_t size = strtoull(hex.c_str(), &end, 16);
+    if(*end) {
+        return false;
+    }
+    if(size == 0) {
+        //读取trailer直到空行
+        do {
+            if(!readLine(line)) {
+                return false;
+            }
+        } while(!line.empty());
+        m_finished = true;
+        return true;
+    }
+    m_remain = size;
+    m_chunkCRLF = true;
+    return true;
+}
+
+HttpBodyWriter::HttpBodyWriter(SockStream::ptr stream, bool chunked)
+    :m_stream(stream)
+    ,m_chunked(chunked)
+    ,m_finished(false) {
+}
+
+int HttpBodyWriter::write(const void* buffer, size_t length) {
+    if(m_finished) {
+        return -1;
+    }
+    if(length == 0) {
+        return 0;
+    }
+    if(!m_chunked) {
+        return m_stream->writeFixSize(buffer, length) > 0 ? length : -1;
+    }
+    //长度行、数据和CRLF一起发送，避免小包
+    char head[24];
+    int n = snprintf(head, sizeof(head), "%zx\r\n", length);
+    std::string data;
+    data.reserve(n + length + 2);
+    data.append(head, n);
+    data.append((const char*)buffer, length);
+    data.append("\r\n", 2);
+    return m_stream->writeFixSize(data.c_str(), data.size()) > 0 ? length : -1;
+}
+
+int HttpBodyWriter::write(ByteBuffer::ptr ba, size_t length) {
+    std::string buf;
+    buf.resize(length);
+    ba->read(&buf[0], length);
+    return write(buf.c_str(), length);
+}
+
+bool HttpBodyWriter::finish() {
+    if(m_finished) {
+        return true;
+    }
+    m_finished = true;
+    if(!m_chunked) {
+        return true;
+    }
+    return m_stream->writeFixSize("0\r\n\r\n", 5) > 0;
+}
+
 HSession::HSession(Sock::ptr sock, bool owner)
     :SockStream(sock, owner) {
 }
 
 HttpReq::ptr HSession::recvReq() {
+    auto req = recvReqHeader();
+    if(req && !readBody(req)) {
+        close();
+        return nullptr;
+    }
+    return req;
+}
+
+HttpReq::ptr HSession::recvReqHeader() {
     HttpReqParser::ptr parser(new HttpReqParser);
     uint64_t buff_size = HttpReqParser::GetHttpReqBufferSize();
     //uint64_t buff_size = 100;
@@ -45,40 +278,94 @@ HttpReq::ptr HSession::recvReq() {
             break;
         }
     } while(true);
-    //读取报文体
-    int64_t length = parser->getContentLength();
-    if(length > 0) {
-        std::string body;
-        body.resize(length);
-
-        int len = 0;
-        if(length >= offset) {
-            memcpy(&body[0], data, offset);
-            len = offset;
-        } else {
-            memcpy(&body[0], data, length);
-            len = length;
-        }
-        length -= offset;
-        if(length > 0) {
-            //接受出body剩余没有接收到的数据
-            if(readFixSize(&body[len], length) <= 0) {
-                close();
-                return nullptr;
-            }
-        }
-        parser->getData()->setBody(body);
+    auto req = parser->getData();
+    req->init();
+    //消息体留给调用者读取，解析头部时多读出的数据交给HttpBodyReader
+    uint64_t length = parser->getContentLength();
+    bool chunked = strcasestr(req->getHeader("transfer-encoding").c_str(), "chunked") != nullptr;
+    if(chunked || length > 0) {
+        req->setBodyStream(std::make_shared<HttpBodyReader>(
+                    std::make_shared<SockStream>(m_socket, false)
+                    ,std::string(data, offset), length, chunked));
     }
+    return req;
+}
 
-    parser->getData()->init();
-    return parser->getData();
+bool HSession::readBody(HttpReq::ptr req) {
+    auto reader = std::dynamic_pointer_cast<HttpBodyReader>(req->getBodyStream());
+    if(!reader) {
+        return true;
+    }
+    std::string body;
+    if(!reader->readAll(body, HttpReqParser::GetHttpReqMaxBodySize())) {
+        return false;
+    }
+    req->setBody(body);
+    req->setBodyStream(nullptr);
+    return true;
 }
 
 int HSession::sendRsp(HttpRsp::ptr rsp) {
+    //HTTP/1.0不支持chunked，只能以关闭连接结束消息体
+    if(rsp->getBodyWriter() && rsp->getVersion() < 0x11) {
+        rsp->setClose(true);
+    }
     std::stringstream ss;
     ss << *rsp;
     std::string data = ss.str();
-    return writeFixSize(data.c_str(), data.size());
+    int rt = writeFixSize(data.c_str(), data.size());
+    if(rt <= 0) {
+        return rt;
+    }
+    if(rsp->getBodyWriter()) {
+        HttpBodyWriter::ptr writer = std::make_shared<HttpBodyWriter>(
+                std::make_shared<SockStream>(m_socket, false), rsp->getVersion() >= 0x11);
+        if(!rsp->getBodyWriter()(writer) || !writer->finish()) {
+            return -1;
+        }
+    } else if(rsp->hasBodyFile()) {
+        if(sendFile(rsp->getBodyFile(), rsp->getBodyFileOffset()
+                    ,rsp->getBodyFileLength()) != (int64_t)rsp->getBodyFileLength()) {
+            return -1;
+        }
+    } else if(rsp->hasBodyData() && rsp->getBodyDataLength()) {
+        if(writeFixSize(rsp->getBodyData(), rsp->getBodyDataLength()) <= 0) {
+            return -1;
+        }
+    }
+    return rt;
+}
+
+int64_t HSession::sendFile(const std::string& path, uint64_t offset, uint64_t length) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return -1;
+    }
+    int64_t total = 0;
+    if(!std::dynamic_pointer_cast<SSLSock>(m_socket)) {
+        off_t off = offset;
+        while((uint64_t)total < length) {
+            //hook过的sendfile在发送缓冲区满时挂起协程
+            ssize_t rt = ::sendfile(m_socket->getSock(), fd, &off, length - total);
+            if(rt <= 0) {
+                break;
+            }
+            total += rt;
+        }
+    } else {
+        std::string buf;
+        buf.resize(std::min((uint64_t)s_body_buffer_size, length));
+        while((uint64_t)total < length) {
+            ssize_t rt = pread(fd, &buf[0], std::min((uint64_t)buf.size(), length - total)
+                               ,offset + total);
+            if(rt <= 0 || writeFixSize(buf.c_str(), rt) <= 0) {
+                break;
+            }
+            total += rt;
+        }
+    }
+    ::close(fd);
+    return total;
 }
 
 }
@@ -7,6 +7,125 @@
 namespace yhchaos {
 namespace http {
 
+/**
+ * @brief 流式读取HTTP请求的消息体
+ * @details 支持Content-Length和chunked两种格式，chunked时去掉chunk的长度行和trailer，
+ *          只返回数据。read返回0表示消息体结束
+ */
+class HttpBodyReader : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyReader> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] stream 连接
+     * @param[in] buffered 解析头部时已经从连接读出的数据
+     * @param[in] length Content-Length，chunked时忽略
+     * @param[in] chunked 是否是chunked编码
+     */
+    HttpBodyReader(SockStream::ptr stream, const std::string& buffered
+                   ,uint64_t length, bool chunked);
+
+    virtual int read(void* buffer, size_t length) override;
+    virtual int read(ByteBuffer::ptr ba, size_t length) override;
+    virtual int write(const void* buffer, size_t length) override { return -1;}
+    virtual int write(ByteBuffer::ptr ba, size_t length) override { return -1;}
+    /**
+     * @brief 连接由HSession管理，这里不关闭
+     */
+    virtual void close() override {}
+
+    /**
+     * @brief 读取剩余的全部消息体
+     * @param[out] body 追加读到的数据
+     * @param[in] max_size 消息体的最大长度
+     * @return 出错或者超过max_size返回false
+     */
+    bool readAll(std::string& body, uint64_t max_size);
+
+    /**
+     * @brief 读取并丢弃剩余的消息体，使连接可以继续处理下一个请求
+     * @param[in] max_size 最多丢弃的字节数
+     * @return 出错或者剩余的数据超过max_size返回false
+     */
+    bool drain(uint64_t max_size);
+
+    /**
+     * @brief 消息体是否已经读完
+     */
+    bool isFinished() const { return m_finished;}
+
+    /**
+     * @brief 是否出错(连接关闭或者chunked格式错误)
+     */
+    bool hasError() const { return m_error;}
+
+    /**
+     * @brief 已经读取的消息体字节数
+     */
+    uint64_t getReadSize() const { return m_readSize;}
+private:
+    /**
+     * @brief 优先从m_buffer中读取，没有时从连接读取
+     */
+    int readRaw(void* buffer, size_t length);
+    /**
+     * @brief 读取一行，去掉行尾的CRLF
+     */
+    bool readLine(std::string& line);
+    /**
+     * @brief 读取下一个chunk的长度，最后一个chunk时读取trailer
+     */
+    bool nextChunk();
+private:
+    SockStream::ptr m_stream;
+    /// 已经从连接读出还没有返回的数据
+    std::string m_buffer;
+    size_t m_pos;
+    /// 当前chunk(或者Content-Length)剩余的字节数
+    uint64_t m_remain;
+    uint64_t m_readSize;
+    bool m_chunked;
+    /// chunk数据之后是否还有CRLF没有读取
+    bool m_chunkCRLF;
+    bool m_finished;
+    bool m_error;
+};
+
+/**
+ * @brief 流式发送HTTP响应的消息体
+ * @details chunked时每次write作为一个chunk发送，finish发送结束的chunk
+ */
+class HttpBodyWriter : public Stream {
+public:
+    typedef std::shared_ptr<HttpBodyWriter> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] stream 连接
+     * @param[in] chunked 是否使用chunked编码，HTTP/1.0时为false，直接写出数据
+     */
+    HttpBodyWriter(SockStream::ptr stream, bool chunked);
+
+    virtual int read(void* buffer, size_t length) override { return -1;}
+    virtual int read(ByteBuffer::ptr ba, size_t length) override { return -1;}
+    virtual int write(const void* buffer, size_t length) override;
+    virtual int write(ByteBuffer::ptr ba, size_t length) override;
+    /**
+     * @brief 结束消息体，等同于finish
+     */
+    virtual void close() override { finish();}
+
+    /**
+     * @brief 发送结束的chunk，之后不能再写
+     */
+    bool finish();
+private:
+    SockStream::ptr m_stream;
+    bool m_chunked;
+    bool m_finished;
+};
+
 /**
  * @brief HTTPSession封装，对某个socket解析http请求报文，发送http响应报文，
  */
@@ -24,17 +143,42 @@ public:
 
     /**
      * @brief 接收HTTP请求，read循环读socket，并将读出的http报文解析为httpReq对象
+     * @details 消息体(包括chunked)完整读到HttpReq::getBody()中，
+     *          超过http.request.max_body_size时失败
      */
     HttpReq::ptr recvReq();
 
+    /**
+     * @brief 只接收HTTP请求的头部
+     * @details 有消息体时设置HttpReq::getBodyStream()，由调用者流式读取或者调用readBody
+     */
+    HttpReq::ptr recvReqHeader();
+
+    /**
+     * @brief 将请求中还没有读取的消息体读到HttpReq::getBody()中
+     * @return 出错或者超过http.request.max_body_size返回false
+     */
+    bool readBody(HttpReq::ptr req);
+
     /**
      * @brief 发送HTTP响应
+     * @details 设置了BodyWriter时使用chunked编码流式发送，设置了文件时通过sendfile发送
      * @param[in] rsp HTTP响应
      * @return >0 发送成功
      *         =0 对方关闭
      *         <0 Sock异常
      */
     int sendRsp(HttpRsp::ptr rsp);
+
+    /**
+     * @brief 发送文件的一部分
+     * @details 普通socket使用sendfile，避免拷贝到用户态；SSL连接读文件后加密发送
+     * @param[in] path 文件路径
+     * @param[in] offset 起始偏移
+     * @param[in] length 长度
+     * @return 实际发送的字节数，打开文件失败返回-1
+     */
+    int64_t sendFile(const std::string& path, uint64_t offset, uint64_t length);
 };
 
 }
@@ -1,5 +1,7 @@
 #include "httpsvr.h"
 #include "yhchaos/log.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/http2/http2_session.h"
 #include "yhchaos/http/servlets/config_cpp_servlet.h"
 #include "yhchaos/http/servlets/status_cpp_servlet.h"
 
@@ -8,12 +10,16 @@ namespace http {
 
 static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
 
+static yhchaos::AppConfigVar<bool>::ptr g_http2_enable =
+    yhchaos::AppConfig::SearchFor("http2.enable", true, "http server enable h2c");
+
 HttpSvr::HttpSvr(bool keepalive
                ,yhchaos::IOCoScheduler* worker
                ,yhchaos::IOCoScheduler* io_worker
                ,yhchaos::IOCoScheduler* accept_worker)
     :TcpSvr(worker, io_worker, accept_worker)
-    ,m_isKeepalive(keepalive) {
+    ,m_isKeepalive(keepalive)
+    ,m_http2(g_http2_enable->getValue()) {
     m_dispatch.reset(new CppServletDispatch);
 
     m_type = "http";
@@ -25,15 +31,23 @@ void HttpSvr::setName(const std::string& v) {
     TcpSvr::setName(v);
     m_dispatch->setDefault(std::make_shared<NotFoundCppServlet>(v));
 }
+/// keep-alive时最多丢弃的未读取请求消息体大小
+static const uint64_t s_drain_max_size = 64 * 1024;
+
 //httpReq.m_close和http_server的m_iskeepalive是为了在服务器端保持这个连接，即当收到
 //已连接客户端的请求并发送回应后，继续在下一个循环中等待客户端发送的请求，而不是发送回应后
 //就关闭socket和客户端的连接，退出handleClient协程。
 void HttpSvr::handleClient(Sock::ptr client) {
     YHCHAOS_LOG_DEBUG(g_logger) << "handleClient " << *client;
+    if(m_http2 && http2::Http2Session::IsPreface(client)) {
+        startHttp2(client, nullptr, "");
+        return;
+    }
     //因为一个新连接就是一个session
-    HSession::ptr session(new HSession(client));
+    //session不托管socket，升级为HTTP/2后socket交给Http2Session
+    HSession::ptr session(new HSession(client, false));
     do {
-        auto req = session->recvReq();
+        auto req = session->recvReqHeader();
         if(!req) {
             YHCHAOS_LOG_DEBUG(g_logger) << "recv http request fail, errno="
                 << errno << " errstr=" << strerror(errno)
@@ -41,17 +55,62 @@ void HttpSvr::handleClient(Sock::ptr client) {
             break;
         }
 
+        //只有流式的CppServlet自己读取消息体，其他的先完整读到req->getBody()
+        auto slt = m_dispatch->getMatchedCppServlet(req->getPath(), req);
+        if(req->getBodyStream() && !(slt && slt->isStreamBody())
+                && !session->readBody(req)) {
+            YHCHAOS_LOG_DEBUG(g_logger) << "recv http request body fail, errno="
+                << errno << " errstr=" << strerror(errno)
+                << " cliet:" << *client;
+            break;
+        }
+
+        if(m_http2 && strcasestr(req->getHeader("Upgrade").c_str(), "h2c")
+                && !req->getBodyStream()
+                && startHttp2(client, req, req->getHeader("HTTP2-Settings"))) {
+            return;
+        }
+
         HttpRsp::ptr rsp(new HttpRsp(req->getVersion()
                             ,req->isClose() || !m_isKeepalive));
         rsp->setHeader("Svr", getName());
-        m_dispatch->handle(req, rsp, session);
-        session->sendRsp(rsp);
+        if(slt) {
+            slt->handle(req, rsp, session);
+        }
+        if(session->sendRsp(rsp) <= 0) {
+            break;
+        }
+
+        //CppServlet没有读完的消息体需要丢弃，剩余太多时直接关闭连接
+        auto reader = std::dynamic_pointer_cast<HttpBodyReader>(req->getBodyStream());
+        if(reader && !reader->drain(s_drain_max_size)) {
+            break;
+        }
 
-        if(!m_isKeepalive || req->isClose()) {
+        if(!m_isKeepalive || req->isClose() || rsp->isClose()) {
             break;
         }
     } while(true);
-    session->close();
+    client->close();
+}
+
+bool HttpSvr::startHttp2(Sock::ptr client, HttpReq::ptr req, const std::string& settings) {
+    http2::Http2Session::ptr session(new http2::Http2Session(client, m_dispatch, getName()));
+    session->setWorker(m_worker);
+    if(req) {
+        if(!req->hasHeader("HTTP2-Settings") || !session->upgrade(req, settings)) {
+            return false;
+        }
+        static const char s_switching[] = "HTTP/1.1 101 Switching Protocols\r\n"
+                                          "Connection: Upgrade\r\n"
+                                          "Upgrade: h2c\r\n\r\n";
+        if(client->send(s_switching, sizeof(s_switching) - 1) <= 0) {
+            return false;
+        }
+    }
+    YHCHAOS_LOG_DEBUG(g_logger) << "http2 session " << *client
+        << (req ? " upgrade" : " prior knowledge");
+    return session->start();
 }
 
 }
@@ -37,14 +37,32 @@ public:
      */
     void setCppServletDispatch(CppServletDispatch::ptr v) { m_dispatch = v;}
 
+    /**
+     * @brief 是否支持HTTP/2(h2c)，默认使用配置http2.enable
+     * @details 开启后连接以HTTP/2连接序言开头(prior knowledge)或者请求带有Upgrade: h2c时，
+     *          切换为Http2Session处理
+     */
+    bool isHttp2() const { return m_http2;}
+    void setHttp2(bool v) { m_http2 = v;}
+
     virtual void setName(const std::string& v) override;
 protected:
     virtual void handleClient(Sock::ptr client) override;
+
+    /**
+     * @brief 切换为HTTP/2处理该连接
+     * @param[in] req h2c升级请求，prior knowledge时为nullptr
+     * @param[in] settings 升级请求的HTTP2-Settings头部
+     * @return HTTP2-Settings不合法时返回false，继续按HTTP/1.1处理
+     */
+    bool startHttp2(Sock::ptr client, HttpReq::ptr req, const std::string& settings);
 private:
     /// 是否支持长连接，一条连接可以支持多个请求和相应的发送
     bool m_isKeepalive;//keepalive=false
     /// CppServlet分发器
     CppServletDispatch::ptr m_dispatch;//m_dispatch.reset(new CppServletDispatch);
+    /// 是否支持HTTP/2
+    bool m_http2;
     //TcpSvr的m_type = "http";
 };
 
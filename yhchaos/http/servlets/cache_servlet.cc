@@ -0,0 +1,329 @@
+#include "cache_servlet.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/util.h"
+#include <atomic>
+#include <string.h>
+
+namespace yhchaos {
+namespace http {
+
+static yhchaos::AppConfigVar<uint64_t>::ptr g_response_cache_max_size =
+    yhchaos::AppConfig::SearchFor("http.response_cache.max_size"
+            ,(uint64_t)(64 * 1024 * 1024), "http response cache max total size");
+
+static std::atomic<uint64_t> s_cache_servlet_id(0);
+
+size_t ResponseCache::Entry::getSize() const {
+    size_t size = sizeof(Entry) + reason.size() + body.size();
+    for(auto& i : headers) {
+        size += i.first.size() + i.second.size() + 64;
+    }
+    return size;
+}
+
+ResponseCache::ResponseCache() {
+}
+
+ResponseCache::Shard& ResponseCache::getShard(const std::string& key) {
+    return m_shards[std::hash<std::string>()(key) % SHARD_COUNT];
+}
+
+ResponseCache::Entry::ptr ResponseCache::get(const std::string& key) {
+    Shard& shard = getShard(key);
+    Mtx::Lock lock(shard.mutex);
+    auto it = shard.items.find(key);
+    if(it == shard.items.end()) {
+        return nullptr;
+    }
+    auto entry = it->second->second;
+    if(entry->expire <= GetCurrentMS()) {
+        delNolock(shard, key);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    return entry;
+}
+
+ResponseCache::Entry::ptr ResponseCache::load(const std::string& key
+                        ,std::function<Entry::ptr()> cb, bool& loaded) {
+    Shard& shard = getShard(key);
+    Pending::ptr pending;
+    loaded = false;
+    {
+        Mtx::Lock lock(shard.mutex);
+        auto it = shard.items.find(key);
+        if(it != shard.items.end()) {
+            auto entry = it->second->second;
+            if(entry->expire > GetCurrentMS()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                return entry;
+            }
+            delNolock(shard, key);
+        }
+        auto pit = shard.pending.find(key);
+        if(pit == shard.pending.end()) {
+            pending = std::make_shared<Pending>();
+            shard.pending[key] = pending;
+            loaded = true;
+        } else {
+            pending = pit->second;
+            ++pending->waiters;
+        }
+    }
+
+    if(!loaded) {
+        pending->sem.wait();
+        return pending->entry;
+    }
+
+    //cb抛出异常时也要移除pending并唤醒等待的协程，否则它们会一直等待
+    struct Finisher {
+        ResponseCache* cache;
+        Shard& shard;
+        const std::string& key;
+        Pending::ptr pending;
+        Entry::ptr entry;
+
+        ~Finisher() {
+            uint32_t waiters = 0;
+            {
+                Mtx::Lock lock(shard.mutex);
+                if(entry) {
+                    cache->addNolock(shard, key, entry);
+                }
+                pending->entry = entry;
+                shard.pending.erase(key);
+                waiters = pending->waiters;
+            }
+            for(uint32_t i = 0; i < waiters; ++i) {
+                pending->sem.notify();
+            }
+        }
+    } finisher = {this, shard, key, pending, nullptr};
+    finisher.entry = cb();
+    return finisher.entry;
+}
+
+void ResponseCache::del(const std::string& key) {
+    Shard& shard = getShard(key);
+    Mtx::Lock lock(shard.mutex);
+    delNolock(shard, key);
+}
+
+void ResponseCache::clear() {
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        Mtx::Lock lock(m_shards[i].mutex);
+        m_shards[i].lru.clear();
+        m_shards[i].items.clear();
+        m_shards[i].size = 0;
+    }
+}
+
+void ResponseCache::getInfo(size_t& count, uint64_t& size) {
+    count = 0;
+    size = 0;
+    for(size_t i = 0; i < SHARD_COUNT; ++i) {
+        Mtx::Lock lock(m_shards[i].mutex);
+        count += m_shards[i].items.size();
+        size += m_shards[i].size;
+    }
+}
+
+void ResponseCache::addNolock(Shard& shard, const std::string& key, Entry::ptr entry) {
+    delNolock(shard, key);
+    uint64_t max_size = g_response_cache_max_size->getValue() / SHARD_COUNT;
+    size_t size = entry->getSize() + key.size();
+    if(size > max_size) {
+        return;
+    }
+    shard.lru.push_front(std::make_pair(key, entry));
+    shard.items[key] = shard.lru.begin();
+    shard.size += size;
+    while(shard.size > max_size) {
+        delNolock(shard, shard.lru.back().first);
+    }
+}
+
+void ResponseCache::delNolock(Shard& shard, const std::string& key) {
+    auto it = shard.items.find(key);
+    if(it == shard.items.end()) {
+        return;
+    }
+    shard.size -= it->second->second->getSize() + key.size();
+    shard.lru.erase(it->second);
+    shard.items.erase(it);
+}
+
+CacheCppServlet::CacheCppServlet(CppServlet::ptr servlet, uint64_t ttl
+                                 ,const std::vector<std::string>& vary)
+    :CppServlet("CacheCppServlet")
+    ,m_servlet(servlet)
+    ,m_id(++s_cache_servlet_id)
+    ,m_ttl(ttl)
+    ,m_vary(vary) {
+    //HttpSvr按匹配到的CppServlet决定是否预先读取消息体，需要和被包装的一致
+    setStreamBody(m_servlet->isStreamBody());
+}
+
+int32_t CacheCppServlet::handle(yhchaos::http::HttpReq::ptr request
+                                ,yhchaos::http::HttpRsp::ptr response
+                                ,yhchaos::http::HSession::ptr session) {
+    if(!isCacheable(request)) {
+        return m_servlet->handle(request, response, session);
+    }
+    std::string key = makeKey(request);
+    int32_t rt = 0;
+    bool loaded = false;
+    auto entry = ResponseCacheMgr::GetInstance()->load(key, [&]() {
+        rt = m_servlet->handle(request, response, session);
+        return toEntry(response);
+    }, loaded);
+    if(loaded) {
+        response->setHeader("X-Cache", "MISS");
+        return rt;
+    }
+    if(!entry) {
+        //同时等待的响应不能缓存，自己处理
+        return m_servlet->handle(request, response, session);
+    }
+    fill(response, entry);
+    return 0;
+}
+
+bool CacheCppServlet::isCacheable(HttpReq::ptr request) {
+    if(request->getMethod() != HMethod::GET && request->getMethod() != HMethod::HEAD) {
+        return false;
+    }
+    //带身份信息的请求响应因人而异，不能共享
+    if(request->hasHeader("Authorization") || request->hasHeader("Cookie")) {
+        return false;
+    }
+    //流式的消息体不参与缓存key，缓存命中时也不会被读取
+    if(request->getBodyStream()) {
+        return false;
+    }
+    return true;
+}
+
+bool CacheCppServlet::isVaryCovered(const std::string& vary) {
+    size_t begin = 0;
+    while(begin < vary.size()) {
+        size_t end = vary.find(',', begin);
+        if(end == std::string::npos) {
+            end = vary.size();
+        }
+        std::string item = StringUtil::Trim(vary.substr(begin, end - begin));
+        begin = end + 1;
+        if(item.empty()) {
+            continue;
+        }
+        if(item == "*") {
+            return false;
+        }
+        bool found = false;
+        for(auto& i : m_vary) {
+            if(strcasecmp(i.c_str(), item.c_str()) == 0) {
+                found = true;
+                break;
+            }
+        }
+        if(!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string CacheCppServlet::makeKey(HttpReq::ptr request) {
+    //所有实例共用ResponseCacheMgr，key中带上实例id和Host，避免不同的servlet或虚拟主机互相命中
+    std::stringstream ss;
+    ss << m_id << " " << HMethodToString(request->getMethod())
+       << " " << request->getHeader("Host") << request->getPath();
+    if(!request->getQuery().empty()) {
+        ss << "?" << request->getQuery();
+    }
+    for(auto& i : m_vary) {
+        ss << "\n" << i << ":" << request->getHeader(i);
+    }
+    return ss.str();
+}
+
+ResponseCache::Entry::ptr CacheCppServlet::toEntry(HttpRsp::ptr response) {
+    switch(response->getStatus()) {
+        case HStatus::OK:
+        case HStatus::NON_AUTHORITATIVE_INFORMATION:
+        case HStatus::MOVED_PERMANENTLY:
+        case HStatus::NOT_FOUND:
+        case HStatus::GONE:
+            break;
+        default:
+            return nullptr;
+    }
+    if(!response->getCookies().empty() || !response->getHeader("Set-Cookie").empty()
+            || response->getBodyWriter() || response->hasBodyFile()
+            || response->hasBodyData()) {
+        return nullptr;
+    }
+    //Vary的请求头部都在缓存key中时才能缓存
+    std::string vary = response->getHeader("Vary");
+    if(!vary.empty() && !isVaryCovered(vary)) {
+        return nullptr;
+    }
+
+    uint64_t ttl = m_ttl;
+    std::string cc = response->getHeader("Cache-Control");
+    if(!cc.empty()) {
+        int64_t max_age = -1;
+        int64_t s_maxage = -1;
+        size_t begin = 0;
+        while(begin < cc.size()) {
+            size_t end = cc.find(',', begin);
+            if(end == std::string::npos) {
+                end = cc.size();
+            }
+            std::string item = yhchaos::ToLower(StringUtil::Trim(cc.substr(begin, end - begin)));
+            begin = end + 1;
+            //no-cache="..."和private="..."只针对部分头部，这里按整个响应不缓存处理
+            if(item == "no-store" || item == "no-cache" || item == "private"
+                    || item.compare(0, 9, "no-cache=") == 0
+                    || item.compare(0, 8, "private=") == 0) {
+                return nullptr;
+            } else if(item.compare(0, 8, "max-age=") == 0) {
+                max_age = atoll(item.c_str() + 8);
+            } else if(item.compare(0, 9, "s-maxage=") == 0) {
+                s_maxage = atoll(item.c_str() + 9);
+            }
+        }
+        if(s_maxage >= 0) {
+            ttl = s_maxage * 1000;
+        } else if(max_age >= 0) {
+            ttl = max_age * 1000;
+        }
+    }
+    if(ttl == 0) {
+        return nullptr;
+    }
+
+    ResponseCache::Entry::ptr entry(new ResponseCache::Entry);
+    entry->status = response->getStatus();
+    entry->reason = response->getReason();
+    entry->headers = response->getHeaders();
+    entry->body = response->getBody();
+    entry->created = GetCurrentMS();
+    entry->expire = entry->created + ttl;
+    return entry;
+}
+
+void CacheCppServlet::fill(HttpRsp::ptr response, ResponseCache::Entry::ptr entry) {
+    response->setStatus(entry->status);
+    response->setReason(entry->reason);
+    for(auto& i : entry->headers) {
+        response->setHeader(i.first, i.second);
+    }
+    response->setBody(entry->body);
+    response->setHeader("Age", std::to_string((GetCurrentMS() - entry->created) / 1000));
+    response->setHeader("X-Cache", "HIT");
+}
+
+}
+}
@@ -0,0 +1,156 @@
+#ifndef __YHCHAOS_HTTP_SERVLETS_CACHE_SERVLET_H__
+#define __YHCHAOS_HTTP_SERVLETS_CACHE_SERVLET_H__
+
+#include "yhchaos/http/cpp_servlet.h"
+#include "yhchaos/mtx.h"
+#include "yhchaos/singleton.h"
+#include <list>
+
+namespace yhchaos {
+namespace http {
+
+/**
+ * @brief HTTP响应缓存
+ * @details 按key的hash分片，每个分片一个LRU，所有分片的总大小受http.response_cache.max_size限制。
+ *          同一个key并发未命中时只有一个协程生成响应，其他协程在CoroutineSem上等待结果
+ */
+class ResponseCache {
+public:
+    typedef std::shared_ptr<ResponseCache> ptr;
+
+    /**
+     * @brief 缓存的响应
+     */
+    struct Entry {
+        typedef std::shared_ptr<Entry> ptr;
+        HStatus status = HStatus::OK;
+        std::string reason;
+        HttpRsp::MapType headers;
+        std::string body;
+        /// 生成时间(毫秒)
+        uint64_t created = 0;
+        /// 过期时间(毫秒)
+        uint64_t expire = 0;
+
+        /**
+         * @brief 占用的内存大小(估算)
+         */
+        size_t getSize() const;
+    };
+
+    ResponseCache();
+
+    /**
+     * @brief 获取没有过期的缓存
+     */
+    Entry::ptr get(const std::string& key);
+
+    /**
+     * @brief 获取缓存，没有时由第一个协程调用cb生成，同时未命中的其他协程等待它的结果
+     * @param[in] key 缓存key
+     * @param[in] cb 生成缓存项，返回nullptr表示结果不能缓存
+     * @param[out] loaded 是否是当前协程调用了cb
+     * @return 缓存项，结果不能缓存或者cb抛出异常时等待的协程得到nullptr
+     */
+    Entry::ptr load(const std::string& key, std::function<Entry::ptr()> cb, bool& loaded);
+
+    void del(const std::string& key);
+    void clear();
+
+    /**
+     * @brief 缓存项数和总大小
+     */
+    void getInfo(size_t& count, uint64_t& size);
+private:
+    /**
+     * @brief 正在生成的缓存项
+     */
+    struct Pending {
+        typedef std::shared_ptr<Pending> ptr;
+        CoroutineSem sem;
+        /// 等待结果的协程数，受分片的锁保护
+        uint32_t waiters = 0;
+        Entry::ptr entry;
+    };
+
+    struct Shard {
+        Mtx mutex;
+        /// LRU链表，最近使用的在前
+        std::list<std::pair<std::string, Entry::ptr> > lru;
+        std::unordered_map<std::string, std::list<std::pair<std::string, Entry::ptr> >::iterator> items;
+        std::unordered_map<std::string, Pending::ptr> pending;
+        uint64_t size = 0;
+    };
+
+    Shard& getShard(const std::string& key);
+    void addNolock(Shard& shard, const std::string& key, Entry::ptr entry);
+    void delNolock(Shard& shard, const std::string& key);
+private:
+    static const size_t SHARD_COUNT = 16;
+    Shard m_shards[SHARD_COUNT];
+};
+
+typedef yhchaos::Singleton<ResponseCache> ResponseCacheMgr;
+
+/**
+ * @brief 响应缓存CppServlet，包装另一个CppServlet
+ * @details
+ *  1. 只缓存GET和HEAD，key由实例id、方法、Host、路径、query和指定的请求头部组成，
+ *     不同的实例和虚拟主机即使路径相同也不会共用缓存；
+ *     带Authorization/Cookie或者流式消息体的请求不走缓存
+ *  2. 响应的Cache-Control(s-maxage/max-age)决定缓存时间，
+ *     no-store/no-cache/private(包括no-cache="..."和private="..."的形式)不缓存；
+ *     没有Cache-Control时使用默认的ttl
+ *  3. 有Set-Cookie、流式消息体或者状态码不可缓存的响应不缓存；
+ *     Vary中有不在缓存key里的请求头部时不缓存
+ *  通过CppServletDispatch::addCppServlet(uri, std::make_shared<CacheCppServlet>(servlet))注册
+ */
+class CacheCppServlet : public CppServlet {
+public:
+    typedef std::shared_ptr<CacheCppServlet> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] servlet 被缓存的CppServlet
+     * @param[in] ttl 响应没有Cache-Control时的缓存时间(毫秒)，0表示不缓存
+     * @param[in] vary 参与缓存key的请求头部
+     */
+    CacheCppServlet(CppServlet::ptr servlet, uint64_t ttl = 0
+                    ,const std::vector<std::string>& vary = {});
+
+    virtual int32_t handle(yhchaos::http::HttpReq::ptr request
+                   , yhchaos::http::HttpRsp::ptr response
+                   , yhchaos::http::HSession::ptr session) override;
+
+    CppServlet::ptr getCppServlet() const { return m_servlet;}
+private:
+    /**
+     * @brief 请求是否可以使用缓存
+     */
+    bool isCacheable(HttpReq::ptr request);
+    /**
+     * @brief 响应Vary的请求头部是否都在缓存key中
+     */
+    bool isVaryCovered(const std::string& vary);
+    std::string makeKey(HttpReq::ptr request);
+    /**
+     * @brief 把响应转换为缓存项
+     * @return 不能缓存时返回nullptr
+     */
+    ResponseCache::Entry::ptr toEntry(HttpRsp::ptr response);
+    /**
+     * @brief 用缓存项填充响应
+     */
+    void fill(HttpRsp::ptr response, ResponseCache::Entry::ptr entry);
+private:
+    CppServlet::ptr m_servlet;
+    /// 实例id，区分共用ResponseCacheMgr的不同实例
+    uint64_t m_id;
+    uint64_t m_ttl;
+    std::vector<std::string> m_vary;
+};
+
+}
+}
+
+#endif
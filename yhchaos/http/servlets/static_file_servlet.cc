@@ -0,0 +1,360 @@
+#include "static_file_servlet.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/log.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace yhchaos {
+namespace http {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
+static yhchaos::AppConfigVar<uint64_t>::ptr g_static_cache_max_size =
+    yhchaos::AppConfig::SearchFor("http.static_file.cache_max_size"
+            ,(uint64_t)(64 * 1024 * 1024), "static file mmap cache max total size");
+
+static yhchaos::AppConfigVar<uint64_t>::ptr g_static_cache_file_max_size =
+    yhchaos::AppConfig::SearchFor("http.static_file.cache_file_max_size"
+            ,(uint64_t)(256 * 1024), "static file max size to cache, larger files use sendfile");
+
+static const char* s_http_date_format = "%a, %d %b %Y %H:%M:%S GMT";
+
+static std::string HttpDate(time_t t) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), s_http_date_format, &tm);
+    return buf;
+}
+
+static bool ParseUint(const std::string& str, uint64_t& v) {
+    if(str.empty() || str.size() > 19
+            || str.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    v = strtoull(str.c_str(), nullptr, 10);
+    return true;
+}
+
+static const char* GetContentType(const std::string& path) {
+    static const std::unordered_map<std::string, const char*> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css; charset=utf-8"},
+        {"js", "application/javascript; charset=utf-8"},
+        {"json", "application/json; charset=utf-8"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "text/xml; charset=utf-8"},
+        {"svg", "image/svg+xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"ico", "image/x-icon"},
+        {"webp", "image/webp"},
+        {"woff", "font/woff"},
+        {"woff2", "font/woff2"},
+        {"ttf", "font/ttf"},
+        {"wasm", "application/wasm"},
+        {"pdf", "application/pdf"},
+        {"mp4", "video/mp4"},
+        {"zip", "application/zip"},
+    };
+    size_t pos = path.rfind('.');
+    if(pos != std::string::npos && path.find('/', pos) == std::string::npos) {
+        auto it = s_types.find(yhchaos::ToLower(path.substr(pos + 1)));
+        if(it != s_types.end()) {
+            return it->second;
+        }
+    }
+    return "application/octet-stream";
+}
+
+//没有消息体的响应，带上Content-Length让keep-alive的客户端知道响应已经结束
+static void SetEmptyRsp(HttpRsp::ptr response, HStatus status) {
+    response->setStatus(status);
+    response->setHeader("Content-Length", "0");
+}
+
+StaticFileCppServlet::FileInfo::FileInfo()
+    :size(0)
+    ,mtime(0)
+    ,inode(0)
+    ,data(nullptr) {
+}
+
+StaticFileCppServlet::FileInfo::~FileInfo() {
+    if(data) {
+        munmap((void*)data, size);
+    }
+}
+
+StaticFileCppServlet::StaticFileCppServlet(const std::string& root, const std::string& prefix)
+    :CppServlet("StaticFileCppServlet")
+    ,m_root(root)
+    ,m_prefix(prefix)
+    ,m_index("index.html")
+    ,m_gzip(true)
+    ,m_maxAge(0)
+    ,m_cacheSize(0) {
+    while(m_root.size() > 1 && m_root.back() == '/') {
+        m_root.pop_back();
+    }
+}
+
+int32_t StaticFileCppServlet::handle(yhchaos::http::HttpReq::ptr request
+                                     ,yhchaos::http::HttpRsp::ptr response
+                                     ,yhchaos::http::HSession::ptr session) {
+    if(request->getMethod() != HMethod::GET && request->getMethod() != HMethod::HEAD) {
+        SetEmptyRsp(response, HStatus::METHOD_NOT_ALLOWED);
+        response->setHeader("Allow", "GET, HEAD");
+        return 0;
+    }
+    std::string path;
+    if(!toFilePath(request->getPath(), path)) {
+        SetEmptyRsp(response, HStatus::FORBIDDEN);
+        return 0;
+    }
+    if(path.back() == '/') {
+        path += m_index;
+    }
+
+    FileInfo::ptr info;
+    bool gzip = false;
+    if(m_gzip && strcasestr(request->getHeader("Accept-Encoding").c_str(), "gzip")) {
+        info = getFile(path + ".gz");
+        gzip = info != nullptr;
+    }
+    if(!info) {
+        info = getFile(path);
+    }
+    if(!info) {
+        //请求的是没有以'/'结尾的目录
+        struct stat st;
+        if(stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            path += "/" + m_index;
+            info = getFile(path);
+        }
+    }
+    if(!info) {
+        SetEmptyRsp(response, HStatus::NOT_FOUND);
+        return 0;
+    }
+
+    response->setHeader("Content-Type", GetContentType(path));
+    response->setHeader("ETag", info->etag);
+    response->setHeader("Last-Modified", info->lastModified);
+    response->setHeader("Accept-Ranges", "bytes");
+    if(m_maxAge) {
+        response->setHeader("Cache-Control", "max-age=" + std::to_string(m_maxAge));
+    }
+    if(m_gzip) {
+        response->setHeader("Vary", "Accept-Encoding");
+    }
+    if(gzip) {
+        response->setHeader("Content-Encoding", "gzip");
+    }
+    if(isNotModified(request, info)) {
+        SetEmptyRsp(response, HStatus::NOT_MODIFIED);
+        return 0;
+    }
+
+    uint64_t offset = 0;
+    uint64_t length = info->size;
+    int rt = parseRange(request, info, offset, length);
+    if(rt < 0) {
+        SetEmptyRsp(response, HStatus::RANGE_NOT_SATISFIABLE);
+        response->setHeader("Content-Range", "bytes */" + std::to_string(info->size));
+        return 0;
+    } else if(rt > 0) {
+        response->setStatus(HStatus::PARTIAL_CONTENT);
+        response->setHeader("Content-Range", "bytes " + std::to_string(offset)
+                + "-" + std::to_string(offset + length - 1) + "/" + std::to_string(info->size));
+    }
+
+    if(request->getMethod() == HMethod::HEAD || length == 0) {
+        response->setHeader("Content-Length", std::to_string(length));
+    } else if(info->data) {
+        //info持有映射，发送完成前不会被munmap
+        response->setBodyData(info, info->data + offset, length);
+    } else if(!response->setBodyFile(info->path, offset, length)) {
+        response->delHeader("Content-Range");
+        SetEmptyRsp(response, HStatus::NOT_FOUND);
+    }
+    return 0;
+}
+
+void StaticFileCppServlet::getCacheInfo(size_t& count, uint64_t& size) {
+    Mtx::Lock lock(m_mutex);
+    count = m_cache.size();
+    size = m_cacheSize;
+}
+
+bool StaticFileCppServlet::toFilePath(const std::string& uri, std::string& path) {
+    if(uri.compare(0, m_prefix.size(), m_prefix) != 0) {
+        return false;
+    }
+    std::string p = StringUtil::UrlDecode(uri.substr(m_prefix.size()), false);
+    if(p.find('\0') != std::string::npos) {
+        return false;
+    }
+    //不允许通过".."访问根目录之外的文件
+    size_t begin = 0;
+    while(begin <= p.size()) {
+        size_t end = p.find('/', begin);
+        if(end == std::string::npos) {
+            end = p.size();
+        }
+        if(p.compare(begin, end - begin, "..") == 0) {
+            return false;
+        }
+        begin = end + 1;
+    }
+    if(p.empty() || p[0] != '/') {
+        p = "/" + p;
+    }
+    path = m_root + p;
+    return true;
+}
+
+StaticFileCppServlet::FileInfo::ptr StaticFileCppServlet::getFile(const std::string& path) {
+    struct stat st;
+    if(stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return nullptr;
+    }
+    {
+        Mtx::Lock lock(m_mutex);
+        auto it = m_cache.find(path);
+        if(it != m_cache.end()) {
+            auto info = *it->second;
+            if(info->mtime == st.st_mtime && info->size == (uint64_t)st.st_size
+                    && info->inode == st.st_ino) {
+                m_lru.splice(m_lru.begin(), m_lru, it->second);
+                return info;
+            }
+            //文件已经变化，缓存失效
+            m_cacheSize -= info->size;
+            m_lru.erase(it->second);
+            m_cache.erase(it);
+        }
+    }
+
+    FileInfo::ptr info(new FileInfo);
+    info->path = path;
+    info->size = st.st_size;
+    info->mtime = st.st_mtime;
+    info->inode = st.st_ino;
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%lx-%lx\"", (unsigned long)st.st_mtime
+            ,(unsigned long)st.st_size);
+    info->etag = etag;
+    info->lastModified = HttpDate(st.st_mtime);
+
+    uint64_t cache_max_size = g_static_cache_max_size->getValue();
+    if(info->size == 0 || info->size > g_static_cache_file_max_size->getValue()
+            || info->size > cache_max_size) {
+        return info;
+    }
+    //更新文件时应该写新文件后rename，已经映射的旧文件不受影响；
+    //直接截断正在映射的文件会导致访问时SIGBUS
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        return info;
+    }
+    void* data = mmap(nullptr, info->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED) {
+        YHCHAOS_LOG_WARN(g_logger) << "mmap " << path << " fail, errno="
+            << errno << " errstr=" << strerror(errno);
+        return info;
+    }
+    info->data = (const char*)data;
+
+    Mtx::Lock lock(m_mutex);
+    auto it = m_cache.find(path);
+    if(it != m_cache.end()) {
+        m_cacheSize -= (*it->second)->size;
+        m_lru.erase(it->second);
+    }
+    m_lru.push_front(info);
+    m_cache[path] = m_lru.begin();
+    m_cacheSize += info->size;
+    while(m_cacheSize > cache_max_size) {
+        auto& last = m_lru.back();
+        m_cacheSize -= last->size;
+        m_cache.erase(last->path);
+        m_lru.pop_back();
+    }
+    return info;
+}
+
+bool StaticFileCppServlet::isNotModified(HttpReq::ptr request, FileInfo::ptr info) {
+    //If-None-Match优先于If-Modified-Since
+    std::string inm = request->getHeader("If-None-Match");
+    if(!inm.empty()) {
+        return inm == "*" || inm.find(info->etag) != std::string::npos;
+    }
+    std::string ims = request->getHeader("If-Modified-Since");
+    if(!ims.empty()) {
+        struct tm tm;
+        memset(&tm, 0, sizeof(tm));
+        if(strptime(ims.c_str(), s_http_date_format, &tm)) {
+            return timegm(&tm) >= info->mtime;
+        }
+    }
+    return false;
+}
+
+int StaticFileCppServlet::parseRange(HttpReq::ptr request, FileInfo::ptr info
+                                     ,uint64_t& offset, uint64_t& length) {
+    std::string range = request->getHeader("Range");
+    if(range.size() < 6 || strncasecmp(range.c_str(), "bytes=", 6) != 0) {
+        return 0;
+    }
+    //文件已经变化时返回整个文件
+    std::string if_range = request->getHeader("If-Range");
+    if(!if_range.empty() && if_range != info->etag && if_range != info->lastModified) {
+        return 0;
+    }
+    std::string spec = StringUtil::Trim(range.substr(6));
+    //多个区间时返回整个文件
+    size_t pos = spec.find('-');
+    if(pos == std::string::npos || spec.find(',') != std::string::npos) {
+        return 0;
+    }
+    std::string first = StringUtil::Trim(spec.substr(0, pos));
+    std::string last = StringUtil::Trim(spec.substr(pos + 1));
+    uint64_t begin = 0;
+    uint64_t end = 0;
+    if(first.empty()) {
+        //bytes=-n，最后n个字节
+        if(!ParseUint(last, end)) {
+            return 0;
+        }
+        if(end == 0 || info->size == 0) {
+            return -1;
+        }
+        length = std::min(end, info->size);
+        offset = info->size - length;
+        return 1;
+    }
+    if(!ParseUint(first, begin)) {
+        return 0;
+    }
+    if(last.empty()) {
+        end = info->size - 1;
+    } else if(!ParseUint(last, end) || end < begin) {
+        return 0;
+    }
+    if(begin >= info->size) {
+        return -1;
+    }
+    end = std::min(end, info->size - 1);
+    offset = begin;
+    length = end - begin + 1;
+    return 1;
+}
+
+}
+}
@@ -0,0 +1,113 @@
+#ifndef __YHCHAOS_HTTP_SERVLETS_STATIC_FILE_SERVLET_H__
+#define __YHCHAOS_HTTP_SERVLETS_STATIC_FILE_SERVLET_H__
+
+#include "yhchaos/http/cpp_servlet.h"
+#include "yhchaos/mtx.h"
+#include <list>
+
+namespace yhchaos {
+namespace http {
+
+/**
+ * @brief 静态文件CppServlet，把请求路径映射到根目录下的文件
+ * @details
+ *  1. 小文件mmap后放在LRU缓存中，直接从映射的内存发送，不拷贝；大文件通过sendfile发送
+ *  2. 支持ETag/Last-Modified的条件请求(If-None-Match/If-Modified-Since)返回304
+ *  3. 支持单个区间的Range请求(If-Range)返回206
+ *  4. 客户端接受gzip并且存在同名的.gz文件时，直接返回预压缩的文件
+ *  通过CppServletDispatch::addGlobCppServlet注册，模式为前缀加"*"，如"/static/"后跟*
+ */
+class StaticFileCppServlet : public CppServlet {
+public:
+    typedef std::shared_ptr<StaticFileCppServlet> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] root 根目录
+     * @param[in] prefix 请求路径中需要去掉的前缀，如"/static"
+     */
+    StaticFileCppServlet(const std::string& root, const std::string& prefix = "");
+
+    virtual int32_t handle(yhchaos::http::HttpReq::ptr request
+                   , yhchaos::http::HttpRsp::ptr response
+                   , yhchaos::http::HSession::ptr session) override;
+
+    /**
+     * @brief 设置请求目录时返回的文件，默认index.html
+     */
+    void setIndex(const std::string& v) { m_index = v;}
+
+    /**
+     * @brief 设置是否返回预压缩的.gz文件
+     */
+    void setGzip(bool v) { m_gzip = v;}
+
+    /**
+     * @brief 设置Cache-Control的max-age(秒)，0表示不设置
+     */
+    void setMaxAge(uint32_t v) { m_maxAge = v;}
+
+    /**
+     * @brief 缓存中的文件数和总大小
+     */
+    void getCacheInfo(size_t& count, uint64_t& size);
+private:
+    /**
+     * @brief 文件信息，小文件同时持有mmap的内容
+     */
+    struct FileInfo {
+        typedef std::shared_ptr<FileInfo> ptr;
+        FileInfo();
+        ~FileInfo();
+
+        std::string path;
+        uint64_t size;
+        time_t mtime;
+        ino_t inode;
+        std::string etag;
+        std::string lastModified;
+        /// mmap的文件内容，没有缓存时为nullptr
+        const char* data;
+    };
+
+    /**
+     * @brief 获取文件信息，缓存中的文件发生变化时重新加载
+     * @return 文件不存在或者不是普通文件时返回nullptr
+     */
+    FileInfo::ptr getFile(const std::string& path);
+
+    /**
+     * @brief 请求路径转换为文件路径
+     * @return 路径中有".."等不允许访问的部分时返回false
+     */
+    bool toFilePath(const std::string& uri, std::string& path);
+
+    /**
+     * @brief 是否满足条件请求，满足时返回304
+     */
+    bool isNotModified(HttpReq::ptr request, FileInfo::ptr info);
+
+    /**
+     * @brief 解析Range头部
+     * @return -1 区间无效(416)，0 忽略Range返回整个文件，1 返回[offset, offset+length)
+     */
+    int parseRange(HttpReq::ptr request, FileInfo::ptr info
+                   ,uint64_t& offset, uint64_t& length);
+private:
+    std::string m_root;
+    std::string m_prefix;
+    std::string m_index;
+    bool m_gzip;
+    uint32_t m_maxAge;
+
+    Mtx m_mutex;
+    /// LRU链表，最近使用的在前
+    std::list<FileInfo::ptr> m_lru;
+    std::unordered_map<std::string, std::list<FileInfo::ptr>::iterator> m_cache;
+    uint64_t m_cacheSize;
+};
+
+}
+}
+
+#endif
@@ -61,8 +61,12 @@ std::pair<HttpRes::ptr, WClient::ptr> WClient::Create(UriDesc::ptr uri
         req->setHeader("connection", "Upgrade");
     }
     req->setHeader("Upgrade", "websocket");
-    req->setHeader("Sec-webSock-Version", "13");
-    req->setHeader("Sec-webSock-Key", yhchaos::base64encode(random_string(16)));
+    req->setHeader("Sec-WebSocket-Version", "13");
+    req->setHeader("Sec-WebSocket-Key", yhchaos::base64encode(random_string(16)));
+    std::string offer = WDeflate::Offer();
+    if(!offer.empty() && req->getHeader("Sec-WebSocket-Extensions").empty()) {
+        req->setHeader("Sec-WebSocket-Extensions", offer);
+    }
     if(!has_host) {
         req->setHeader("Host", uri->getHost());
     }
@@ -88,20 +92,29 @@ std::pair<HttpRes::ptr, WClient::ptr> WClient::Create(UriDesc::ptr uri
         return std::make_pair(std::make_shared<HttpRes>(50
                     , rsp, "not websocket server " + addr->toString()), nullptr);
     }
+    std::string extensions = rsp->getHeader("Sec-WebSocket-Extensions");
+    if(!extensions.empty()) {
+        bool error = false;
+        conn->m_deflate = WDeflate::Accept(extensions, error);
+        if(error) {
+            return std::make_pair(std::make_shared<HttpRes>(50
+                        , rsp, "invalid Sec-WebSocket-Extensions " + extensions), nullptr);
+        }
+    }
     return std::make_pair(std::make_shared<HttpRes>((int)HttpRes::Error::OK
                 , rsp, "ok"), conn);
 }
 
 WFrameMSG::ptr WClient::recvMSG() {
-    return WRecvMSG(this, true);
+    return WRecvMSG(this, true, &m_recvBuffer, m_deflate.get());
 }
 
 int32_t WClient::sendMSG(WFrameMSG::ptr msg, bool fin) {
-    return WSendMSG(this, msg, true, fin);
+    return WSendMSG(this, msg, true, fin, m_deflate.get());
 }
 
 int32_t WClient::sendMSG(const std::string& msg, int32_t opcode, bool fin) {
-    return WSendMSG(this, std::make_shared<WFrameMSG>(opcode, msg), true, fin);
+    return WSendMSG(this, std::make_shared<WFrameMSG>(opcode, msg), true, fin, m_deflate.get());
 }
 
 int32_t WClient::ping() {
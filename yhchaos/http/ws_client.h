@@ -17,17 +17,28 @@ public:
     /**
      * @brief 创建websocket连接，发送连接验证请求
      * @return 返回HttpRes::ptr（包含请求回应HttpRsp，其中HStatus=HStatus::SWITCHING_PROTOCOLS， 
-     * 并设置了Sec-WebSock-Accept头）和WClient::ptr
+     * 并设置了Sec-WebSocket-Accept头）和WClient::ptr
+     * @details websocket.deflate.enable打开时请求permessage-deflate扩展，服务器端接受后自动压缩
     */
     static std::pair<HttpRes::ptr, WClient::ptr> Create(UriDesc::ptr uri
                                     ,uint64_t timeout_ms
                                     , const std::map<std::string, std::string>& headers = {});
-    WFrameMSG::ptr recvMesage();
+    WFrameMSG::ptr recvMSG();
 
     int32_t sendMSG(WFrameMSG::ptr msg, bool fin = true);
     int32_t sendMSG(const std::string& msg, int32_t opcode = WFrameHead::TEXT_FRAME, bool fin = true);
     int32_t ping();
     int32_t pong();
+
+    /**
+     * @brief 服务器端接受的permessage-deflate，没有接受时为nullptr
+     */
+    WDeflate::ptr getDeflate() const { return m_deflate;}
+private:
+    /// 接收缓冲区
+    WFrameBuffer m_recvBuffer;
+    /// permessage-deflate
+    WDeflate::ptr m_deflate;
 };
 
 }
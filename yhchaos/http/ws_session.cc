@@ -1,7 +1,14 @@
 #include "ws_session.h"
 #include "yhchaos/log.h"
 #include "yhchaos/endian.h"
+#include "yhchaos/streams/sock_stream.h"
 #include <string.h>
+#include <sys/uio.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 namespace yhchaos {
 namespace http {
@@ -12,6 +19,284 @@ yhchaos::AppConfigVar<uint32_t>::ptr g_websocket_message_max_size
     = yhchaos::AppConfig::SearchFor("websocket.message.max_size"
             ,(uint32_t) 1024 * 1024 * 32, "websocket message max size");
 
+static yhchaos::AppConfigVar<bool>::ptr g_websocket_deflate_enable
+    = yhchaos::AppConfig::SearchFor("websocket.deflate.enable"
+            ,true, "websocket permessage-deflate enable");
+
+static yhchaos::AppConfigVar<int>::ptr g_websocket_deflate_level
+    = yhchaos::AppConfig::SearchFor("websocket.deflate.level"
+            ,(int)6, "websocket permessage-deflate compression level");
+
+static yhchaos::AppConfigVar<int>::ptr g_websocket_deflate_server_max_window_bits
+    = yhchaos::AppConfig::SearchFor("websocket.deflate.server_max_window_bits"
+            ,(int)15, "websocket permessage-deflate server max window bits(9-15)");
+
+static yhchaos::AppConfigVar<bool>::ptr g_websocket_deflate_server_no_context_takeover
+    = yhchaos::AppConfig::SearchFor("websocket.deflate.server_no_context_takeover"
+            ,false, "websocket permessage-deflate server no context takeover");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_websocket_deflate_min_size
+    = yhchaos::AppConfig::SearchFor("websocket.deflate.min_size"
+            ,(uint32_t)64, "websocket permessage-deflate min message size to compress");
+
+//Sec-WebSocket-Extensions中的一个扩展，参数名都转成小写
+struct WExtension {
+    std::string name;
+    std::vector<std::pair<std::string, std::string> > params;
+};
+
+//解析 "ext1; a; b=1, ext2" 格式的扩展列表
+static std::vector<WExtension> ParseExtensions(const std::string& value) {
+    std::vector<WExtension> rt;
+    size_t begin = 0;
+    while(begin < value.size()) {
+        size_t end = value.find(',', begin);
+        if(end == std::string::npos) {
+            end = value.size();
+        }
+        std::string item = value.substr(begin, end - begin);
+        begin = end + 1;
+
+        WExtension ext;
+        size_t pos = 0;
+        bool first = true;
+        while(pos <= item.size()) {
+            size_t next = item.find(';', pos);
+            if(next == std::string::npos) {
+                next = item.size();
+            }
+            std::string param = StringUtil::Trim(item.substr(pos, next - pos));
+            pos = next + 1;
+            if(first) {
+                ext.name = yhchaos::ToLower(param);
+                first = false;
+                continue;
+            }
+            if(param.empty()) {
+                continue;
+            }
+            std::string k = param;
+            std::string v;
+            size_t eq = param.find('=');
+            if(eq != std::string::npos) {
+                k = StringUtil::Trim(param.substr(0, eq));
+                v = StringUtil::Trim(StringUtil::Trim(param.substr(eq + 1)), "\"");
+            }
+            ext.params.push_back(std::make_pair(yhchaos::ToLower(k), v));
+        }
+        if(!ext.name.empty()) {
+            rt.push_back(ext);
+        }
+    }
+    return rt;
+}
+
+//窗口大小参数，不合法返回-1
+static int ParseWindowBits(const std::string& v) {
+    if(v.empty() || v.size() > 2 || !isdigit(v[0]) || (v.size() == 2 && !isdigit(v[1]))) {
+        return -1;
+    }
+    int bits = atoi(v.c_str());
+    return (bits >= 8 && bits <= 15) ? bits : -1;
+}
+
+WDeflate::ptr WDeflate::Negotiate(const std::string& offer) {
+    if(!g_websocket_deflate_enable->getValue()) {
+        return nullptr;
+    }
+    int max_bits = std::min(15, std::max(9, g_websocket_deflate_server_max_window_bits->getValue()));
+    auto exts = ParseExtensions(offer);
+    for(auto& ext : exts) {
+        if(ext.name != "permessage-deflate") {
+            continue;
+        }
+        Params params;
+        params.server_no_context_takeover = g_websocket_deflate_server_no_context_takeover->getValue();
+        params.server_max_window_bits = max_bits;
+        bool ok = true;
+        for(auto& i : ext.params) {
+            if(i.first == "server_no_context_takeover") {
+                params.server_no_context_takeover = true;
+                ok = i.second.empty();
+            } else if(i.first == "client_no_context_takeover") {
+                params.client_no_context_takeover = true;
+                ok = i.second.empty();
+            } else if(i.first == "server_max_window_bits") {
+                int bits = ParseWindowBits(i.second);
+                //zlib的raw deflate不支持8位窗口
+                ok = bits > 8;
+                params.server_max_window_bits = std::min(params.server_max_window_bits, bits);
+            } else if(i.first == "client_max_window_bits") {
+                //只限制客户端的压缩窗口，解压缩总是使用15位窗口，不需要响应
+                ok = i.second.empty() || ParseWindowBits(i.second) > 0;
+            } else {
+                ok = false;
+            }
+            if(!ok) {
+                break;
+            }
+        }
+        if(ok) {
+            return std::make_shared<WDeflate>(params, false);
+        }
+        YHCHAOS_LOG_DEBUG(g_logger) << "decline permessage-deflate offer: " << offer;
+    }
+    return nullptr;
+}
+
+std::string WDeflate::Offer() {
+    if(!g_websocket_deflate_enable->getValue()) {
+        return "";
+    }
+    return "permessage-deflate";
+}
+
+WDeflate::ptr WDeflate::Accept(const std::string& response, bool& error) {
+    error = false;
+    auto exts = ParseExtensions(response);
+    if(exts.empty()) {
+        return nullptr;
+    }
+    if(exts.size() != 1 || exts[0].name != "permessage-deflate") {
+        error = true;
+        return nullptr;
+    }
+    Params params;
+    for(auto& i : exts[0].params) {
+        if(i.first == "server_no_context_takeover" && i.second.empty()) {
+            params.server_no_context_takeover = true;
+        } else if(i.first == "client_no_context_takeover" && i.second.empty()) {
+            params.client_no_context_takeover = true;
+        } else if(i.first == "server_max_window_bits" && ParseWindowBits(i.second) > 0) {
+            params.server_max_window_bits = ParseWindowBits(i.second);
+        } else {
+            //没有请求client_max_window_bits，服务器端不能响应
+            error = true;
+            return nullptr;
+        }
+    }
+    return std::make_shared<WDeflate>(params, true);
+}
+
+WDeflate::WDeflate(const Params& params, bool client)
+    :m_params(params)
+    ,m_client(client) {
+}
+
+bool WDeflate::compress(const std::string& in, std::string& out) {
+    if(!m_deflate) {
+        int level = std::min(9, std::max(-1, g_websocket_deflate_level->getValue()));
+        m_deflate = ZlibStream::Create(true, 16 * 1024, ZlibStream::DEFLATE, level
+                    ,m_client ? m_params.client_max_window_bits : m_params.server_max_window_bits);
+        if(!m_deflate) {
+            return false;
+        }
+    }
+    if(m_deflate->write(in.c_str(), in.size()) != Z_OK
+            || m_deflate->sync() != Z_OK) {
+        m_deflate->clearBuffers();
+        return false;
+    }
+    out = m_deflate->getRes();
+    m_deflate->clearBuffers();
+    //Z_SYNC_FLUSH输出的空块结尾 0x00 0x00 0xff 0xff 不发送
+    if(out.size() >= 4 && memcmp(&out[out.size() - 4], "\x00\x00\xff\xff", 4) == 0) {
+        out.resize(out.size() - 4);
+    }
+    if(m_client ? m_params.client_no_context_takeover
+                : m_params.server_no_context_takeover) {
+        m_deflate->reset();
+    }
+    return true;
+}
+
+bool WDeflate::decompress(const std::string& in, std::string& out, uint64_t max_size) {
+    if(!m_inflate) {
+        m_inflate = ZlibStream::Create(false, 16 * 1024, ZlibStream::DEFLATE);
+        if(!m_inflate) {
+            return false;
+        }
+    }
+    //分块解压，解压后超过max_size时尽早失败，防止压缩炸弹
+    static const size_t s_chunk_size = 4096;
+    auto out_size = [this]() {
+        uint64_t size = 0;
+        for(auto& i : m_inflate->getBuffers()) {
+            size += i.iov_len;
+        }
+        return size;
+    };
+    bool ok = true;
+    for(size_t pos = 0; ok && pos < in.size(); pos += s_chunk_size) {
+        size_t len = std::min(s_chunk_size, in.size() - pos);
+        ok = m_inflate->write(in.c_str() + pos, len) == Z_OK
+                && out_size() <= max_size;
+    }
+    ok = ok && m_inflate->write("\x00\x00\xff\xff", 4) == Z_OK
+            && out_size() <= max_size;
+    if(ok) {
+        out = m_inflate->getRes();
+    }
+    m_inflate->clearBuffers();
+    if(!ok || (m_client ? m_params.server_no_context_takeover
+                        : m_params.client_no_context_takeover)) {
+        m_inflate->reset();
+    }
+    return ok;
+}
+
+bool WDeflate::needCompress(size_t size) const {
+    return size >= g_websocket_deflate_min_size->getValue();
+}
+
+std::string WDeflate::toString() const {
+    std::stringstream ss;
+    ss << "permessage-deflate";
+    if(m_params.server_no_context_takeover) {
+        ss << "; server_no_context_takeover";
+    }
+    if(m_params.client_no_context_takeover) {
+        ss << "; client_no_context_takeover";
+    }
+    if(m_params.server_max_window_bits < 15) {
+        ss << "; server_max_window_bits=" << m_params.server_max_window_bits;
+    }
+    return ss.str();
+}
+
+WFrameBuffer::WFrameBuffer(size_t size)
+    :m_pos(0)
+    ,m_end(0) {
+    m_buffer.resize(size);
+}
+
+int WFrameBuffer::readFixSize(Stream* stream, void* buffer, size_t length) {
+    char* out = (char*)buffer;
+    size_t left = length;
+    while(left > 0) {
+        if(m_pos < m_end) {
+            size_t len = std::min(left, m_end - m_pos);
+            memcpy(out, &m_buffer[m_pos], len);
+            m_pos += len;
+            out += len;
+            left -= len;
+            continue;
+        }
+        //缓冲区放不下的数据直接读到目标中，避免多一次拷贝
+        if(left >= m_buffer.size()) {
+            int rt = stream->readFixSize(out, left);
+            return rt <= 0 ? rt : length;
+        }
+        int rt = stream->read(&m_buffer[0], m_buffer.size());
+        if(rt <= 0) {
+            return rt;
+        }
+        m_pos = 0;
+        m_end = rt;
+    }
+    return length;
+}
+
 WSession::WSession(Sock::ptr sock, bool owner)
     :HSession(sock, owner) {
 }
@@ -28,17 +313,18 @@ HttpReq::ptr WSession::handleShake() {
             YHCHAOS_LOG_INFO(g_logger) << "http header Upgrade != websocket";
             break;
         }
-        if(strcasecmp(req->getHeader("Client").c_str(), "Upgrade")) {
-            YHCHAOS_LOG_INFO(g_logger) << "http header Client != Upgrade";
+        //Connection可能是 "keep-alive, Upgrade"
+        if(yhchaos::ToLower(req->getHeader("Connection")).find("upgrade") == std::string::npos) {
+            YHCHAOS_LOG_INFO(g_logger) << "http header Connection != Upgrade";
             break;
         }
-        if(req->getHeaderAs<int>("Sec-webSock-Version") != 13) {
-            YHCHAOS_LOG_INFO(g_logger) << "http header Sec-webSock-Version != 13";
+        if(req->getHeaderAs<int>("Sec-WebSocket-Version") != 13) {
+            YHCHAOS_LOG_INFO(g_logger) << "http header Sec-WebSocket-Version != 13";
             break;
         }
-        std::string key = req->getHeader("Sec-WebSock-Key");
+        std::string key = req->getHeader("Sec-WebSocket-Key");
         if(key.empty()) {
-            YHCHAOS_LOG_INFO(g_logger) << "http header Sec-WebSock-Key = null";
+            YHCHAOS_LOG_INFO(g_logger) << "http header Sec-WebSocket-Key = null";
             break;
         }
 
@@ -51,8 +337,16 @@ HttpReq::ptr WSession::handleShake() {
         rsp->setWebsocket(true);
         rsp->setReason("Web Sock Protocol Handshake");
         rsp->setHeader("Upgrade", "websocket");
-        rsp->setHeader("Client", "Upgrade");
-        rsp->setHeader("Sec-WebSock-Accept", v);
+        rsp->setHeader("Connection", "Upgrade");
+        rsp->setHeader("Sec-WebSocket-Accept", v);
+
+        std::string extensions = req->getHeader("Sec-WebSocket-Extensions");
+        if(!extensions.empty()) {
+            m_deflate = WDeflate::Negotiate(extensions);
+            if(m_deflate) {
+                rsp->setHeader("Sec-WebSocket-Extensions", m_deflate->toString());
+            }
+        }
 
         sendRsp(rsp);
         YHCHAOS_LOG_DEBUG(g_logger) << *req;
@@ -84,28 +378,106 @@ std::string WFrameHead::toString() const {
 }
 
 WFrameMSG::ptr WSession::recvMSG() {
-    return WRecvMSG(this, false);
+    return WRecvMSG(this, false, &m_recvBuffer, m_deflate.get());
 }
 
 int32_t WSession::sendMSG(WFrameMSG::ptr msg, bool fin) {
-    return WSendMSG(this, msg, false, fin);
+    return WSendMSG(this, msg, false, fin, m_deflate.get());
 }
 
 int32_t WSession::sendMSG(const std::string& msg, int32_t opcode, bool fin) {
-    return WSendMSG(this, std::make_shared<WFrameMSG>(opcode, msg), false, fin);
+    return WSendMSG(this, std::make_shared<WFrameMSG>(opcode, msg), false, fin, m_deflate.get());
 }
 
 int32_t WSession::ping() {
     return WPing(this);
 }
 
-WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
+void WMask(char* data, size_t length, const char mask[4]) {
+    uint32_t mask32 = 0;
+    memcpy(&mask32, mask, sizeof(mask32));
+    size_t i = 0;
+    //每一步的字节数都是4的倍数，掩码的相位不变
+#if defined(__AVX2__)
+    __m256i mask256 = _mm256_set1_epi32((int)mask32);
+    for(; i + 32 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(data + i));
+        _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(v, mask256));
+    }
+#endif
+#if defined(__SSE2__)
+    __m128i mask128 = _mm_set1_epi32((int)mask32);
+    for(; i + 16 <= length; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+        _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(v, mask128));
+    }
+#elif defined(__ARM_NEON)
+    uint8x16_t mask128 = vreinterpretq_u8_u32(vdupq_n_u32(mask32));
+    for(; i + 16 <= length; i += 16) {
+        uint8x16_t v = vld1q_u8((const uint8_t*)(data + i));
+        vst1q_u8((uint8_t*)(data + i), veorq_u8(v, mask128));
+    }
+#endif
+    uint64_t mask64 = ((uint64_t)mask32 << 32) | mask32;
+    for(; i + 8 <= length; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, sizeof(v));
+        v ^= mask64;
+        memcpy(data + i, &v, sizeof(v));
+    }
+    for(; i < length; ++i) {
+        data[i] ^= mask[i % 4];
+    }
+}
+
+//有buffer时通过连接的接收缓冲区读取
+static int WReadFixSize(Stream* stream, WFrameBuffer* buffer, void* data, size_t length) {
+    if(buffer) {
+        return buffer->readFixSize(stream, data, length);
+    }
+    return stream->readFixSize(data, length);
+}
+
+//SockStream通过一次writev发送多块数据，处理部分发送的情况
+static bool WWritev(Stream* stream, iovec* iovs, size_t count) {
+    SockStream* sock_stream = dynamic_cast<SockStream*>(stream);
+    if(!sock_stream) {
+        for(size_t i = 0; i < count; ++i) {
+            if(stream->writeFixSize(iovs[i].iov_base, iovs[i].iov_len) <= 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+    Sock::ptr sock = sock_stream->getSock();
+    while(count > 0) {
+        int rt = sock->send(iovs, count);
+        if(rt <= 0) {
+            return false;
+        }
+        size_t len = rt;
+        while(count > 0 && len >= iovs->iov_len) {
+            len -= iovs->iov_len;
+            ++iovs;
+            --count;
+        }
+        if(count > 0) {
+            iovs->iov_base = (char*)iovs->iov_base + len;
+            iovs->iov_len -= len;
+        }
+    }
+    return true;
+}
+
+WFrameMSG::ptr WRecvMSG(Stream* stream, bool client, WFrameBuffer* buffer
+                        ,WDeflate* deflate) {
     int opcode = 0;
+    bool compressed = false;
     std::string data;
-    int cur_len = 0;
+    uint64_t cur_len = 0;
     do {
         WFrameHead ws_head;
-        if(stream->readFixSize(&ws_head, sizeof(ws_head)) <= 0) {
+        if(WReadFixSize(stream, buffer, &ws_head, sizeof(ws_head)) <= 0) {
             break;
         }
         YHCHAOS_LOG_DEBUG(g_logger) << "WFrameHead " << ws_head.toString();
@@ -125,6 +497,14 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
                 YHCHAOS_LOG_INFO(g_logger) << "WFrameHead mask != 1";
                 break;
             }
+            //RSV1只能在压缩消息的第一个分片帧置位
+            if(ws_head.rsv1) {
+                if(!deflate || ws_head.opcode == WFrameHead::CONTINUE) {
+                    YHCHAOS_LOG_INFO(g_logger) << "WFrameHead unexpected rsv1";
+                    break;
+                }
+                compressed = true;
+            }
             uint64_t length = 0;
             /**
              * 解析WebSock帧的有效负载长度（payload length）的部分。WebSock头部中的
@@ -135,13 +515,13 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
             */
             if(ws_head.payload == 126) {
                 uint16_t len = 0;
-                if(stream->readFixSize(&len, sizeof(len)) <= 0) {
+                if(WReadFixSize(stream, buffer, &len, sizeof(len)) <= 0) {
                     break;
                 }
                 length = yhchaos::swapbyteOnLittleEndian(len);
             } else if(ws_head.payload == 127) {
                 uint64_t len = 0;
-                if(stream->readFixSize(&len, sizeof(len)) <= 0) {
+                if(WReadFixSize(stream, buffer, &len, sizeof(len)) <= 0) {
                     break;
                 }
                 length = yhchaos::swapbyteOnLittleEndian(len);
@@ -158,18 +538,16 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
 
             char mask[4] = {0};
             if(ws_head.mask) {
-                if(stream->readFixSize(mask, sizeof(mask)) <= 0) {
+                if(WReadFixSize(stream, buffer, mask, sizeof(mask)) <= 0) {
                     break;
                 }
             }
             data.resize(cur_len + length);
-            if(stream->readFixSize(&data[cur_len], length) <= 0) {
+            if(length && WReadFixSize(stream, buffer, &data[cur_len], length) <= 0) {
                 break;
             }
             if(ws_head.mask) {
-                for(int i = 0; i < (int)length; ++i) {
-                    data[cur_len + i] ^= mask[i % 4];
-                }
+                WMask(&data[cur_len], length, mask);
             }
             cur_len += length;
             //opcode表示第一个分片帧类型，表示后面的分片帧都是这个类型
@@ -178,6 +556,14 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
             }
             //知道遇到fin为止。表示某个消息的分片帧接收完毕
             if(ws_head.fin) {
+                if(compressed) {
+                    std::string out;
+                    if(!deflate->decompress(data, out, g_websocket_message_max_size->getValue())) {
+                        YHCHAOS_LOG_WARN(g_logger) << "WFrameMSG decompress fail, size=" << data.size();
+                        break;
+                    }
+                    data.swap(out);
+                }
                 YHCHAOS_LOG_DEBUG(g_logger) << data;
                 return WFrameMSG::ptr(new WFrameMSG(opcode, std::move(data)));
             }
@@ -189,57 +575,81 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client) {
     return nullptr;
 }
 
-int32_t WSendMSG(Stream* stream, WFrameMSG::ptr msg, bool client, bool fin) {
-    do {
-        WFrameHead ws_head;
-        memset(&ws_head, 0, sizeof(ws_head));
-        ws_head.fin = fin;
-        ws_head.opcode = msg->getOpcode();
-        ws_head.mask = client;
-        uint64_t size = msg->getData().size();
-        if(size < 126) {
-            ws_head.payload = size;
-        } else if(size < 65536) {
-            ws_head.payload = 126;
-        } else {
-            ws_head.payload = 127;
-        }
-        
-        if(stream->writeFixSize(&ws_head, sizeof(ws_head)) <= 0) {
-            break;
-        }
-        if(ws_head.payload == 126) {
-            uint16_t len = size;
-            len = yhchaos::swapbyteOnLittleEndian(len);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0) {
-                break;
-            }
-        } else if(ws_head.payload == 127) {
-            uint64_t len = yhchaos::swapbyteOnLittleEndian(size);
-            if(stream->writeFixSize(&len, sizeof(len)) <= 0) {
-                break;
-            }
-        }
-        if(client) {
-            char mask[4];
-            uint32_t rand_value = rand();
-            memcpy(mask, &rand_value, sizeof(mask));
-            std::string& data = msg->getData();
-            for(size_t i = 0; i < data.size(); ++i) {
-                data[i] ^= mask[i % 4];
-            }
+int32_t WSendMSG(Stream* stream, WFrameMSG::ptr msg, bool client, bool fin
+                 ,WDeflate* deflate) {
+    //2字节帧头 + 最多8字节扩展长度 + 4字节掩码
+    char head[sizeof(WFrameHead) + 8 + 4];
+    size_t head_len = sizeof(WFrameHead);
+    WFrameHead ws_head;
+    memset(&ws_head, 0, sizeof(ws_head));
+    ws_head.fin = fin;
+    ws_head.opcode = msg->getOpcode();
+    ws_head.mask = client;
 
-            if(stream->writeFixSize(mask, sizeof(mask)) <= 0) {
-                break;
-            }
+    //只压缩不分片的消息，分片发送的消息原样发送
+    std::string compressed;
+    const std::string* payload = &msg->getData();
+    if(deflate && fin && (ws_head.opcode == WFrameHead::TEXT_FRAME
+                || ws_head.opcode == WFrameHead::BIN_FRAME)
+            && deflate->needCompress(payload->size())) {
+        if(!deflate->compress(*payload, compressed)) {
+            //压缩上下文和对方不一致了，不能再继续
+            YHCHAOS_LOG_WARN(g_logger) << "WFrameMSG compress fail, size=" << payload->size();
+            stream->close();
+            return -1;
         }
-        if(stream->writeFixSize(msg->getData().c_str(), size) <= 0) {
-            break;
+        ws_head.rsv1 = 1;
+        payload = &compressed;
+    }
+    uint64_t size = payload->size();
+    if(size < 126) {
+        ws_head.payload = size;
+    } else if(size < 65536) {
+        ws_head.payload = 126;
+    } else {
+        ws_head.payload = 127;
+    }
+    memcpy(head, &ws_head, sizeof(ws_head));
+
+    if(ws_head.payload == 126) {
+        uint16_t len = size;
+        len = yhchaos::swapbyteOnLittleEndian(len);
+        memcpy(head + head_len, &len, sizeof(len));
+        head_len += sizeof(len);
+    } else if(ws_head.payload == 127) {
+        uint64_t len = yhchaos::swapbyteOnLittleEndian(size);
+        memcpy(head + head_len, &len, sizeof(len));
+        head_len += sizeof(len);
+    }
+
+    const char* data = payload->c_str();
+    std::string masked;
+    if(client) {
+        char mask[4];
+        uint32_t rand_value = rand();
+        memcpy(mask, &rand_value, sizeof(mask));
+        memcpy(head + head_len, mask, sizeof(mask));
+        head_len += sizeof(mask);
+        if(payload == &compressed) {
+            //压缩后的数据是自己的副本，可以直接加掩码
+            masked.swap(compressed);
+        } else {
+            masked = *payload;
         }
-        return size + sizeof(ws_head);
-    } while(0);
-    stream->close();
-    return -1;
+        WMask(&masked[0], masked.size(), mask);
+        data = masked.c_str();
+    }
+
+    iovec iovs[2];
+    iovs[0].iov_base = head;
+    iovs[0].iov_len = head_len;
+    iovs[1].iov_base = (void*)data;
+    iovs[1].iov_len = size;
+    if(!WWritev(stream, iovs, size ? 2 : 1)) {
+        stream->close();
+        return -1;
+    }
+    return size + sizeof(ws_head);
 }
 
 int32_t WSession::pong() {
@@ -3,6 +3,7 @@
 
 #include "yhchaos/appconfig.h"
 #include "yhchaos/http/http_session.h"
+#include "yhchaos/streams/zlib_stream.h"
 #include <stdint.h>
 
 namespace yhchaos {
@@ -51,6 +52,124 @@ private:
     std::string m_data;
 };
 
+/**
+ * @brief websocket帧的接收缓冲区，每个连接一个，复用于所有的帧
+ * @details 帧头、扩展长度、掩码和小帧的负载通过一次read读到缓冲区中，减少系统调用；
+ *          缓冲区放不下的负载直接读到消息中
+ */
+class WFrameBuffer {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] size 缓冲区大小
+     */
+    WFrameBuffer(size_t size = 16 * 1024);
+
+    /**
+     * @brief 读取固定长度的数据，缓冲区中的数据不够时从stream读取
+     * @return >0 成功，<=0 stream出错或者关闭
+     */
+    int readFixSize(Stream* stream, void* buffer, size_t length);
+
+    /**
+     * @brief 缓冲区中还没有读取的字节数
+     */
+    size_t getReadSize() const { return m_end - m_pos;}
+private:
+    std::string m_buffer;
+    size_t m_pos;
+    size_t m_end;
+};
+
+/**
+ * @brief websocket的permessage-deflate扩展(RFC 7692)，每个连接一个
+ * @details
+ *  1. 压缩和解压缩上下文在连接的所有消息间复用，第一次使用时才创建，空闲连接不占用zlib内存
+ *  2. 有context takeover时后面的消息可以引用前面消息的内容，重复的JSON字段压缩率更高；
+ *     协商了no_context_takeover时每个消息结束后重置上下文
+ *  3. 压缩后的消息去掉末尾的0x00 0x00 0xff 0xff，解压缩前补上
+ *  4. zlib的raw deflate不支持8位窗口，对方要求server_max_window_bits=8时拒绝该offer
+ */
+class WDeflate {
+public:
+    typedef std::shared_ptr<WDeflate> ptr;
+
+    /**
+     * @brief 协商后的扩展参数
+     */
+    struct Params {
+        /// 服务器端每个消息后重置压缩上下文
+        bool server_no_context_takeover = false;
+        /// 客户端每个消息后重置压缩上下文
+        bool client_no_context_takeover = false;
+        /// 服务器端压缩使用的窗口大小
+        int server_max_window_bits = 15;
+        /// 客户端压缩使用的窗口大小
+        int client_max_window_bits = 15;
+    };
+
+    /**
+     * @brief 服务器端根据请求的Sec-WebSocket-Extensions协商
+     * @param[in] offer 请求头部的值，可能包含多个offer
+     * @return 接受的扩展，没有可接受的offer或者配置关闭时返回nullptr
+     */
+    static WDeflate::ptr Negotiate(const std::string& offer);
+
+    /**
+     * @brief 客户端请求的Sec-WebSocket-Extensions，配置关闭时返回空串
+     */
+    static std::string Offer();
+
+    /**
+     * @brief 客户端根据响应的Sec-WebSocket-Extensions创建
+     * @param[in] response 响应头部的值
+     * @param[out] error 响应不合法时为true
+     * @return 服务器端没有接受扩展或者响应不合法时返回nullptr
+     */
+    static WDeflate::ptr Accept(const std::string& response, bool& error);
+
+    /**
+     * @brief 构造函数
+     * @param[in] params 协商后的参数
+     * @param[in] client 是否是客户端
+     */
+    WDeflate(const Params& params, bool client);
+
+    /**
+     * @brief 压缩一个完整的消息
+     * @return 是否成功
+     */
+    bool compress(const std::string& in, std::string& out);
+
+    /**
+     * @brief 解压缩一个完整的消息
+     * @param[in] max_size 解压后的最大长度，超过时失败
+     * @return 是否成功
+     */
+    bool decompress(const std::string& in, std::string& out, uint64_t max_size);
+
+    /**
+     * @brief 是否需要压缩该长度的消息，太短的消息压缩后反而变长
+     */
+    bool needCompress(size_t size) const;
+
+    const Params& getParams() const { return m_params;}
+
+    /**
+     * @brief 服务器端响应的Sec-WebSocket-Extensions
+     */
+    std::string toString() const;
+private:
+    /// 协商后的参数
+    Params m_params;
+    /// 是否是客户端
+    bool m_client;
+    /// 压缩上下文
+    ZlibStream::ptr m_deflate;
+    /// 解压缩上下文
+    ZlibStream::ptr m_inflate;
+};
+
 class WSession : public HSession {
 public:
     typedef std::shared_ptr<WSession> ptr;
@@ -66,20 +185,43 @@ public:
     int32_t sendMSG(const std::string& msg, int32_t opcode = WFrameHead::TEXT_FRAME, bool fin = true);
     int32_t ping();
     int32_t pong();
+
+    /**
+     * @brief 握手时协商的permessage-deflate，没有协商时为nullptr
+     */
+    WDeflate::ptr getDeflate() const { return m_deflate;}
 private:
     bool handleSvrShake();
     bool handleClientShake();
+private:
+    /// 接收缓冲区
+    WFrameBuffer m_recvBuffer;
+    /// permessage-deflate
+    WDeflate::ptr m_deflate;
 };
 
 extern yhchaos::AppConfigVar<uint32_t>::ptr g_websocket_message_max_size;
 
+/**
+ * @brief 对数据进行websocket掩码处理，加掩码和解掩码是同一个操作
+ * @details 按编译时可用的指令集每次处理32(AVX2)或16(SSE2/NEON)字节，剩余部分每次处理8字节
+ * @param[in,out] data 数据
+ * @param[in] length 数据长度
+ * @param[in] mask 4字节掩码，data[0]对应mask[0]
+ */
+void WMask(char* data, size_t length, const char mask[4]);
+
 /**
  * @brief 服务器端接收websocket请求消息
  * @param[in] stream 流
  * @param[in] client 接收端是否是客户端，如果是服务器端接收消息，则收到的信息是经过掩码处理的，需要解掩码
- * @details 接受一个客户端消息的所有分片帧的数据部分，对其进行解掩码处理，然后组成一个WFrameMSG
+ * @param[in] buffer 连接的接收缓冲区，为nullptr时直接从stream读取
+ * @param[in] deflate 协商的permessage-deflate，为nullptr时收到RSV1置位的消息关闭连接
+ * @details 接受一个客户端消息的所有分片帧的数据部分，对其进行解掩码处理，然后组成一个WFrameMSG，
+ *          第一个分片帧的RSV1置位表示消息是压缩的，收完后解压缩
 */
-WFrameMSG::ptr WRecvMSG(Stream* stream, bool client);
+WFrameMSG::ptr WRecvMSG(Stream* stream, bool client, WFrameBuffer* buffer = nullptr
+                        ,WDeflate* deflate = nullptr);
 
 /**
  * @brief 服务器端发送websocket消息
@@ -87,9 +229,12 @@ WFrameMSG::ptr WRecvMSG(Stream* stream, bool client);
  * @param[in] msg 消息
  * @param[in] client 发送端是否是客户端，如果是服务器端发送消息，则发送的信息不需要进行掩码处理，否则需要进行掩码处理
  * @param[in] fin 是否是消息的最后一个分片
+ * @param[in] deflate 协商的permessage-deflate，只压缩不分片的文本和二进制消息
+ * @details 帧头和数据通过一次writev发送，客户端加掩码时不修改msg
  * @return 发送的实际字节数，不包括发送的长度和掩码，只包括wssocket的头和数据部分，返回时不关闭流
 */
-int32_t WSendMSG(Stream* stream, WFrameMSG::ptr msg, bool client, bool fin);
+int32_t WSendMSG(Stream* stream, WFrameMSG::ptr msg, bool client, bool fin
+                 ,WDeflate* deflate = nullptr);
 //发送ping信息
 int32_t WPing(Stream* stream);
 //发送ping信息的回复pong信息
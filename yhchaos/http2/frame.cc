@@ -0,0 +1,202 @@
+#include "frame.h"
+#include <sstream>
+
+namespace yhchaos {
+namespace http2 {
+
+const char CLIENT_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+const char* FrameTypeToString(FrameType type) {
+    switch(type) {
+#define XX(name) \
+        case FrameType::name: \
+            return #name;
+        XX(DATA);
+        XX(HEADERS);
+        XX(PRIORITY);
+        XX(RST_STREAM);
+        XX(SETTINGS);
+        XX(PUSH_PROMISE);
+        XX(PING);
+        XX(GOAWAY);
+        XX(WINDOW_UPDATE);
+        XX(CONTINUATION);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+const char* Http2ErrorToString(Http2Error error) {
+    switch(error) {
+#define XX(name) \
+        case Http2Error::name: \
+            return #name;
+        XX(NO_ERROR);
+        XX(PROTOCOL_ERROR);
+        XX(INTERNAL_ERROR);
+        XX(FLOW_CONTROL_ERROR);
+        XX(SETTINGS_TIMEOUT);
+        XX(STREAM_CLOSED);
+        XX(FRAME_SIZE_ERROR);
+        XX(REFUSED_STREAM);
+        XX(CANCEL);
+        XX(COMPRESSION_ERROR);
+        XX(CONNECT_ERROR);
+        XX(ENHANCE_YOUR_CALM);
+        XX(INADEQUATE_SECURITY);
+        XX(HTTP_1_1_REQUIRED);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+uint32_t ReadUint32(const char* p) {
+    const uint8_t* u = (const uint8_t*)p;
+    return ((uint32_t)u[0] << 24) | ((uint32_t)u[1] << 16)
+        | ((uint32_t)u[2] << 8) | u[3];
+}
+
+uint32_t ReadUint24(const char* p) {
+    const uint8_t* u = (const uint8_t*)p;
+    return ((uint32_t)u[0] << 16) | ((uint32_t)u[1] << 8) | u[2];
+}
+
+uint16_t ReadUint16(const char* p) {
+    const uint8_t* u = (const uint8_t*)p;
+    return ((uint16_t)u[0] << 8) | u[1];
+}
+
+void AppendUint32(std::string& out, uint32_t v) {
+    out.push_back((char)(v >> 24));
+    AppendUint24(out, v);
+}
+
+void AppendUint24(std::string& out, uint32_t v) {
+    out.push_back((char)(v >> 16));
+    AppendUint16(out, v);
+}
+
+void AppendUint16(std::string& out, uint16_t v) {
+    out.push_back((char)(v >> 8));
+    out.push_back((char)v);
+}
+
+Frame::Frame(FrameType _type, uint8_t _flags, uint32_t _stream_id)
+    :type(_type)
+    ,flags(_flags)
+    ,streamId(_stream_id) {
+}
+
+Frame::ptr Frame::Read(Stream::ptr stream, uint32_t max_size, Http2Error& error) {
+    char header[FRAME_HEADER_SIZE];
+    if(stream->readFixSize(header, sizeof(header)) <= 0) {
+        return nullptr;
+    }
+    uint32_t length = ReadUint24(header);
+    if(length > max_size) {
+        error = Http2Error::FRAME_SIZE_ERROR;
+        return nullptr;
+    }
+    Frame::ptr frame(new Frame((FrameType)(uint8_t)header[3], header[4]
+                    ,ReadUint32(header + 5) & 0x7fffffff));
+    if(length > 0) {
+        frame->data.resize(length);
+        if(stream->readFixSize(&frame->data[0], length) <= 0) {
+            return nullptr;
+        }
+    }
+    return frame;
+}
+
+bool Frame::writeTo(Stream::ptr stream) const {
+    std::string buf;
+    buf.reserve(FRAME_HEADER_SIZE + data.size());
+    AppendUint24(buf, data.size());
+    buf.push_back((char)type);
+    buf.push_back((char)flags);
+    AppendUint32(buf, streamId);
+    buf.append(data);
+    return stream->writeFixSize(buf.c_str(), buf.size()) > 0;
+}
+
+bool Frame::stripPadding() {
+    size_t begin = 0;
+    size_t pad = 0;
+    if(hasFlag(PADDED)) {
+        if(data.empty()) {
+            return false;
+        }
+        pad = (uint8_t)data[0];
+        begin = 1;
+    }
+    if(type == FrameType::HEADERS && hasFlag(PRIORITY)) {
+        begin += 5;
+    }
+    if(begin + pad > data.size()) {
+        return false;
+    }
+    data = data.substr(begin, data.size() - begin - pad);
+    flags &= ~(PADDED | PRIORITY);
+    return true;
+}
+
+std::string Frame::toString() const {
+    std::stringstream ss;
+    ss << "[Frame type=" << FrameTypeToString(type)
+       << " flags=0x" << std::hex << (uint32_t)flags << std::dec
+       << " stream_id=" << streamId
+       << " length=" << data.size()
+       << "]";
+    return ss.str();
+}
+
+Frame::ptr Frame::CreateSettings(const std::vector<std::pair<SettingsId, uint32_t> >& settings) {
+    Frame::ptr frame(new Frame(FrameType::SETTINGS));
+    for(auto& i : settings) {
+        AppendUint16(frame->data, (uint16_t)i.first);
+        AppendUint32(frame->data, i.second);
+    }
+    return frame;
+}
+
+Frame::ptr Frame::CreateSettingsAck() {
+    return std::make_shared<Frame>(FrameType::SETTINGS, ACK);
+}
+
+Frame::ptr Frame::CreateWindowUpdate(uint32_t stream_id, uint32_t increment) {
+    Frame::ptr frame(new Frame(FrameType::WINDOW_UPDATE, 0, stream_id));
+    AppendUint32(frame->data, increment & 0x7fffffff);
+    return frame;
+}
+
+Frame::ptr Frame::CreateRstStream(uint32_t stream_id, Http2Error error) {
+    Frame::ptr frame(new Frame(FrameType::RST_STREAM, 0, stream_id));
+    AppendUint32(frame->data, (uint32_t)error);
+    return frame;
+}
+
+Frame::ptr Frame::CreateGoAway(uint32_t last_stream_id, Http2Error error, const std::string& debug) {
+    Frame::ptr frame(new Frame(FrameType::GOAWAY));
+    AppendUint32(frame->data, last_stream_id & 0x7fffffff);
+    AppendUint32(frame->data, (uint32_t)error);
+    frame->data.append(debug);
+    return frame;
+}
+
+Frame::ptr Frame::CreatePing(const std::string& opaque, bool ack) {
+    Frame::ptr frame(new Frame(FrameType::PING, ack ? ACK : 0));
+    frame->data = opaque;
+    frame->data.resize(8);
+    return frame;
+}
+
+Frame::ptr Frame::CreateData(uint32_t stream_id, const std::string& data, bool end_stream) {
+    Frame::ptr frame(new Frame(FrameType::DATA, end_stream ? END_STREAM : 0, stream_id));
+    frame->data = data;
+    return frame;
+}
+
+}
+}
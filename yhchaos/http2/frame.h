@@ -0,0 +1,147 @@
+#ifndef __YHCHAOS_HTTP2_FRAME_H__
+#define __YHCHAOS_HTTP2_FRAME_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "yhchaos/stream.h"
+
+namespace yhchaos {
+namespace http2 {
+
+/// 客户端连接序言(RFC 7540 3.5)
+extern const char CLIENT_PREFACE[];
+/// 客户端连接序言的长度
+static const uint32_t CLIENT_PREFACE_LEN = 24;
+/// 帧头长度
+static const uint32_t FRAME_HEADER_SIZE = 9;
+/// 默认的窗口大小
+static const int32_t DEFAULT_WINDOW_SIZE = 65535;
+/// 默认的最大帧大小
+static const uint32_t DEFAULT_MAX_FRAME_SIZE = 16384;
+/// 窗口的最大值
+static const int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+
+/**
+ * @brief 帧类型
+ */
+enum class FrameType {
+    DATA            = 0x0,
+    HEADERS         = 0x1,
+    PRIORITY        = 0x2,
+    RST_STREAM      = 0x3,
+    SETTINGS        = 0x4,
+    PUSH_PROMISE    = 0x5,
+    PING            = 0x6,
+    GOAWAY          = 0x7,
+    WINDOW_UPDATE   = 0x8,
+    CONTINUATION    = 0x9,
+};
+
+/**
+ * @brief 帧标志位
+ */
+enum FrameFlag {
+    END_STREAM  = 0x1,
+    ACK         = 0x1,
+    END_HEADERS = 0x4,
+    PADDED      = 0x8,
+    PRIORITY    = 0x20,
+};
+
+/**
+ * @brief 错误码(RFC 7540 7)
+ */
+enum class Http2Error {
+    NO_ERROR            = 0x0,
+    PROTOCOL_ERROR      = 0x1,
+    INTERNAL_ERROR      = 0x2,
+    FLOW_CONTROL_ERROR  = 0x3,
+    SETTINGS_TIMEOUT    = 0x4,
+    STREAM_CLOSED       = 0x5,
+    FRAME_SIZE_ERROR    = 0x6,
+    REFUSED_STREAM      = 0x7,
+    CANCEL              = 0x8,
+    COMPRESSION_ERROR   = 0x9,
+    CONNECT_ERROR       = 0xa,
+    ENHANCE_YOUR_CALM   = 0xb,
+    INADEQUATE_SECURITY = 0xc,
+    HTTP_1_1_REQUIRED   = 0xd,
+};
+
+/**
+ * @brief SETTINGS参数
+ */
+enum class SettingsId {
+    HEADER_TABLE_SIZE       = 0x1,
+    ENABLE_PUSH             = 0x2,
+    MAX_CONCURRENT_STREAMS  = 0x3,
+    INITIAL_WINDOW_SIZE     = 0x4,
+    MAX_FRAME_SIZE          = 0x5,
+    MAX_HEADER_LIST_SIZE    = 0x6,
+};
+
+const char* FrameTypeToString(FrameType type);
+const char* Http2ErrorToString(Http2Error error);
+
+/**
+ * @brief HTTP/2帧
+ */
+struct Frame {
+    typedef std::shared_ptr<Frame> ptr;
+
+    Frame(FrameType _type = FrameType::DATA, uint8_t _flags = 0, uint32_t _stream_id = 0);
+
+    /**
+     * @brief 从流中读取一帧
+     * @param[in] stream 数据流
+     * @param[in] max_size 本端允许的最大帧大小
+     * @param[out] error 帧超过max_size时为FRAME_SIZE_ERROR，读失败时不修改
+     * @return 失败返回nullptr
+     */
+    static Frame::ptr Read(Stream::ptr stream, uint32_t max_size, Http2Error& error);
+
+    /**
+     * @brief 帧头和负载一次写入流中
+     * @return 成功返回true
+     */
+    bool writeTo(Stream::ptr stream) const;
+
+    /**
+     * @brief 去掉DATA/HEADERS的填充，以及HEADERS的优先级字段
+     * @return 填充长度不合法时返回false
+     */
+    bool stripPadding();
+
+    bool hasFlag(uint8_t flag) const { return flags & flag;}
+
+    std::string toString() const;
+
+    static Frame::ptr CreateSettings(const std::vector<std::pair<SettingsId, uint32_t> >& settings);
+    static Frame::ptr CreateSettingsAck();
+    static Frame::ptr CreateWindowUpdate(uint32_t stream_id, uint32_t increment);
+    static Frame::ptr CreateRstStream(uint32_t stream_id, Http2Error error);
+    static Frame::ptr CreateGoAway(uint32_t last_stream_id, Http2Error error, const std::string& debug = "");
+    static Frame::ptr CreatePing(const std::string& opaque, bool ack);
+    static Frame::ptr CreateData(uint32_t stream_id, const std::string& data, bool end_stream);
+
+    FrameType type;
+    uint8_t flags;
+    uint32_t streamId;
+    std::string data;
+};
+
+/**
+ * @brief 读写网络字节序的整数
+ */
+uint32_t ReadUint32(const char* p);
+uint32_t ReadUint24(const char* p);
+uint16_t ReadUint16(const char* p);
+void AppendUint32(std::string& out, uint32_t v);
+void AppendUint24(std::string& out, uint32_t v);
+void AppendUint16(std::string& out, uint16_t v);
+
+}
+}
+
+#endif
@@ -0,0 +1,483 @@
+#include "hpack.h"
+#include <string.h>
+#include <algorithm>
+
+namespace yhchaos {
+namespace http2 {
+
+//RFC 7541 附录B，每个符号(0~255, 256=EOS)的哈夫曼编码长度
+//编码是规范哈夫曼编码，按(长度, 符号)排序后依次递增即可还原
+static const uint8_t s_huffman_lengths[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+     6, 10, 10, 12, 13,  6,  8, 11, 10, 10,  8, 11,  8,  6,  6,  6,
+     5,  5,  5,  6,  6,  6,  6,  6,  6,  6,  7,  8, 15,  6, 12, 10,
+    13,  6,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,  7,
+     7,  7,  7,  7,  7,  7,  7,  7,  8,  7,  8, 13, 19, 13, 14,  6,
+    15,  5,  6,  5,  6,  5,  6,  6,  6,  5,  7,  7,  6,  6,  6,  5,
+     6,  7,  6,  5,  5,  6,  7,  7,  7,  7,  7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,};
+
+namespace {
+
+struct HuffmanTable {
+    uint32_t codes[257];
+    /// 每种长度的第一个编码
+    uint32_t first[31];
+    /// 每种长度的编码个数
+    uint32_t count[31];
+    /// 每种长度在symbols中的起始位置
+    uint32_t offset[31];
+    /// 按(长度, 符号)排序的符号
+    uint16_t symbols[257];
+
+    HuffmanTable() {
+        memset(first, 0, sizeof(first));
+        memset(count, 0, sizeof(count));
+        memset(offset, 0, sizeof(offset));
+        for(uint16_t i = 0; i < 257; ++i) {
+            symbols[i] = i;
+        }
+        std::stable_sort(symbols, symbols + 257, [](uint16_t a, uint16_t b) {
+            return s_huffman_lengths[a] < s_huffman_lengths[b];
+        });
+        uint32_t code = 0;
+        uint32_t prev = 0;
+        for(uint32_t i = 0; i < 257; ++i) {
+            uint16_t sym = symbols[i];
+            uint32_t len = s_huffman_lengths[sym];
+            if(i > 0) {
+                code = (code + 1) << (len - prev);
+            }
+            if(count[len] == 0) {
+                first[len] = code;
+                offset[len] = i;
+            }
+            ++count[len];
+            codes[sym] = code;
+            prev = len;
+        }
+    }
+};
+
+static const HuffmanTable s_huffman;
+
+//RFC 7541 附录A 静态表，index从1开始
+static const char* s_static_table[][2] = {
+    {"", ""},
+    {":authority", ""},
+    {":method", "GET"},
+    {":method", "POST"},
+    {":path", "/"},
+    {":path", "/index.html"},
+    {":scheme", "http"},
+    {":scheme", "https"},
+    {":status", "200"},
+    {":status", "204"},
+    {":status", "206"},
+    {":status", "304"},
+    {":status", "400"},
+    {":status", "404"},
+    {":status", "500"},
+    {"accept-charset", ""},
+    {"accept-encoding", "gzip, deflate"},
+    {"accept-language", ""},
+    {"accept-ranges", ""},
+    {"accept", ""},
+    {"access-control-allow-origin", ""},
+    {"age", ""},
+    {"allow", ""},
+    {"authorization", ""},
+    {"cache-control", ""},
+    {"content-disposition", ""},
+    {"content-encoding", ""},
+    {"content-language", ""},
+    {"content-length", ""},
+    {"content-location", ""},
+    {"content-range", ""},
+    {"content-type", ""},
+    {"cookie", ""},
+    {"date", ""},
+    {"etag", ""},
+    {"expect", ""},
+    {"expires", ""},
+    {"from", ""},
+    {"host", ""},
+    {"if-match", ""},
+    {"if-modified-since", ""},
+    {"if-none-match", ""},
+    {"if-range", ""},
+    {"if-unmodified-since", ""},
+    {"last-modified", ""},
+    {"link", ""},
+    {"location", ""},
+    {"max-forwards", ""},
+    {"proxy-authenticate", ""},
+    {"proxy-authorization", ""},
+    {"range", ""},
+    {"referer", ""},
+    {"refresh", ""},
+    {"retry-after", ""},
+    {"server", ""},
+    {"set-cookie", ""},
+    {"strict-transport-security", ""},
+    {"transfer-encoding", ""},
+    {"user-agent", ""},
+    {"vary", ""},
+    {"via", ""},
+    {"www-authenticate", ""},
+};
+
+static const uint32_t s_static_count = sizeof(s_static_table) / sizeof(s_static_table[0]) - 1;
+
+//每一项占用的动态表大小
+static uint32_t EntrySize(const std::string& name, const std::string& value) {
+    return name.size() + value.size() + 32;
+}
+
+//N位前缀整数编码(RFC 7541 5.1)
+static void EncodeInt(std::string& out, uint8_t flags, uint8_t prefix, uint64_t v) {
+    uint32_t max = (1u << prefix) - 1;
+    if(v < max) {
+        out.push_back((char)(flags | v));
+        return;
+    }
+    out.push_back((char)(flags | max));
+    v -= max;
+    while(v >= 128) {
+        out.push_back((char)((v & 0x7f) | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+static bool DecodeInt(const uint8_t*& p, const uint8_t* end, uint8_t prefix, uint32_t& v) {
+    if(p >= end) {
+        return false;
+    }
+    uint32_t max = (1u << prefix) - 1;
+    uint64_t rt = *p++ & max;
+    if(rt < max) {
+        v = rt;
+        return true;
+    }
+    for(uint32_t shift = 0; p < end; shift += 7) {
+        //限制在32位内，防止恶意的超长整数
+        if(shift > 28) {
+            return false;
+        }
+        uint8_t b = *p++;
+        rt += (uint64_t)(b & 0x7f) << shift;
+        if(!(b & 0x80)) {
+            if(rt > 0xffffffffull) {
+                return false;
+            }
+            v = rt;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool DecodeString(const uint8_t*& p, const uint8_t* end, std::string& out) {
+    if(p >= end) {
+        return false;
+    }
+    bool huffman = *p & 0x80;
+    uint32_t len = 0;
+    if(!DecodeInt(p, end, 7, len) || len > (uint32_t)(end - p)) {
+        return false;
+    }
+    out.clear();
+    if(huffman) {
+        if(!Huffman::Decode((const char*)p, len, out)) {
+            return false;
+        }
+    } else {
+        out.assign((const char*)p, len);
+    }
+    p += len;
+    return true;
+}
+
+static void EncodeString(std::string& out, const std::string& str) {
+    size_t hlen = Huffman::EncodedLength(str);
+    if(hlen < str.size()) {
+        EncodeInt(out, 0x80, 7, hlen);
+        Huffman::Encode(str, out);
+    } else {
+        EncodeInt(out, 0, 7, str.size());
+        out.append(str);
+    }
+}
+
+}
+
+void Huffman::Encode(const std::string& src, std::string& out) {
+    uint64_t bits = 0;
+    uint32_t nbits = 0;
+    for(unsigned char c : src) {
+        uint32_t len = s_huffman_lengths[c];
+        bits = (bits << len) | s_huffman.codes[c];
+        nbits += len;
+        while(nbits >= 8) {
+            nbits -= 8;
+            out.push_back((char)(bits >> nbits));
+        }
+    }
+    if(nbits > 0) {
+        out.push_back((char)((bits << (8 - nbits)) | (0xff >> nbits)));
+    }
+}
+
+size_t Huffman::EncodedLength(const std::string& src) {
+    size_t nbits = 0;
+    for(unsigned char c : src) {
+        nbits += s_huffman_lengths[c];
+    }
+    return (nbits + 7) / 8;
+}
+
+bool Huffman::Decode(const char* data, size_t len, std::string& out) {
+    uint32_t code = 0;
+    uint32_t nbits = 0;
+    for(size_t i = 0; i < len; ++i) {
+        uint8_t b = data[i];
+        for(int j = 7; j >= 0; --j) {
+            code = (code << 1) | ((b >> j) & 1);
+            ++nbits;
+            if(nbits < 5) {
+                continue;
+            }
+            if(nbits > 30) {
+                return false;
+            }
+            uint32_t idx = code - s_huffman.first[nbits];
+            if(code >= s_huffman.first[nbits] && idx < s_huffman.count[nbits]) {
+                uint16_t sym = s_huffman.symbols[s_huffman.offset[nbits] + idx];
+                if(sym == 256) {
+                    return false;
+                }
+                out.push_back((char)sym);
+                code = 0;
+                nbits = 0;
+            }
+        }
+    }
+    //填充必须是EOS的高位(全1)，并且不超过7位
+    return nbits < 8 && code == (1u << nbits) - 1;
+}
+
+DynamicTable::DynamicTable(uint32_t max_size)
+    :m_size(0)
+    ,m_maxSize(max_size) {
+}
+
+void DynamicTable::add(const std::string& name, const std::string& value) {
+    uint32_t size = EntrySize(name, value);
+    if(size > m_maxSize) {
+        //比整个表还大的项会清空动态表，并且不会被加入
+        m_entries.clear();
+        m_size = 0;
+        return;
+    }
+    evict(m_maxSize - size);
+    m_entries.emplace_front(name, value);
+    m_size += size;
+}
+
+bool DynamicTable::get(uint32_t index, std::string& name, std::string& value) const {
+    if(index == 0) {
+        return false;
+    }
+    if(index <= s_static_count) {
+        name = s_static_table[index][0];
+        value = s_static_table[index][1];
+        return true;
+    }
+    index -= s_static_count + 1;
+    if(index >= m_entries.size()) {
+        return false;
+    }
+    name = m_entries[index].first;
+    value = m_entries[index].second;
+    return true;
+}
+
+uint32_t DynamicTable::find(const std::string& name, const std::string& value, bool& value_matched) const {
+    uint32_t name_idx = 0;
+    value_matched = false;
+    for(uint32_t i = 1; i <= s_static_count; ++i) {
+        if(name == s_static_table[i][0]) {
+            if(value == s_static_table[i][1]) {
+                value_matched = true;
+                return i;
+            }
+            if(!name_idx) {
+                name_idx = i;
+            }
+        }
+    }
+    for(size_t i = 0; i < m_entries.size(); ++i) {
+        if(m_entries[i].first == name) {
+            if(m_entries[i].second == value) {
+                value_matched = true;
+                return s_static_count + 1 + i;
+            }
+            if(!name_idx) {
+                name_idx = s_static_count + 1 + i;
+            }
+        }
+    }
+    return name_idx;
+}
+
+void DynamicTable::setMaxSize(uint32_t v) {
+    m_maxSize = v;
+    evict(v);
+}
+
+void DynamicTable::evict(uint32_t max_size) {
+    while(m_size > max_size && !m_entries.empty()) {
+        auto& e = m_entries.back();
+        m_size -= EntrySize(e.first, e.second);
+        m_entries.pop_back();
+    }
+}
+
+HPackDecoder::HPackDecoder(uint32_t max_table_size)
+    :m_table(max_table_size)
+    ,m_maxTableSize(max_table_size)
+    ,m_maxHeaderListSize(0) {
+}
+
+int HPackDecoder::decode(const char* data, size_t len, HeaderList& headers) {
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + len;
+    bool header_decoded = false;
+    uint64_t list_size = 0;
+    std::string name;
+    std::string value;
+    //索引字段1个字节就能展开出很长的头部，必须按解码后的大小限制
+#define XX() \
+    list_size += name.size() + value.size() + 32; \
+    if(m_maxHeaderListSize && list_size > m_maxHeaderListSize) { \
+        return -2; \
+    }
+    while(p < end) {
+        uint8_t b = *p;
+        uint32_t index = 0;
+        if(b & 0x80) {
+            //Indexed Header Field
+            if(!DecodeInt(p, end, 7, index)
+                    || !m_table.get(index, name, value)) {
+                return -1;
+            }
+            XX();
+            headers.emplace_back(name, value);
+            header_decoded = true;
+            continue;
+        }
+        if((b & 0xe0) == 0x20) {
+            //Dynamic Table Size Update，只能出现在头部块的开头
+            if(header_decoded || !DecodeInt(p, end, 5, index)
+                    || index > m_maxTableSize) {
+                return -1;
+            }
+            m_table.setMaxSize(index);
+            continue;
+        }
+        bool incremental = (b & 0xc0) == 0x40;
+        if(!DecodeInt(p, end, incremental ? 6 : 4, index)) {
+            return -1;
+        }
+        if(index) {
+            std::string v;
+            if(!m_table.get(index, name, v)) {
+                return -1;
+            }
+        } else if(!DecodeString(p, end, name)) {
+            return -1;
+        }
+        if(!DecodeString(p, end, value)) {
+            return -1;
+        }
+        XX();
+        if(incremental) {
+            m_table.add(name, value);
+        }
+        headers.emplace_back(name, value);
+        header_decoded = true;
+    }
+#undef XX
+    return 0;
+}
+
+HPackEncoder::HPackEncoder(uint32_t max_table_size)
+    :m_table(max_table_size)
+    ,m_pendingSize(max_table_size)
+    ,m_sizeChanged(false) {
+}
+
+void HPackEncoder::setMaxTableSize(uint32_t v) {
+    //只使用不超过默认大小的表，节省内存
+    v = std::min(v, (uint32_t)4096);
+    if(v != m_table.getMaxSize() || m_sizeChanged) {
+        m_pendingSize = v;
+        m_sizeChanged = true;
+    }
+}
+
+//这些头部包含敏感信息，不能进入压缩上下文(RFC 7541 7.1.3)
+static bool IsSensitive(const std::string& name) {
+    return name == "authorization" || name == "cookie"
+        || name == "set-cookie" || name == "proxy-authorization";
+}
+
+//这些头部的值几乎每次都不同，加入动态表只会挤掉有用的项
+static bool IsVolatile(const std::string& name) {
+    return name == ":path" || name == "content-length" || name == "date"
+        || name == "etag" || name == "last-modified" || name == "age"
+        || name == "if-modified-since" || name == "if-none-match"
+        || name == "content-range" || name == "expires";
+}
+
+void HPackEncoder::encode(const HeaderList& headers, std::string& out) {
+    if(m_sizeChanged) {
+        m_table.setMaxSize(m_pendingSize);
+        EncodeInt(out, 0x20, 5, m_pendingSize);
+        m_sizeChanged = false;
+    }
+    for(auto& i : headers) {
+        bool sensitive = IsSensitive(i.first);
+        bool value_matched = false;
+        uint32_t index = m_table.find(i.first, i.second, value_matched);
+        if(value_matched && !sensitive) {
+            EncodeInt(out, 0x80, 7, index);
+            continue;
+        }
+        if(sensitive) {
+            EncodeInt(out, 0x10, 4, index);
+        } else if(IsVolatile(i.first)) {
+            EncodeInt(out, 0x00, 4, index);
+        } else {
+            EncodeInt(out, 0x40, 6, index);
+            m_table.add(i.first, i.second);
+        }
+        if(!index) {
+            EncodeString(out, i.first);
+        }
+        EncodeString(out, i.second);
+    }
+}
+
+}
+}
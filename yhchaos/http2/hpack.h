@@ -0,0 +1,133 @@
+#ifndef __YHCHAOS_HTTP2_HPACK_H__
+#define __YHCHAOS_HTTP2_HPACK_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+
+namespace yhchaos {
+namespace http2 {
+
+/// 头部列表，保持收发顺序，名称为小写
+typedef std::vector<std::pair<std::string, std::string> > HeaderList;
+
+/**
+ * @brief HPACK(RFC 7541)使用的静态哈夫曼编码
+ */
+class Huffman {
+public:
+    /**
+     * @brief 编码，末尾不足一个字节的部分用EOS的高位(全1)填充
+     */
+    static void Encode(const std::string& src, std::string& out);
+
+    /**
+     * @brief 返回编码后的字节数
+     */
+    static size_t EncodedLength(const std::string& src);
+
+    /**
+     * @brief 解码
+     * @return 填充不合法或者包含EOS时返回false
+     */
+    static bool Decode(const char* data, size_t len, std::string& out);
+};
+
+/**
+ * @brief HPACK的动态表，index从静态表之后(62)开始，最新添加的项index最小
+ */
+class DynamicTable {
+public:
+    DynamicTable(uint32_t max_size = 4096);
+
+    /**
+     * @brief 添加一项，超出大小时从最旧的开始淘汰
+     */
+    void add(const std::string& name, const std::string& value);
+
+    /**
+     * @brief 按HPACK的index(包括静态表)取出一项
+     */
+    bool get(uint32_t index, std::string& name, std::string& value) const;
+
+    /**
+     * @brief 在静态表和动态表中查找
+     * @param[out] value_matched 返回的index是否名称和值都相同
+     * @return HPACK的index，没有找到时返回0
+     */
+    uint32_t find(const std::string& name, const std::string& value, bool& value_matched) const;
+
+    void setMaxSize(uint32_t v);
+    uint32_t getMaxSize() const { return m_maxSize;}
+    uint32_t getSize() const { return m_size;}
+    size_t getCount() const { return m_entries.size();}
+private:
+    void evict(uint32_t max_size);
+private:
+    std::deque<std::pair<std::string, std::string> > m_entries;
+    uint32_t m_size;
+    uint32_t m_maxSize;
+};
+
+/**
+ * @brief HPACK解码器，每个连接接收方向一个
+ */
+class HPackDecoder {
+public:
+    typedef std::shared_ptr<HPackDecoder> ptr;
+
+    /**
+     * @param[in] max_table_size 通过SETTINGS_HEADER_TABLE_SIZE允许对端使用的最大动态表大小
+     */
+    HPackDecoder(uint32_t max_table_size = 4096);
+
+    /**
+     * @brief 解码一个完整的头部块
+     * @return 成功返回0，失败返回-1(COMPRESSION_ERROR)，
+     *         解码出的头部列表超过getMaxHeaderListSize()返回-2，此时动态表已经不可用
+     */
+    int decode(const char* data, size_t len, HeaderList& headers);
+
+    /**
+     * @brief 设置头部列表的最大大小，按RFC 7540 6.5.2计算(名字+值+32)，0表示不限制
+     */
+    void setMaxHeaderListSize(uint32_t v) { m_maxHeaderListSize = v;}
+    uint32_t getMaxHeaderListSize() const { return m_maxHeaderListSize;}
+
+    const DynamicTable& getTable() const { return m_table;}
+private:
+    DynamicTable m_table;
+    uint32_t m_maxTableSize;
+    uint32_t m_maxHeaderListSize;
+};
+
+/**
+ * @brief HPACK编码器，每个连接发送方向一个，必须按发送顺序调用
+ */
+class HPackEncoder {
+public:
+    typedef std::shared_ptr<HPackEncoder> ptr;
+    HPackEncoder(uint32_t max_table_size = 4096);
+
+    /**
+     * @brief 对端通过SETTINGS_HEADER_TABLE_SIZE修改了动态表大小，下一个头部块开头会带上大小更新
+     */
+    void setMaxTableSize(uint32_t v);
+
+    /**
+     * @brief 编码一个头部块并追加到out
+     */
+    void encode(const HeaderList& headers, std::string& out);
+
+    const DynamicTable& getTable() const { return m_table;}
+private:
+    DynamicTable m_table;
+    uint32_t m_pendingSize;
+    bool m_sizeChanged;
+};
+
+}
+}
+
+#endif
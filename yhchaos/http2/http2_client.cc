@@ -0,0 +1,177 @@
+#include "http2_client.h"
+#include "yhchaos/log.h"
+#include "yhchaos/util.h"
+#include "yhchaos/util/hash_util.h"
+
+namespace yhchaos {
+namespace http2 {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
+Http2Client::Http2Client()
+    :Http2SockStream(nullptr, true)
+    ,m_upgraded(false) {
+}
+
+bool Http2Client::connect(NetworkAddress::ptr addr, const std::string& host
+                          ,bool upgrade, uint64_t timeout_ms) {
+    m_socket = Sock::CreateTCP(addr);
+    if(!m_socket->connect(addr, timeout_ms)) {
+        YHCHAOS_LOG_DEBUG(g_logger) << "http2 connect fail " << addr->toString();
+        return false;
+    }
+    m_authority = host.empty() ? addr->toString() : host;
+    if(upgrade && !doUpgrade()) {
+        m_socket->close();
+        return false;
+    }
+    return start();
+}
+
+bool Http2Client::doUpgrade() {
+    std::string settings = yhchaos::base64encode(Frame::CreateSettings(getLocalSettings())->data);
+    //base64url，没有填充
+    for(auto& c : settings) {
+        if(c == '+') {
+            c = '-';
+        } else if(c == '/') {
+            c = '_';
+        }
+    }
+    settings.erase(settings.find_last_not_of('=') + 1);
+
+    std::stringstream ss;
+    ss << "GET / HTTP/1.1\r\n"
+       << "Host: " << m_authority << "\r\n"
+       << "Connection: Upgrade, HTTP2-Settings\r\n"
+       << "Upgrade: h2c\r\n"
+       << "HTTP2-Settings: " << settings << "\r\n\r\n";
+    std::string data = ss.str();
+    if(writeFixSize(data.c_str(), data.size()) <= 0) {
+        return false;
+    }
+
+    //逐字节读取响应头，101之后的数据都是HTTP/2的帧
+    std::string head;
+    while(head.size() < 4096) {
+        char c;
+        if(readFixSize(&c, 1) <= 0) {
+            return false;
+        }
+        head.push_back(c);
+        if(head.size() >= 4 && head.compare(head.size() - 4, 4, "\r\n\r\n") == 0) {
+            break;
+        }
+    }
+    if(head.compare(0, 12, "HTTP/1.1 101") != 0) {
+        YHCHAOS_LOG_DEBUG(g_logger) << "http2 upgrade refused: " << head;
+        return false;
+    }
+    createUpgradeStream();
+    m_upgraded = true;
+    return true;
+}
+
+void Http2Client::onStreamEnd(Http2Stream::ptr stream) {
+    //等待响应的协程已经在notifyStreamNolock中唤醒
+    if(m_upgraded && stream->getId() == 1) {
+        delStream(1);
+    }
+}
+
+http::HttpRes::ptr Http2Client::request(http::HttpReq::ptr req, uint64_t timeout_ms) {
+    HeaderList headers;
+    std::string path = req->getPath().empty() ? "/" : req->getPath();
+    if(!req->getQuery().empty()) {
+        path += "?" + req->getQuery();
+    }
+    std::string authority = req->getHeader("Host", m_authority);
+    headers.push_back(std::make_pair(":method", http::HMethodToString(req->getMethod())));
+    headers.push_back(std::make_pair(":scheme", "http"));
+    headers.push_back(std::make_pair(":authority", authority));
+    headers.push_back(std::make_pair(":path", path));
+    for(auto& i : req->getHeaders()) {
+        std::string name = yhchaos::ToLower(i.first);
+        if(IsConnectionHeader(name) || name == "host" || name == "content-length") {
+            continue;
+        }
+        headers.push_back(std::make_pair(name, i.second));
+    }
+    const std::string& body = req->getBody();
+    if(!body.empty()) {
+        headers.push_back(std::make_pair("content-length", std::to_string(body.size())));
+    }
+
+    auto stream = openStream(headers, body.empty());
+    if(!stream) {
+        return std::make_shared<http::HttpRes>((int)http::HttpRes::Error::SEND_CLOSE_BY_PEER
+                , nullptr, "open stream fail, " + toString());
+    }
+    auto self = std::dynamic_pointer_cast<Http2Client>(shared_from_this());
+    TimedCoroutine::ptr timer;
+    if(timeout_ms != (uint64_t)-1) {
+        timer = IOCoScheduler::GetThis()->addTimedCoroutine(timeout_ms
+                ,std::bind(&Http2Client::onStreamTimeout, self, stream));
+    }
+    if(!body.empty()) {
+        sendData(stream, body, true);
+    }
+    {
+        MtxType::Lock lock(m_streamMtx);
+        while(!stream->isRemoteClosed() && !stream->isReset() && !stream->isTimeout()) {
+            waitStream(stream, lock);
+        }
+    }
+    if(timer) {
+        timer->cancel();
+    }
+    if(stream->isReset()) {
+        return std::make_shared<http::HttpRes>((int)http::HttpRes::Error::SEND_CLOSE_BY_PEER
+                , nullptr, std::string("stream reset ") + Http2ErrorToString(stream->getError()));
+    }
+    if(!stream->isRemoteClosed()) {
+        resetStream(stream, Http2Error::CANCEL);
+        return std::make_shared<http::HttpRes>((int)http::HttpRes::Error::TIMEOUT
+                , nullptr, "recv response timeout " + std::to_string(timeout_ms) + "ms");
+    }
+    delStream(stream->getId());
+    auto rsp = stream->toRsp();
+    if(!rsp) {
+        return std::make_shared<http::HttpRes>((int)http::HttpRes::Error::SEND_CLOSE_BY_PEER
+                , nullptr, "invalid response");
+    }
+    return std::make_shared<http::HttpRes>((int)http::HttpRes::Error::OK, rsp, "ok");
+}
+
+http::HttpRes::ptr Http2Client::doGet(const std::string& path, uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers
+                            ,const std::string& body) {
+    return doReq(http::HMethod::GET, path, timeout_ms, headers, body);
+}
+
+http::HttpRes::ptr Http2Client::doPost(const std::string& path, uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers
+                            ,const std::string& body) {
+    return doReq(http::HMethod::POST, path, timeout_ms, headers, body);
+}
+
+http::HttpRes::ptr Http2Client::doReq(http::HMethod method, const std::string& path
+                            ,uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers
+                            ,const std::string& body) {
+    http::HttpReq::ptr req = std::make_shared<http::HttpReq>(0x20, false);
+    req->setMethod(method);
+    size_t pos = path.find('?');
+    req->setPath(path.substr(0, pos));
+    if(pos != std::string::npos) {
+        req->setQuery(path.substr(pos + 1));
+    }
+    for(auto& i : headers) {
+        req->setHeader(i.first, i.second);
+    }
+    req->setBody(body);
+    return request(req, timeout_ms);
+}
+
+}
+}
@@ -0,0 +1,67 @@
+#ifndef __YHCHAOS_HTTP2_HTTP2_CLIENT_H__
+#define __YHCHAOS_HTTP2_HTTP2_CLIENT_H__
+
+#include "http2_stream.h"
+#include "yhchaos/http/http_client.h"
+
+namespace yhchaos {
+namespace http2 {
+
+/**
+ * @brief HTTP/2客户端，一个连接上并发多个请求
+ * @details 多个协程可以同时调用request，每个请求使用一个独立的流，
+ *          超过服务端的SETTINGS_MAX_CONCURRENT_STREAMS时直接返回失败，由调用方决定重试或者新建连接
+ */
+class Http2Client : public Http2SockStream {
+public:
+    typedef std::shared_ptr<Http2Client> ptr;
+
+    Http2Client();
+
+    /**
+     * @brief 连接服务器并启动读写协程
+     * @param[in] addr 服务器地址
+     * @param[in] host :authority，为空时使用addr
+     * @param[in] upgrade 是否先通过HTTP/1.1的Upgrade: h2c协商，否则直接发送连接序言(prior knowledge)
+     * @param[in] timeout_ms 连接超时时间(毫秒)
+     * @details 必须在IOCoScheduler的协程中调用
+     */
+    bool connect(NetworkAddress::ptr addr, const std::string& host = ""
+                 ,bool upgrade = false, uint64_t timeout_ms = -1);
+
+    /**
+     * @brief 发送HTTP请求，等待响应
+     * @param[in] req 请求，版本和connection头部会被忽略
+     * @param[in] timeout_ms 超时时间(毫秒)，超时后重置该流
+     */
+    http::HttpRes::ptr request(http::HttpReq::ptr req, uint64_t timeout_ms);
+
+    http::HttpRes::ptr doGet(const std::string& path, uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers = {}
+                            ,const std::string& body = "");
+
+    http::HttpRes::ptr doPost(const std::string& path, uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers = {}
+                            ,const std::string& body = "");
+
+    http::HttpRes::ptr doReq(http::HMethod method, const std::string& path
+                            ,uint64_t timeout_ms
+                            ,const std::map<std::string, std::string>& headers = {}
+                            ,const std::string& body = "");
+protected:
+    virtual void onStreamEnd(Http2Stream::ptr stream) override;
+
+    /**
+     * @brief 发送HTTP/1.1的升级请求，等待101响应
+     */
+    bool doUpgrade();
+private:
+    std::string m_authority;
+    /// 是否通过h2c升级，流1是升级请求，没有协程等待它的响应
+    bool m_upgraded;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,210 @@
+#include "http2_session.h"
+#include "yhchaos/log.h"
+#include "yhchaos/util.h"
+#include "yhchaos/util/hash_util.h"
+#include <fcntl.h>
+
+namespace yhchaos {
+namespace http2 {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
+/// 发送文件消息体时每个DATA的大小
+static const size_t s_file_buffer_size = 64 * 1024;
+/// 判断连接序言时至少需要的字节数("PRI ")
+static const size_t s_preface_check_len = 4;
+
+/**
+ * @brief 流式发送响应消息体，每次write发送一个不带END_STREAM的DATA
+ */
+class Http2BodyWriter : public Stream {
+public:
+    Http2BodyWriter(Http2SockStream::ptr session, Http2Stream::ptr stream)
+        :m_session(session)
+        ,m_stream(stream) {
+    }
+
+    virtual int read(void* buffer, size_t length) override { return -1;}
+    virtual int read(ByteBuffer::ptr ba, size_t length) override { return -1;}
+    virtual int write(const void* buffer, size_t length) override {
+        if(length == 0) {
+            return 0;
+        }
+        return m_session->sendData(m_stream, std::string((const char*)buffer, length), false)
+                ? length : -1;
+    }
+    virtual int write(ByteBuffer::ptr ba, size_t length) override {
+        std::string buf;
+        buf.resize(length);
+        ba->read(&buf[0], length);
+        return write(buf.c_str(), length);
+    }
+    virtual void close() override {}
+private:
+    Http2SockStream::ptr m_session;
+    Http2Stream::ptr m_stream;
+};
+
+Http2Session::Http2Session(Sock::ptr sock, http::CppServletDispatch::ptr dispatch
+                           ,const std::string& server_name)
+    :Http2SockStream(sock, false)
+    ,m_dispatch(dispatch)
+    ,m_serverName(server_name)
+    ,m_httpSession(new http::HSession(sock, false)) {
+}
+
+bool Http2Session::IsPreface(Sock::ptr sock) {
+    char buf[CLIENT_PREFACE_LEN];
+    //只阻塞等待一次(受socket的接收超时限制)，第一次到达的数据不一定是完整的序言，
+    //但是HTTP/1.x没有PRI方法，以"PRI "开头就可以确定是HTTP/2，完整的序言在doRecv中校验
+    int rt = sock->recv(buf, sizeof(buf), MSG_PEEK);
+    return rt >= (int)s_preface_check_len && !memcmp(buf, CLIENT_PREFACE, rt);
+}
+
+bool Http2Session::upgrade(http::HttpReq::ptr req, const std::string& settings) {
+    //HTTP2-Settings是base64url编码，没有填充
+    std::string b64 = settings;
+    for(auto& c : b64) {
+        if(c == '-') {
+            c = '+';
+        } else if(c == '_') {
+            c = '/';
+        }
+    }
+    b64.append((4 - b64.size() % 4) % 4, '=');
+    std::string payload = yhchaos::base64decode(b64);
+    if(payload.size() % 6 || (payload.empty() && !settings.empty())) {
+        return false;
+    }
+    if(!applySettings(payload, false)) {
+        return false;
+    }
+    createUpgradeStream();
+    m_upgradeReq = req;
+    return true;
+}
+
+bool Http2Session::start() {
+    if(!Http2SockStream::start()) {
+        return false;
+    }
+    if(m_upgradeReq) {
+        auto stream = getStream(1);
+        if(stream) {
+            m_worker->coschedule(std::bind(&Http2Session::handleReq
+                        ,std::dynamic_pointer_cast<Http2Session>(shared_from_this())
+                        ,stream, m_upgradeReq));
+        }
+        m_upgradeReq = nullptr;
+    }
+    return true;
+}
+
+void Http2Session::onStreamEnd(Http2Stream::ptr stream) {
+    //流的头部和消息体只在接收完成前由doRead协程修改，这里可以不加锁读取
+    auto req = stream->toReq();
+    if(!req) {
+        YHCHAOS_LOG_DEBUG(g_logger) << "http2 invalid request " << stream->toString();
+        resetStream(stream, Http2Error::PROTOCOL_ERROR);
+        return;
+    }
+    m_worker->coschedule(std::bind(&Http2Session::handleReq
+                ,std::dynamic_pointer_cast<Http2Session>(shared_from_this())
+                ,stream, req));
+}
+
+void Http2Session::handleReq(Http2Stream::ptr stream, http::HttpReq::ptr req) {
+    http::HttpRsp::ptr rsp(new http::HttpRsp(0x20, false));
+    if(!m_serverName.empty()) {
+        rsp->setHeader("Svr", m_serverName);
+    }
+    m_dispatch->handle(req, rsp, m_httpSession);
+
+    HeaderList headers;
+    headers.push_back(std::make_pair(":status", std::to_string((uint32_t)rsp->getStatus())));
+    for(auto& i : rsp->getHeaders()) {
+        std::string name = yhchaos::ToLower(i.first);
+        if(IsConnectionHeader(name) || name == "content-length") {
+            continue;
+        }
+        headers.push_back(std::make_pair(name, i.second));
+    }
+    for(auto& i : rsp->getCookies()) {
+        headers.push_back(std::make_pair("set-cookie", i));
+    }
+    const std::string& body = rsp->getBody();
+    bool streaming = rsp->getBodyWriter() || rsp->hasBodyFile()
+                     || (rsp->hasBodyData() && rsp->getBodyDataLength());
+    bool has_body = (streaming || !body.empty()) && req->getMethod() != http::HMethod::HEAD;
+    if(rsp->hasBodyFile()) {
+        headers.push_back(std::make_pair("content-length"
+                    ,std::to_string(rsp->getBodyFileLength())));
+    } else if(rsp->hasBodyData()) {
+        headers.push_back(std::make_pair("content-length"
+                    ,std::to_string(rsp->getBodyDataLength())));
+    } else if(!rsp->getBodyWriter() && !body.empty()) {
+        headers.push_back(std::make_pair("content-length", std::to_string(body.size())));
+    }
+    if(sendHeaders(stream, headers, !has_body) && has_body) {
+        if(rsp->getBodyWriter()) {
+            //HTTP/2的DATA帧本身就是分块的，不需要chunked编码
+            Stream::ptr writer(new Http2BodyWriter(
+                        std::dynamic_pointer_cast<Http2SockStream>(shared_from_this()), stream));
+            if(rsp->getBodyWriter()(writer)) {
+                sendData(stream, "", true);
+            } else {
+                resetStream(stream, Http2Error::INTERNAL_ERROR);
+            }
+        } else if(rsp->hasBodyFile()) {
+            if(!sendFile(stream, rsp)) {
+                resetStream(stream, Http2Error::INTERNAL_ERROR);
+            }
+        } else if(rsp->hasBodyData()) {
+            const char* data = rsp->getBodyData();
+            uint64_t length = rsp->getBodyDataLength();
+            while(length > 0) {
+                uint64_t len = std::min((uint64_t)s_file_buffer_size, length);
+                length -= len;
+                if(!sendData(stream, std::string(data, len), length == 0)) {
+                    resetStream(stream, Http2Error::INTERNAL_ERROR);
+                    break;
+                }
+                data += len;
+            }
+        } else {
+            sendData(stream, body, true);
+        }
+    }
+    delStream(stream->getId());
+}
+
+bool Http2Session::sendFile(Http2Stream::ptr stream, http::HttpRsp::ptr rsp) {
+    //DATA帧需要分帧加上帧头，不能使用sendfile，按块读取后发送
+    int fd = open(rsp->getBodyFile().c_str(), O_RDONLY);
+    if(fd < 0) {
+        return false;
+    }
+    uint64_t offset = rsp->getBodyFileOffset();
+    uint64_t length = rsp->getBodyFileLength();
+    std::string buf;
+    bool rt = true;
+    do {
+        buf.resize(std::min((uint64_t)s_file_buffer_size, length));
+        ssize_t len = buf.empty() ? 0 : pread(fd, &buf[0], buf.size(), offset);
+        if(len < (ssize_t)buf.size()) {
+            rt = false;
+            break;
+        }
+        offset += len;
+        length -= len;
+        if(!sendData(stream, buf, length == 0)) {
+            rt = false;
+            break;
+        }
+    } while(length > 0);
+    ::close(fd);
+    return rt;
+}
+
+}
+}
@@ -0,0 +1,67 @@
+#ifndef __YHCHAOS_HTTP2_HTTP2_SESSION_H__
+#define __YHCHAOS_HTTP2_HTTP2_SESSION_H__
+
+#include "http2_stream.h"
+#include "yhchaos/http/cpp_servlet.h"
+
+namespace yhchaos {
+namespace http2 {
+
+/**
+ * @brief 服务端的HTTP/2连接
+ * @details 每个流收到完整的请求后在worker中转换为HttpReq，交给CppServletDispatch处理，
+ *          同一个连接上的多个请求并发处理，响应按完成顺序发送
+ */
+class Http2Session : public Http2SockStream {
+public:
+    typedef std::shared_ptr<Http2Session> ptr;
+
+    /**
+     * @param[in] sock socket
+     * @param[in] dispatch CppServlet分发器
+     * @param[in] server_name 响应的Svr头部，和HTTP/1.1的响应一致
+     */
+    Http2Session(Sock::ptr sock, http::CppServletDispatch::ptr dispatch
+                 ,const std::string& server_name = "");
+
+    /**
+     * @brief 处理HTTP/1.1的h2c升级请求(RFC 7540 3.2)
+     * @param[in] req 升级请求，作为流1处理
+     * @param[in] settings HTTP2-Settings头部(base64url编码的SETTINGS负载)
+     * @details 调用前需要已经发送101响应，调用后再调用start
+     * @return HTTP2-Settings不合法时返回false
+     */
+    bool upgrade(http::HttpReq::ptr req, const std::string& settings);
+
+    virtual bool start() override;
+
+    /**
+     * @brief 是否是HTTP/2的连接序言(不读取数据)
+     * @details 最多等待一次数据到达，等待时间由socket的接收超时决定
+     */
+    static bool IsPreface(Sock::ptr sock);
+protected:
+    virtual void onStreamEnd(Http2Stream::ptr stream) override;
+
+    /**
+     * @brief 在worker中处理请求并发送响应
+     */
+    void handleReq(Http2Stream::ptr stream, http::HttpReq::ptr req);
+
+    /**
+     * @brief 按块读取响应的文件并作为DATA发送
+     */
+    bool sendFile(Http2Stream::ptr stream, http::HttpRsp::ptr rsp);
+private:
+    http::CppServletDispatch::ptr m_dispatch;
+    std::string m_serverName;
+    /// 传给CppServlet的连接，只用于获取地址等连接信息，不托管socket，读写由Http2Session负责
+    http::HSession::ptr m_httpSession;
+    /// h2c升级请求，start后处理
+    http::HttpReq::ptr m_upgradeReq;
+};
+
+}
+}
+
+#endif
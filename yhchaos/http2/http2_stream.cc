@@ -0,0 +1,902 @@
+#include "http2_stream.h"
+#include "yhchaos/log.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/http/http_parser.h"
+#include <sstream>
+
+namespace yhchaos {
+namespace http2 {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_http2_max_concurrent_streams =
+    yhchaos::AppConfig::SearchFor("http2.max_concurrent_streams", (uint32_t)128
+    ,"http2 max concurrent streams per connection");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_http2_initial_window_size =
+    yhchaos::AppConfig::SearchFor("http2.initial_window_size", (uint32_t)(1024 * 1024)
+    ,"http2 stream initial window size");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_http2_connection_window_size =
+    yhchaos::AppConfig::SearchFor("http2.connection_window_size", (uint32_t)(16 * 1024 * 1024)
+    ,"http2 connection window size");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_http2_max_frame_size =
+    yhchaos::AppConfig::SearchFor("http2.max_frame_size", (uint32_t)DEFAULT_MAX_FRAME_SIZE
+    ,"http2 max frame size");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_http2_max_header_list_size =
+    yhchaos::AppConfig::SearchFor("http2.max_header_list_size", (uint32_t)(64 * 1024)
+    ,"http2 max header list size");
+
+bool IsConnectionHeader(const std::string& name) {
+    return name == "connection" || name == "keep-alive"
+        || name == "proxy-connection" || name == "transfer-encoding"
+        || name == "upgrade" || name == "http2-settings";
+}
+
+Http2Stream::Http2Stream(uint32_t id, int64_t send_window, int64_t recv_window)
+    :m_id(id)
+    ,m_sendWindow(send_window)
+    ,m_recvWindow(recv_window)
+    ,m_recvUnacked(0)
+    ,m_headersRecved(false)
+    ,m_remoteClosed(false)
+    ,m_localClosed(false)
+    ,m_reset(false)
+    ,m_timeout(false)
+    ,m_error(Http2Error::NO_ERROR)
+    ,m_waiting(false) {
+}
+
+http::HttpReq::ptr Http2Stream::toReq() const {
+    http::HttpReq::ptr req(new http::HttpReq(0x20, false));
+    bool has_method = false;
+    bool has_path = false;
+    std::string cookie;
+    for(auto& i : m_headers) {
+        if(i.first.empty()) {
+            return nullptr;
+        }
+        if(i.first[0] != ':') {
+            if(i.first == "cookie") {
+                //多个cookie头部用"; "合并(RFC 7540 8.1.2.5)
+                cookie += cookie.empty() ? i.second : "; " + i.second;
+                continue;
+            }
+            std::string v = req->getHeader(i.first);
+            req->setHeader(i.first, v.empty() ? i.second : v + ", " + i.second);
+            continue;
+        }
+        if(i.first == ":method") {
+            auto m = http::StringToHMethod(i.second);
+            if(m == http::HMethod::INVALID_METHOD) {
+                return nullptr;
+            }
+            req->setMethod(m);
+            has_method = true;
+        } else if(i.first == ":path") {
+            std::string path = i.second;
+            size_t pos = path.find('#');
+            if(pos != std::string::npos) {
+                req->setFragment(path.substr(pos + 1));
+                path.resize(pos);
+            }
+            pos = path.find('?');
+            if(pos != std::string::npos) {
+                req->setQuery(path.substr(pos + 1));
+                path.resize(pos);
+            }
+            req->setPath(path);
+            has_path = !path.empty();
+        } else if(i.first == ":authority") {
+            req->setHeader("Host", i.second);
+        } else if(i.first != ":scheme") {
+            return nullptr;
+        }
+    }
+    if(!has_method || !has_path) {
+        return nullptr;
+    }
+    if(!cookie.empty()) {
+        req->setHeader("cookie", cookie);
+    }
+    req->setBody(m_body);
+    return req;
+}
+
+http::HttpRsp::ptr Http2Stream::toRsp() const {
+    http::HttpRsp::ptr rsp(new http::HttpRsp(0x20, false));
+    bool has_status = false;
+    std::vector<std::string> cookies;
+    for(auto& i : m_headers) {
+        if(i.first == ":status") {
+            rsp->setStatus((http::HStatus)atoi(i.second.c_str()));
+            has_status = true;
+        } else if(i.first == "set-cookie") {
+            cookies.push_back(i.second);
+        } else if(!i.first.empty() && i.first[0] != ':') {
+            std::string v = rsp->getHeader(i.first);
+            rsp->setHeader(i.first, v.empty() ? i.second : v + ", " + i.second);
+        }
+    }
+    if(!has_status) {
+        return nullptr;
+    }
+    rsp->setCookies(cookies);
+    rsp->setBody(m_body);
+    return rsp;
+}
+
+std::string Http2Stream::toString() const {
+    std::stringstream ss;
+    ss << "[Http2Stream id=" << m_id
+       << " send_window=" << m_sendWindow
+       << " recv_window=" << m_recvWindow
+       << " remote_closed=" << m_remoteClosed
+       << " local_closed=" << m_localClosed
+       << " reset=" << m_reset;
+    if(m_reset) {
+        ss << " error=" << Http2ErrorToString(m_error);
+    }
+    ss << "]";
+    return ss.str();
+}
+
+Http2SockStream::Http2SockStream(Sock::ptr sock, bool is_client)
+    :AsyncSockStream(sock, true)
+    ,m_isClient(is_client)
+    ,m_prefaceRecved(is_client)
+    ,m_error(false)
+    ,m_goAway(false)
+    ,m_lastStreamId(is_client ? 1 : 0)
+    ,m_goAwayStreamId(0)
+    ,m_sendWindow(DEFAULT_WINDOW_SIZE)
+    ,m_recvWindow(DEFAULT_WINDOW_SIZE)
+    ,m_recvUnacked(0)
+    ,m_peerInitialWindow(DEFAULT_WINDOW_SIZE)
+    ,m_peerMaxFrameSize(DEFAULT_MAX_FRAME_SIZE)
+    ,m_peerMaxStreams(-1)
+    ,m_localInitialWindow(g_http2_initial_window_size->getValue())
+    ,m_localMaxFrameSize(g_http2_max_frame_size->getValue())
+    ,m_localMaxStreams(g_http2_max_concurrent_streams->getValue())
+    ,m_localConnWindow(g_http2_connection_window_size->getValue())
+    ,m_localMaxHeaderListSize(g_http2_max_header_list_size->getValue())
+    ,m_continuationId(0)
+    ,m_continuationEndStream(false) {
+    m_localInitialWindow = std::min(m_localInitialWindow, (uint32_t)MAX_WINDOW_SIZE);
+    m_localMaxFrameSize = std::max(m_localMaxFrameSize, DEFAULT_MAX_FRAME_SIZE);
+    m_localMaxFrameSize = std::min(m_localMaxFrameSize, (uint32_t)0xffffff);
+    m_localConnWindow = std::max(m_localConnWindow, (uint32_t)DEFAULT_WINDOW_SIZE);
+    m_localConnWindow = std::min(m_localConnWindow, (uint32_t)MAX_WINDOW_SIZE);
+    m_localMaxHeaderListSize = std::max(m_localMaxHeaderListSize, (uint32_t)4096);
+    m_decoder.setMaxHeaderListSize(m_localMaxHeaderListSize);
+}
+
+Http2SockStream::~Http2SockStream() {
+    YHCHAOS_LOG_DEBUG(g_logger) << "Http2SockStream::~Http2SockStream " << this;
+}
+
+bool Http2SockStream::start() {
+    //在读写协程启动前入队，保证序言和SETTINGS是最先发送的
+    if(m_isClient) {
+        enqueue(std::make_shared<PrefaceSendCtx>());
+    }
+    sendFrame(Frame::CreateSettings(getLocalSettings()));
+    if(m_localConnWindow > (uint32_t)DEFAULT_WINDOW_SIZE) {
+        MtxType::Lock lock(m_streamMtx);
+        m_recvWindow = m_localConnWindow;
+        lock.unlock();
+        sendFrame(Frame::CreateWindowUpdate(0, m_localConnWindow - DEFAULT_WINDOW_SIZE));
+    }
+    return AsyncSockStream::start();
+}
+
+std::vector<std::pair<SettingsId, uint32_t> > Http2SockStream::getLocalSettings() const {
+    std::vector<std::pair<SettingsId, uint32_t> > settings;
+    settings.push_back(std::make_pair(SettingsId::MAX_CONCURRENT_STREAMS, m_localMaxStreams));
+    settings.push_back(std::make_pair(SettingsId::INITIAL_WINDOW_SIZE, m_localInitialWindow));
+    settings.push_back(std::make_pair(SettingsId::MAX_FRAME_SIZE, m_localMaxFrameSize));
+    settings.push_back(std::make_pair(SettingsId::MAX_HEADER_LIST_SIZE, m_localMaxHeaderListSize));
+    if(m_isClient) {
+        settings.push_back(std::make_pair(SettingsId::ENABLE_PUSH, 0));
+    }
+    return settings;
+}
+
+bool Http2SockStream::PrefaceSendCtx::doSend(AsyncSockStream::ptr stream) {
+    return stream->writeFixSize(CLIENT_PREFACE, CLIENT_PREFACE_LEN) > 0;
+}
+
+bool Http2SockStream::FrameSendCtx::doSend(AsyncSockStream::ptr stream) {
+    bool rt = frame->writeTo(stream);
+    //返回false后doWrite会关闭连接
+    return rt && !close;
+}
+
+bool Http2SockStream::HeadersSendCtx::doSend(AsyncSockStream::ptr stream) {
+    auto self = std::dynamic_pointer_cast<Http2SockStream>(stream);
+    std::string block;
+    self->m_encoder.encode(headers, block);
+    uint32_t max_size = 0;
+    {
+        MtxType::Lock lock(self->m_streamMtx);
+        max_size = self->m_peerMaxFrameSize;
+    }
+    size_t offset = 0;
+    do {
+        size_t len = std::min(block.size() - offset, (size_t)max_size);
+        Frame frame(offset == 0 ? FrameType::HEADERS : FrameType::CONTINUATION
+                    ,0, streamId);
+        if(offset == 0 && endStream) {
+            frame.flags |= END_STREAM;
+        }
+        if(offset + len == block.size()) {
+            frame.flags |= END_HEADERS;
+        }
+        frame.data = block.substr(offset, len);
+        if(!frame.writeTo(stream)) {
+            return false;
+        }
+        offset += len;
+    } while(offset < block.size());
+    return true;
+}
+
+bool Http2SockStream::SettingsAckCtx::doSend(AsyncSockStream::ptr stream) {
+    if(tableSizeChanged) {
+        std::dynamic_pointer_cast<Http2SockStream>(stream)
+            ->m_encoder.setMaxTableSize(tableSize);
+    }
+    if(!ack) {
+        return true;
+    }
+    return Frame::CreateSettingsAck()->writeTo(stream);
+}
+
+void Http2SockStream::sendFrame(Frame::ptr frame) {
+    FrameSendCtx::ptr ctx(new FrameSendCtx);
+    ctx->frame = frame;
+    enqueue(ctx);
+}
+
+Http2Stream::ptr Http2SockStream::openStream(const HeaderList& headers, bool end_stream) {
+    if(!isConnected()) {
+        return nullptr;
+    }
+    MtxType::Lock lock(m_streamMtx);
+    if(m_goAway || m_streams.size() >= m_peerMaxStreams
+            || m_lastStreamId > MAX_WINDOW_SIZE) {
+        return nullptr;
+    }
+    uint32_t id = m_lastStreamId;
+    m_lastStreamId += 2;
+    auto stream = newStreamNolock(id);
+    stream->m_localClosed = end_stream;
+
+    HeadersSendCtx::ptr ctx(new HeadersSendCtx);
+    ctx->streamId = id;
+    ctx->endStream = end_stream;
+    ctx->headers = headers;
+    enqueue(ctx);
+    return stream;
+}
+
+Http2Stream::ptr Http2SockStream::createUpgradeStream() {
+    MtxType::Lock lock(m_streamMtx);
+    auto stream = newStreamNolock(1);
+    if(m_isClient) {
+        stream->m_localClosed = true;
+        m_lastStreamId = 3;
+    } else {
+        stream->m_headersRecved = true;
+        stream->m_remoteClosed = true;
+        m_lastStreamId = 1;
+    }
+    return stream;
+}
+
+bool Http2SockStream::sendHeaders(Http2Stream::ptr stream, const HeaderList& headers, bool end_stream) {
+    if(!isConnected()) {
+        return false;
+    }
+    {
+        MtxType::Lock lock(m_streamMtx);
+        if(stream->m_reset || stream->m_localClosed) {
+            return false;
+        }
+        stream->m_localClosed = end_stream;
+    }
+    HeadersSendCtx::ptr ctx(new HeadersSendCtx);
+    ctx->streamId = stream->m_id;
+    ctx->endStream = end_stream;
+    ctx->headers = headers;
+    enqueue(ctx);
+    return true;
+}
+
+bool Http2SockStream::sendData(Http2Stream::ptr stream, const std::string& data, bool end_stream) {
+    if(data.empty() && !end_stream) {
+        return true;
+    }
+    size_t offset = 0;
+    MtxType::Lock lock(m_streamMtx);
+    if(stream->m_localClosed) {
+        return false;
+    }
+    do {
+        if(stream->m_reset || stream->m_timeout || !isConnected()) {
+            return false;
+        }
+        size_t remain = data.size() - offset;
+        int64_t avail = std::min(std::min(m_sendWindow, stream->m_sendWindow)
+                                 ,(int64_t)m_peerMaxFrameSize);
+        if(remain > 0 && avail <= 0) {
+            waitStream(stream, lock);
+            continue;
+        }
+        size_t len = std::min((int64_t)remain, std::max(avail, (int64_t)0));
+        m_sendWindow -= len;
+        stream->m_sendWindow -= len;
+        bool last = offset + len == data.size();
+        if(last && end_stream) {
+            stream->m_localClosed = true;
+        }
+        sendFrame(Frame::CreateData(stream->m_id, data.substr(offset, len), last && end_stream));
+        offset += len;
+    } while(offset < data.size());
+    return true;
+}
+
+void Http2SockStream::resetStream(Http2Stream::ptr stream, Http2Error error) {
+    {
+        MtxType::Lock lock(m_streamMtx);
+        m_streams.erase(stream->m_id);
+        if(stream->m_reset) {
+            return;
+        }
+        stream->m_reset = true;
+        stream->m_error = error;
+        notifyStreamNolock(stream);
+    }
+    sendFrame(Frame::CreateRstStream(stream->m_id, error));
+}
+
+void Http2SockStream::goAway(Http2Error error) {
+    uint32_t last_id = 0;
+    if(!m_isClient) {
+        MtxType::Lock lock(m_streamMtx);
+        last_id = m_lastStreamId;
+    }
+    sendFrame(Frame::CreateGoAway(last_id, error));
+}
+
+size_t Http2SockStream::getStreamCount() {
+    MtxType::Lock lock(m_streamMtx);
+    return m_streams.size();
+}
+
+std::string Http2SockStream::toString() {
+    std::stringstream ss;
+    MtxType::Lock lock(m_streamMtx);
+    ss << "[Http2SockStream " << (m_isClient ? "client" : "server")
+       << " streams=" << m_streams.size()
+       << " last_stream_id=" << m_lastStreamId
+       << " send_window=" << m_sendWindow
+       << " recv_window=" << m_recvWindow
+       << " peer_max_streams=" << m_peerMaxStreams
+       << " peer_initial_window=" << m_peerInitialWindow
+       << " peer_max_frame_size=" << m_peerMaxFrameSize
+       << " go_away=" << m_goAway
+       << "]";
+    return ss.str();
+}
+
+Http2Stream::ptr Http2SockStream::newStreamNolock(uint32_t id) {
+    Http2Stream::ptr stream(new Http2Stream(id, m_peerInitialWindow, m_localInitialWindow));
+    m_streams[id] = stream;
+    return stream;
+}
+
+Http2Stream::ptr Http2SockStream::getStream(uint32_t id) {
+    MtxType::Lock lock(m_streamMtx);
+    auto it = m_streams.find(id);
+    return it == m_streams.end() ? nullptr : it->second;
+}
+
+void Http2SockStream::delStream(uint32_t id) {
+    MtxType::Lock lock(m_streamMtx);
+    m_streams.erase(id);
+}
+
+void Http2SockStream::waitStream(Http2Stream::ptr stream, MtxType::Lock& lock) {
+    stream->m_waiting = true;
+    lock.unlock();
+    //unlock之后到wait之前的notify会让wait直接返回，不会丢失
+    stream->m_sem.wait();
+    lock.lock();
+}
+
+void Http2SockStream::notifyStreamNolock(Http2Stream::ptr stream) {
+    if(stream->m_waiting) {
+        stream->m_waiting = false;
+        stream->m_sem.notify();
+    }
+}
+
+void Http2SockStream::onStreamTimeout(Http2Stream::ptr stream) {
+    MtxType::Lock lock(m_streamMtx);
+    stream->m_timeout = true;
+    notifyStreamNolock(stream);
+}
+
+void Http2SockStream::connectionError(Http2Error error, const std::string& msg) {
+    YHCHAOS_LOG_WARN(g_logger) << "http2 connection error "
+        << Http2ErrorToString(error) << " " << msg
+        << " " << (m_socket ? m_socket->toString() : "");
+    if(m_error) {
+        return;
+    }
+    m_error = true;
+    uint32_t last_id = 0;
+    if(!m_isClient) {
+        MtxType::Lock lock(m_streamMtx);
+        last_id = m_lastStreamId;
+    }
+    FrameSendCtx::ptr ctx(new FrameSendCtx);
+    ctx->frame = Frame::CreateGoAway(last_id, error, msg);
+    ctx->close = true;
+    enqueue(ctx);
+}
+
+void Http2SockStream::onClose() {
+    MtxType::Lock lock(m_streamMtx);
+    for(auto& i : m_streams) {
+        auto& stream = i.second;
+        if(!stream->m_reset) {
+            stream->m_reset = true;
+            stream->m_error = Http2Error::CANCEL;
+        }
+        notifyStreamNolock(stream);
+    }
+    m_streams.clear();
+}
+
+AsyncSockStream::Ctx::ptr Http2SockStream::doRecv() {
+    if(m_error) {
+        //已经发送了GOAWAY，丢弃剩余的数据直到连接被关闭
+        char buf[4096];
+        if(read(buf, sizeof(buf)) <= 0) {
+            innerClose();
+            onClose();
+        }
+        return nullptr;
+    }
+    if(!m_prefaceRecved) {
+        char preface[CLIENT_PREFACE_LEN];
+        if(readFixSize(preface, sizeof(preface)) <= 0
+                || memcmp(preface, CLIENT_PREFACE, CLIENT_PREFACE_LEN)) {
+            YHCHAOS_LOG_DEBUG(g_logger) << "http2 invalid preface";
+            innerClose();
+            onClose();
+            return nullptr;
+        }
+        m_prefaceRecved = true;
+        return nullptr;
+    }
+    Http2Error error = Http2Error::NO_ERROR;
+    auto frame = Frame::Read(shared_from_this(), m_localMaxFrameSize, error);
+    if(!frame) {
+        if(error != Http2Error::NO_ERROR) {
+            connectionError(error, "frame too large");
+        } else {
+            innerClose();
+            onClose();
+        }
+        return nullptr;
+    }
+    handleFrame(frame);
+    return nullptr;
+}
+
+bool Http2SockStream::handleFrame(Frame::ptr frame) {
+    if(m_continuationId && (frame->type != FrameType::CONTINUATION
+                || frame->streamId != m_continuationId)) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "expect continuation");
+        return false;
+    }
+    switch(frame->type) {
+        case FrameType::DATA:
+            return handleData(frame);
+        case FrameType::HEADERS:
+            return handleHeaders(frame);
+        case FrameType::PRIORITY:
+            //不支持优先级，忽略
+            if(frame->streamId == 0) {
+                connectionError(Http2Error::PROTOCOL_ERROR, "priority stream_id=0");
+                return false;
+            }
+            return true;
+        case FrameType::RST_STREAM:
+            return handleRstStream(frame);
+        case FrameType::SETTINGS:
+            return handleSettings(frame);
+        case FrameType::PUSH_PROMISE:
+            //客户端通过ENABLE_PUSH=0禁用了服务端推送，服务端不能收到PUSH_PROMISE
+            connectionError(Http2Error::PROTOCOL_ERROR, "push promise");
+            return false;
+        case FrameType::PING:
+            return handlePing(frame);
+        case FrameType::GOAWAY:
+            return handleGoAway(frame);
+        case FrameType::WINDOW_UPDATE:
+            return handleWindowUpdate(frame);
+        case FrameType::CONTINUATION:
+            if(!m_continuationId) {
+                connectionError(Http2Error::PROTOCOL_ERROR, "unexpected continuation");
+                return false;
+            }
+            //压缩后的头部块不会比解码后的头部列表大，超过限制时不再继续累积
+            if(m_headerBlock.size() + frame->data.size() > m_localMaxHeaderListSize) {
+                connectionError(Http2Error::ENHANCE_YOUR_CALM, "header block too large");
+                return false;
+            }
+            m_headerBlock.append(frame->data);
+            if(frame->hasFlag(END_HEADERS)) {
+                return handleHeaderBlock(frame->streamId, m_continuationEndStream);
+            }
+            return true;
+        default:
+            //未知类型的帧必须忽略
+            return true;
+    }
+}
+
+bool Http2SockStream::handleData(Frame::ptr frame) {
+    if(frame->streamId == 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "data stream_id=0");
+        return false;
+    }
+    //填充也计入流量控制
+    uint32_t flow_len = frame->data.size();
+    if(!frame->stripPadding()) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+        return false;
+    }
+    bool end_stream = frame->hasFlag(END_STREAM);
+    uint64_t max_body_size = m_isClient ? http::HttpRspParser::GetHttpRspMaxBodySize()
+                                        : http::HttpReqParser::GetHttpReqMaxBodySize();
+    std::vector<Frame::ptr> frames;
+    Http2Stream::ptr stream;
+    Http2Error stream_error = Http2Error::NO_ERROR;
+    {
+        MtxType::Lock lock(m_streamMtx);
+        m_recvWindow -= flow_len;
+        if(m_recvWindow < 0) {
+            lock.unlock();
+            connectionError(Http2Error::FLOW_CONTROL_ERROR, "connection window exceeded");
+            return false;
+        }
+        m_recvUnacked += flow_len;
+        if(m_recvUnacked >= m_localConnWindow / 2) {
+            frames.push_back(Frame::CreateWindowUpdate(0, m_recvUnacked));
+            m_recvWindow += m_recvUnacked;
+            m_recvUnacked = 0;
+        }
+
+        auto it = m_streams.find(frame->streamId);
+        if(it == m_streams.end() || it->second->m_remoteClosed
+                || !it->second->m_headersRecved) {
+            frames.push_back(Frame::CreateRstStream(frame->streamId, Http2Error::STREAM_CLOSED));
+            stream = nullptr;
+        } else {
+            stream = it->second;
+            stream->m_recvWindow -= flow_len;
+            if(stream->m_recvWindow < 0) {
+                stream_error = Http2Error::FLOW_CONTROL_ERROR;
+            } else if(stream->m_body.size() + frame->data.size() > max_body_size) {
+                stream_error = Http2Error::CANCEL;
+            } else {
+                stream->m_body.append(frame->data);
+                if(end_stream) {
+                    stream->m_remoteClosed = true;
+                    notifyStreamNolock(stream);
+                } else {
+                    stream->m_recvUnacked += flow_len;
+                    if(stream->m_recvUnacked >= m_localInitialWindow / 2) {
+                        frames.push_back(Frame::CreateWindowUpdate(stream->m_id, stream->m_recvUnacked));
+                        stream->m_recvWindow += stream->m_recvUnacked;
+                        stream->m_recvUnacked = 0;
+                    }
+                }
+            }
+        }
+    }
+    for(auto& i : frames) {
+        sendFrame(i);
+    }
+    if(stream_error != Http2Error::NO_ERROR) {
+        resetStream(stream, stream_error);
+    } else if(stream && end_stream) {
+        onStreamEnd(stream);
+    }
+    return true;
+}
+
+bool Http2SockStream::handleHeaders(Frame::ptr frame) {
+    if(frame->streamId == 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "headers stream_id=0");
+        return false;
+    }
+    if(!frame->stripPadding()) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "invalid padding");
+        return false;
+    }
+    if(frame->data.size() > m_localMaxHeaderListSize) {
+        connectionError(Http2Error::ENHANCE_YOUR_CALM, "header block too large");
+        return false;
+    }
+    m_headerBlock.swap(frame->data);
+    if(frame->hasFlag(END_HEADERS)) {
+        return handleHeaderBlock(frame->streamId, frame->hasFlag(END_STREAM));
+    }
+    m_continuationId = frame->streamId;
+    m_continuationEndStream = frame->hasFlag(END_STREAM);
+    return true;
+}
+
+bool Http2SockStream::handleHeaderBlock(uint32_t id, bool end_stream) {
+    m_continuationId = 0;
+    HeaderList headers;
+    //不管流是否还存在都要解码，保持HPACK动态表同步
+    int rt = m_decoder.decode(m_headerBlock.c_str(), m_headerBlock.size(), headers);
+    m_headerBlock.clear();
+    if(rt == -2) {
+        connectionError(Http2Error::ENHANCE_YOUR_CALM, "header list too large");
+        return false;
+    }
+    if(rt) {
+        connectionError(Http2Error::COMPRESSION_ERROR, "hpack decode fail");
+        return false;
+    }
+
+    Http2Stream::ptr stream;
+    Http2Error stream_error = Http2Error::NO_ERROR;
+    {
+        MtxType::Lock lock(m_streamMtx);
+        auto it = m_streams.find(id);
+        if(it != m_streams.end()) {
+            stream = it->second;
+        } else if(m_isClient) {
+            //请求超时或者取消后流已经删除
+            return true;
+        } else {
+            if(id % 2 == 0) {
+                lock.unlock();
+                connectionError(Http2Error::PROTOCOL_ERROR, "invalid stream id");
+                return false;
+            }
+            if(id <= m_lastStreamId) {
+                //已经关闭(或者被跳过而隐式关闭)的流，是流错误(RFC 7540 5.1)
+                lock.unlock();
+                sendFrame(Frame::CreateRstStream(id, Http2Error::STREAM_CLOSED));
+                return true;
+            }
+            m_lastStreamId = id;
+            if(m_streams.size() >= m_localMaxStreams) {
+                lock.unlock();
+                sendFrame(Frame::CreateRstStream(id, Http2Error::REFUSED_STREAM));
+                return true;
+            }
+            stream = newStreamNolock(id);
+        }
+
+        if(stream->m_remoteClosed) {
+            stream_error = Http2Error::STREAM_CLOSED;
+        } else if(stream->m_headersRecved && !end_stream) {
+            //trailer必须带END_STREAM
+            stream_error = Http2Error::PROTOCOL_ERROR;
+        } else if(m_isClient && !headers.empty() && headers[0].first == ":status"
+                && headers[0].second.size() == 3 && headers[0].second[0] == '1') {
+            //1xx的响应忽略，后面还有最终的响应
+            return true;
+        } else {
+            stream->m_headers.insert(stream->m_headers.end(), headers.begin(), headers.end());
+            stream->m_headersRecved = true;
+            if(end_stream) {
+                stream->m_remoteClosed = true;
+                notifyStreamNolock(stream);
+            }
+        }
+    }
+    if(stream_error != Http2Error::NO_ERROR) {
+        resetStream(stream, stream_error);
+    } else if(end_stream) {
+        onStreamEnd(stream);
+    }
+    return true;
+}
+
+bool Http2SockStream::handleSettings(Frame::ptr frame) {
+    if(frame->streamId != 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "settings stream_id!=0");
+        return false;
+    }
+    if(frame->hasFlag(ACK)) {
+        if(!frame->data.empty()) {
+            connectionError(Http2Error::FRAME_SIZE_ERROR, "settings ack with payload");
+            return false;
+        }
+        return true;
+    }
+    if(frame->data.size() % 6) {
+        connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid settings length");
+        return false;
+    }
+    return applySettings(frame->data, true);
+}
+
+bool Http2SockStream::applySettings(const std::string& payload, bool ack) {
+    SettingsAckCtx::ptr ctx(new SettingsAckCtx);
+    ctx->ack = ack;
+    Http2Error error = Http2Error::NO_ERROR;
+    {
+        MtxType::Lock lock(m_streamMtx);
+        for(size_t i = 0; i + 6 <= payload.size(); i += 6) {
+            SettingsId id = (SettingsId)ReadUint16(&payload[i]);
+            uint32_t v = ReadUint32(&payload[i + 2]);
+            if(id == SettingsId::HEADER_TABLE_SIZE) {
+                ctx->tableSizeChanged = true;
+                ctx->tableSize = v;
+            } else if(id == SettingsId::ENABLE_PUSH) {
+                if(v > 1) {
+                    error = Http2Error::PROTOCOL_ERROR;
+                    break;
+                }
+            } else if(id == SettingsId::MAX_CONCURRENT_STREAMS) {
+                m_peerMaxStreams = v;
+            } else if(id == SettingsId::INITIAL_WINDOW_SIZE) {
+                if(v > MAX_WINDOW_SIZE) {
+                    error = Http2Error::FLOW_CONTROL_ERROR;
+                    break;
+                }
+                //调整所有流的发送窗口(RFC 7540 6.9.2)
+                int64_t delta = (int64_t)v - m_peerInitialWindow;
+                m_peerInitialWindow = v;
+                for(auto& it : m_streams) {
+                    it.second->m_sendWindow += delta;
+                    if(it.second->m_sendWindow > MAX_WINDOW_SIZE) {
+                        error = Http2Error::FLOW_CONTROL_ERROR;
+                        break;
+                    }
+                    if(delta > 0) {
+                        notifyStreamNolock(it.second);
+                    }
+                }
+            } else if(id == SettingsId::MAX_FRAME_SIZE) {
+                if(v < DEFAULT_MAX_FRAME_SIZE || v > 0xffffff) {
+                    error = Http2Error::PROTOCOL_ERROR;
+                    break;
+                }
+                m_peerMaxFrameSize = v;
+            }
+            //未知的参数必须忽略
+        }
+    }
+    if(error != Http2Error::NO_ERROR) {
+        connectionError(error, "invalid settings");
+        return false;
+    }
+    enqueue(ctx);
+    return true;
+}
+
+bool Http2SockStream::handleWindowUpdate(Frame::ptr frame) {
+    if(frame->data.size() != 4) {
+        connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid window update length");
+        return false;
+    }
+    uint32_t increment = ReadUint32(frame->data.c_str()) & 0x7fffffff;
+    MtxType::Lock lock(m_streamMtx);
+    if(frame->streamId == 0) {
+        m_sendWindow += increment;
+        if(increment == 0 || m_sendWindow > MAX_WINDOW_SIZE) {
+            lock.unlock();
+            connectionError(increment ? Http2Error::FLOW_CONTROL_ERROR
+                    : Http2Error::PROTOCOL_ERROR, "invalid connection window update");
+            return false;
+        }
+        for(auto& i : m_streams) {
+            notifyStreamNolock(i.second);
+        }
+        return true;
+    }
+    auto it = m_streams.find(frame->streamId);
+    if(it == m_streams.end()) {
+        return true;
+    }
+    auto stream = it->second;
+    stream->m_sendWindow += increment;
+    if(increment == 0 || stream->m_sendWindow > MAX_WINDOW_SIZE) {
+        lock.unlock();
+        resetStream(stream, increment ? Http2Error::FLOW_CONTROL_ERROR
+                                      : Http2Error::PROTOCOL_ERROR);
+        return true;
+    }
+    notifyStreamNolock(stream);
+    return true;
+}
+
+bool Http2SockStream::handleRstStream(Frame::ptr frame) {
+    if(frame->streamId == 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "rst_stream stream_id=0");
+        return false;
+    }
+    if(frame->data.size() != 4) {
+        connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid rst_stream length");
+        return false;
+    }
+    MtxType::Lock lock(m_streamMtx);
+    auto it = m_streams.find(frame->streamId);
+    if(it == m_streams.end()) {
+        return true;
+    }
+    auto stream = it->second;
+    m_streams.erase(it);
+    stream->m_reset = true;
+    stream->m_error = (Http2Error)ReadUint32(frame->data.c_str());
+    notifyStreamNolock(stream);
+    return true;
+}
+
+bool Http2SockStream::handleGoAway(Frame::ptr frame) {
+    if(frame->streamId != 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "goaway stream_id!=0");
+        return false;
+    }
+    if(frame->data.size() < 8) {
+        connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid goaway length");
+        return false;
+    }
+    uint32_t last_id = ReadUint32(frame->data.c_str()) & 0x7fffffff;
+    Http2Error error = (Http2Error)ReadUint32(frame->data.c_str() + 4);
+    YHCHAOS_LOG_DEBUG(g_logger) << "http2 recv goaway last_stream_id=" << last_id
+        << " error=" << Http2ErrorToString(error)
+        << " debug=" << frame->data.substr(8);
+    MtxType::Lock lock(m_streamMtx);
+    m_goAway = true;
+    m_goAwayStreamId = last_id;
+    if(!m_isClient) {
+        return true;
+    }
+    //大于last_id的流没有被处理，可以安全重试
+    for(auto it = m_streams.begin(); it != m_streams.end();) {
+        if(it->first > last_id) {
+            it->second->m_reset = true;
+            it->second->m_error = Http2Error::REFUSED_STREAM;
+            notifyStreamNolock(it->second);
+            it = m_streams.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return true;
+}
+
+bool Http2SockStream::handlePing(Frame::ptr frame) {
+    if(frame->streamId != 0) {
+        connectionError(Http2Error::PROTOCOL_ERROR, "ping stream_id!=0");
+        return false;
+    }
+    if(frame->data.size() != 8) {
+        connectionError(Http2Error::FRAME_SIZE_ERROR, "invalid ping length");
+        return false;
+    }
+    if(!frame->hasFlag(ACK)) {
+        sendFrame(Frame::CreatePing(frame->data, true));
+    }
+    return true;
+}
+
+}
+}
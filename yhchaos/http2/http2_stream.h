@@ -0,0 +1,315 @@
+#ifndef __YHCHAOS_HTTP2_HTTP2_STREAM_H__
+#define __YHCHAOS_HTTP2_HTTP2_STREAM_H__
+
+#include "yhchaos/streams/async_sock_stream.h"
+#include "yhchaos/http/http.h"
+#include "frame.h"
+#include "hpack.h"
+
+namespace yhchaos {
+namespace http2 {
+
+class Http2SockStream;
+
+/**
+ * @brief 是否是HTTP/2中禁止的连接相关的头部(RFC 7540 8.1.2.2)
+ * @param[in] name 小写的头部名称
+ */
+bool IsConnectionHeader(const std::string& name);
+
+/**
+ * @brief HTTP/2连接上的一个流，对应一次请求和响应
+ * @details 所有状态都由所属连接的m_streamMtx保护
+ */
+class Http2Stream {
+friend class Http2SockStream;
+public:
+    typedef std::shared_ptr<Http2Stream> ptr;
+
+    Http2Stream(uint32_t id, int64_t send_window, int64_t recv_window);
+
+    uint32_t getId() const { return m_id;}
+
+    /**
+     * @brief 收到的头部(包括伪头部和trailer)
+     */
+    const HeaderList& getHeaders() const { return m_headers;}
+
+    /**
+     * @brief 收到的消息体
+     */
+    const std::string& getBody() const { return m_body;}
+
+    /**
+     * @brief 对端是否已经发送了END_STREAM
+     */
+    bool isRemoteClosed() const { return m_remoteClosed;}
+
+    /**
+     * @brief 本端是否已经发送了END_STREAM
+     */
+    bool isLocalClosed() const { return m_localClosed;}
+
+    /**
+     * @brief 流是否被重置，重置后不能再发送
+     */
+    bool isReset() const { return m_reset;}
+    Http2Error getError() const { return m_error;}
+
+    /**
+     * @brief 等待是否已经超时
+     */
+    bool isTimeout() const { return m_timeout;}
+
+    /**
+     * @brief 将收到的头部和消息体转换为HTTP请求
+     * @return 缺少必需的伪头部时返回nullptr
+     */
+    http::HttpReq::ptr toReq() const;
+
+    /**
+     * @brief 将收到的头部和消息体转换为HTTP响应
+     * @return 缺少:status时返回nullptr
+     */
+    http::HttpRsp::ptr toRsp() const;
+
+    std::string toString() const;
+private:
+    uint32_t m_id;
+    HeaderList m_headers;
+    std::string m_body;
+    /// 发送窗口，SETTINGS_INITIAL_WINDOW_SIZE变小时可以为负
+    int64_t m_sendWindow;
+    /// 接收窗口
+    int64_t m_recvWindow;
+    /// 已经接收但还没有通过WINDOW_UPDATE归还的字节数
+    uint32_t m_recvUnacked;
+    bool m_headersRecved;
+    bool m_remoteClosed;
+    bool m_localClosed;
+    bool m_reset;
+    bool m_timeout;
+    Http2Error m_error;
+    /// 是否有协程在m_sem上等待，只有为true时才notify，避免残留的信号量
+    bool m_waiting;
+    CoroutineSem m_sem;
+};
+
+/**
+ * @brief HTTP/2连接，负责帧的收发、HPACK、流的管理和流量控制
+ * @details
+ *  1. 所有的帧都通过AsyncSockStream的发送队列由doWrite协程顺序写出，
+ *     HEADERS在doWrite协程中编码，保证HPACK的编码顺序和发送顺序一致
+ *  2. doRead协程循环读帧，请求/响应完整后交给子类处理
+ *  3. sendData按连接和流两级窗口分片发送，窗口不足时阻塞当前协程，
+ *     收到WINDOW_UPDATE后唤醒
+ */
+class Http2SockStream : public AsyncSockStream {
+public:
+    typedef std::shared_ptr<Http2SockStream> ptr;
+    typedef Mtx MtxType;
+
+    /**
+     * @param[in] sock socket
+     * @param[in] is_client 是否是客户端
+     */
+    Http2SockStream(Sock::ptr sock, bool is_client);
+    ~Http2SockStream();
+
+    /**
+     * @brief 发送连接序言和SETTINGS，开始读写
+     */
+    virtual bool start() override;
+
+    /**
+     * @brief 发送头部，超过对端最大帧大小时拆分为CONTINUATION
+     * @param[in] end_stream 是否没有消息体
+     */
+    bool sendHeaders(Http2Stream::ptr stream, const HeaderList& headers, bool end_stream);
+
+    /**
+     * @brief 发送消息体
+     * @details 按连接窗口、流窗口和对端最大帧大小分片，窗口不足时阻塞当前协程
+     * @return 流被重置或者连接关闭返回false
+     */
+    bool sendData(Http2Stream::ptr stream, const std::string& data, bool end_stream = true);
+
+    /**
+     * @brief 重置流
+     */
+    void resetStream(Http2Stream::ptr stream, Http2Error error);
+
+    /**
+     * @brief 发送GOAWAY，不再接受新的流，已有的流继续处理
+     */
+    void goAway(Http2Error error = Http2Error::NO_ERROR);
+
+    bool isClient() const { return m_isClient;}
+
+    /**
+     * @brief 是否收到了对端的GOAWAY
+     */
+    bool isGoAway() const { return m_goAway;}
+
+    size_t getStreamCount();
+    std::string toString();
+protected:
+    /**
+     * @brief 发送一个已经序列化的帧
+     */
+    struct FrameSendCtx : public SendCtx {
+        typedef std::shared_ptr<FrameSendCtx> ptr;
+        Frame::ptr frame;
+        /// 发送后关闭连接(用于出错时的GOAWAY)
+        bool close = false;
+        virtual bool doSend(AsyncSockStream::ptr stream) override;
+    };
+
+    /**
+     * @brief 发送头部，在doWrite协程中进行HPACK编码
+     */
+    struct HeadersSendCtx : public SendCtx {
+        typedef std::shared_ptr<HeadersSendCtx> ptr;
+        uint32_t streamId = 0;
+        bool endStream = false;
+        HeaderList headers;
+        virtual bool doSend(AsyncSockStream::ptr stream) override;
+    };
+
+    /**
+     * @brief 应用对端的SETTINGS_HEADER_TABLE_SIZE并回复ACK
+     * @details 编码器只在doWrite协程中使用，所以修改也放到发送队列中
+     */
+    struct SettingsAckCtx : public SendCtx {
+        typedef std::shared_ptr<SettingsAckCtx> ptr;
+        bool ack = true;
+        bool tableSizeChanged = false;
+        uint32_t tableSize = 0;
+        virtual bool doSend(AsyncSockStream::ptr stream) override;
+    };
+
+    /**
+     * @brief 发送客户端连接序言
+     */
+    struct PrefaceSendCtx : public SendCtx {
+        virtual bool doSend(AsyncSockStream::ptr stream) override;
+    };
+
+    /**
+     * @brief 流接收完成(收到END_STREAM)
+     */
+    virtual void onStreamEnd(Http2Stream::ptr stream) = 0;
+
+    virtual Ctx::ptr doRecv() override;
+
+    /**
+     * @brief 本端的SETTINGS参数
+     */
+    std::vector<std::pair<SettingsId, uint32_t> > getLocalSettings() const;
+
+    /**
+     * @brief 客户端创建新的流并发送头部
+     * @details 分配流id和头部入队在同一个锁内，保证流id按发送顺序递增
+     * @return 连接已关闭、收到GOAWAY或者超过对端的并发流限制时返回nullptr
+     */
+    Http2Stream::ptr openStream(const HeaderList& headers, bool end_stream);
+
+    /**
+     * @brief h2c升级后创建流1
+     * @details 服务端的流1已经通过HTTP/1.1收到了请求，客户端的流1已经发送了请求
+     */
+    Http2Stream::ptr createUpgradeStream();
+
+    /**
+     * @brief 应用对端的SETTINGS
+     * @param[in] payload SETTINGS帧的负载
+     * @param[in] ack 是否回复ACK，h2c升级时的HTTP2-Settings不需要回复
+     */
+    bool applySettings(const std::string& payload, bool ack);
+
+    /**
+     * @brief 创建流并加入m_streams，需要持有m_streamMtx
+     */
+    Http2Stream::ptr newStreamNolock(uint32_t id);
+    Http2Stream::ptr getStream(uint32_t id);
+    void delStream(uint32_t id);
+
+    /**
+     * @brief 在流上等待，调用前需要持有lock，返回时重新持有lock
+     */
+    void waitStream(Http2Stream::ptr stream, MtxType::Lock& lock);
+
+    /**
+     * @brief 唤醒在流上等待的协程，需要持有m_streamMtx
+     */
+    void notifyStreamNolock(Http2Stream::ptr stream);
+
+    /**
+     * @brief 流超时，唤醒等待的协程
+     */
+    void onStreamTimeout(Http2Stream::ptr stream);
+
+    void sendFrame(Frame::ptr frame);
+
+    /**
+     * @brief 连接错误，发送GOAWAY后关闭连接
+     */
+    void connectionError(Http2Error error, const std::string& msg);
+
+    /**
+     * @brief 连接关闭，唤醒所有等待的流
+     */
+    void onClose();
+
+    bool handleFrame(Frame::ptr frame);
+    bool handleData(Frame::ptr frame);
+    bool handleHeaders(Frame::ptr frame);
+    bool handleHeaderBlock(uint32_t id, bool end_stream);
+    bool handleSettings(Frame::ptr frame);
+    bool handleWindowUpdate(Frame::ptr frame);
+    bool handleRstStream(Frame::ptr frame);
+    bool handleGoAway(Frame::ptr frame);
+    bool handlePing(Frame::ptr frame);
+protected:
+    bool m_isClient;
+    bool m_prefaceRecved;
+    /// 出现连接错误，之后收到的帧都丢弃
+    bool m_error;
+    /// 收到了GOAWAY
+    bool m_goAway;
+    /// 保护流的状态和窗口
+    MtxType m_streamMtx;
+    std::unordered_map<uint32_t, Http2Stream::ptr> m_streams;
+    /// 服务端: 对端创建的最大流id, 客户端: 下一个流id
+    uint32_t m_lastStreamId;
+    /// 对端GOAWAY中的最后一个流id
+    uint32_t m_goAwayStreamId;
+    int64_t m_sendWindow;
+    int64_t m_recvWindow;
+    uint32_t m_recvUnacked;
+    /// 对端的SETTINGS
+    uint32_t m_peerInitialWindow;
+    uint32_t m_peerMaxFrameSize;
+    uint32_t m_peerMaxStreams;
+    /// 本端的SETTINGS
+    uint32_t m_localInitialWindow;
+    uint32_t m_localMaxFrameSize;
+    uint32_t m_localMaxStreams;
+    /// 本端的连接级接收窗口大小
+    uint32_t m_localConnWindow;
+    /// 本端允许的头部列表最大大小，同时限制累积的头部块大小
+    uint32_t m_localMaxHeaderListSize;
+    /// 只在doWrite协程中使用
+    HPackEncoder m_encoder;
+    /// 只在doRead协程中使用
+    HPackDecoder m_decoder;
+    /// 正在接收CONTINUATION的流id，0表示没有
+    uint32_t m_continuationId;
+    bool m_continuationEndStream;
+    std::string m_headerBlock;
+};
+
+}
+}
+
+#endif
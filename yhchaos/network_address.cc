@@ -6,6 +6,7 @@
 #include <stddef.h>
 
 #include "endian.h"
+#include "dns_resolver.h"
 
 namespace yhchaos {
 
@@ -93,6 +94,25 @@ bool NetworkAddress::SearchFor(std::vector<NetworkAddress::ptr>& result, const s
     if(node.empty()) {
         node = host;
     }
+
+    //协程中使用DnsResolver，避免getaddrinfo阻塞整个IO线程
+    if((family == AF_INET || family == AF_INET6 || family == AF_UNSPEC)
+            && (!service || isdigit(*service) || !*service)
+            && DnsResolverMgr::GetInstance()->isAvailable()) {
+        std::vector<IPNetworkAddress::ptr> addrs;
+        if(!DnsResolverMgr::GetInstance()->resolve(addrs, node, family)) {
+            YHCHAOS_LOG_DEBUG(g_logger) << "NetworkAddress::SearchFor DnsResolver(" << host << ", "
+                << family << ", " << type << ") fail";
+            return false;
+        }
+        uint16_t port = service ? atoi(service) : 0;
+        for(auto& i : addrs) {
+            i->setPort(port);
+            result.push_back(i);
+        }
+        return true;
+    }
+
     int error = getaddrinfo(node.c_str(), service, &hints, &results);
     if(error) {
         YHCHAOS_LOG_DEBUG(g_logger) << "NetworkAddress::SearchFor getaddress(" << host << ", "
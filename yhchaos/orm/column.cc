@@ -0,0 +1,289 @@
+#include "column.h"
+#include "util.h"
+#include "yhchaos/log.h"
+#include "yhchaos/util.h"
+
+namespace yhchaos {
+namespace orm {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("orm");
+
+Column::Type Column::ParseType(const std::string& v) {
+#define XX(a, b) \
+    if(v == #b) { \
+        return a; \
+    }
+    XX(TYPE_INT8, int8);
+    XX(TYPE_UINT8, uint8);
+    XX(TYPE_INT16, int16);
+    XX(TYPE_UINT16, uint16);
+    XX(TYPE_INT32, int32);
+    XX(TYPE_UINT32, uint32);
+    XX(TYPE_INT64, int64);
+    XX(TYPE_UINT64, uint64);
+    XX(TYPE_FLOAT, float);
+    XX(TYPE_DOUBLE, double);
+    XX(TYPE_STRING, string);
+    XX(TYPE_TEXT, text);
+    XX(TYPE_BLOB, blob);
+    XX(TYPE_TIMESTAMP, timestamp);
+#undef XX
+    return TYPE_NULL;
+}
+
+std::string Column::TypeToString(Type type) {
+    switch(type) {
+#define XX(a, b) \
+        case a: \
+            return #b;
+        XX(TYPE_INT8, int8);
+        XX(TYPE_UINT8, uint8);
+        XX(TYPE_INT16, int16);
+        XX(TYPE_UINT16, uint16);
+        XX(TYPE_INT32, int32);
+        XX(TYPE_UINT32, uint32);
+        XX(TYPE_INT64, int64);
+        XX(TYPE_UINT64, uint64);
+        XX(TYPE_FLOAT, float);
+        XX(TYPE_DOUBLE, double);
+        XX(TYPE_STRING, string);
+        XX(TYPE_TEXT, text);
+        XX(TYPE_BLOB, blob);
+        XX(TYPE_TIMESTAMP, timestamp);
+#undef XX
+        default:
+            return "null";
+    }
+}
+
+bool Column::init(const tinyxml2::XMLElement& node) {
+    if(!node.Attribute("name")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name not exists";
+        return false;
+    }
+    m_name = node.Attribute("name");
+    if(!IsIdentifier(m_name)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name << " is not a valid identifier";
+        return false;
+    }
+
+    if(!node.Attribute("type")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name << " type is null";
+        return false;
+    }
+    m_typeName = node.Attribute("type");
+    m_type = ParseType(m_typeName);
+    if(m_type == TYPE_NULL) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name << " type=" << m_typeName
+            << " invalid (int8|uint8|int16|uint16|int32|uint32|int64|uint64"
+            << "|float|double|string|text|blob|timestamp)";
+        return false;
+    }
+
+    if(node.Attribute("desc")) {
+        m_desc = node.Attribute("desc");
+    }
+    if(node.Attribute("default")) {
+        m_default = node.Attribute("default");
+    }
+    if(node.Attribute("update")) {
+        m_update = node.Attribute("update");
+    }
+    m_length = node.IntAttribute("length", 0);
+    m_autoIncrement = node.BoolAttribute("auto_increment", false);
+    if(m_autoIncrement && (isString() || m_type == TYPE_TIMESTAMP
+                || m_type == TYPE_FLOAT || m_type == TYPE_DOUBLE)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name
+            << " auto_increment must be integer";
+        return false;
+    }
+    //字面量默认值在批量写入时需要转成时间戳
+    if(m_type == TYPE_TIMESTAMP && !m_default.empty() && !isCurrentTimestamp(m_default)
+            && !yhchaos::Str2Time(m_default.c_str())) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name
+            << " timestamp default must be current_timestamp or '%Y-%m-%d %H:%M:%S'";
+        return false;
+    }
+    if(m_type != TYPE_TIMESTAMP && !m_update.empty()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "column name=" << m_name
+            << " update only for timestamp";
+        return false;
+    }
+    return true;
+}
+
+bool Column::isString() const {
+    return m_type == TYPE_STRING || m_type == TYPE_TEXT || m_type == TYPE_BLOB;
+}
+
+bool Column::isCurrentTimestamp(const std::string& v) const {
+    return yhchaos::ToLower(v) == "current_timestamp";
+}
+
+std::string Column::getCppType() const {
+    switch(m_type) {
+#define XX(a, b) \
+        case a: \
+            return #b;
+        XX(TYPE_INT8, int8_t);
+        XX(TYPE_UINT8, uint8_t);
+        XX(TYPE_INT16, int16_t);
+        XX(TYPE_UINT16, uint16_t);
+        XX(TYPE_INT32, int32_t);
+        XX(TYPE_UINT32, uint32_t);
+        XX(TYPE_INT64, int64_t);
+        XX(TYPE_UINT64, uint64_t);
+        XX(TYPE_FLOAT, float);
+        XX(TYPE_DOUBLE, double);
+        XX(TYPE_STRING, std::string);
+        XX(TYPE_TEXT, std::string);
+        XX(TYPE_BLOB, std::string);
+        XX(TYPE_TIMESTAMP, int64_t);
+#undef XX
+        default:
+            return "";
+    }
+}
+
+std::string Column::getCppDefault() const {
+    if(isString()) {
+        return m_default.empty() ? "" : ToCppString(m_default);
+    }
+    if(m_type == TYPE_TIMESTAMP || m_default.empty()) {
+        return "0";
+    }
+    return m_default;
+}
+
+std::string Column::getSQLType() const {
+    switch(m_type) {
+        case TYPE_INT8:
+            return "tinyint";
+        case TYPE_UINT8:
+            return "tinyint unsigned";
+        case TYPE_INT16:
+            return "smallint";
+        case TYPE_UINT16:
+            return "smallint unsigned";
+        case TYPE_INT32:
+            return "int";
+        case TYPE_UINT32:
+            return "int unsigned";
+        case TYPE_INT64:
+            return "bigint";
+        case TYPE_UINT64:
+            return "bigint unsigned";
+        case TYPE_FLOAT:
+            return "float";
+        case TYPE_DOUBLE:
+            return "double";
+        case TYPE_STRING:
+            return "varchar(" + std::to_string(m_length > 0 ? m_length : 128) + ")";
+        case TYPE_TEXT:
+            return "text";
+        case TYPE_BLOB:
+            return "blob";
+        case TYPE_TIMESTAMP:
+            return "timestamp";
+        default:
+            return "";
+    }
+}
+
+std::string Column::getSQLDefine() const {
+    std::string rt = "`" + m_name + "` " + getSQLType();
+    if(m_type == TYPE_TIMESTAMP) {
+        //没有默认值的时间戳为0时写入NULL
+        if(m_default.empty()) {
+            rt += " NULL DEFAULT NULL";
+        } else {
+            rt += " NOT NULL DEFAULT " + getDefaultSQL();
+        }
+        if(!m_update.empty()) {
+            rt += " ON UPDATE " + getUpdateSQL();
+        }
+    } else if(m_autoIncrement) {
+        rt += " NOT NULL AUTO_INCREMENT";
+    } else if(m_type == TYPE_TEXT || m_type == TYPE_BLOB) {
+        //text/blob不能有默认值
+        rt += " NOT NULL";
+    } else if(isString()) {
+        rt += " NOT NULL DEFAULT " + ToSQLString(m_default);
+    } else {
+        rt += " NOT NULL DEFAULT " + (m_default.empty() ? std::string("0") : m_default);
+    }
+    if(!m_desc.empty()) {
+        rt += " COMMENT " + ToSQLString(m_desc);
+    }
+    return rt;
+}
+
+std::string Column::getSelectExpr() const {
+    if(m_type == TYPE_TIMESTAMP) {
+        return "UNIX_TIMESTAMP(`" + m_name + "`)";
+    }
+    return "`" + m_name + "`";
+}
+
+std::string Column::getInsertExpr() const {
+    if(m_autoIncrement) {
+        return "NULLIF(?, 0)";
+    }
+    if(m_type == TYPE_TIMESTAMP) {
+        //有默认值的列是NOT NULL，为0时不能写入NULL
+        if(!m_default.empty()) {
+            return "COALESCE(FROM_UNIXTIME(NULLIF(?, 0)), " + getDefaultSQL() + ")";
+        }
+        return "FROM_UNIXTIME(NULLIF(?, 0))";
+    }
+    return "?";
+}
+
+std::string Column::getAssignExpr() const {
+    if(m_type == TYPE_TIMESTAMP) {
+        return "`" + m_name + "` = " + getInsertExpr();
+    }
+    return "`" + m_name + "` = ?";
+}
+
+std::string Column::getWhereExpr() const {
+    if(m_type == TYPE_TIMESTAMP) {
+        return "`" + m_name + "` = FROM_UNIXTIME(?)";
+    }
+    return "`" + m_name + "` = ?";
+}
+
+std::string Column::getUpdateSQL() const {
+    if(m_update.empty()) {
+        return "";
+    }
+    return isCurrentTimestamp(m_update) ? "CURRENT_TIMESTAMP" : ToSQLString(m_update);
+}
+
+std::string Column::getDefaultSQL() const {
+    if(m_default.empty()) {
+        return "";
+    }
+    if(m_type == TYPE_TIMESTAMP && isCurrentTimestamp(m_default)) {
+        return "CURRENT_TIMESTAMP";
+    }
+    return ToSQLString(m_default);
+}
+
+std::string Column::getBatchValue(const std::string& var) const {
+    if(m_type != TYPE_TIMESTAMP) {
+        return var + "." + m_name;
+    }
+    if(isCurrentTimestamp(m_default)) {
+        return "yhchaos::CppMySQLTime(" + var + "." + m_name + " ? " + var + "."
+            + m_name + " : time(0))";
+    }
+    if(!m_default.empty()) {
+        return "yhchaos::CppMySQLTime(" + var + "." + m_name + " ? " + var + "."
+            + m_name + " : yhchaos::Str2Time(" + ToCppString(m_default) + "))";
+    }
+    return "yhchaos::CppMySQLTime(" + var + "." + m_name + ")";
+}
+
+}
+}
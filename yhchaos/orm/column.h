@@ -0,0 +1,129 @@
+#ifndef __YHCHAOS_ORM_COLUMN_H__
+#define __YHCHAOS_ORM_COLUMN_H__
+
+#include <memory>
+#include <string>
+#include <tinyxml2.h>
+
+namespace yhchaos {
+namespace orm {
+
+class Table;
+
+/**
+ * @brief 表的一列，对应xml中的<column>
+ * @details 属性: name(必须，也是结构体的字段名)，type(必须)，desc，default，update，length，auto_increment
+ */
+class Column {
+friend class Table;
+public:
+    typedef std::shared_ptr<Column> ptr;
+
+    enum Type {
+        TYPE_NULL = 0,
+        TYPE_INT8,
+        TYPE_UINT8,
+        TYPE_INT16,
+        TYPE_UINT16,
+        TYPE_INT32,
+        TYPE_UINT32,
+        TYPE_INT64,
+        TYPE_UINT64,
+        TYPE_FLOAT,
+        TYPE_DOUBLE,
+        TYPE_STRING,
+        TYPE_TEXT,
+        TYPE_BLOB,
+        //结构体中是int64_t的unix时间戳，sql中用FROM_UNIXTIME/UNIX_TIMESTAMP转换
+        TYPE_TIMESTAMP
+    };
+
+    static Type ParseType(const std::string& v);
+    static std::string TypeToString(Type type);
+
+    bool init(const tinyxml2::XMLElement& node);
+
+    const std::string& getName() const { return m_name;}
+    const std::string& getDesc() const { return m_desc;}
+    const std::string& getTypeName() const { return m_typeName;}
+    const std::string& getDefault() const { return m_default;}
+    const std::string& getUpdate() const { return m_update;}
+    Type getType() const { return m_type;}
+    int getLength() const { return m_length;}
+    int getIndex() const { return m_index;}
+    bool isAutoIncrement() const { return m_autoIncrement;}
+    bool isString() const;
+    //默认值或者更新值是CURRENT_TIMESTAMP
+    bool isCurrentTimestamp(const std::string& v) const;
+
+    /**
+     * @brief 结构体中字段的类型
+     */
+    std::string getCppType() const;
+
+    /**
+     * @brief 结构体构造函数中字段的初始值
+     */
+    std::string getCppDefault() const;
+
+    /**
+     * @brief mysql的列类型，如varchar(30)
+     */
+    std::string getSQLType() const;
+
+    /**
+     * @brief CREATE TABLE中列的定义
+     */
+    std::string getSQLDefine() const;
+
+    /**
+     * @brief SELECT中的表达式，时间戳列转成整数
+     */
+    std::string getSelectExpr() const;
+
+    /**
+     * @brief INSERT的VALUES中的参数表达式
+     * @details 自增列为0时由数据库生成，时间戳为0时使用列的默认值，没有默认值时为NULL
+     */
+    std::string getInsertExpr() const;
+
+    /**
+     * @brief UPDATE的SET中的"`name` = ?"，时间戳为0的处理同getInsertExpr
+     */
+    std::string getAssignExpr() const;
+
+    /**
+     * @brief WHERE中的"`name` = ?"，时间戳参数转成时间
+     */
+    std::string getWhereExpr() const;
+
+    /**
+     * @brief update属性对应的sql表达式，没有update属性返回空
+     */
+    std::string getUpdateSQL() const;
+
+    /**
+     * @brief default属性对应的sql表达式，没有default属性返回空
+     */
+    std::string getDefaultSQL() const;
+
+    /**
+     * @brief CppMySQLBatch::add的参数表达式，var为结构体变量
+     */
+    std::string getBatchValue(const std::string& var) const;
+private:
+    std::string m_name;
+    std::string m_typeName;
+    std::string m_desc;
+    std::string m_default;
+    std::string m_update;
+    Type m_type = TYPE_NULL;
+    int m_length = 0;
+    int m_index = 0;
+    bool m_autoIncrement = false;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "index.h"
+#include "util.h"
+#include "yhchaos/log.h"
+
+namespace yhchaos {
+namespace orm {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("orm");
+
+Index::Type Index::ParseType(const std::string& v) {
+#define XX(a, b) \
+    if(v == b) { \
+        return a; \
+    }
+    XX(TYPE_PK, "pk");
+    XX(TYPE_UNIQ, "uniq");
+    XX(TYPE_INDEX, "index");
+#undef XX
+    return TYPE_NULL;
+}
+
+std::string Index::TypeToString(Type v) {
+#define XX(a, b) \
+    if(v == a) { \
+        return b; \
+    }
+    XX(TYPE_PK, "pk");
+    XX(TYPE_UNIQ, "uniq");
+    XX(TYPE_INDEX, "index");
+#undef XX
+    return "";
+}
+
+bool Index::init(const tinyxml2::XMLElement& node) {
+    if(!node.Attribute("name")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "index name not exists";
+        return false;
+    }
+    m_name = node.Attribute("name");
+
+    if(!node.Attribute("type")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "index name=" << m_name << " type is null";
+        return false;
+    }
+    m_type = ParseType(node.Attribute("type"));
+    if(m_type == TYPE_NULL) {
+        YHCHAOS_LOG_ERROR(g_logger) << "index name=" << m_name << " type="
+            << node.Attribute("type") << " invalid (pk|uniq|index)";
+        return false;
+    }
+
+    if(!node.Attribute("cols")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "index name=" << m_name << " cols is null";
+        return false;
+    }
+    m_cols = Split(node.Attribute("cols"), ',');
+    if(m_cols.empty()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "index name=" << m_name << " cols is empty";
+        return false;
+    }
+
+    if(node.Attribute("desc")) {
+        m_desc = node.Attribute("desc");
+    }
+    return true;
+}
+
+std::string Index::getFunSuffix() const {
+    if(isPK()) {
+        return "";
+    }
+    std::string rt = "By";
+    for(auto& i : m_cols) {
+        rt += GetAsClassName(i);
+    }
+    return rt;
+}
+
+}
+}
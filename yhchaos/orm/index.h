@@ -0,0 +1,56 @@
+#ifndef __YHCHAOS_ORM_INDEX_H__
+#define __YHCHAOS_ORM_INDEX_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <tinyxml2.h>
+
+namespace yhchaos {
+namespace orm {
+
+/**
+ * @brief 表的索引，对应xml中的<index>
+ * @details 属性: name，cols(逗号分隔的列名)，type(pk|uniq|index)，desc；
+ *          pk和uniq生成按索引读取一行的Get，index生成读取多行的Query，都生成Delete
+ */
+class Index {
+public:
+    typedef std::shared_ptr<Index> ptr;
+
+    enum Type {
+        TYPE_NULL = 0,
+        TYPE_PK,
+        TYPE_UNIQ,
+        TYPE_INDEX
+    };
+
+    static Type ParseType(const std::string& v);
+    static std::string TypeToString(Type v);
+
+    bool init(const tinyxml2::XMLElement& node);
+
+    const std::string& getName() const { return m_name;}
+    const std::string& getDesc() const { return m_desc;}
+    const std::vector<std::string>& getCols() const { return m_cols;}
+    Type getType() const { return m_type;}
+
+    bool isPK() const { return m_type == TYPE_PK;}
+    //一个值最多对应一行
+    bool isUnique() const { return m_type == TYPE_PK || m_type == TYPE_UNIQ;}
+
+    /**
+     * @brief 生成的函数名后缀，如cols=name,email -> ByNameEmail，主键为空
+     */
+    std::string getFunSuffix() const;
+private:
+    std::string m_name;
+    std::string m_desc;
+    std::vector<std::string> m_cols;
+    Type m_type = TYPE_NULL;
+};
+
+}
+}
+
+#endif
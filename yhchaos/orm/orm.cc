@@ -0,0 +1,71 @@
+#include "table.h"
+#include "util.h"
+#include "yhchaos/log.h"
+#include "yhchaos/util.h"
+#include <iostream>
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("orm");
+
+//orm 表定义xml所在目录 输出目录
+//例: bin/orm bin/orm_conf orm_out，生成的代码编译成库orm_data
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        std::cout << "use as[" << argv[0] << " orm_config_path orm_output_path]" << std::endl;
+        return 0;
+    }
+
+    std::string input_path = argv[1];
+    std::string out_path = argv[2];
+    std::vector<std::string> files;
+    yhchaos::FSUtil::ListAllFile(files, input_path, ".xml");
+    if(files.empty()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "no xml in " << input_path;
+        return 1;
+    }
+
+    std::vector<yhchaos::orm::Table::ptr> tbs;
+    for(auto& i : files) {
+        YHCHAOS_LOG_INFO(g_logger) << "init xml=" << i << " begin";
+        tinyxml2::XMLDocument doc;
+        if(doc.LoadFile(i.c_str())) {
+            YHCHAOS_LOG_ERROR(g_logger) << "error: " << doc.ErrorStr();
+            return 1;
+        }
+        const tinyxml2::XMLElement* root = doc.RootElement();
+        if(!root) {
+            YHCHAOS_LOG_ERROR(g_logger) << "xml=" << i << " no root element";
+            return 1;
+        }
+        yhchaos::orm::Table::ptr table(new yhchaos::orm::Table);
+        if(!table->init(*root)) {
+            YHCHAOS_LOG_ERROR(g_logger) << "table init error xml=" << i;
+            return 1;
+        }
+        tbs.push_back(table);
+    }
+
+    std::vector<std::string> srcs;
+    for(auto& i : tbs) {
+        if(!i->gen(out_path, srcs)) {
+            return 1;
+        }
+    }
+
+    std::ofstream ofs;
+    std::string filename = out_path + "/CMakeLists.txt";
+    if(!yhchaos::FSUtil::OpenForWrite(ofs, filename, std::ios::trunc)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "open file=" << filename << " error";
+        return 1;
+    }
+    ofs << "#由orm生成，不要修改" << std::endl;
+    ofs << "cmake_minimum_required(VERSION 3.0)" << std::endl << std::endl;
+    ofs << "set(LIB_SRC" << std::endl;
+    for(auto& i : srcs) {
+        ofs << "    " << i << std::endl;
+    }
+    ofs << "    )" << std::endl << std::endl;
+    ofs << "add_library(orm_data ${LIB_SRC})" << std::endl;
+    ofs << "force_redefine_file_macro_funor_sources(orm_data)" << std::endl;
+    YHCHAOS_LOG_INFO(g_logger) << "generate " << tbs.size() << " tables to " << out_path;
+    return 0;
+}
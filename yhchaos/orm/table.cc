@@ -0,0 +1,685 @@
+#include "table.h"
+#include "util.h"
+#include "yhchaos/log.h"
+#include "yhchaos/util.h"
+#include <set>
+
+namespace yhchaos {
+namespace orm {
+
+static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("orm");
+
+bool Table::init(const tinyxml2::XMLElement& node) {
+    if(!node.Attribute("name")) {
+        YHCHAOS_LOG_ERROR(g_logger) << "table name is null";
+        return false;
+    }
+    m_name = node.Attribute("name");
+    if(!IsIdentifier(m_name)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " is not a valid identifier";
+        return false;
+    }
+    if(node.Attribute("namespace")) {
+        m_namespace = node.Attribute("namespace");
+        for(auto& i : Split(m_namespace, '.')) {
+            if(!IsIdentifier(i)) {
+                YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name
+                    << " invalid namespace=" << m_namespace;
+                return false;
+            }
+        }
+    }
+    if(node.Attribute("desc")) {
+        m_desc = node.Attribute("desc");
+    }
+
+    const tinyxml2::XMLElement* cols = node.FirstChildElement("columns");
+    if(!cols) {
+        YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " columns is null";
+        return false;
+    }
+    std::set<std::string> names;
+    for(auto col = cols->FirstChildElement("column"); col
+            ; col = col->NextSiblingElement("column")) {
+        Column::ptr c(new Column);
+        if(!c->init(*col)) {
+            YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " init column error";
+            return false;
+        }
+        if(!names.insert(c->getName()).second) {
+            YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " column name="
+                << c->getName() << " exists";
+            return false;
+        }
+        if(c->isAutoIncrement()) {
+            if(m_autoIncrement) {
+                YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name
+                    << " more than one auto_increment column";
+                return false;
+            }
+            m_autoIncrement = c;
+        }
+        c->m_index = m_cols.size();
+        m_cols.push_back(c);
+    }
+    if(m_cols.empty()) {
+        YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " columns is empty";
+        return false;
+    }
+
+    const tinyxml2::XMLElement* idxs = node.FirstChildElement("indexs");
+    if(idxs) {
+        for(auto idx = idxs->FirstChildElement("index"); idx
+                ; idx = idx->NextSiblingElement("index")) {
+            Index::ptr i(new Index);
+            if(!i->init(*idx)) {
+                YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " init index error";
+                return false;
+            }
+            for(auto& c : i->getCols()) {
+                if(!getCol(c)) {
+                    YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " index="
+                        << i->getName() << " column=" << c << " not exists";
+                    return false;
+                }
+            }
+            if(i->isPK()) {
+                if(m_pk) {
+                    YHCHAOS_LOG_ERROR(g_logger) << "table name=" << m_name << " more than one pk";
+                    return false;
+                }
+                m_pk = i;
+            }
+            m_idxs.push_back(i);
+        }
+    }
+    return true;
+}
+
+Column::ptr Table::getCol(const std::string& name) const {
+    for(auto& i : m_cols) {
+        if(i->getName() == name) {
+            return i;
+        }
+    }
+    return nullptr;
+}
+
+std::string Table::getFilename() const {
+    return yhchaos::ToLower(m_name + m_subfix);
+}
+
+std::string Table::getClassName() const {
+    return GetAsClassName(m_name + m_subfix);
+}
+
+std::string Table::getDaoClassName() const {
+    return getClassName() + "Dao";
+}
+
+std::string Table::getNamespaceDir() const {
+    std::string rt;
+    for(auto& i : Split(m_namespace, '.')) {
+        rt += i + "/";
+    }
+    return rt;
+}
+
+bool Table::gen(const std::string& path, std::vector<std::string>& srcs) {
+    if(!genInc(path) || !genSrc(path)) {
+        return false;
+    }
+    srcs.push_back(getNamespaceDir() + getFilename() + ".cc");
+    return true;
+}
+
+std::string Table::genSelectSQL() const {
+    std::string rt = "SELECT ";
+    for(size_t i = 0; i < m_cols.size(); ++i) {
+        if(i) {
+            rt += ", ";
+        }
+        rt += m_cols[i]->getSelectExpr();
+    }
+    return rt + " FROM `" + m_name + "`";
+}
+
+std::string Table::genCreateSQL() const {
+    std::string rt = "CREATE TABLE IF NOT EXISTS `" + m_name + "` (";
+    for(size_t i = 0; i < m_cols.size(); ++i) {
+        if(i) {
+            rt += ", ";
+        }
+        rt += m_cols[i]->getSQLDefine();
+    }
+    for(auto& i : m_idxs) {
+        rt += ", ";
+        if(i->isPK()) {
+            rt += "PRIMARY KEY (";
+        } else if(i->isUnique()) {
+            rt += "UNIQUE KEY `" + i->getName() + "` (";
+        } else {
+            rt += "KEY `" + i->getName() + "` (";
+        }
+        for(size_t n = 0; n < i->getCols().size(); ++n) {
+            rt += (n ? ", `" : "`") + i->getCols()[n] + "`";
+        }
+        rt += ")";
+    }
+    rt += ")";
+    if(!m_desc.empty()) {
+        rt += " COMMENT=" + ToSQLString(m_desc);
+    }
+    return rt;
+}
+
+std::string Table::genIndexParams(Index::ptr idx) const {
+    std::string rt;
+    for(auto& i : idx->getCols()) {
+        if(!rt.empty()) {
+            rt += ", ";
+        }
+        rt += "const " + getCol(i)->getCppType() + "& " + i;
+    }
+    return rt;
+}
+
+std::string Table::genIndexArgs(Index::ptr idx) const {
+    std::string rt;
+    for(auto& i : idx->getCols()) {
+        if(!rt.empty()) {
+            rt += ", ";
+        }
+        rt += i;
+    }
+    return rt;
+}
+
+std::string Table::genIndexWhere(Index::ptr idx) const {
+    std::string rt;
+    for(auto& i : idx->getCols()) {
+        if(!rt.empty()) {
+            rt += " AND ";
+        }
+        rt += getCol(i)->getWhereExpr();
+    }
+    return rt;
+}
+
+bool Table::genInc(const std::string& path) {
+    std::string filename = path + "/" + getNamespaceDir() + getFilename() + ".h";
+    std::ofstream ofs;
+    if(!yhchaos::FSUtil::OpenForWrite(ofs, filename, std::ios::trunc)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "open file=" << filename << " error";
+        return false;
+    }
+    std::string def = GetAsDefineMacro(m_namespace, getFilename());
+    ofs << "//由orm根据表" << m_name << "的定义生成，不要修改" << std::endl;
+    ofs << "#ifndef " << def << std::endl;
+    ofs << "#define " << def << std::endl << std::endl;
+    ofs << "#include \"yhchaos/db/cpp_mysql.h\"" << std::endl;
+    ofs << "#include <functional>" << std::endl;
+    ofs << "#include <memory>" << std::endl;
+    ofs << "#include <string>" << std::endl;
+    ofs << "#include <vector>" << std::endl;
+    ofs << "#include <stdint.h>" << std::endl << std::endl;
+
+    auto ns = Split(m_namespace, '.');
+    for(auto& i : ns) {
+        ofs << "namespace " << i << " {" << std::endl;
+    }
+    ofs << std::endl;
+    genStructInc(ofs);
+    ofs << std::endl;
+    genDaoInc(ofs);
+    ofs << std::endl;
+    for(auto it = ns.rbegin(); it != ns.rend(); ++it) {
+        ofs << "} //namespace " << *it << std::endl;
+    }
+    ofs << std::endl << "#endif" << std::endl;
+    return true;
+}
+
+void Table::genStructInc(std::ofstream& ofs) {
+    std::string class_name = getClassName();
+    ofs << "/**" << std::endl;
+    ofs << " * @brief 表" << m_name << "的一行";
+    if(!m_desc.empty()) {
+        ofs << "(" << m_desc << ")";
+    }
+    ofs << std::endl << " */" << std::endl;
+    ofs << "struct " << class_name << " {" << std::endl;
+    ofs << "    typedef std::shared_ptr<" << class_name << "> ptr;" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 列的元数据" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    struct ColumnMeta {" << std::endl;
+    ofs << "        //列名，也是字段名" << std::endl;
+    ofs << "        const char* name;" << std::endl;
+    ofs << "        //表定义中的类型" << std::endl;
+    ofs << "        const char* type;" << std::endl;
+    ofs << "        //mysql的列类型" << std::endl;
+    ofs << "        const char* sql_type;" << std::endl;
+    ofs << "        const char* desc;" << std::endl;
+    ofs << "        bool auto_increment;" << std::endl;
+    ofs << "        bool primary_key;" << std::endl;
+    ofs << "    };" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 列的下标，和COLUMNS、SELECT_SQL中的顺序一致" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    enum ColumnIndex {" << std::endl;
+    for(auto& i : m_cols) {
+        ofs << "        " << GetAsColumnEnum(i->getName()) << " = " << i->getIndex()
+            << "," << std::endl;
+    }
+    ofs << "    };" << std::endl << std::endl;
+
+    std::set<std::string> pk_cols;
+    if(m_pk) {
+        pk_cols.insert(m_pk->getCols().begin(), m_pk->getCols().end());
+    }
+    ofs << "    static constexpr const char* TABLE_NAME = " << ToCppString(m_name) << ";" << std::endl;
+    ofs << "    static constexpr size_t COLUMN_COUNT = " << m_cols.size() << ";" << std::endl;
+    ofs << "    static constexpr ColumnMeta COLUMNS[COLUMN_COUNT] = {" << std::endl;
+    for(auto& i : m_cols) {
+        ofs << "        {" << ToCppString(i->getName())
+            << ", " << ToCppString(i->getTypeName())
+            << ", " << ToCppString(i->getSQLType())
+            << ", " << ToCppString(i->getDesc())
+            << ", " << (i->isAutoIncrement() ? "true" : "false")
+            << ", " << (pk_cols.count(i->getName()) ? "true" : "false")
+            << "}," << std::endl;
+    }
+    ofs << "    };" << std::endl;
+    ofs << "    //查询所有列，时间戳列转成unix时间戳" << std::endl;
+    ofs << "    static constexpr const char* SELECT_SQL = " << ToCppString(genSelectSQL())
+        << ";" << std::endl << std::endl;
+
+    ofs << "    " << class_name << "();" << std::endl << std::endl;
+    ofs << "    std::string toString() const;" << std::endl << std::endl;
+
+    for(auto& i : m_cols) {
+        if(!i->getDesc().empty()) {
+            ofs << "    //" << i->getDesc() << std::endl;
+        }
+        ofs << "    " << i->getCppType() << " " << i->getName() << ";" << std::endl;
+    }
+    ofs << "};" << std::endl;
+}
+
+void Table::genDaoInc(std::ofstream& ofs) {
+    std::string class_name = getClassName();
+    std::string conn = "yhchaos::CppMySQL::ptr conn";
+    ofs << "/**" << std::endl;
+    ofs << " * @brief 表" << m_name << "的读写，预处理语句的参数和结果列直接绑定"
+        << class_name << "的字段" << std::endl;
+    ofs << " * @details 连接由调用者获取并在调用期间持有(读写分离时写用CppMySQLMgr::getWrite，读用getRead)；" << std::endl;
+    ofs << " *          返回int的函数，0表示成功，否则为错误码" << std::endl;
+    ofs << " */" << std::endl;
+    ofs << "class " << getDaoClassName() << " {" << std::endl;
+    ofs << "public:" << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 插入一行";
+    if(m_autoIncrement) {
+        ofs << "，" << m_autoIncrement->getName() << "为0时由数据库生成，写回info";
+    }
+    ofs << std::endl << "     */" << std::endl;
+    ofs << "    static int Insert(" << class_name << "& info, " << conn << ");" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 插入一行，主键或唯一索引冲突时更新其他列" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    static int InsertOrUpdate(" << class_name << "& info, " << conn << ");" << std::endl << std::endl;
+
+    if(m_pk) {
+        if(m_pk->getCols().size() < m_cols.size()) {
+            ofs << "    /**" << std::endl;
+            ofs << "     * @brief 按主键更新其他列" << std::endl;
+            ofs << "     */" << std::endl;
+            ofs << "    static int Update(const " << class_name << "& info, " << conn << ");" << std::endl << std::endl;
+        }
+        ofs << "    /**" << std::endl;
+        ofs << "     * @brief 按主键删除" << std::endl;
+        ofs << "     */" << std::endl;
+        ofs << "    static int Delete(const " << class_name << "& info, " << conn << ");" << std::endl << std::endl;
+    }
+
+    for(auto& i : m_idxs) {
+        ofs << "    //索引" << i->getName() << "(" << Index::TypeToString(i->getType());
+        if(!i->getDesc().empty()) {
+            ofs << "，" << i->getDesc();
+        }
+        ofs << ")" << std::endl;
+        std::string params = genIndexParams(i);
+        if(i->isUnique()) {
+            ofs << "    static " << class_name << "::ptr Get" << i->getFunSuffix() << "("
+                << params << ", " << conn << ");" << std::endl;
+        } else {
+            ofs << "    static int Query" << i->getFunSuffix() << "(" << params
+                << ", std::vector<" << class_name << "::ptr>& results, " << conn << ");" << std::endl;
+        }
+        ofs << "    static int Delete" << i->getFunSuffix() << "(" << params << ", "
+            << conn << ");" << std::endl << std::endl;
+    }
+
+    ofs << "    static int QueryAll(std::vector<" << class_name << "::ptr>& results, "
+        << conn << ");" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 流式读取整个表，cb返回false停止" << std::endl;
+    ofs << "     * @details 每行读到同一个对象，结果集不缓存在客户端，cb中不能使用conn" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    static int ForEach(std::function<bool(const " << class_name << "&)> cb, "
+        << conn << ");" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 按条件查询，where为SELECT_SQL之后的部分，如\"WHERE `a` = ? ORDER BY `b`\"" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    template<class... Args>" << std::endl;
+    ofs << "    static int QueryWhere(std::vector<" << class_name << "::ptr>& results, " << conn << std::endl;
+    ofs << "                          ,const std::string& where, Args&&... args) {" << std::endl;
+    ofs << "        yhchaos::CppMySQLStmtFetcher fetcher(conn, std::string(" << class_name
+        << "::SELECT_SQL) + \" \" + where);" << std::endl;
+    ofs << "        " << class_name << " row;" << std::endl;
+    ofs << "        BindRow(fetcher, row);" << std::endl;
+    ofs << "        int rt = fetcher.execute(args...);" << std::endl;
+    ofs << "        if(rt) {" << std::endl;
+    ofs << "            return rt;" << std::endl;
+    ofs << "        }" << std::endl;
+    ofs << "        while(fetcher.next()) {" << std::endl;
+    ofs << "            results.push_back(std::make_shared<" << class_name << ">(row));" << std::endl;
+    ofs << "        }" << std::endl;
+    ofs << "        return fetcher.getErrno();" << std::endl;
+    ofs << "    }" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 用CppMySQLBatch多行插入" << std::endl;
+    ofs << "     * @return 返回影响行数，失败返回-1" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    static int64_t BatchInsert(const std::vector<" << class_name
+        << "::ptr>& infos, const std::string& db_name);" << std::endl << std::endl;
+
+    ofs << "    static int CreateTable(" << conn << ");" << std::endl << std::endl;
+
+    ofs << "    /**" << std::endl;
+    ofs << "     * @brief 结果列按SELECT_SQL的顺序绑定到info的字段" << std::endl;
+    ofs << "     */" << std::endl;
+    ofs << "    static void BindRow(yhchaos::CppMySQLStmtFetcher& fetcher, "
+        << class_name << "& info);" << std::endl;
+    ofs << "};" << std::endl;
+}
+
+bool Table::genSrc(const std::string& path) {
+    std::string filename = path + "/" + getNamespaceDir() + getFilename() + ".cc";
+    std::ofstream ofs;
+    if(!yhchaos::FSUtil::OpenForWrite(ofs, filename, std::ios::trunc)) {
+        YHCHAOS_LOG_ERROR(g_logger) << "open file=" << filename << " error";
+        return false;
+    }
+    ofs << "//由orm根据表" << m_name << "的定义生成，不要修改" << std::endl;
+    ofs << "#include \"" << getFilename() << ".h\"" << std::endl;
+    ofs << "#include \"yhchaos/util.h\"" << std::endl;
+    ofs << "#include <sstream>" << std::endl;
+    ofs << "#include <time.h>" << std::endl << std::endl;
+
+    auto ns = Split(m_namespace, '.');
+    for(auto& i : ns) {
+        ofs << "namespace " << i << " {" << std::endl;
+    }
+    ofs << std::endl;
+    genStructSrc(ofs);
+    genInsertSrc(ofs, false);
+    genInsertSrc(ofs, true);
+    genUpdateSrc(ofs);
+    for(auto& i : m_idxs) {
+        genIndexSrc(ofs, i);
+    }
+    genQuerySrc(ofs);
+    genBatchSrc(ofs);
+    genCreateSrc(ofs);
+    for(auto it = ns.rbegin(); it != ns.rend(); ++it) {
+        ofs << "} //namespace " << *it << std::endl;
+    }
+    return true;
+}
+
+void Table::genStructSrc(std::ofstream& ofs) {
+    std::string class_name = getClassName();
+    ofs << "constexpr const char* " << class_name << "::TABLE_NAME;" << std::endl;
+    ofs << "constexpr size_t " << class_name << "::COLUMN_COUNT;" << std::endl;
+    ofs << "constexpr " << class_name << "::ColumnMeta " << class_name << "::COLUMNS[];" << std::endl;
+    ofs << "constexpr const char* " << class_name << "::SELECT_SQL;" << std::endl;
+    ofs << "static_assert(" << class_name << "::" << GetAsColumnEnum(m_cols.back()->getName())
+        << " + 1 == " << class_name << "::COLUMN_COUNT, \"column count mismatch\");"
+        << std::endl << std::endl;
+
+    ofs << class_name << "::" << class_name << "()" << std::endl;
+    for(size_t i = 0; i < m_cols.size(); ++i) {
+        ofs << "    " << (i ? "," : ":") << m_cols[i]->getName() << "("
+            << m_cols[i]->getCppDefault() << ")" << std::endl;
+    }
+    ofs << "{" << std::endl << "}" << std::endl << std::endl;
+
+    ofs << "std::string " << class_name << "::toString() const {" << std::endl;
+    ofs << "    std::stringstream ss;" << std::endl;
+    ofs << "    ss << \"[" << class_name;
+    for(auto& i : m_cols) {
+        ofs << " " << i->getName() << "=\" << ";
+        switch(i->getType()) {
+            case Column::TYPE_INT8:
+            case Column::TYPE_UINT8:
+                ofs << "(int)" << i->getName();
+                break;
+            case Column::TYPE_BLOB:
+                ofs << i->getName() << ".size() << \"bytes\"";
+                break;
+            default:
+                ofs << i->getName();
+                break;
+        }
+        ofs << std::endl << "       << \"";
+    }
+    ofs << "]\";" << std::endl;
+    ofs << "    return ss.str();" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+
+    ofs << "void " << getDaoClassName() << "::BindRow(yhchaos::CppMySQLStmtFetcher& fetcher, "
+        << class_name << "& info) {" << std::endl;
+    for(auto& i : m_cols) {
+        ofs << "    fetcher.bind(" << class_name << "::" << GetAsColumnEnum(i->getName())
+            << ", info." << i->getName() << ");" << std::endl;
+    }
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genInsertSrc(std::ofstream& ofs, bool update) {
+    std::string sql = "INSERT INTO `" + m_name + "` (";
+    std::string values;
+    std::string args;
+    for(size_t i = 0; i < m_cols.size(); ++i) {
+        sql += (i ? ", `" : "`") + m_cols[i]->getName() + "`";
+        values += (i ? ", " : "") + m_cols[i]->getInsertExpr();
+        args += ", info." + m_cols[i]->getName();
+    }
+    sql += ") VALUES (" + values + ")";
+    if(update) {
+        std::set<std::string> pk_cols;
+        if(m_pk) {
+            pk_cols.insert(m_pk->getCols().begin(), m_pk->getCols().end());
+        }
+        std::string set;
+        for(auto& i : m_cols) {
+            std::string v;
+            if(i->isAutoIncrement()) {
+                //更新时getLastInsertId返回已有行的值
+                v = "LAST_INSERT_ID(`" + i->getName() + "`)";
+            } else if(pk_cols.count(i->getName())) {
+                continue;
+            } else if(!i->getUpdate().empty()) {
+                v = i->getUpdateSQL();
+            } else {
+                v = "VALUES(`" + i->getName() + "`)";
+            }
+            set += (set.empty() ? "`" : ", `") + i->getName() + "` = " + v;
+        }
+        if(set.empty()) {
+            set = "`" + m_cols[0]->getName() + "` = `" + m_cols[0]->getName() + "`";
+        }
+        sql += " ON DUPLICATE KEY UPDATE " + set;
+    }
+
+    ofs << "int " << getDaoClassName() << "::" << (update ? "InsertOrUpdate" : "Insert")
+        << "(" << getClassName() << "& info, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    int rt = conn->execStmt(" << ToCppString(sql) << std::endl
+        << "                " << args << ");" << std::endl;
+    if(m_autoIncrement) {
+        ofs << "    if(rt == 0) {" << std::endl;
+        ofs << "        info." << m_autoIncrement->getName() << " = conn->getLastInsertId();" << std::endl;
+        ofs << "    }" << std::endl;
+    }
+    ofs << "    return rt;" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genUpdateSrc(std::ofstream& ofs) {
+    if(!m_pk) {
+        return;
+    }
+    std::string class_name = getClassName();
+    std::string where;
+    std::string where_args;
+    std::set<std::string> pk_cols;
+    for(auto& i : m_pk->getCols()) {
+        pk_cols.insert(i);
+        where += (where.empty() ? "" : " AND ") + getCol(i)->getWhereExpr();
+        where_args += ", info." + i;
+    }
+
+    if(m_pk->getCols().size() < m_cols.size()) {
+        std::string set;
+        std::string args;
+        for(auto& i : m_cols) {
+            if(pk_cols.count(i->getName())) {
+                continue;
+            }
+            if(!set.empty()) {
+                set += ", ";
+            }
+            if(!i->getUpdate().empty()) {
+                set += "`" + i->getName() + "` = " + i->getUpdateSQL();
+            } else {
+                set += i->getAssignExpr();
+                args += ", info." + i->getName();
+            }
+        }
+        std::string sql = "UPDATE `" + m_name + "` SET " + set + " WHERE " + where;
+        ofs << "int " << getDaoClassName() << "::Update(const " << class_name
+            << "& info, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+        ofs << "    return conn->execStmt(" << ToCppString(sql) << std::endl
+            << "                " << args << where_args << ");" << std::endl;
+        ofs << "}" << std::endl << std::endl;
+    }
+
+    std::string sql = "DELETE FROM `" + m_name + "` WHERE " + where;
+    ofs << "int " << getDaoClassName() << "::Delete(const " << class_name
+        << "& info, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    return conn->execStmt(" << ToCppString(sql) << where_args << ");" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genIndexSrc(std::ofstream& ofs, Index::ptr idx) {
+    std::string class_name = getClassName();
+    std::string params = genIndexParams(idx);
+    std::string args = genIndexArgs(idx);
+    std::string where = "WHERE " + genIndexWhere(idx);
+    if(idx->isUnique()) {
+        std::string sql = genSelectSQL() + " " + where;
+        ofs << class_name << "::ptr " << getDaoClassName() << "::Get" << idx->getFunSuffix()
+            << "(" << params << ", yhchaos::CppMySQL::ptr conn) {" << std::endl;
+        ofs << "    yhchaos::CppMySQLStmtFetcher fetcher(conn, " << ToCppString(sql) << ");" << std::endl;
+        ofs << "    " << class_name << "::ptr info = std::make_shared<" << class_name << ">();" << std::endl;
+        ofs << "    BindRow(fetcher, *info);" << std::endl;
+        ofs << "    if(fetcher.execute(" << args << ") || !fetcher.next()) {" << std::endl;
+        ofs << "        return nullptr;" << std::endl;
+        ofs << "    }" << std::endl;
+        ofs << "    return info;" << std::endl;
+        ofs << "}" << std::endl << std::endl;
+    } else {
+        ofs << "int " << getDaoClassName() << "::Query" << idx->getFunSuffix() << "("
+            << params << ", std::vector<" << class_name
+            << "::ptr>& results, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+        ofs << "    return QueryWhere(results, conn, " << ToCppString(where) << ", "
+            << args << ");" << std::endl;
+        ofs << "}" << std::endl << std::endl;
+    }
+
+    std::string sql = "DELETE FROM `" + m_name + "` " + where;
+    ofs << "int " << getDaoClassName() << "::Delete" << idx->getFunSuffix() << "("
+        << params << ", yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    return conn->execStmt(" << ToCppString(sql) << ", " << args << ");" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genQuerySrc(std::ofstream& ofs) {
+    std::string class_name = getClassName();
+    ofs << "int " << getDaoClassName() << "::QueryAll(std::vector<" << class_name
+        << "::ptr>& results, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    return QueryWhere(results, conn, \"\");" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+
+    ofs << "int " << getDaoClassName() << "::ForEach(std::function<bool(const " << class_name
+        << "&)> cb, yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    yhchaos::CppMySQLStmtFetcher fetcher(conn, " << class_name
+        << "::SELECT_SQL, true);" << std::endl;
+    ofs << "    " << class_name << " row;" << std::endl;
+    ofs << "    BindRow(fetcher, row);" << std::endl;
+    ofs << "    int rt = fetcher.execute();" << std::endl;
+    ofs << "    if(rt) {" << std::endl;
+    ofs << "        return rt;" << std::endl;
+    ofs << "    }" << std::endl;
+    ofs << "    while(fetcher.next()) {" << std::endl;
+    ofs << "        if(!cb(row)) {" << std::endl;
+    ofs << "            break;" << std::endl;
+    ofs << "        }" << std::endl;
+    ofs << "    }" << std::endl;
+    ofs << "    return fetcher.getErrno();" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genBatchSrc(std::ofstream& ofs) {
+    std::string sql = "INSERT INTO `" + m_name + "` (";
+    std::string args;
+    for(size_t i = 0; i < m_cols.size(); ++i) {
+        sql += (i ? ", `" : "`") + m_cols[i]->getName() + "`";
+        args += (i ? ", " : "") + m_cols[i]->getBatchValue("info");
+    }
+    sql += ")";
+
+    ofs << "int64_t " << getDaoClassName() << "::BatchInsert(const std::vector<"
+        << getClassName() << "::ptr>& infos, const std::string& db_name) {" << std::endl;
+    ofs << "    yhchaos::CppMySQLBatch batch(db_name, " << ToCppString(sql) << ");" << std::endl;
+    ofs << "    int64_t affected = 0;" << std::endl;
+    ofs << "    for(auto& i : infos) {" << std::endl;
+    ofs << "        const " << getClassName() << "& info = *i;" << std::endl;
+    ofs << "        int64_t rt = batch.add(" << args << ");" << std::endl;
+    ofs << "        if(rt < 0) {" << std::endl;
+    ofs << "            return -1;" << std::endl;
+    ofs << "        }" << std::endl;
+    ofs << "        affected += rt;" << std::endl;
+    ofs << "    }" << std::endl;
+    ofs << "    int64_t rt = batch.flush();" << std::endl;
+    ofs << "    return rt < 0 ? -1 : affected + rt;" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+void Table::genCreateSrc(std::ofstream& ofs) {
+    ofs << "int " << getDaoClassName() << "::CreateTable(yhchaos::CppMySQL::ptr conn) {" << std::endl;
+    ofs << "    return conn->execute(std::string(" << ToCppString(genCreateSQL()) << "));" << std::endl;
+    ofs << "}" << std::endl << std::endl;
+}
+
+}
+}
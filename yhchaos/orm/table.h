@@ -0,0 +1,83 @@
+#ifndef __YHCHAOS_ORM_TABLE_H__
+#define __YHCHAOS_ORM_TABLE_H__
+
+#include "column.h"
+#include "index.h"
+#include <fstream>
+
+namespace yhchaos {
+namespace orm {
+
+/**
+ * @brief 一张表，对应一个xml文件的<table name="" namespace="" desc="">
+ * @details 生成namespace目录下的<name>_info.h/.cc:
+ *          1. <Name>Info结构体，每列一个公有字段，列的元数据是constexpr常量
+ *          2. <Name>InfoDao，预处理语句的参数和结果列直接绑定结构体的字段，
+ *             整数/浮点数/时间戳按二进制协议读写，不经过字符串转换和IMySQLData的虚函数
+ */
+class Table {
+public:
+    typedef std::shared_ptr<Table> ptr;
+
+    bool init(const tinyxml2::XMLElement& node);
+
+    /**
+     * @brief 生成代码到path/namespace目录
+     * @param[out] srcs 追加生成的.cc相对path的路径
+     */
+    bool gen(const std::string& path, std::vector<std::string>& srcs);
+
+    const std::string& getName() const { return m_name;}
+    const std::string& getNamespace() const { return m_namespace;}
+    const std::string& getDesc() const { return m_desc;}
+    const std::vector<Column::ptr>& getCols() const { return m_cols;}
+    const std::vector<Index::ptr>& getIdxs() const { return m_idxs;}
+
+    //user_info
+    std::string getFilename() const;
+    //UserInfo
+    std::string getClassName() const;
+    //UserInfoDao
+    std::string getDaoClassName() const;
+private:
+    Column::ptr getCol(const std::string& name) const;
+    //namespace对应的目录，如test/orm
+    std::string getNamespaceDir() const;
+
+    bool genInc(const std::string& path);
+    bool genSrc(const std::string& path);
+
+    void genStructInc(std::ofstream& ofs);
+    void genDaoInc(std::ofstream& ofs);
+    void genStructSrc(std::ofstream& ofs);
+    void genInsertSrc(std::ofstream& ofs, bool update);
+    void genUpdateSrc(std::ofstream& ofs);
+    void genIndexSrc(std::ofstream& ofs, Index::ptr idx);
+    void genQuerySrc(std::ofstream& ofs);
+    void genBatchSrc(std::ofstream& ofs);
+    void genCreateSrc(std::ofstream& ofs);
+
+    //"SELECT `id`, ... FROM `user`"
+    std::string genSelectSQL() const;
+    std::string genCreateSQL() const;
+    //"const int64_t& id, const std::string& name"
+    std::string genIndexParams(Index::ptr idx) const;
+    //"id, name"
+    std::string genIndexArgs(Index::ptr idx) const;
+    //"`id` = ? AND `name` = ?"
+    std::string genIndexWhere(Index::ptr idx) const;
+private:
+    std::string m_name;
+    std::string m_namespace;
+    std::string m_desc;
+    std::string m_subfix = "_info";
+    std::vector<Column::ptr> m_cols;
+    std::vector<Index::ptr> m_idxs;
+    Index::ptr m_pk;
+    Column::ptr m_autoIncrement;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "util.h"
+#include "yhchaos/util.h"
+#include <ctype.h>
+#include <sstream>
+
+namespace yhchaos {
+namespace orm {
+
+std::string GetAsClassName(const std::string& v) {
+    std::string rt;
+    bool upper = true;
+    for(auto c : v) {
+        if(c == '_' || c == '.') {
+            upper = true;
+            continue;
+        }
+        rt.push_back(upper ? toupper(c) : c);
+        upper = false;
+    }
+    return rt;
+}
+
+std::string GetAsVariable(const std::string& v) {
+    std::string rt = GetAsClassName(v);
+    if(!rt.empty()) {
+        rt[0] = tolower(rt[0]);
+    }
+    return rt;
+}
+
+std::string GetAsColumnEnum(const std::string& v) {
+    return "COL_" + yhchaos::ToUpper(v);
+}
+
+std::string GetAsDefineMacro(const std::string& ns, const std::string& name) {
+    std::string rt = "__";
+    for(auto c : ns + "." + name) {
+        rt.push_back(isalnum(c) ? toupper(c) : '_');
+    }
+    return rt + "_H__";
+}
+
+bool IsIdentifier(const std::string& v) {
+    if(v.empty() || isdigit(v[0])) {
+        return false;
+    }
+    for(auto c : v) {
+        if(!isalnum(c) && c != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string ToCppString(const std::string& v) {
+    std::string rt = "\"";
+    for(auto c : v) {
+        switch(c) {
+            case '"': rt.append("\\\""); break;
+            case '\\': rt.append("\\\\"); break;
+            case '\n': rt.append("\\n"); break;
+            case '\r': rt.append("\\r"); break;
+            case '\t': rt.append("\\t"); break;
+            default: rt.push_back(c); break;
+        }
+    }
+    rt.push_back('"');
+    return rt;
+}
+
+std::string ToSQLString(const std::string& v) {
+    std::string rt = "'";
+    for(auto c : v) {
+        if(c == '\'' || c == '\\') {
+            rt.push_back('\\');
+        }
+        rt.push_back(c);
+    }
+    rt.push_back('\'');
+    return rt;
+}
+
+std::vector<std::string> Split(const std::string& v, char delim) {
+    std::vector<std::string> rt;
+    std::stringstream ss(v);
+    std::string item;
+    while(std::getline(ss, item, delim)) {
+        item = yhchaos::StringUtil::Trim(item);
+        if(!item.empty()) {
+            rt.push_back(item);
+        }
+    }
+    return rt;
+}
+
+}
+}
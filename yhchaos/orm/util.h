@@ -0,0 +1,53 @@
+#ifndef __YHCHAOS_ORM_UTIL_H__
+#define __YHCHAOS_ORM_UTIL_H__
+
+#include <string>
+#include <vector>
+
+namespace yhchaos {
+namespace orm {
+
+/**
+ * @brief 下划线命名转成驼峰，首字母大写，如create_time -> CreateTime
+ */
+std::string GetAsClassName(const std::string& v);
+
+/**
+ * @brief 下划线命名转成驼峰，首字母小写，如create_time -> createTime
+ */
+std::string GetAsVariable(const std::string& v);
+
+/**
+ * @brief 转成枚举常量名，如create_time -> COL_CREATE_TIME
+ */
+std::string GetAsColumnEnum(const std::string& v);
+
+/**
+ * @brief 头文件的宏名，如(test.orm, user_info) -> __TEST_ORM_USER_INFO_H__
+ */
+std::string GetAsDefineMacro(const std::string& ns, const std::string& name);
+
+/**
+ * @brief 是否是合法的C++标识符，列名直接用作结构体的字段名
+ */
+bool IsIdentifier(const std::string& v);
+
+/**
+ * @brief 转成C++字符串字面量，加上双引号
+ */
+std::string ToCppString(const std::string& v);
+
+/**
+ * @brief 转成SQL字符串字面量，加上单引号
+ */
+std::string ToSQLString(const std::string& v);
+
+/**
+ * @brief 按分隔符拆分，去掉空白和空项
+ */
+std::vector<std::string> Split(const std::string& v, char delim);
+
+}
+}
+
+#endif
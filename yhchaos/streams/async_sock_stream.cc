@@ -168,6 +168,16 @@ void AsyncSockStream::onTimeOut(Ctx::ptr ctx) {
     ctx->doRsp();
 }
 
+bool AsyncSockStream::cancel(uint32_t sn) {
+    auto ctx = getAndDelCtx(sn);
+    if(!ctx) {
+        return false;
+    }
+    ctx->result = CANCELLED;
+    ctx->doRsp();
+    return true;
+}
+
 AsyncSockStream::Ctx::ptr AsyncSockStream::getCtx(uint32_t sn) {
     RWMtxType::ReadLock lock(m_mutex);
     auto it = m_ctxs.find(sn);
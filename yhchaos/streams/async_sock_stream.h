@@ -21,6 +21,7 @@ public:
         TIMEOUT = -1,
         IO_ERROR = -2,
         NOT_CONNECT = -3,
+        CANCELLED = -4,
     };
     AsyncSockStream(Sock::ptr sock, bool owner = true);
     void setWorker(yhchaos::IOCoScheduler* v) { m_worker = v;}
@@ -51,6 +52,13 @@ public:
     }
     virtual bool start();
     virtual void close() override;
+
+    /**
+     * @brief 取消还在等待回复的请求
+     * @param[in] sn 请求的sn
+     * @return 请求还在等待时返回true，等待的协程立即以CANCELLED结果恢复执行
+    */
+    bool cancel(uint32_t sn);
 protected:
     //doWrite用来发送request的
     struct SendCtx {
@@ -2,12 +2,101 @@
 #include "yhchaos/log.h"
 #include "yhchaos/worker.h"
 #include "yhchaos/macro.h"
+#include "yhchaos/appconfig.h"
+#include "yhchaos/streams/async_sock_stream.h"
 #include <math.h>
+#include <string.h>
 
 namespace yhchaos {
 
 static yhchaos::Logger::ptr g_logger = YHCHAOS_LOG_NAME("system");
 
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_p2c_decay =
+    yhchaos::AppConfig::SearchFor("loadbalance.p2c.decay_ms"
+                ,(uint32_t)10000, "p2c loadbalance peak-ewma decay time(ms)");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_p2c_penalty =
+    yhchaos::AppConfig::SearchFor("loadbalance.p2c.penalty_ms"
+                ,(uint32_t)1000, "p2c loadbalance latency penalty(ms) of failed request");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_consecutive_errors =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.consecutive_errors"
+                ,(uint32_t)5, "circuit breaker ejects after consecutive errors, 0 disable");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_error_rate =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.error_rate"
+                ,(uint32_t)50, "circuit breaker ejects when error percent reaches, 0 disable");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_min_requests =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.min_requests"
+                ,(uint32_t)20, "circuit breaker min requests to check error rate");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_error_rate_window =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.error_rate_window_ms"
+                ,(uint32_t)5000, "circuit breaker ignores error rate within this time(ms) after closed");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_base_eject =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.base_eject_ms"
+                ,(uint32_t)5000, "circuit breaker base ejection time(ms)");
+
+static yhchaos::AppConfigVar<uint32_t>::ptr g_lb_breaker_max_eject =
+    yhchaos::AppConfig::SearchFor("loadbalance.breaker.max_eject_ms"
+                ,(uint32_t)300000, "circuit breaker max ejection time(ms)");
+
+//配置监听器在修改配置的线程中写，请求路径上relaxed读
+static std::atomic<double> s_lb_p2c_decay_us(0);
+static std::atomic<double> s_lb_p2c_penalty_us(0);
+static std::atomic<uint32_t> s_lb_breaker_consecutive_errors(0);
+static std::atomic<uint32_t> s_lb_breaker_error_rate(0);
+static std::atomic<uint32_t> s_lb_breaker_min_requests(0);
+static std::atomic<uint32_t> s_lb_breaker_error_rate_window(0);
+static std::atomic<uint32_t> s_lb_breaker_base_eject(0);
+static std::atomic<uint32_t> s_lb_breaker_max_eject(0);
+
+#define LB_CONF(name) s_lb_ ## name.load(std::memory_order_relaxed)
+
+namespace {
+struct _LBIniter {
+    _LBIniter() {
+        s_lb_p2c_decay_us.store(g_lb_p2c_decay->getValue() * 1000.0, std::memory_order_relaxed);
+        s_lb_p2c_penalty_us.store(g_lb_p2c_penalty->getValue() * 1000.0, std::memory_order_relaxed);
+#define XX(name) \
+        s_lb_breaker_ ## name.store(g_lb_breaker_ ## name->getValue(), std::memory_order_relaxed);
+        XX(consecutive_errors);
+        XX(error_rate);
+        XX(min_requests);
+        XX(error_rate_window);
+        XX(base_eject);
+        XX(max_eject);
+#undef XX
+
+        g_lb_p2c_decay->addListener(
+                [](const uint32_t& ov, const uint32_t& nv){
+                s_lb_p2c_decay_us.store(nv * 1000.0, std::memory_order_relaxed);
+        });
+
+        g_lb_p2c_penalty->addListener(
+                [](const uint32_t& ov, const uint32_t& nv){
+                s_lb_p2c_penalty_us.store(nv * 1000.0, std::memory_order_relaxed);
+        });
+
+#define XX(name) \
+        g_lb_breaker_ ## name->addListener( \
+                [](const uint32_t& ov, const uint32_t& nv){ \
+                s_lb_breaker_ ## name.store(nv, std::memory_order_relaxed); \
+        });
+        XX(consecutive_errors);
+        XX(error_rate);
+        XX(min_requests);
+        XX(error_rate_window);
+        XX(base_eject);
+        XX(max_eject);
+#undef XX
+    }
+};
+static _LBIniter _init;
+}
+
 HolderStats HolderStatsSet::getTotal() {
     HolderStats rt;
     for(auto& i : m_stats) {
@@ -19,10 +108,53 @@ HolderStats HolderStatsSet::getTotal() {
         XX(m_oks);
         XX(m_errs);
 #undef XX
+        for(int n = 0; n < HolderStats::LATENCY_BUCKETS; ++n) {
+            rt.m_latency[n] += i.m_latency[n];
+        }
     }
     return rt;
 }
 
+//每两个桶翻一倍，最后一个桶兜底
+static const uint32_t s_latency_bounds[HolderStats::LATENCY_BUCKETS] = {
+    1, 2, 3, 4, 6, 8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256,
+    384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384,
+    24576, 32768, 49152, (uint32_t)-1
+};
+
+uint32_t HolderStats::LatencyBound(uint32_t idx) {
+    return idx < LATENCY_BUCKETS ? s_latency_bounds[idx] : (uint32_t)-1;
+}
+
+void HolderStats::incLatency(uint32_t ms) {
+    auto it = std::lower_bound(s_latency_bounds, s_latency_bounds + LATENCY_BUCKETS, ms);
+    yhchaos::Atomic::addFetch(m_latency[it - s_latency_bounds], 1);
+}
+
+uint32_t HolderStats::getLatencyCount() const {
+    uint32_t total = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; ++i) {
+        total += m_latency[i];
+    }
+    return total;
+}
+
+uint32_t HolderStats::getLatencyPercentile(float p) const {
+    uint32_t total = getLatencyCount();
+    if(total == 0) {
+        return 0;
+    }
+    uint64_t rank = ceil(total * p / 100.0);
+    uint64_t cur = 0;
+    for(int i = 0; i < LATENCY_BUCKETS; ++i) {
+        cur += m_latency[i];
+        if(cur >= rank) {
+            return s_latency_bounds[i];
+        }
+    }
+    return s_latency_bounds[LATENCY_BUCKETS - 1];
+}
+
 std::string HolderStats::toString() {
     std::stringstream ss;
     ss << "[Stat total=" << m_total
@@ -34,11 +166,168 @@ std::string HolderStats::toString() {
        << " oks_rate=" << (m_total ? (m_oks * 100.0 / m_total) : 0)
        << " errs_rate=" << (m_total ? (m_errs * 100.0 / m_total) : 0)
        << " avg_used=" << (m_oks ? (m_usedTime * 1.0 / m_oks) : 0)
+       << " p99_used=" << getLatencyPercentile(99)
        << " weight=" << getWeight(1)
        << "]";
     return ss.str();
 }
 
+CircuitBreaker::CircuitBreaker()
+    :m_state(CLOSED)
+    ,m_consecutiveErrs(0)
+    ,m_ejections(0)
+    ,m_ejectUntil(0)
+    ,m_closedAt(0)
+    ,m_probing(false) {
+}
+
+bool CircuitBreaker::isAvailable() {
+    int state = m_state.load(std::memory_order_relaxed);
+    if(state == CLOSED) {
+        return true;
+    }
+    if(state == OPEN) {
+        //定时器没能触发(比如不在IOCoScheduler中)时，按截止时间转为HALF_OPEN
+        if(yhchaos::GetCurrentMS() < m_ejectUntil.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        toHalfOpen();
+    }
+    return !m_probing.load(std::memory_order_relaxed);
+}
+
+bool CircuitBreaker::onReqBegin(bool& probe) {
+    probe = false;
+    int state = m_state.load(std::memory_order_relaxed);
+    if(state == CLOSED) {
+        return true;
+    }
+    if(state == OPEN) {
+        if(yhchaos::GetCurrentMS() < m_ejectUntil.load(std::memory_order_relaxed)) {
+            return false;
+        }
+        toHalfOpen();
+        state = m_state.load();
+        if(state != HALF_OPEN) {
+            return state == CLOSED;
+        }
+    }
+    //多个请求同时通过了isAvailable，只有一个能占用探测名额
+    bool probing = false;
+    probe = m_probing.compare_exchange_strong(probing, true);
+    return probe;
+}
+
+void CircuitBreaker::onReqCancel(bool probe) {
+    //对冲请求中被取消的其他请求没有占用探测名额，不能把名额放给第二个探测请求
+    if(probe && m_state.load(std::memory_order_relaxed) == HALF_OPEN) {
+        m_probing = false;
+    }
+}
+
+void CircuitBreaker::onReqEnd(bool ok, const HolderStats& stats) {
+    uint64_t now = yhchaos::GetCurrentMS();
+    int state = m_state.load();
+    if(ok) {
+        m_consecutiveErrs = 0;
+        if(state == HALF_OPEN && m_state.compare_exchange_strong(state, CLOSED)) {
+            m_closedAt = now;
+            m_probing = false;
+            YHCHAOS_LOG_INFO(g_logger) << "CircuitBreaker closed " << toString();
+        } else if(state == CLOSED && m_ejections
+                && now - m_closedAt > LB_CONF(breaker_max_eject)) {
+            //稳定运行一段时间后，摘除时间重新从base_eject_ms开始计算
+            m_ejections = 0;
+        }
+        return;
+    }
+
+    uint32_t errs = ++m_consecutiveErrs;
+    if(state == HALF_OPEN) {
+        eject(now);
+        return;
+    }
+    if(state != CLOSED) {
+        return;
+    }
+    uint32_t consecutive_errors = LB_CONF(breaker_consecutive_errors);
+    if(consecutive_errors && errs >= consecutive_errors) {
+        eject(now);
+        return;
+    }
+    //stats是最近几秒的统计，刚恢复时里面还有摘除前的失败，不参与计算
+    uint32_t error_rate = LB_CONF(breaker_error_rate);
+    if(error_rate && now - m_closedAt >= LB_CONF(breaker_error_rate_window)) {
+        uint32_t fails = stats.getErrs() + stats.getTimeouts();
+        uint32_t total = fails + stats.getOks();
+        if(total >= LB_CONF(breaker_min_requests)
+                && fails * 100 >= total * error_rate) {
+            eject(now);
+        }
+    }
+}
+
+void CircuitBreaker::eject(uint64_t now) {
+    int state = m_state.load();
+    if(state == OPEN || !m_state.compare_exchange_strong(state, OPEN)) {
+        return;
+    }
+    uint32_t n = ++m_ejections;
+    uint64_t ms = (uint64_t)LB_CONF(breaker_base_eject) << std::min(n - 1, 20u);
+    uint64_t max_eject = LB_CONF(breaker_max_eject);
+    if(ms > max_eject) {
+        ms = max_eject;
+    }
+    m_ejectUntil = now + ms;
+    m_consecutiveErrs = 0;
+    m_probing = false;
+    YHCHAOS_LOG_WARN(g_logger) << "CircuitBreaker ejected " << ms << "ms " << toString();
+
+    auto iom = yhchaos::IOCoScheduler::GetThis();
+    if(iom) {
+        std::weak_ptr<CircuitBreaker> weak(shared_from_this());
+        iom->addConditionTimedCoroutine(ms, [weak](){
+            auto self = weak.lock();
+            if(self) {
+                self->toHalfOpen();
+            }
+        }, weak);
+    }
+}
+
+void CircuitBreaker::toHalfOpen() {
+    int state = OPEN;
+    if(m_state.compare_exchange_strong(state, HALF_OPEN)) {
+        m_probing = false;
+    }
+}
+
+std::string CircuitBreaker::toString() const {
+    static const char* s_states[] = {"closed", "open", "half_open"};
+    std::stringstream ss;
+    ss << "[CircuitBreaker state=" << s_states[m_state.load()]
+       << " ejections=" << m_ejections
+       << " consecutive_errs=" << m_consecutiveErrs
+       << "]";
+    return ss.str();
+}
+
+LBItem::LBItem()
+    :m_breaker(new CircuitBreaker) {
+}
+
+bool LBItem::onReqBegin(bool& probe) {
+    return m_breaker->onReqBegin(probe);
+}
+
+void LBItem::onReqEnd(int32_t result, uint64_t used_us, bool probe) {
+    if(result == AsyncSockStream::CANCELLED) {
+        m_breaker->onReqCancel(probe);
+        return;
+    }
+    m_breaker->onReqEnd(result >= 0, m_stats.getTotal());
+}
+
 void LBItem::close() {
     if(m_stream) {
         auto stream = m_stream;
@@ -49,7 +338,7 @@ void LBItem::close() {
 }
 
 bool LBItem::isValid() {
-    return m_stream && m_stream->isConnected();
+    return m_stream && m_stream->isConnected() && m_breaker->isAvailable();
 }
 
 std::string LBItem::toString() {
@@ -62,7 +351,7 @@ std::string LBItem::toString() {
         ss << " stream=[" << m_stream->getRemoteNetworkAddressString()
            << " is_connected=" << m_stream->isConnected() << "]";
     }
-    ss << m_stats.getTotal().toString() << "]";
+    ss << m_stats.getTotal().toString() << m_breaker->toString() << "]";
     //float w = 0;
     //float w2 = 0;
     //for(uint64_t n = 0; n < 5; ++n) {
@@ -237,6 +526,7 @@ void HolderStats::clear() {
     m_timeouts = 0;
     m_oks = 0;
     m_errs = 0;
+    memset(m_latency, 0, sizeof(m_latency));
 }
 
 float HolderStats::getWeight(float rate) {
@@ -344,14 +634,16 @@ int32_t FairLB::getIdx() {
 }
 
 SDLB::SDLB(ISD::ptr sd)
-    :m_sd(sd) {
+    :m_sd(sd)
+    ,m_datas(std::make_shared<const LBMap>())
+    ,m_types(std::make_shared<const TypeMap>()) {
 }
 
 LB::ptr SDLB::get(const std::string& domain, const std::string& service, bool auto_create) {
     do {
-        RWMtxType::ReadLock lock(m_mutex);
-        auto it = m_datas.find(domain);
-        if(it == m_datas.end()) {
+        auto datas = std::atomic_load(&m_datas);
+        auto it = datas->find(domain);
+        if(it == datas->end()) {
             break;
         }
         auto iit = it->second.find(service);
@@ -367,18 +659,29 @@ LB::ptr SDLB::get(const std::string& domain, const std::string& service, bool au
 
     auto type = getType(domain, service);
 
-    auto lb = createLB(type);
     RWMtxType::WriteLock lock(m_mutex);
-    m_datas[domain][service] = lb;
+    //加锁期间可能已经被其他写者创建
+    auto datas = std::atomic_load(&m_datas);
+    auto it = datas->find(domain);
+    if(it != datas->end()) {
+        auto iit = it->second.find(service);
+        if(iit != it->second.end()) {
+            return iit->second;
+        }
+    }
+    auto lb = createLB(type);
+    std::shared_ptr<LBMap> new_datas(new LBMap(*datas));
+    (*new_datas)[domain][service] = lb;
+    std::atomic_store(&m_datas, std::shared_ptr<const LBMap>(new_datas));
     lock.unlock();
     return lb;
 }
 
 
 ILB::Type SDLB::getType(const std::string& domain, const std::string& service) {
-    RWMtxType::ReadLock lock(m_mutex);
-    auto it = m_types.find(domain);
-    if(it == m_types.end()) {
+    auto types = std::atomic_load(&m_types);
+    auto it = types->find(domain);
+    if(it == types->end()) {
         return m_defaultType;
     }
     auto iit = it->second.find(service);
@@ -395,6 +698,302 @@ LB::ptr SDLB::createLB(ILB::Type type) {
         return WeightLB::ptr(new WeightLB);
     } else if(type == ILB::FAIR) {
         return WeightLB::ptr(new WeightLB);
+    } else if(type == ILB::P2C) {
+        return P2CLB::ptr(new P2CLB);
+    } else if(type == ILB::MAGLEV) {
+        return MaglevLB::ptr(new MaglevLB);
+    }
+    return nullptr;
+}
+
+P2CLBItem::P2CLBItem()
+    :m_ewma(0)
+    ,m_stamp(yhchaos::GetCurrentUS())
+    ,m_inflight(0) {
+}
+
+bool P2CLBItem::onReqBegin(bool& probe) {
+    if(!LBItem::onReqBegin(probe)) {
+        return false;
+    }
+    m_inflight.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void P2CLBItem::onReqEnd(int32_t result, uint64_t used_us, bool probe) {
+    LBItem::onReqEnd(result, used_us, probe);
+    m_inflight.fetch_sub(1, std::memory_order_relaxed);
+    if(result == AsyncSockStream::CANCELLED) {
+        return;
+    }
+    double rtt = used_us;
+    //失败的请求返回得再快也不能让它看起来更优
+    double penalty = LB_CONF(p2c_penalty_us);
+    if(result != 0 && rtt < penalty) {
+        rtt = penalty;
+    }
+    observe(rtt, yhchaos::GetCurrentUS());
+}
+
+void P2CLBItem::observe(double rtt_us, uint64_t now_us) {
+    uint64_t last = m_stamp.exchange(now_us, std::memory_order_relaxed);
+    double elapsed = now_us > last ? (double)(now_us - last) : 0.0;
+    double decay = LB_CONF(p2c_decay_us);
+    double w = decay > 0 ? exp(-elapsed / decay) : 0.0;
+    double old = m_ewma.load(std::memory_order_relaxed);
+    double v = 0;
+    do {
+        v = rtt_us > old ? rtt_us : old * w + rtt_us * (1 - w);
+    } while(!m_ewma.compare_exchange_weak(old, v, std::memory_order_relaxed));
+}
+
+double P2CLBItem::getCost(uint64_t now_us) {
+    double ewma = m_ewma.load(std::memory_order_relaxed);
+    uint64_t last = m_stamp.load(std::memory_order_relaxed);
+    //长时间没有回复的流，延迟逐渐衰减，让它有机会重新被选中
+    double decay = LB_CONF(p2c_decay_us);
+    if(now_us > last && decay > 0) {
+        ewma *= exp(-(double)(now_us - last) / decay);
+    }
+    int32_t weight = m_weight > 0 ? m_weight : 1;
+    return (ewma + 1) * (m_inflight.load(std::memory_order_relaxed) + 1) / weight;
+}
+
+P2CLB::P2CLB()
+    :m_items(std::make_shared<const std::vector<P2CLBItem::ptr> >()) {
+}
+
+void P2CLB::initNolock() {
+    auto items = std::make_shared<std::vector<P2CLBItem::ptr> >();
+    items->reserve(m_datas.size());
+    for(auto& i : m_datas) {
+        auto item = std::dynamic_pointer_cast<P2CLBItem>(i.second);
+        if(!item) {
+            YHCHAOS_LOG_ERROR(g_logger) << "P2CLB invalid item " << i.second->toString();
+            continue;
+        }
+        items->push_back(item);
+    }
+    std::atomic_store(&m_items, std::shared_ptr<const std::vector<P2CLBItem::ptr> >(items));
+}
+
+static uint64_t p2c_rand() {
+    //xorshift64*，每个线程独立的状态，避免rand()的全局锁
+    static thread_local uint64_t s_seed = yhchaos::GetCurrentUS() ^ (uint64_t)yhchaos::GetCppThreadId() << 32;
+    s_seed ^= s_seed >> 12;
+    s_seed ^= s_seed << 25;
+    s_seed ^= s_seed >> 27;
+    return s_seed * 2685821657736338717ull;
+}
+
+LBItem::ptr P2CLB::get(uint64_t v) {
+    auto items = std::atomic_load(&m_items);
+    size_t size = items->size();
+    if(size == 0) {
+        return nullptr;
+    }
+    if(size == 1) {
+        auto& h = (*items)[0];
+        return h->isValid() ? h : nullptr;
+    }
+
+    uint64_t now = yhchaos::GetCurrentUS();
+    //两个候选都不可用时重新抽取，抽取次数有上限
+    for(int n = 0; n < 3; ++n) {
+        uint64_t r = p2c_rand();
+        size_t a = r % size;
+        size_t b = (a + 1 + (r >> 32) % (size - 1)) % size;
+        auto& ha = (*items)[a];
+        auto& hb = (*items)[b];
+        bool va = ha->isValid();
+        bool vb = hb->isValid();
+        if(va && vb) {
+            return ha->getCost(now) <= hb->getCost(now) ? ha : hb;
+        } else if(va) {
+            return ha;
+        } else if(vb) {
+            return hb;
+        }
+    }
+
+    //大部分流都不可用，退化为顺序查找
+    size_t r = p2c_rand() % size;
+    for(size_t i = 0; i < size; ++i) {
+        auto& h = (*items)[(r + i) % size];
+        if(h->isValid()) {
+            return h;
+        }
+    }
+    return nullptr;
+}
+
+MaglevLB::MaglevLB()
+    :m_table(std::make_shared<Table>())
+    ,m_version(0)
+    ,m_building(false) {
+}
+
+//查找表大小取素数，且至少是流个数的100倍，保证各流分到的槽位足够均匀
+static uint32_t maglev_table_size(size_t n) {
+    static const uint32_t s_primes[] = {5003, 65537, 655373};
+    for(auto& i : s_primes) {
+        if(i >= n * 100) {
+            return i;
+        }
+    }
+    return s_primes[sizeof(s_primes) / sizeof(s_primes[0]) - 1];
+}
+
+void MaglevLB::initNolock() {
+    //按id排序，查找表只取决于流的集合，与m_datas的遍历顺序无关
+    std::vector<LBItem::ptr> items;
+    items.reserve(m_datas.size());
+    for(auto& i : m_datas) {
+        items.push_back(i.second);
+    }
+    std::sort(items.begin(), items.end(), [](const LBItem::ptr& a, const LBItem::ptr& b) {
+        return a->getId() < b->getId();
+    });
+    std::vector<int32_t> weights(items.size());
+    for(size_t i = 0; i < items.size(); ++i) {
+        weights[i] = items[i]->getWeight();
+    }
+    //流和权重都没有变化时不需要重建
+    if(items == m_pending && weights == m_pendingWeights) {
+        return;
+    }
+    m_pending.swap(items);
+    m_pendingWeights.swap(weights);
+    uint64_t version = ++m_version;
+
+    auto s = yhchaos::CoSchedulerMgr::GetInstance()->get("service_io");
+    if(!s || std::atomic_load(&m_table)->items.empty()) {
+        //没有后台调度器，或者还没有可用的查找表时直接构建，set()返回后get()就可以使用
+        build(m_pending, version);
+        return;
+    }
+    bool building = false;
+    if(!m_building.compare_exchange_strong(building, true)) {
+        //正在进行的重建结束时会发现版本变化并再次重建
+        return;
+    }
+    s->coschedule(std::bind(&MaglevLB::rebuild, shared_from_this()));
+}
+
+void MaglevLB::rebuild() {
+    while(true) {
+        std::vector<LBItem::ptr> items;
+        uint64_t version = 0;
+        {
+            RWMtxType::ReadLock lock(m_mutex);
+            items = m_pending;
+            version = m_version;
+        }
+        build(items, version);
+        m_building = false;
+
+        bool building = false;
+        if(m_version == version
+                || !m_building.compare_exchange_strong(building, true)) {
+            break;
+        }
+    }
+}
+
+void MaglevLB::build(const std::vector<LBItem::ptr>& items, uint64_t version) {
+    //后台重建和set()中的直接构建可能同时进行，串行执行，旧版本不覆盖新版本
+    yhchaos::Mtx::Lock lock(m_buildMutex);
+    if(std::atomic_load(&m_table)->version >= version) {
+        return;
+    }
+    Table::ptr table(new Table);
+    table->items = items;
+    table->version = version;
+    size_t n = items.size();
+    if(n == 0) {
+        std::atomic_store(&m_table, table);
+        return;
+    }
+
+    uint32_t m = maglev_table_size(n);
+    if(m != m_permSize) {
+        m_perms.clear();
+        m_permSize = m;
+    }
+    //只为新增的流计算填充序列，已删除的流随之丢弃
+    std::unordered_map<uint64_t, Permutation> perms;
+    std::vector<Permutation> p(n);
+    std::vector<int64_t> weights(n);
+    int64_t max_weight = 0;
+    for(size_t i = 0; i < n; ++i) {
+        uint64_t id = items[i]->getId();
+        auto it = m_perms.find(id);
+        if(it != m_perms.end()) {
+            p[i] = it->second;
+        } else {
+            p[i].offset = murmur3_hash(&id, sizeof(id), 0x9e3779b9) % m;
+            p[i].skip = murmur3_hash(&id, sizeof(id), 0x85ebca6b) % (m - 1) + 1;
+        }
+        perms[id] = p[i];
+        weights[i] = items[i]->getWeight();
+        max_weight = std::max(max_weight, weights[i]);
+    }
+    m_perms.swap(perms);
+    if(max_weight <= 0) {
+        //都没有设置权重时平均分配
+        std::fill(weights.begin(), weights.end(), 1);
+        max_weight = 1;
+    }
+
+    //每一轮每个流积累m_weight的额度，额度够max_weight时按自己的填充序列抢占一个空槽位
+    std::vector<uint64_t> next(n, 0);
+    std::vector<int64_t> credits(n, 0);
+    table->slots.assign(m, (uint32_t)-1);
+    uint32_t filled = 0;
+    while(filled < m) {
+        for(size_t i = 0; i < n && filled < m; ++i) {
+            if(weights[i] <= 0) {
+                continue;
+            }
+            credits[i] += weights[i];
+            if(credits[i] < max_weight) {
+                continue;
+            }
+            credits[i] -= max_weight;
+            uint32_t c = (p[i].offset + next[i] * p[i].skip) % m;
+            while(table->slots[c] != (uint32_t)-1) {
+                ++next[i];
+                c = (p[i].offset + next[i] * p[i].skip) % m;
+            }
+            table->slots[c] = i;
+            ++next[i];
+            ++filled;
+        }
+    }
+    std::atomic_store(&m_table, table);
+}
+
+LBItem::ptr MaglevLB::get(uint64_t v) {
+    auto table = std::atomic_load(&m_table);
+    if(table->items.empty()) {
+        return nullptr;
+    }
+    uint64_t h = (v == (uint64_t)-1 ? p2c_rand() : v);
+    size_t m = table->slots.size();
+    for(size_t i = 0; i < 32; ++i) {
+        auto& item = table->items[table->slots[(h + i) % m]];
+        if(item->isValid()) {
+            return item;
+        }
+    }
+    //大部分流都不可用，退化为顺序查找
+    size_t size = table->items.size();
+    size_t idx = table->slots[h % m];
+    for(size_t i = 0; i < size; ++i) {
+        auto& item = table->items[(idx + i) % size];
+        if(item->isValid()) {
+            return item;
+        }
     }
     return nullptr;
 }
@@ -407,6 +1006,10 @@ LBItem::ptr SDLB::createLBItem(ILB::Type type) {
         item.reset(new LBItem);
     } else if(type == ILB::FAIR) {
         item.reset(new FairLBItem);
+    } else if(type == ILB::P2C) {
+        item.reset(new P2CLBItem);
+    } else if(type == ILB::MAGLEV) {
+        item.reset(new LBItem);
     }
     return item;
 }
@@ -476,7 +1079,7 @@ void SDLB::stop() {
 //{aylar.top:{all:fair}}
 void SDLB::initConf(const std::unordered_map<std::string
                             ,std::unordered_map<std::string,std::string> >& confs) {
-    decltype(m_types) types;//{aylar.top:{all:FAIR}}
+    std::shared_ptr<TypeMap> types(new TypeMap);//{aylar.top:{all:FAIR}}
     std::unordered_map<std::string, std::unordered_set<std::string> > query_infos;//{aylar.top:[all]}
     for(auto& i : confs) {
         for(auto& n : i.second) {
@@ -485,23 +1088,23 @@ void SDLB::initConf(const std::unordered_map<std::string
                 t = ILB::ROUNDROBIN;
             } else if(n.second == "weight") {
                 t = ILB::WEIGHT;
+            } else if(n.second == "p2c") {
+                t = ILB::P2C;
+            } else if(n.second == "maglev") {
+                t = ILB::MAGLEV;
             }
-            types[i.first][n.first] = t;
+            (*types)[i.first][n.first] = t;
             query_infos[i.first].insert(n.first);
         }
     }
     m_sd->setQuerySvr(query_infos);
-    RWMtxType::WriteLock lock(m_mutex);
-    types.swap(m_types);
-    lock.unlock();
+    std::atomic_store(&m_types, std::shared_ptr<const TypeMap>(types));
 }
 
 std::string SDLB::statusString() {
-    RWMtxType::ReadLock lock(m_mutex);
-    decltype(m_datas) datas = m_datas;
-    lock.unlock();
+    auto datas = std::atomic_load(&m_datas);
     std::stringstream ss;
-    for(auto& i : datas) {
+    for(auto& i : *datas) {
         ss << i.first << ":" << std::endl;
         for(auto& n : i.second) {
             ss << "\t" << n.first << ":" << std::endl;
@@ -7,6 +7,7 @@
 #include "yhchaos/streams/service_discovery.h"
 #include <vector>
 #include <unordered_map>
+#include <atomic>
 
 namespace yhchaos {
 
@@ -14,6 +15,10 @@ class HolderStatsSet;
 class HolderStats {
 friend class HolderStatsSet;
 public:
+    //延迟直方图的桶数，第i个桶记录耗时不超过LatencyBound(i)毫秒的请求
+    enum { LATENCY_BUCKETS = 32 };
+    static uint32_t LatencyBound(uint32_t idx);
+
     uint32_t getUsedTime() const { return m_usedTime; }
     uint32_t getTotal() const { return m_total; }
     uint32_t getDoing() const { return m_doing; }
@@ -30,6 +35,12 @@ public:
     uint32_t incErrs(uint32_t v) { return yhchaos::Atomic::addFetch(m_errs, v);}
 
     uint32_t decDoing(uint32_t v) { return yhchaos::Atomic::subFetch(m_doing, v);}
+    //记录一次成功请求的耗时(毫秒)
+    void incLatency(uint32_t ms);
+    //返回耗时的p(0-100)百分位(毫秒，取桶的上界)，没有样本时返回0
+    uint32_t getLatencyPercentile(float p) const;
+    //直方图中的样本数
+    uint32_t getLatencyCount() const;
     void clear();
     float getWeight(float rate = 1.0f);
 
@@ -41,6 +52,7 @@ private:
     uint32_t m_timeouts = 0;
     uint32_t m_oks = 0;
     uint32_t m_errs = 0;
+    uint32_t m_latency[LATENCY_BUCKETS] = {};
 };
 class HolderStatsSet {
 public:
@@ -55,11 +67,73 @@ private:
     uint32_t m_lastUpdateTime = 0; //seconds
     std::vector<HolderStats> m_stats;
 };
+/**
+ * @brief 熔断器，根据请求结果把不健康的流摘除(OPEN)，到期后放行探测请求(HALF_OPEN)
+ * @details
+ *  1. CLOSED: 连续失败次数或最近一段时间的失败率超过阈值时进入OPEN，
+ *     进入CLOSED后error_rate_window_ms内不检查失败率
+ *  2. OPEN: 摘除时间为base_eject_ms * 2^(连续摘除次数-1)，不超过max_eject_ms，到期由定时器转为HALF_OPEN
+ *  3. HALF_OPEN: 只放行一个探测请求，成功则CLOSED，失败则再次OPEN
+ *  阈值通过loadbalance.breaker.*配置，所有状态都是原子变量，isAvailable是O(1)的
+*/
+class CircuitBreaker : public std::enable_shared_from_this<CircuitBreaker> {
+public:
+    typedef std::shared_ptr<CircuitBreaker> ptr;
+    enum State {
+        CLOSED = 0,
+        OPEN = 1,
+        HALF_OPEN = 2
+    };
+    CircuitBreaker();
+
+    //是否可以向这个流发送请求，只用于选择，不占用探测名额
+    bool isAvailable();
+    /**
+     * @brief 请求发出前调用，检查状态并在HALF_OPEN时通过CAS占用唯一的探测名额
+     * @param[out] probe 这个请求是否占用了探测名额，请求取消时传给onReqCancel
+     * @return 返回false时不能发送请求(OPEN或者探测名额已被占用)
+    */
+    bool onReqBegin(bool& probe);
+    /**
+     * @brief 请求被主动取消，不计入结果
+     * @param[in] probe onReqBegin返回的probe，只有占用探测名额的请求才归还名额
+    */
+    void onReqCancel(bool probe);
+    /**
+     * @brief 请求结束后调用
+     * @param[in] ok 请求是否成功
+     * @param[in] stats 最近一段时间的统计，用于计算失败率
+    */
+    void onReqEnd(bool ok, const HolderStats& stats);
+
+    State getState() const { return (State)m_state.load();}
+    uint32_t getEjections() const { return m_ejections;}
+    std::string toString() const;
+private:
+    //进入OPEN状态，并启动转为HALF_OPEN的定时器
+    void eject(uint64_t now);
+    //OPEN到期后转为HALF_OPEN
+    void toHalfOpen();
+private:
+    std::atomic<int> m_state;
+    //连续失败次数
+    std::atomic<uint32_t> m_consecutiveErrs;
+    //连续摘除次数，决定摘除时间的指数
+    std::atomic<uint32_t> m_ejections;
+    //OPEN状态的截止时间(毫秒)，没有定时器可用时由isAvailable检查
+    std::atomic<uint64_t> m_ejectUntil;
+    //最近一次进入CLOSED的时间(毫秒)，之前的统计不参与失败率计算
+    std::atomic<uint64_t> m_closedAt;
+    //HALF_OPEN时是否已有探测请求在途
+    std::atomic<bool> m_probing;
+};
+
 //某个流m_stream的（负载均衡信息）HolderStatsSet
 //来记录这个流过去一定长度时间点的统计信息
 class LBItem {
 public:
     typedef std::shared_ptr<LBItem> ptr;
+    LBItem();
     virtual ~LBItem() {}
 
     SockStream::ptr getStream() const { return m_stream;}
@@ -69,6 +143,8 @@ public:
     uint64_t getId() const { return m_id;}
 
     HolderStats& get(const uint32_t& now = time(0));
+    //最近一段时间的统计之和
+    HolderStats getTotal() { return m_stats.getTotal();}
 
     template<class T>
     std::shared_ptr<T> getStreamAs() {
@@ -78,15 +154,33 @@ public:
     virtual int32_t getWeight() { return m_weight;}
     void setWeight(int32_t v) { m_weight = v;}
 
+    //流已连接且没有被熔断
     virtual bool isValid();
     void close();
 
+    CircuitBreaker::ptr getBreaker() const { return m_breaker;}
+
+    /**
+     * @brief 请求发出前调用，子类可以据此维护在途请求数等实时统计
+     * @param[out] probe 这个请求是否占用了熔断器的探测名额，结束时传给onReqEnd
+     * @return 熔断器不允许发送时返回false，此时不能发送请求，也不调用onReqEnd
+    */
+    virtual bool onReqBegin(bool& probe);
+    /**
+     * @brief 请求结束(收到回复/超时/出错)后调用，需在更新get()的统计之后调用
+     * @param[in] result 请求结果，0表示成功，AsyncSockStream::Error(<0)表示失败，CANCELLED不计入统计
+     * @param[in] used_us 请求耗时(微秒)
+     * @param[in] probe onReqBegin返回的probe
+    */
+    virtual void onReqEnd(int32_t result, uint64_t used_us, bool probe);
+
     std::string toString();
 protected:
     uint64_t m_id = 0;//ServiceItemInfo::m_id
     SockStream::ptr m_stream;
     int32_t m_weight = 0;//这个流的权重，lditem->setWeight(10000)
     HolderStatsSet m_stats;
+    CircuitBreaker::ptr m_breaker;
 };
 
 class ILB {
@@ -94,7 +188,9 @@ public:
     enum Type {
         ROUNDROBIN = 1,
         WEIGHT = 2,
-        FAIR = 3
+        FAIR = 3,
+        P2C = 4,
+        MAGLEV = 5
     };
 
     enum Error {
@@ -205,12 +301,127 @@ private:
     std::vector<int32_t> m_weights;
 };
 
+/**
+ * @brief 带peak-EWMA延迟和在途请求数的负载均衡信息
+ * @details 所有统计都是原子变量，onReqBegin/onReqEnd在每次请求时无锁更新
+*/
+class P2CLBItem : public LBItem {
+public:
+    typedef std::shared_ptr<P2CLBItem> ptr;
+    P2CLBItem();
+
+    virtual bool onReqBegin(bool& probe) override;
+    virtual void onReqEnd(int32_t result, uint64_t used_us, bool probe) override;
+
+    /**
+     * @brief 获取选择代价，越小越优先
+     * @param[in] now_us 当前时间(微秒)
+     * @details 代价 = 衰减后的peak-EWMA延迟 * (在途请求数 + 1) / m_weight
+    */
+    double getCost(uint64_t now_us);
+    double getEwma() const { return m_ewma;}
+    uint32_t getInflight() const { return m_inflight;}
+private:
+    /**
+     * @brief 记录一次延迟样本
+     * @details 样本大于当前值时直接取样本(peak)，否则按距上次更新的时间做指数衰减平均
+    */
+    void observe(double rtt_us, uint64_t now_us);
+private:
+    //peak-EWMA延迟(微秒)
+    std::atomic<double> m_ewma;
+    //m_ewma上次更新的时间(微秒)
+    std::atomic<uint64_t> m_stamp;
+    //在途请求数
+    std::atomic<uint32_t> m_inflight;
+};
+
+/**
+ * @brief power-of-two-choices负载均衡
+ * @details 随机选取两个流，取getCost较小的那个，选择代价与流的个数无关；
+ *          m_items是只读快照，只在m_datas变化时重建并原子替换，get不加锁
+*/
+class P2CLB : public LB {
+public:
+    typedef std::shared_ptr<P2CLB> ptr;
+    P2CLB();
+    //v被忽略，每次随机选取两个候选
+    virtual LBItem::ptr get(uint64_t v = -1) override;
+protected:
+    virtual void initNolock();
+private:
+    //通过std::atomic_load/std::atomic_store访问
+    std::shared_ptr<const std::vector<P2CLBItem::ptr> > m_items;
+};
+
+/**
+ * @brief Maglev一致性哈希负载均衡
+ * @details get(v)把v当作哈希值查表，同一个v总是落到同一个流上，流增删时只有少量v被重新映射；
+ *          每个流在查找表中占的槽位数与m_weight成正比。
+ *          流或者权重变化时在service_io调度器中后台重建查找表，重建完成后原子替换，get不加锁；
+ *          还没有查找表时在set()中直接构建。必须由shared_ptr持有
+*/
+class MaglevLB : public LB
+                ,public std::enable_shared_from_this<MaglevLB> {
+public:
+    typedef std::shared_ptr<MaglevLB> ptr;
+    MaglevLB();
+    /**
+     * @brief 根据哈希值获取流
+     * @param[in] v 哈希值，-1表示随机选取
+     * @details 查到的流不可用时沿查找表向后探测，同一个v探测的结果也是一致的
+    */
+    virtual LBItem::ptr get(uint64_t v = -1) override;
+protected:
+    //记录待重建的流，并调度后台重建
+    virtual void initNolock();
+private:
+    struct Table {
+        typedef std::shared_ptr<Table> ptr;
+        std::vector<LBItem::ptr> items;
+        //槽位 -> items下标
+        std::vector<uint32_t> slots;
+        //构建时m_pending的版本号
+        uint64_t version = 0;
+    };
+    //流在查找表中的填充序列，offset + i * skip
+    struct Permutation {
+        uint32_t offset;
+        uint32_t skip;
+    };
+    //从m_pending重建，直到版本不再变化
+    void rebuild();
+    //根据items生成查找表，比已发布的版本新时发布
+    void build(const std::vector<LBItem::ptr>& items, uint64_t version);
+private:
+    //通过std::atomic_load/std::atomic_store访问
+    Table::ptr m_table;
+    //待重建的流，按id排序，受m_mutex保护
+    std::vector<LBItem::ptr> m_pending;
+    //m_pending对应的权重，判断是否需要重建
+    std::vector<int32_t> m_pendingWeights;
+    //m_pending的版本号
+    std::atomic<uint64_t> m_version;
+    //是否有重建在进行，同一时刻只有一个重建
+    std::atomic<bool> m_building;
+    //串行化build，保护m_perms和m_permSize
+    yhchaos::Mtx m_buildMutex;
+    //缓存的填充序列，只在构建时访问，流不变时不需要重新计算哈希
+    std::unordered_map<uint64_t, Permutation> m_perms;
+    //m_perms对应的查找表大小
+    uint32_t m_permSize = 0;
+};
+
 class SDLB {
 public:
     typedef std::shared_ptr<SDLB> ptr;
     //通过ServiceItemInfo::ptr返回一个SockStream::ptr
     typedef std::function<SockStream::ptr(ServiceItemInfo::ptr)> stream_callback;
     typedef yhchaos::RWMtx RWMtxType;
+    //domain -> [service -> LB]
+    typedef std::unordered_map<std::string, std::unordered_map<std::string, LB::ptr> > LBMap;
+    //domain -> [service -> ILB::Type]
+    typedef std::unordered_map<std::string, std::unordered_map<std::string, ILB::Type> > TypeMap;
 
     SDLB(ISD::ptr sd);
 
@@ -230,12 +441,13 @@ public:
      * @param[in] service 服务名称
      * @param[in] auto_create 若不存在是否自动创建负载均衡对象
      * @return 返回m_datas中domain-service对应的负载均衡对象，auto_create=true时，若不存在则创建一个getType(domain, service)的负载均衡对象并添加到m_datas中
+     * @details 读m_datas的快照，不加锁；只有创建时才加锁复制一份新的m_datas并替换
     */
     LB::ptr get(const std::string& domain, const std::string& service, bool auto_create = false);
     
     /**
      * @brief 重新初始化m_types和m_sd->m_queryInfos，初始化负载均衡类型的时候的同时初始化m_sd->m_queryInfos
-     * @param[in] confs domain -> [service -> |"round_robin"|"weight"|"fair"|]
+     * @param[in] confs domain -> [service -> |"round_robin"|"weight"|"fair"|"p2c"|"maglev"|]
      * @details 根据confs创建m_types和m_sd->m_queryInfos对象，然后替换m_types和m_sd->m_queryInfos
     */
     void initConf(const std::unordered_map<std::string, 
@@ -267,25 +479,28 @@ private:
     
     /**
      * @brief 根据ILB::Type获取负载均衡对象
-     * @param[in] type ROUNDROBIN/WEIGHT/FAIR
-     * @return RoundRobinLB/WeightLB/FairLB
+     * @param[in] type ROUNDROBIN/WEIGHT/FAIR/P2C/MAGLEV
+     * @return RoundRobinLB/WeightLB/FairLB/P2CLB/MaglevLB
     */
     LB::ptr createLB(ILB::Type type);
 
     /**
      * @brief 根据ILB::Type返回对应的LBItem
-     * @param[in] type ROUNDROBIN/WEIGHT/FAIR
-     * @return LBItem/FairLBItem
+     * @param[in] type ROUNDROBIN/WEIGHT/FAIR/P2C/MAGLEV
+     * @return LBItem/FairLBItem/P2CLBItem/LBItem
     */
     LBItem::ptr createLBItem(ILB::Type type);
 
 protected:
+    //串行化m_datas的写者，读者不加锁
     RWMtxType m_mutex;
     ISD::ptr m_sd;//=sd
     //每一个domain-service都有一个负载均衡对象，表示该domain-service下的服务器如何进行负载均衡
-    std::unordered_map<std::string, std::unordered_map<std::string, LB::ptr> > m_datas;
+    //只读快照，通过std::atomic_load/std::atomic_store访问，修改时复制后整体替换
+    std::shared_ptr<const LBMap> m_datas;
     //每一个domain-service都有一个负载均衡类型，表示该domain-service下的服务器选择什么样的负载均衡类型来进行负载均衡
-    std::unordered_map<std::string, std::unordered_map<std::string, ILB::Type> > m_types;
+    //只读快照，initConf时整体替换
+    std::shared_ptr<const TypeMap> m_types;
     ILB::Type m_defaultType = ILB::FAIR;
     //获取某个ServiceItemInfo对应的流SockStream
     stream_callback m_cb;
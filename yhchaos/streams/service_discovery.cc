@@ -56,8 +56,7 @@ void ISD::querySvr(const std::string& domain, const std::string& service) {
 
 void ISD::listSvr(std::unordered_map<std::string, std::unordered_map<std::string
                                    ,std::unordered_map<uint64_t, ServiceItemInfo::ptr> > >& infos) {
-    yhchaos::RWMtx::ReadLock lock(m_mutex);
-    infos = m_datas;
+    infos = *std::atomic_load(&m_datas);
 }
 
 void ISD::listRegisterSvr(std::unordered_map<std::string, std::unordered_map<std::string
@@ -315,7 +314,9 @@ bool ZKSD::getChildren(const std::string& path) {
 
     auto new_vals = infos;
     yhchaos::RWMtx::WriteLock lock(m_mutex);
-    m_datas[domain][service].swap(infos);
+    std::shared_ptr<ServiceMap> datas(new ServiceMap(*std::atomic_load(&m_datas)));
+    (*datas)[domain][service].swap(infos);
+    std::atomic_store(&m_datas, std::shared_ptr<const ServiceMap>(datas));
     lock.unlock();
 
     m_cb(domain, service, infos, new_vals);
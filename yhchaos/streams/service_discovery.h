@@ -38,6 +38,9 @@ private:
 class ISD {
 public:
     typedef std::shared_ptr<ISD> ptr;
+    //domain -> [service -> [ServiceItemInfo::m_id -> ServiceItemInfo]]
+    typedef std::unordered_map<std::string, std::unordered_map<std::string
+                ,std::unordered_map<uint64_t, ServiceItemInfo::ptr> > > ServiceMap;
     typedef std::function<void(const std::string& domain, const std::string& service
                 ,const std::unordered_map<uint64_t, ServiceItemInfo::ptr>& old_value
                 ,const std::unordered_map<uint64_t, ServiceItemInfo::ptr>& new_value)> service_callback;
@@ -49,6 +52,8 @@ public:
 
     void listSvr(std::unordered_map<std::string, std::unordered_map<std::string
                     ,std::unordered_map<uint64_t, ServiceItemInfo::ptr> > >& infos);
+    //返回m_datas当前的只读快照，不加锁也不复制
+    std::shared_ptr<const ServiceMap> getSvrSnapshot() const { return std::atomic_load(&m_datas);}
     void listRegisterSvr(std::unordered_map<std::string, std::unordered_map<std::string
                             ,std::unordered_map<std::string, std::string> > >& infos);
 
@@ -62,10 +67,11 @@ public:
     //m_queryInfos = v
     void setQuerySvr(const std::unordered_map<std::string, std::unordered_set<std::string> >& v);
 protected:
+    //保护m_registerInfos和m_queryInfos，并串行化m_datas的写者
     yhchaos::RWMtx m_mutex;
     //客户端会用到，当前感兴趣的开放域名：服务的所有可用主机
-    std::unordered_map<std::string, std::unordered_map<std::string
-        ,std::unordered_map<uint64_t, ServiceItemInfo::ptr> > > m_datas;
+    //只读快照，通过std::atomic_load/std::atomic_store访问，zk回调时复制后整体替换
+    std::shared_ptr<const ServiceMap> m_datas = std::make_shared<const ServiceMap>();
     //provider, 提供服务的服务器端会设置这个成员，当服务开放时会将服务信息(ip+port)注册到zkserver
     std::unordered_map<std::string, std::unordered_map<std::string
         ,std::unordered_map<std::string, std::string> > > m_registerInfos;
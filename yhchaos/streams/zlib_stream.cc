@@ -57,9 +57,9 @@ int ZlibStream::write(const void* buffer, size_t length) {
     ivc.iov_base = (void*)buffer;
     ivc.iov_len = length;
     if(m_encode) {
-        return encode(&ivc, 1, false);
+        return encode(&ivc, 1, Z_NO_FLUSH);
     } else {
-        return decode(&ivc, 1, false);
+        return decode(&ivc, 1, Z_NO_FLUSH);
     }
 }
 
@@ -67,9 +67,9 @@ int ZlibStream::write(ByteBuffer::ptr ba, size_t length) {
     std::vector<iovec> buffers;
     ba->getReadBuffers(buffers, length);
     if(m_encode) {
-        return encode(&buffers[0], buffers.size(), false);
+        return encode(&buffers[0], buffers.size(), Z_NO_FLUSH);
     } else {
-        return decode(&buffers[0], buffers.size(), false);
+        return decode(&buffers[0], buffers.size(), Z_NO_FLUSH);
     }
 }
 
@@ -109,14 +109,14 @@ int ZlibStream::init(Type type, int level, int window_bits
     }
 }
 
-int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) {
+int ZlibStream::encode(const iovec* v, const uint64_t& size, int mode) {
     int ret = 0;
     int flush = 0;
     for(uint64_t i = 0; i < size; ++i) {
         m_zstream.avail_in = v[i].iov_len;
         m_zstream.next_in = (Bytef*)v[i].iov_base;
 
-        flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
+        flush = i == size - 1 ? mode : Z_NO_FLUSH;
 
         iovec* ivc = nullptr;
         do {
@@ -146,14 +146,14 @@ int ZlibStream::encode(const iovec* v, const uint64_t& size, bool finish) {
     return Z_OK;
 }
 
-int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish) {
+int ZlibStream::decode(const iovec* v, const uint64_t& size, int mode) {
     int ret = 0;
     int flush = 0;
     for(uint64_t i = 0; i < size; ++i) {
         m_zstream.avail_in = v[i].iov_len;
         m_zstream.next_in = (Bytef*)v[i].iov_base;
 
-        flush = finish ? (i == size - 1 ? Z_FINISH : Z_NO_FLUSH) : Z_NO_FLUSH;
+        flush = i == size - 1 ? mode : Z_NO_FLUSH;
 
         iovec* ivc = nullptr;
         do {
@@ -171,7 +171,8 @@ int ZlibStream::decode(const iovec* v, const uint64_t& size, bool finish) {
             m_zstream.next_out = (Bytef*)ivc->iov_base + ivc->iov_len;
 
             ret = inflate(&m_zstream, flush);
-            if(ret == Z_STREAM_ERROR) {
+            if(ret == Z_STREAM_ERROR || ret == Z_DATA_ERROR
+                    || ret == Z_NEED_DICT || ret == Z_MEM_ERROR) {
                 return ret;
             }
             ivc->iov_len = m_buffSize - m_zstream.avail_out;
@@ -190,10 +191,39 @@ int ZlibStream::flush() {
     ivc.iov_len = 0;
 
     if(m_encode) {
-        return encode(&ivc, 1, true);
+        return encode(&ivc, 1, Z_FINISH);
+    } else {
+        return decode(&ivc, 1, Z_FINISH);
+    }
+}
+
+int ZlibStream::sync() {
+    iovec ivc;
+    ivc.iov_base = nullptr;
+    ivc.iov_len = 0;
+
+    if(m_encode) {
+        return encode(&ivc, 1, Z_SYNC_FLUSH);
+    } else {
+        return decode(&ivc, 1, Z_SYNC_FLUSH);
+    }
+}
+
+int ZlibStream::reset() {
+    if(m_encode) {
+        return deflateReset(&m_zstream);
     } else {
-        return decode(&ivc, 1, true);
+        return inflateReset(&m_zstream);
+    }
+}
+
+void ZlibStream::clearBuffers() {
+    if(m_free) {
+        for(auto& i : m_buffs) {
+            free(i.iov_base);
+        }
     }
+    m_buffs.clear();
 }
 
 std::string ZlibStream::getRes() const {
@@ -67,6 +67,22 @@ public:
     */
     int flush();
 
+    /**
+     * @brief 输出已经写入的全部数据但不结束流(Z_SYNC_FLUSH)，之后可以继续写入
+     * @details 用于websocket的permessage-deflate，多个消息共享同一个压缩上下文
+     */
+    int sync();
+
+    /**
+     * @brief 重置压缩/解压缩上下文，丢弃之前的窗口数据，不释放已经输出的数据
+     */
+    int reset();
+
+    /**
+     * @brief 释放已经输出的数据
+     */
+    void clearBuffers();
+
     bool isFree() const { return m_free;}
     void setFree(bool v) { m_free = v;}
 
@@ -84,20 +100,21 @@ private:
      * @brief 压缩数据
      * @param[in] v 待压缩数据指针数组
      * @param[in] size 待压缩数据指针数组长度
-     * @param[in] finish true：写入完后关闭流；false：不刷新，写入数据，最后不关闭流
+     * @param[in] flush 最后一块数据使用的flush参数，Z_FINISH：写入完后关闭流；
+     *            Z_SYNC_FLUSH：输出全部数据，不关闭流；Z_NO_FLUSH：不刷新
      * @return 返回是否压缩成功
      * @details 将iovec数组中的数据压缩到m_buffs中的iovec中
     */
-    int encode(const iovec* v, const uint64_t& size, bool finish);
+    int encode(const iovec* v, const uint64_t& size, int flush);
      /**
      * @brief 解压缩数据
      * @param[in] v 已压缩数据指针数组
      * @param[in] size 已压缩数据指针数组长度
-     * @param[in] finish true：写入完后关闭流；false：不刷新，写入数据，最后不关闭流
-     * @return 返回是否解压缩成功
+     * @param[in] flush 最后一块数据使用的flush参数，同encode
+     * @return 返回是否解压缩成功，数据格式错误时返回Z_DATA_ERROR
      * @details 将iovec数组中的数据压缩到m_buffs中的iovec中
     */
-    int decode(const iovec* v, const uint64_t& size, bool finish);
+    int decode(const iovec* v, const uint64_t& size, int flush);
 private:
     z_stream m_zstream;
     uint32_t m_buffSize;